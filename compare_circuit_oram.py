@@ -0,0 +1,104 @@
+import subprocess
+from pathlib import Path
+import pytomlpp
+
+BUILD_DIR = Path("build")
+
+EXECUTABLE_LOCATION = (BUILD_DIR / "src" / "OramSimulator").absolute()
+
+ORAM_OUTPUT_DIR = Path("orams").absolute()
+
+EXPERIMENT_FOLDER = Path("experiments").absolute()
+
+NUM_ACCESSES = "100Ki"
+
+ORAM_CONFIGS = (
+    # (ORAM Type, (Number of entries, Entry Size), Page Size, Stash Capacity, Extra Options)
+    ("PageOptimizedRAWOram", (1_000_000, 64), 4096, 200, ("--tree_order", "2", "--num_accesses_per_eviction", "4")),
+    ("CircuitOram", (1_000_000, 64), 4096, 8, ("--evictions_per_access", "2", "--levels_per_page", "1")),
+    ("CircuitOram", (1_000_000, 64), 1024, 8, ("--evictions_per_access", "2", "--levels_per_page", "2")),
+)
+
+ORAM_STAT_FILES = {
+    "PageOptimizedRAWOram": "page_optimized_raw_oram_stat.toml",
+    "CircuitOram": "circuit_oram_stat.toml",
+}
+
+
+def oram_name(type: str, num_blocks: int, block_size: int, page_size: int, stash_capacity: int, extra_options) -> str:
+    return f"{type}-{num_blocks // 1_000_000}M-{block_size}B-{page_size}B-S{stash_capacity}-{'-'.join(extra_options[1::2])}"
+
+
+def generate_oram(type: str, num_blocks_block_size, page_size: int, stash_capacity: int, extra_options) -> Path:
+    num_blocks, block_size = num_blocks_block_size
+    oram_dir = ORAM_OUTPUT_DIR / oram_name(type, num_blocks, block_size, page_size, stash_capacity, extra_options)
+    if oram_dir.is_dir():
+        print(f"{oram_dir} already exists, skipping.")
+        return oram_dir
+
+    subprocess.run(
+        [
+            EXECUTABLE_LOCATION,
+            "create",
+            "--type", type,
+            "--size", str(num_blocks * block_size),
+            "--block_size", str(block_size),
+            "--page_size", str(page_size),
+            "--stash_capacity", str(stash_capacity),
+            "--load_factor", str(0.75),
+            "--output", oram_dir,
+            "--fast_init",
+            "--crypto_module", "AEGIS256",
+            *extra_options,
+        ],
+        check=True,
+        encoding="utf-8"
+    )
+    return oram_dir
+
+
+def run_oram(type: str, oram_dir: Path):
+    experiment_dir = EXPERIMENT_FOLDER / f"Throughput-{oram_dir.name}"
+    experiment_dir.mkdir(parents=True, exist_ok=True)
+    stat_file = experiment_dir / "run_trace-stat.toml"
+
+    subprocess.run(
+        [
+            EXECUTABLE_LOCATION,
+            "run_trace",
+            "--memory", oram_dir,
+            "--pattern", "Uniform",
+            "--count", NUM_ACCESSES,
+            "--stat_file", stat_file,
+        ],
+        check=True,
+        cwd=experiment_dir,
+        encoding="utf-8"
+    )
+
+    stats = pytomlpp.load(stat_file)
+    oram_stats = pytomlpp.load(experiment_dir / ORAM_STAT_FILES[type])
+    throughput = stats["total_accesses"] / stats["overall_time"]
+    disk_time = (oram_stats["path_read_ns"] + oram_stats["path_write_ns"]) / 1_000_000_000
+    return throughput, disk_time / stats["overall_time"]
+
+
+def main():
+    if not ORAM_OUTPUT_DIR.is_dir():
+        ORAM_OUTPUT_DIR.mkdir()
+
+    results = []
+    for config in ORAM_CONFIGS:
+        print(config)
+        oram_dir = generate_oram(*config)
+        throughput, disk_fraction = run_oram(config[0], oram_dir)
+        results.append((oram_dir.name, throughput, disk_fraction))
+
+    print()
+    print(f"{'ORAM':<60} {'accesses/s':>12} {'disk time':>10}")
+    for name, throughput, disk_fraction in results:
+        print(f"{name:<60} {throughput:>12.1f} {disk_fraction:>10.1%}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,106 @@
+import subprocess
+from pathlib import Path
+import pytomlpp
+
+BUILD_DIR = Path("build")
+
+EXECUTABLE_LOCATION = (BUILD_DIR / "src" / "OramSimulator").absolute()
+
+ORAM_OUTPUT_DIR = Path("orams").absolute()
+
+EXPERIMENT_FOLDER = Path("experiments").absolute()
+
+# (Number of entries, Entry Size), the ORAM has to hold at least the largest round
+ORAM_SIZE = (1_000_000, 64)
+
+SAMPLES_PER_ROUND = (1_000, 2_000, 5_000, 10_000, 20_000, 50_000, 100_000)
+
+NUM_ROUNDS = 4
+
+BUFFERS = ("LinearScanBuffer", "HashBuffer")
+
+# a LinearScanBuffer round costs O(samples^2), larger rounds take hours
+MAX_LINEAR_SCAN_SAMPLES = 50_000
+
+
+def generate_oram() -> Path:
+    num_blocks, block_size = ORAM_SIZE
+    oram_dir = ORAM_OUTPUT_DIR / f"PageOptimizedRAWOram-{num_blocks // 1_000_000}M-{block_size}B-4Ki-S200"
+    if oram_dir.is_dir():
+        print(f"{oram_dir} already exists, skipping.")
+        return oram_dir
+
+    subprocess.run(
+        [
+            EXECUTABLE_LOCATION,
+            "create",
+            "--type", "PageOptimizedRAWOram",
+            "--size", str(num_blocks * block_size),
+            "--block_size", str(block_size),
+            "--page_size", "4096",
+            "--stash_capacity", "200",
+            "--load_factor", str(0.75),
+            "--output", oram_dir,
+            "--fast_init",
+            "--crypto_module", "AEGIS256",
+        ],
+        check=True,
+        encoding="utf-8"
+    )
+    return oram_dir
+
+
+def run_buffer(buffer: str, samples_per_round: int, oram_dir: Path) -> float:
+    experiment_dir = EXPERIMENT_FOLDER / f"HashBuffer-{buffer}-{samples_per_round}"
+    experiment_dir.mkdir(parents=True, exist_ok=True)
+    stat_file = experiment_dir / "recsys_sim-stat.toml"
+
+    subprocess.run(
+        [
+            EXECUTABLE_LOCATION,
+            "recsys_sim",
+            "--memory", oram_dir,
+            "--buffer", buffer,
+            "--pattern", "Uniform",
+            "--rounds", str(NUM_ROUNDS),
+            "--samples_per_round", str(samples_per_round),
+            "--output_file", stat_file,
+        ],
+        check=True,
+        cwd=experiment_dir,
+        encoding="utf-8"
+    )
+
+    # the buffer time leaves out the ORAM accesses, which are the same for both buffers
+    stats = pytomlpp.load(stat_file)
+    return stats["buffer_time_seconds"] * 1_000_000 / (samples_per_round * NUM_ROUNDS)
+
+
+def main():
+    if not ORAM_OUTPUT_DIR.is_dir():
+        ORAM_OUTPUT_DIR.mkdir()
+
+    oram_dir = generate_oram()
+    results = []
+    for samples_per_round in SAMPLES_PER_ROUND:
+        times = {}
+        for buffer in BUFFERS:
+            if buffer == "LinearScanBuffer" and samples_per_round > MAX_LINEAR_SCAN_SAMPLES:
+                continue
+            print((buffer, samples_per_round))
+            times[buffer] = run_buffer(buffer, samples_per_round, oram_dir)
+        results.append((samples_per_round, times))
+
+    print()
+    print(f"{'samples/round':>13} {'linear scan us/sample':>22} {'hash us/sample':>15} {'speedup':>8}")
+    for samples_per_round, times in results:
+        linear = times.get("LinearScanBuffer")
+        hashed = times["HashBuffer"]
+        if linear is None:
+            print(f"{samples_per_round:>13} {'skipped':>22} {hashed:>15.2f} {'':>8}")
+        else:
+            print(f"{samples_per_round:>13} {linear:>22.2f} {hashed:>15.2f} {linear / hashed:>7.1f}x")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <memory_defs.hpp>
+
+/**
+ * @brief Number of messages aegis256_encrypt_batch and aegis256_decrypt_batch process side by side, 0 if
+ * the CPU has no AES instructions and the batch functions can not be used.
+ */
+std::size_t aegis256_batch_lanes() noexcept;
+
+/**
+ * @brief Encrypts count messages of the same length in place under one key, with the output of
+ * crypto_aead_aegis256_encrypt_detached without additional data.
+ *
+ * The messages are interleaved so that the AES rounds of several independent AEGIS states are in flight
+ * at once, a single AEGIS state can not keep the AES units busy.
+ */
+void aegis256_encrypt_batch(const byte_t *key, std::size_t count, const byte_t *const *nonces, byte_t *const *buffers, std::size_t length, byte_t *const *auth_tags) noexcept;
+
+/**
+ * @brief Decrypts count messages of the same length in place, same as crypto_aead_aegis256_decrypt_detached
+ * without additional data.
+ *
+ * @return false if any of the auth tags does not match
+ */
+bool aegis256_decrypt_batch(const byte_t *key, std::size_t count, const byte_t *const *nonces, byte_t *const *buffers, std::size_t length, const byte_t *const *auth_tags) noexcept;
@@ -9,6 +9,7 @@
 #include <absl/random/random.h>
 #include <block_callback.hpp>
 #include <low_level_path_oram_interface.hpp>
+#include <util.hpp>
 
 class BinaryPathOram2: public Memory, public LLPathOramInterface {
     public:
@@ -83,6 +84,8 @@ class BinaryPathOram2: public Memory, public LLPathOramInterface {
         uint64_t bucket_size;
         uint64_t blocks_per_bucket;
         uint64_t levels_per_page;
+        // every bucket has 2^tree_bits children
+        uint64_t tree_bits = 1;
         uint64_t levels;
         uint64_t page_levels;
         uint64_t num_blocks;
@@ -99,7 +102,7 @@ class BinaryPathOram2: public Memory, public LLPathOramInterface {
     unique_memory_t untrusted_memory;
     std::unique_ptr<CryptoModule> crypto_module;
     
-    const Parameters parameters;
+    Parameters parameters;
     // const uint64_t block_size;
     // const uint64_t bucket_size;
     // const uint64_t blocks_per_bucket;
@@ -121,13 +124,15 @@ class BinaryPathOram2: public Memory, public LLPathOramInterface {
     static Parameters compute_parameters(
         uint64_t block_size, uint64_t page_size, uint64_t levels_per_page, 
         uint64_t num_blocks, CryptoModule * crypto_module,
-        double max_load_factor = 0.75, bool strict_bucket_size = false
+        double max_load_factor = 0.75, bool strict_bucket_size = false,
+        uint64_t tree_order = 2
     );
 
     static Parameters compute_parameters_known_oram_size(
         uint64_t block_size, uint64_t page_size, uint64_t levels_per_page,
         uint64_t num_blocks, CryptoModule * crypto_module,
-        uint64_t min_num_slots, bool strict_bucket_size = false
+        uint64_t min_num_slots, bool strict_bucket_size = false,
+        uint64_t tree_order = 2
     ); 
     static unique_memory_t create(
         std::string_view name,
@@ -146,10 +151,10 @@ class BinaryPathOram2: public Memory, public LLPathOramInterface {
     //     unique_tree_layout_t &&metadata_address_gen,
     //     bool bypass_path_read_on_stash_hit = false
     // );
-    virtual ~BinaryPathOram2() = default;
+    virtual ~BinaryPathOram2();
     protected:
     BinaryPathOram2(
-        std::string_view name,
+        std::string_view type, std::string_view name,
         unique_memory_t &&position_map, unique_memory_t &&untrusted_memory,
         std::unique_ptr<CryptoModule> &&crypto_module,
         BinaryPathOramStatistics *statistics,
@@ -186,12 +191,30 @@ class BinaryPathOram2: public Memory, public LLPathOramInterface {
 
     virtual void barrier() override;
 
+    /**
+     * @brief Largest number of blocks the current tree can hold while staying under max_load_factor
+     */
+    uint64_t max_num_blocks(double max_load_factor) const;
+
+    /**
+     * @brief Grow the ORAM to new_num_blocks without rebuilding the tree.
+     * 
+     * The tree has to have enough free slots already, see max_num_blocks(). The position map is
+     * replaced by new_position_map, existing entries are copied over and the new blocks are assigned
+     * random paths. Like after init(), the new blocks have to be written before they can be read.
+     * 
+     * @param new_num_blocks total number of blocks after growing
+     * @param max_load_factor load factor the tree must not exceed
+     * @param new_position_map uninitialized memory large enough for new_num_blocks position map entries
+     */
+    void grow(uint64_t new_num_blocks, double max_load_factor, unique_memory_t &&new_position_map);
+
     // LLPathOramInterface
     virtual std::uint64_t read_and_update_position_map(uint64_t logical_block_address, uint64_t new_path, bool is_dummy = false) override;
     virtual void find_and_remove_block_from_path(BlockMetadata *metadata, byte_t * data) override;
     virtual void place_block_on_path(const BlockMetadata *metadata, const byte_t * data) override;
     virtual std::uint64_t num_paths() const noexcept override{
-        return 1UL << (this->parameters.levels - 1);
+        return 1UL << ((this->parameters.levels - 1) * this->parameters.tree_bits);
     }
 
     protected:
@@ -206,11 +229,33 @@ class BinaryPathOram2: public Memory, public LLPathOramInterface {
         } else {
             std::uint64_t page_level = level / this->parameters.levels_per_page;
             std::uint64_t subtree_level = level % this->parameters.levels_per_page;
-            std::uint64_t subtree_offset = (this->currently_loaded_path.value() >> (this->parameters.levels - 1 - page_level * this->parameters.levels_per_page - subtree_level)) % (1UL << subtree_level);
+            std::uint64_t subtree_offset = (this->currently_loaded_path.value() >> ((this->parameters.levels - 1 - page_level * this->parameters.levels_per_page - subtree_level) * this->parameters.tree_bits)) % (1UL << (subtree_level * this->parameters.tree_bits));
             // std::uint64_t subtree_offset = subtree_path % (1UL << subtree_level);
 
-            return this->decrypted_path.data() + page_level * this->parameters.page_size + ((1UL << subtree_level) - 1 + subtree_offset) * this->parameters.bucket_size;
+            return this->decrypted_path.data() + page_level * this->parameters.page_size + (heap_level_start(subtree_level, this->parameters.tree_bits) + subtree_offset) * this->parameters.bucket_size;
+        }
+    }
+
+    inline addr_t get_page_address(std::uint64_t path, std::uint64_t page_level) const noexcept {
+        addr_t page_level_start_offset = 0;
+        for (std::uint64_t i = 0; i < page_level; i++) {
+            page_level_start_offset += 1UL << (i * this->parameters.levels_per_page * this->parameters.tree_bits);
         }
+        return (page_level_start_offset + this->get_page_offset(path, page_level)) * this->parameters.page_size;
+    }
+
+    // offset of the page on the given path within its page level
+    inline addr_t get_page_offset(std::uint64_t path, std::uint64_t page_level) const noexcept {
+        return path >> ((this->parameters.levels - 1 - page_level * this->parameters.levels_per_page) * this->parameters.tree_bits);
+    }
+
+    // index of the page on the given path among the children of its parent page
+    inline std::uint64_t get_child_index(std::uint64_t path, std::uint64_t page_level) const noexcept {
+        return this->get_page_offset(path, page_level) % this->children_per_page();
+    }
+
+    inline std::uint64_t children_per_page() const noexcept {
+        return 1UL << (this->parameters.levels_per_page * this->parameters.tree_bits);
     }
 
     inline byte_t *get_metadata(std::uint64_t level, std::uint64_t slot) {
@@ -225,7 +270,7 @@ class BinaryPathOram2: public Memory, public LLPathOramInterface {
         std::uint64_t counter = 0;
         std::memcpy(
             &counter,
-            this->decrypted_path.data() + (page_level + 1) * this->parameters.page_size - this->parameters.auth_tag_size - ((1UL << this->parameters.levels_per_page) - child_index) * sizeof(std::uint64_t),
+            this->decrypted_path.data() + (page_level + 1) * this->parameters.page_size - this->parameters.auth_tag_size - (this->children_per_page() - child_index) * sizeof(std::uint64_t),
             sizeof(std::uint64_t)
         );
         return counter;
@@ -233,7 +278,7 @@ class BinaryPathOram2: public Memory, public LLPathOramInterface {
 
     inline void set_counter(std::uint64_t page_level, std::uint64_t child_index, std::uint64_t counter) {
         std::memcpy(
-            this->decrypted_path.data() + (page_level + 1) * this->parameters.page_size - this->parameters.auth_tag_size - ((1UL << this->parameters.levels_per_page) - child_index) * sizeof(std::uint64_t),
+            this->decrypted_path.data() + (page_level + 1) * this->parameters.page_size - this->parameters.auth_tag_size - (this->children_per_page() - child_index) * sizeof(std::uint64_t),
             &counter,
             sizeof(std::uint64_t)
         );
@@ -242,7 +287,10 @@ class BinaryPathOram2: public Memory, public LLPathOramInterface {
     protected:
     bool access_block(MemoryRequestType access_type, uint64_t block_address, MemoryRequest &request, uint64_t offset = 0, uint64_t length = UINT64_MAX);
     void read_path(uint64_t path);
-    void evict_and_write_path();
+    virtual void evict_and_write_path();
+    void write_path();
+    // waits for the path write started by write_path, if there is one
+    void complete_write_back() const;
 
     bool find_and_remove_block_on_path_buffer(addr_t logical_block_address, BlockMetadata* metadata_buffer, byte_t *block_buffer);
     std::size_t try_evict_block_from_path_buffer(std::size_t max_count, uint64_t ignored_bits, uint64_t path, BlockMetadata *metadatas, byte_t *data_blocks, uint64_t level_limit = std::numeric_limits<uint64_t>::max());
@@ -261,7 +309,15 @@ class BinaryPathOram2: public Memory, public LLPathOramInterface {
     bytes_t key;
 
     std::vector<MemoryRequest> path_access;
+    // the requests of path_access that are read from the memory
+    std::vector<MemoryRequest> path_read_access;
     bytes_t decrypted_path;
 
     std::optional<std::uint64_t> currently_loaded_path;
+
+    // write_path only submits the write, the next path read is issued before it is completed
+    mutable std::vector<MemoryRequest> write_back_access;
+    mutable bool write_back_in_flight;
+    // the last written path, its pages are still decrypted in decrypted_path
+    std::optional<std::uint64_t> last_written_path;
 };
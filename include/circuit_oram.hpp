@@ -0,0 +1,75 @@
+#pragma once
+
+#include <binary_path_oram_2.hpp>
+#include <eviction_path_generator.hpp>
+
+/**
+ * @brief Circuit ORAM on top of the BinaryPathOram2 tree and page format.
+ *
+ * Accesses read and remove blocks the same way as BinaryPathOram2, but evictions
+ * only move at most one block per bucket along the path. A metadata-only scan
+ * decides which block to pick up at each level and where to drop it, so a single
+ * pass over the path suffices and the stash stays at O(1) blocks.
+ *
+ * Besides the path that was just read, every access evicts along
+ * evictions_per_access additional paths in reverse lexicographic order.
+ */
+class CircuitOram: public BinaryPathOram2 {
+    public:
+    static unique_memory_t create(
+        std::string_view name,
+        unique_memory_t &&position_map, unique_memory_t &&untrusted_memory,
+        std::unique_ptr<CryptoModule> &&crypto_module,
+        Parameters parameters,
+        uint64_t max_stash_size,
+        uint64_t evictions_per_access = 2
+    );
+
+    virtual ~CircuitOram() = default;
+
+    protected:
+    CircuitOram(
+        std::string_view name,
+        unique_memory_t &&position_map, unique_memory_t &&untrusted_memory,
+        std::unique_ptr<CryptoModule> &&crypto_module,
+        BinaryPathOramStatistics *statistics,
+        Parameters parameters,
+        uint64_t max_stash_size,
+        uint64_t evictions_per_access
+    );
+    CircuitOram(
+        std::string_view type, const toml::table &table,
+        unique_memory_t &&position_map, unique_memory_t &&untrusted_memory,
+        BinaryPathOramStatistics *statistics
+    );
+
+    public:
+    static unique_memory_t load_from_disk(const std::filesystem::path &location);
+    static unique_memory_t load_from_disk(const std::filesystem::path &location, const toml::table &table);
+
+    protected:
+    virtual toml::table to_toml_self() const override;
+    virtual void evict_and_write_path() override;
+
+    void evict_along_loaded_path();
+
+    int64_t deepest_level_in_bucket(uint64_t level, uint64_t path, bool *has_empty_slot);
+    void conditional_remove_deepest_from_bucket(bool do_remove, uint64_t level, uint64_t path, BlockMetadata *metadata, byte_t *data);
+    void conditional_place_in_bucket(bool do_place, uint64_t level, const BlockMetadata *metadata, const byte_t *data);
+
+    protected:
+    static constexpr int64_t stash_level = -1;
+    static constexpr int64_t no_level = -2;
+
+    const uint64_t evictions_per_access;
+    EvictionPathGenerator eviction_path_gen;
+
+    std::vector<int64_t> deepest;
+    std::vector<int64_t> target;
+    std::vector<bool> has_empty_slot;
+
+    BlockMetadata hold_metadata;
+    bytes_t hold_block;
+    BlockMetadata to_write_metadata;
+    bytes_t to_write_block;
+};
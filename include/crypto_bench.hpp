@@ -0,0 +1,3 @@
+#pragma once
+
+int crypto_bench_entry_point(int argc, const char** argv);
@@ -5,8 +5,11 @@
 #include <memory_defs.hpp>
 #include <assert.h>
 #include <cstring>
+#include <algorithm>
 #include <memory>
+#include <vector>
 #include <absl/strings/str_format.h>
+#include <aegis256_batch.hpp>
 
 class CryptoModule
 {
@@ -15,6 +18,30 @@ public:
     virtual void encrypt(const byte_t *key, const byte_t *nonce, const byte_t *message, std::size_t length, byte_t *cipher_text, byte_t *auth_tag) = 0;
     virtual bool decrypt(const byte_t *key, const byte_t *nonce, const byte_t *cipher_text, std::size_t length, const byte_t *auth_tag, byte_t *message) = 0;
 
+    // message and cipher text share one buffer, override if the cipher can not work in place
+    virtual void encrypt_in_place(const byte_t *key, const byte_t *nonce, byte_t *buffer, std::size_t length, byte_t *auth_tag) {
+        this->encrypt(key, nonce, buffer, length, buffer, auth_tag);
+    }
+    virtual bool decrypt_in_place(const byte_t *key, const byte_t *nonce, byte_t *buffer, std::size_t length, const byte_t *auth_tag) {
+        return this->decrypt(key, nonce, buffer, length, auth_tag, buffer);
+    }
+
+    // count messages of the same length in place, each with its own nonce and tag
+    // override if the cipher can work on several messages at once
+    virtual void encrypt_batch(const byte_t *key, std::size_t count, const byte_t *const *nonces, byte_t *const *buffers, std::size_t length, byte_t *const *auth_tags) {
+        for (std::size_t i = 0; i < count; i++) {
+            this->encrypt_in_place(key, nonces[i], buffers[i], length, auth_tags[i]);
+        }
+    }
+    // false if any of the messages fails verification
+    virtual bool decrypt_batch(const byte_t *key, std::size_t count, const byte_t *const *nonces, byte_t *const *buffers, std::size_t length, const byte_t *const *auth_tags) {
+        bool verified = true;
+        for (std::size_t i = 0; i < count; i++) {
+            verified &= this->decrypt_in_place(key, nonces[i], buffers[i], length, auth_tags[i]);
+        }
+        return verified;
+    }
+
 public:
     [[nodiscard]] virtual std::size_t key_size() const noexcept = 0;
     [[nodiscard]] virtual std::size_t nonce_size() const noexcept = 0;
@@ -95,6 +122,21 @@ public:
 
         return ret_code != -1;
     }
+    virtual void encrypt_batch(const byte_t *key, std::size_t count, const byte_t *const *nonces, byte_t *const *buffers, std::size_t length, byte_t *const *auth_tags) override
+    {
+        if (aegis256_batch_lanes() == 0) {
+            this->CryptoModule::encrypt_batch(key, count, nonces, buffers, length, auth_tags);
+            return;
+        }
+        aegis256_encrypt_batch(key, count, nonces, buffers, length, auth_tags);
+    }
+    virtual bool decrypt_batch(const byte_t *key, std::size_t count, const byte_t *const *nonces, byte_t *const *buffers, std::size_t length, const byte_t *const *auth_tags) override
+    {
+        if (aegis256_batch_lanes() == 0) {
+            return this->CryptoModule::decrypt_batch(key, count, nonces, buffers, length, auth_tags);
+        }
+        return aegis256_decrypt_batch(key, count, nonces, buffers, length, auth_tags);
+    }
 
 public:
     [[nodiscard]] virtual std::size_t key_size() const noexcept
@@ -119,6 +161,178 @@ public:
     virtual ~AEGIS256Module() noexcept = default;
 };
 
+class AEGIS128LModule : public CryptoModule
+{
+public:
+AEGIS128LModule() {
+    if(sodium_init() == -1) {
+        throw std::runtime_error("Libsodium init failed!");
+    }
+}
+
+public:
+    virtual void encrypt(const byte_t *key, const byte_t *nonce, const byte_t *message, std::size_t length, byte_t *cipher_text, byte_t *auth_tag) override
+    {
+        crypto_aead_aegis128l_encrypt_detached(
+            cipher_text,
+            auth_tag,
+            NULL,
+            message,
+            length,
+            NULL,
+            0,
+            NULL,
+            nonce,
+            key);
+    }
+    virtual bool decrypt(const byte_t *key, const byte_t *nonce, const byte_t *cipher_text, std::size_t length, const byte_t *auth_tag, byte_t *message) override
+    {
+        auto ret_code = crypto_aead_aegis128l_decrypt_detached(
+            message,
+            NULL,
+            cipher_text,
+            length,
+            auth_tag,
+            NULL,
+            0,
+            nonce,
+            key
+        );
+
+        return ret_code != -1;
+    }
+
+public:
+    [[nodiscard]] virtual std::size_t key_size() const noexcept
+    {
+        return crypto_aead_aegis128l_KEYBYTES;
+    }
+
+    // 16 bytes, exactly the address and counter the ORAMs put in the nonce
+    [[nodiscard]] virtual std::size_t nonce_size() const noexcept
+    {
+        return crypto_aead_aegis128l_NPUBBYTES;
+    }
+
+    [[nodiscard]] virtual std::size_t auth_tag_size() const noexcept
+    {
+        return crypto_aead_aegis128l_ABYTES;
+    };
+
+    [[nodiscard]] virtual std::string name() const noexcept {
+        return "AEGIS128L";
+    }
+
+    virtual ~AEGIS128LModule() noexcept = default;
+};
+
+/**
+ * @brief AES-256-GCM through libsodium, only available on CPUs with AES-NI and PCLMUL.
+ *
+ * The ORAMs lay out a nonce as random bytes followed by a 64 bit address and a 64 bit counter, which needs
+ * 16 bytes, but GCM takes a 96 bit nonce. The module reports a 16 byte nonce and keeps the low 48 bits of
+ * each half, so addresses and counters have to stay below 2^48. The expanded key is kept between calls
+ * since a path uses the same key for every page.
+ */
+class AES256GCMModule : public CryptoModule
+{
+public:
+AES256GCMModule() {
+    if(sodium_init() == -1) {
+        throw std::runtime_error("Libsodium init failed!");
+    }
+    if (crypto_aead_aes256gcm_is_available() == 0) {
+        throw std::runtime_error("AES256GCM is not supported on this CPU");
+    }
+}
+
+public:
+    virtual void encrypt(const byte_t *key, const byte_t *nonce, const byte_t *message, std::size_t length, byte_t *cipher_text, byte_t *auth_tag) override
+    {
+        this->expand_key(key);
+        this->fold_nonce(nonce);
+        crypto_aead_aes256gcm_encrypt_detached_afternm(
+            cipher_text,
+            auth_tag,
+            NULL,
+            message,
+            length,
+            NULL,
+            0,
+            NULL,
+            this->gcm_nonce,
+            &this->state);
+    }
+    virtual bool decrypt(const byte_t *key, const byte_t *nonce, const byte_t *cipher_text, std::size_t length, const byte_t *auth_tag, byte_t *message) override
+    {
+        this->expand_key(key);
+        this->fold_nonce(nonce);
+        auto ret_code = crypto_aead_aes256gcm_decrypt_detached_afternm(
+            message,
+            NULL,
+            cipher_text,
+            length,
+            auth_tag,
+            NULL,
+            0,
+            this->gcm_nonce,
+            &this->state
+        );
+
+        return ret_code != -1;
+    }
+
+public:
+    [[nodiscard]] virtual std::size_t key_size() const noexcept
+    {
+        return crypto_aead_aes256gcm_KEYBYTES;
+    }
+
+    [[nodiscard]] virtual std::size_t nonce_size() const noexcept
+    {
+        return 2 * sizeof(std::uint64_t);
+    }
+
+    [[nodiscard]] virtual std::size_t auth_tag_size() const noexcept
+    {
+        return crypto_aead_aes256gcm_ABYTES;
+    };
+
+    [[nodiscard]] virtual std::string name() const noexcept {
+        return "AES256GCM";
+    }
+
+    virtual ~AES256GCMModule() noexcept = default;
+
+private:
+    inline void expand_key(const byte_t *key) {
+        if (this->key_expanded && std::memcmp(this->expanded_key, key, crypto_aead_aes256gcm_KEYBYTES) == 0) {
+            return;
+        }
+        crypto_aead_aes256gcm_beforenm(&this->state, key);
+        std::memcpy(this->expanded_key, key, crypto_aead_aes256gcm_KEYBYTES);
+        this->key_expanded = true;
+    }
+
+    inline void fold_nonce(const byte_t *nonce) {
+        constexpr std::size_t half = crypto_aead_aes256gcm_NPUBBYTES / 2;
+        // the dropped bytes are the top of the little endian address and counter
+        // a non zero dropped byte would fold onto a nonce that is already used, which breaks GCM
+        auto is_zero = [](byte_t b) { return b == 0; };
+        if (!std::all_of(nonce + half, nonce + sizeof(std::uint64_t), is_zero)
+            || !std::all_of(nonce + sizeof(std::uint64_t) + half, nonce + 2 * sizeof(std::uint64_t), is_zero)) {
+            throw std::runtime_error("AES256GCM nonce address or counter does not fit in 48 bits");
+        }
+        std::memcpy(this->gcm_nonce, nonce, half);
+        std::memcpy(this->gcm_nonce + half, nonce + sizeof(std::uint64_t), half);
+    }
+
+    crypto_aead_aes256gcm_state state;
+    byte_t expanded_key[crypto_aead_aes256gcm_KEYBYTES];
+    bool key_expanded = false;
+    byte_t gcm_nonce[crypto_aead_aes256gcm_NPUBBYTES];
+};
+
 class PlainTextModule : public CryptoModule
 {
 
@@ -133,6 +347,15 @@ protected:
         std::memcpy(message, cipher_text, length);
         return std::memcmp(nonce, auth_tag, 32) == 0;
     }
+    // memcpy onto itself is undefined, there is nothing to copy anyway
+    virtual void encrypt_in_place(const byte_t *key, const byte_t *nonce, byte_t *buffer, std::size_t length, byte_t *auth_tag) override
+    {
+        std::memcpy(auth_tag, nonce, 32);
+    }
+    virtual bool decrypt_in_place(const byte_t *key, const byte_t *nonce, byte_t *buffer, std::size_t length, const byte_t *auth_tag) override
+    {
+        return std::memcmp(nonce, auth_tag, 32) == 0;
+    }
 
 public:
     [[nodiscard]] virtual std::size_t key_size() const noexcept
@@ -157,12 +380,66 @@ public:
     virtual ~PlainTextModule() noexcept = default;
 };
 
+/**
+ * @brief Collects same length messages that are encrypted or decrypted in place by one encrypt_batch or
+ * decrypt_batch call. The nonce is copied when a message is added, so one nonce buffer can be reused.
+ */
+class CryptoBatch {
+public:
+    explicit CryptoBatch(std::size_t nonce_size) : nonce_size(nonce_size) {}
+
+    inline void clear() noexcept {
+        this->nonces.clear();
+        this->buffers.clear();
+        this->auth_tags.clear();
+    }
+
+    inline void add(const byte_t *nonce, byte_t *buffer, byte_t *auth_tag) {
+        this->nonces.insert(this->nonces.end(), nonce, nonce + this->nonce_size);
+        this->buffers.push_back(buffer);
+        this->auth_tags.push_back(auth_tag);
+    }
+
+    [[nodiscard]] inline std::size_t size() const noexcept {
+        return this->buffers.size();
+    }
+
+    inline void encrypt(CryptoModule *crypto_module, const byte_t *key, std::size_t length) {
+        this->collect_nonce_pointers();
+        crypto_module->encrypt_batch(key, this->size(), this->nonce_pointers.data(), this->buffers.data(), length, this->auth_tags.data());
+    }
+
+    [[nodiscard]] inline bool decrypt(CryptoModule *crypto_module, const byte_t *key, std::size_t length) {
+        this->collect_nonce_pointers();
+        return crypto_module->decrypt_batch(key, this->size(), this->nonce_pointers.data(), this->buffers.data(), length, this->auth_tags.data());
+    }
+
+private:
+    // the nonces may have moved while adding
+    inline void collect_nonce_pointers() {
+        this->nonce_pointers.resize(this->size());
+        for (std::size_t i = 0; i < this->size(); i++) {
+            this->nonce_pointers[i] = this->nonces.data() + i * this->nonce_size;
+        }
+    }
+
+    std::size_t nonce_size;
+    bytes_t nonces;
+    std::vector<const byte_t *> nonce_pointers;
+    std::vector<byte_t *> buffers;
+    std::vector<byte_t *> auth_tags;
+};
+
 inline std::unique_ptr<CryptoModule> get_crypto_module_by_name(std::string_view name) {
     if (name == "PlainText") {
         return std::make_unique<PlainTextModule>();
     } else if (name == "AGEIS256" || name == "AEGIS256") {
         // maintain compatiblity with the typo version :(
         return std::make_unique<AEGIS256Module>();
+    } else if (name == "AEGIS128L") {
+        return std::make_unique<AEGIS128LModule>();
+    } else if (name == "AES256GCM") {
+        return std::make_unique<AES256GCMModule>();
     } else {
         throw std::runtime_error(absl::StrFormat("Unkown Crypto Module name %s", name));
     }
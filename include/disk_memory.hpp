@@ -77,6 +77,8 @@ class BlockDiskMemoryLibAIO : public Memory{
         [[nodiscard]] virtual bool isBacked() const noexcept override;
         virtual void access(MemoryRequest &request) override;
         virtual void batch_access(std::vector<MemoryRequest> &requests) override;
+        virtual void submit_batch_access(std::vector<MemoryRequest> &requests) override;
+        virtual void complete_batch_access(std::vector<MemoryRequest> &requests) override;
         virtual void barrier() override;
         [[nodiscard]] virtual bool is_request_type_supported(MemoryRequestType type) const noexcept override;
         [[nodiscard]] virtual uint64_t page_size() const noexcept override;
@@ -106,10 +108,17 @@ class BlockDiskMemoryLibAIO : public Memory{
         const uint64_t _page_size;
         const uint64_t fs_block_size;
 
-        uint64_t allocated_buffer_size;
-        std::vector<struct iocb> io_control_blocks;
-        std::vector<struct iocb*> io_control_block_pointers;
-        char* buffer;
+        // one slot per submitted batch, reused once the batch is completed
+        struct InFlightBatch {
+            std::vector<MemoryRequest> *requests = nullptr;
+            uint64_t allocated_buffer_size = 0;
+            std::vector<struct iocb> io_control_blocks;
+            std::vector<struct iocb*> io_control_block_pointers;
+            char* buffer = nullptr;
+            uint64_t outstanding = 0;
+            uint64_t failed = 0;
+        };
+        std::vector<std::unique_ptr<InFlightBatch>> batches;
         std::vector<struct io_event> io_events;
 };
 
@@ -10,6 +10,8 @@ class EvictionPathGenerator final{
         EvictionPathGenerator(std::vector<int64_t> &&level_sizes);
         EvictionPathGenerator(const toml::table *table);
         int64_t next_path();
+        // start over from the first eviction path
+        void reset();
 
         toml::table to_toml() const;
     private:
@@ -12,13 +12,13 @@ size_t index = 0;
 #if defined(__AVX__) || defined(__AVX2__)
 if constexpr (std::is_same_v<double, T>) {
     // constexpr size_t num_doubles_per_vector = 256 / (8 * sizeof(double)); 
-    // for (;index < count - num_doubles_per_vector + 1; index += num_doubles_per_vector) {
+    // for (;index + num_doubles_per_vector <= count; index += num_doubles_per_vector) {
         
     // }
 
 } else if constexpr(std::is_same_v<float, T>){
     constexpr size_t num_floats_per_vector = 256 / (8 * sizeof(float)); 
-    for (;index < count - num_floats_per_vector + 1; index += num_floats_per_vector) {
+    for (;index + num_floats_per_vector <= count; index += num_floats_per_vector) {
         __m256 input = _mm256_loadu_ps(data + index);
         __m256 result = exp256_ps(input);
         _mm256_storeu_ps(data + index, result);
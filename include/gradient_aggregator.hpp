@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory_defs.hpp>
+
+enum class GradientPrecision {
+    FP32,
+    BF16
+};
+
+enum class GradientOptimizer {
+    FED_AVG,
+    ADAGRAD,
+    ADAM
+};
+
+GradientPrecision gradient_precision_from_name(const std::string &name);
+GradientOptimizer gradient_optimizer_from_name(const std::string &name);
+
+struct GradientAggregationConfig {
+    GradientPrecision precision = GradientPrecision::FP32;
+    GradientOptimizer optimizer = GradientOptimizer::FED_AVG;
+    float learning_rate = 0.01f;
+};
+
+/**
+ * @brief Sets the flush-to-zero and denormals-are-zero bits of MXCSR while it lives, so that floating point
+ * instructions take the same time for any value. Nested scopes don't touch MXCSR again.
+ */
+class FlushDenormalsScope {
+    public:
+    FlushDenormalsScope();
+    ~FlushDenormalsScope();
+
+    FlushDenormalsScope(const FlushDenormalsScope &) = delete;
+    FlushDenormalsScope &operator=(const FlushDenormalsScope &) = delete;
+
+    private:
+    unsigned int saved_mxcsr;
+};
+
+/**
+ * @brief Aggregates the client gradients of embedding entries in the recsys buffers and applies them on flush.
+ *
+ * An entry holds dimension() weights in the configured precision, followed by the FP32 optimizer state: the sum
+ * of squared gradients for Adagrad, the two moments and the step count for Adam. Next to every entry the buffers
+ * keep entry_size bytes for an FP32 accumulator of dimension() floats and a uint16 count of the aggregated
+ * gradients. accumulate adds one client gradient to an accumulator. apply averages the accumulator over the
+ * count (FedAvg) and takes one optimizer step on the entry.
+ *
+ * Both run the same instructions for every entry and mask with denormals flushed to zero, so they can be used
+ * inside the oblivious scans. The simulation has no clients, so every client sends the same gradient. Its first
+ * element is 1, so the first accumulator element has to equal the count.
+ */
+class GradientAggregator {
+    public:
+    GradientAggregator(std::uint64_t entry_size, const GradientAggregationConfig &config = GradientAggregationConfig());
+
+    std::uint64_t dimension() const {
+        return this->_dimension;
+    }
+
+    // adds the client gradient to the accumulator if enable, leaves it unchanged otherwise
+    void accumulate(bool enable, byte_t *accumulator) const;
+
+    // updates the entry with the average of count gradients, entries with a count of 0 stay unchanged
+    void apply(byte_t *entry, const byte_t *accumulator, std::uint16_t count);
+
+    bool is_valid(const byte_t *accumulator, std::uint16_t count) const;
+
+    private:
+    static constexpr float beta1 = 0.9f;
+    static constexpr float beta2 = 0.999f;
+    static constexpr float epsilon = 1e-8f;
+
+    const GradientAggregationConfig config;
+    const std::uint64_t entry_size;
+    const std::uint64_t weight_size;
+    const std::uint64_t _dimension;
+    std::vector<float> client_gradient;
+
+    // scratch space of apply, kept between calls
+    bytes_t updated_entry;
+    std::vector<float> weights;
+    std::vector<float> average_gradient;
+    std::vector<float> optimizer_state;
+    std::vector<std::uint16_t> bf16_weights;
+};
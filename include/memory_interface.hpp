@@ -131,6 +131,27 @@ class Memory {
             }
         }
 
+        /**
+         * @brief Starts a batch of requests without waiting for it to finish, so that other requests can
+         * be issued in the meantime. Every call has to be followed by complete_batch_access
+         * with the same requests. Several batches can be in flight at once and completed in any order, as
+         * long as they do not touch the same pages.
+         * 
+         * Memories that can not keep requests in flight perform the whole batch here.
+         * 
+         * @param requests memory requests, read data is only valid after complete_batch_access
+         */
+        virtual void submit_batch_access(std::vector<MemoryRequest> &requests) {
+            this->batch_access(requests);
+        }
+
+        /**
+         * @brief Waits for the batch started by submit_batch_access
+         * 
+         * @param requests the requests given to submit_batch_access
+         */
+        virtual void complete_batch_access(std::vector<MemoryRequest> &requests) {}
+
         virtual uint64_t page_size() const = 0;
 
         virtual void reset_statistics(bool from_file = false) {
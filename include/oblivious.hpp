@@ -0,0 +1,393 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <immintrin.h>
+#include <conditional_memcpy.hpp>
+#include <memory_defs.hpp>
+
+/**
+ * @brief Data-oblivious sorting, compaction and selection: the memory accesses and the instructions only depend
+ * on the number of elements, never on the keys, payloads or marks.
+ *
+ * Elements are kept as two parallel arrays, count keys of type Key (std::uint32_t or std::uint64_t) and count
+ * payloads of PayloadSize bytes each. The payload array may be nullptr when PayloadSize is 0. Keys are compared
+ * as unsigned integers, with AVX-512 or AVX2 when the build enables them. Payloads of the same size as the key
+ * are blended in vector registers together with the keys, other sizes are swapped one element at a time.
+ */
+namespace oblivious {
+    template <typename Key>
+    concept SortKey = std::is_same_v<Key, std::uint32_t> || std::is_same_v<Key, std::uint64_t>;
+
+    /**
+     * @brief Swaps size bytes of a and b if mask is all ones and leaves them unchanged if it is zero.
+     */
+    __attribute__((always_inline)) inline void conditional_swap(std::uint64_t mask, byte_t *a, byte_t *b, std::size_t size) {
+        std::size_t offset = 0;
+
+        #if defined(__AVX2__)
+        const __m256i mask256 = _mm256_set1_epi64x(static_cast<std::int64_t>(mask));
+        for (; offset + 32 <= size; offset += 32) {
+            __m256i value_a = _mm256_loadu_si256(reinterpret_cast<const __m256i_u *>(a + offset));
+            __m256i value_b = _mm256_loadu_si256(reinterpret_cast<const __m256i_u *>(b + offset));
+            __m256i difference = _mm256_and_si256(_mm256_xor_si256(value_a, value_b), mask256);
+            _mm256_storeu_si256(reinterpret_cast<__m256i_u *>(a + offset), _mm256_xor_si256(value_a, difference));
+            _mm256_storeu_si256(reinterpret_cast<__m256i_u *>(b + offset), _mm256_xor_si256(value_b, difference));
+        }
+        #endif
+
+        for (; offset + 8 <= size; offset += 8) {
+            std::uint64_t value_a;
+            std::uint64_t value_b;
+            std::memcpy(&value_a, a + offset, 8);
+            std::memcpy(&value_b, b + offset, 8);
+            std::uint64_t difference = (value_a ^ value_b) & mask;
+            value_a ^= difference;
+            value_b ^= difference;
+            std::memcpy(a + offset, &value_a, 8);
+            std::memcpy(b + offset, &value_b, 8);
+        }
+
+        for (; offset < size; offset++) {
+            byte_t difference = (a[offset] ^ b[offset]) & static_cast<byte_t>(mask);
+            a[offset] ^= difference;
+            b[offset] ^= difference;
+        }
+    }
+
+    namespace detail {
+        // PayloadSize of the sort or compaction when the payload size is only known at run time
+        inline constexpr std::size_t dynamic_payload_size = std::numeric_limits<std::size_t>::max();
+
+        template <std::size_t PayloadSize>
+        inline std::size_t payload_bytes(std::size_t payload_size) {
+            if constexpr (PayloadSize == dynamic_payload_size) {
+                return payload_size;
+            } else {
+                return PayloadSize;
+            }
+        }
+
+        template <std::size_t PayloadSize>
+        inline byte_t *payload_at(byte_t *payloads, std::size_t index, std::size_t payload_size) {
+            if constexpr (PayloadSize == 0) {
+                return payloads;
+            } else {
+                return payloads + index * payload_bytes<PayloadSize>(payload_size);
+            }
+        }
+
+        // swaps the payloads of the lanes whose bit is set in swap_bits
+        template <std::size_t PayloadSize>
+        inline void swap_lane_payloads(byte_t *payloads, std::size_t index, std::size_t distance, std::uint64_t swap_bits, std::size_t lanes, std::size_t payload_size) {
+            const std::size_t size = payload_bytes<PayloadSize>(payload_size);
+            for (std::size_t lane = 0; lane < lanes; lane++) {
+                std::uint64_t mask = 0UL - ((swap_bits >> lane) & 1UL);
+                conditional_swap(mask, payloads + (index + lane) * size, payloads + (index + lane + distance) * size, size);
+            }
+        }
+
+        // swaps element i and i + distance for i in [0, count) if swap_below is not (i >= threshold)
+        template <SortKey Key, std::size_t PayloadSize>
+        void swap_range(Key *keys, byte_t *payloads, std::uint8_t *marks, std::size_t count, std::size_t distance, std::uint64_t swap_below, std::uint64_t threshold, std::size_t payload_size) {
+            const std::size_t size = payload_bytes<PayloadSize>(payload_size);
+            for (std::size_t i = 0; i < count; i++) {
+                std::uint64_t mask = 0UL - (swap_below ^ static_cast<std::uint64_t>(i >= threshold));
+                Key key_difference = (keys[i] ^ keys[i + distance]) & static_cast<Key>(mask);
+                keys[i] ^= key_difference;
+                keys[i + distance] ^= key_difference;
+                std::uint8_t mark_difference = (marks[i] ^ marks[i + distance]) & static_cast<std::uint8_t>(mask);
+                marks[i] ^= mark_difference;
+                marks[i + distance] ^= mark_difference;
+                if constexpr (PayloadSize > 0) {
+                    conditional_swap(mask, payloads + i * size, payloads + (i + distance) * size, size);
+                }
+            }
+        }
+
+        // compacts the marked elements of a power of two count to the front, starting at offset and wrapping around
+        template <SortKey Key, std::size_t PayloadSize>
+        void offset_compact(Key *keys, byte_t *payloads, std::uint8_t *marks, std::size_t count, std::uint64_t offset, std::size_t payload_size) {
+            if (count < 2) {
+                return;
+            }
+            if (count == 2) {
+                std::uint64_t swap = (static_cast<std::uint64_t>(marks[0] ^ 1) & marks[1]) ^ offset;
+                swap_range<Key, PayloadSize>(keys, payloads, marks, 1, 1, swap, 1, payload_size);
+                return;
+            }
+
+            const std::size_t half = count / 2;
+            std::uint64_t marked_in_front = 0;
+            for (std::size_t i = 0; i < half; i++) {
+                marked_in_front += marks[i];
+            }
+
+            byte_t *back_payloads = payloads;
+            if constexpr (PayloadSize > 0) {
+                back_payloads += half * payload_bytes<PayloadSize>(payload_size);
+            }
+            offset_compact<Key, PayloadSize>(keys, payloads, marks, half, offset % half, payload_size);
+            offset_compact<Key, PayloadSize>(keys + half, back_payloads, marks + half, half, (offset + marked_in_front) % half, payload_size);
+
+            std::uint64_t swap_below = static_cast<std::uint64_t>((offset % half) + marked_in_front >= half) ^ static_cast<std::uint64_t>(offset >= half);
+            swap_range<Key, PayloadSize>(keys, payloads, marks, half, half, swap_below, (offset + marked_in_front) % half, payload_size);
+        }
+
+        template <SortKey Key, std::size_t PayloadSize>
+        std::size_t compact(Key *keys, byte_t *payloads, std::uint8_t *marks, std::size_t count, std::size_t payload_size) {
+            std::size_t marked = 0;
+            for (std::size_t i = 0; i < count; i++) {
+                marked += marks[i];
+            }
+            if (count < 2) {
+                return marked;
+            }
+
+            // the part below the largest power of two is compacted on its own and then merged
+            const std::size_t power_of_two = std::bit_floor(count);
+            const std::size_t remainder = count - power_of_two;
+            std::uint64_t marked_in_remainder = 0;
+            for (std::size_t i = 0; i < remainder; i++) {
+                marked_in_remainder += marks[i];
+            }
+
+            byte_t *power_of_two_payloads = payloads;
+            if constexpr (PayloadSize > 0) {
+                power_of_two_payloads += remainder * payload_bytes<PayloadSize>(payload_size);
+            }
+            compact<Key, PayloadSize>(keys, payloads, marks, remainder, payload_size);
+            offset_compact<Key, PayloadSize>(
+                keys + remainder, power_of_two_payloads, marks + remainder,
+                power_of_two, (power_of_two - remainder + marked_in_remainder) % power_of_two, payload_size
+            );
+            swap_range<Key, PayloadSize>(keys, payloads, marks, remainder, power_of_two, 0, marked_in_remainder, payload_size);
+
+            return marked;
+        }
+
+        template <SortKey Key, std::size_t PayloadSize>
+        void compare_exchange(Key *keys, byte_t *payloads, std::size_t count, std::size_t distance, bool ascending, std::size_t payload_size) {
+            std::size_t index = 0;
+            // payloads as wide as the key move in the same vector lanes
+            constexpr bool blend_payloads = (PayloadSize == sizeof(Key));
+
+            #if defined(__AVX512F__)
+            if constexpr (sizeof(Key) == 8) {
+                constexpr std::size_t num_keys_per_512_vector = 8;
+                const __mmask8 direction = ascending ? 0 : 0xFF;
+                for (; index + num_keys_per_512_vector <= count; index += num_keys_per_512_vector) {
+                    __m512i key_a = _mm512_loadu_si512(keys + index);
+                    __m512i key_b = _mm512_loadu_si512(keys + index + distance);
+                    __mmask8 swap = _mm512_cmpgt_epu64_mask(key_a, key_b) ^ direction;
+                    _mm512_storeu_si512(keys + index, _mm512_mask_blend_epi64(swap, key_a, key_b));
+                    _mm512_storeu_si512(keys + index + distance, _mm512_mask_blend_epi64(swap, key_b, key_a));
+
+                    if constexpr (blend_payloads) {
+                        __m512i payload_a = _mm512_loadu_si512(payloads + index * PayloadSize);
+                        __m512i payload_b = _mm512_loadu_si512(payloads + (index + distance) * PayloadSize);
+                        _mm512_storeu_si512(payloads + index * PayloadSize, _mm512_mask_blend_epi64(swap, payload_a, payload_b));
+                        _mm512_storeu_si512(payloads + (index + distance) * PayloadSize, _mm512_mask_blend_epi64(swap, payload_b, payload_a));
+                    } else if constexpr (PayloadSize > 0) {
+                        swap_lane_payloads<PayloadSize>(payloads, index, distance, swap, num_keys_per_512_vector, payload_size);
+                    }
+                }
+            } else {
+                constexpr std::size_t num_keys_per_512_vector = 16;
+                const __mmask16 direction = ascending ? 0 : 0xFFFF;
+                for (; index + num_keys_per_512_vector <= count; index += num_keys_per_512_vector) {
+                    __m512i key_a = _mm512_loadu_si512(keys + index);
+                    __m512i key_b = _mm512_loadu_si512(keys + index + distance);
+                    __mmask16 swap = _mm512_cmpgt_epu32_mask(key_a, key_b) ^ direction;
+                    _mm512_storeu_si512(keys + index, _mm512_mask_blend_epi32(swap, key_a, key_b));
+                    _mm512_storeu_si512(keys + index + distance, _mm512_mask_blend_epi32(swap, key_b, key_a));
+
+                    if constexpr (blend_payloads) {
+                        __m512i payload_a = _mm512_loadu_si512(payloads + index * PayloadSize);
+                        __m512i payload_b = _mm512_loadu_si512(payloads + (index + distance) * PayloadSize);
+                        _mm512_storeu_si512(payloads + index * PayloadSize, _mm512_mask_blend_epi32(swap, payload_a, payload_b));
+                        _mm512_storeu_si512(payloads + (index + distance) * PayloadSize, _mm512_mask_blend_epi32(swap, payload_b, payload_a));
+                    } else if constexpr (PayloadSize > 0) {
+                        swap_lane_payloads<PayloadSize>(payloads, index, distance, swap, num_keys_per_512_vector, payload_size);
+                    }
+                }
+            }
+            #endif
+
+            #if defined(__AVX2__)
+            {
+                constexpr std::size_t num_keys_per_256_vector = 32 / sizeof(Key);
+                // AVX2 only compares signed integers, flipping the sign bit orders unsigned ones the same way
+                __m256i sign_bit;
+                if constexpr (sizeof(Key) == 8) {
+                    sign_bit = _mm256_set1_epi64x(std::numeric_limits<std::int64_t>::min());
+                } else {
+                    sign_bit = _mm256_set1_epi32(std::numeric_limits<std::int32_t>::min());
+                }
+                const __m256i direction = _mm256_set1_epi32(ascending ? 0 : -1);
+                for (; index + num_keys_per_256_vector <= count; index += num_keys_per_256_vector) {
+                    __m256i key_a = _mm256_loadu_si256(reinterpret_cast<const __m256i_u *>(keys + index));
+                    __m256i key_b = _mm256_loadu_si256(reinterpret_cast<const __m256i_u *>(keys + index + distance));
+                    __m256i greater;
+                    if constexpr (sizeof(Key) == 8) {
+                        greater = _mm256_cmpgt_epi64(_mm256_xor_si256(key_a, sign_bit), _mm256_xor_si256(key_b, sign_bit));
+                    } else {
+                        greater = _mm256_cmpgt_epi32(_mm256_xor_si256(key_a, sign_bit), _mm256_xor_si256(key_b, sign_bit));
+                    }
+                    __m256i swap = _mm256_xor_si256(greater, direction);
+                    _mm256_storeu_si256(reinterpret_cast<__m256i_u *>(keys + index), _mm256_blendv_epi8(key_a, key_b, swap));
+                    _mm256_storeu_si256(reinterpret_cast<__m256i_u *>(keys + index + distance), _mm256_blendv_epi8(key_b, key_a, swap));
+
+                    if constexpr (blend_payloads) {
+                        byte_t *payload_a_pointer = payloads + index * PayloadSize;
+                        byte_t *payload_b_pointer = payloads + (index + distance) * PayloadSize;
+                        __m256i payload_a = _mm256_loadu_si256(reinterpret_cast<const __m256i_u *>(payload_a_pointer));
+                        __m256i payload_b = _mm256_loadu_si256(reinterpret_cast<const __m256i_u *>(payload_b_pointer));
+                        _mm256_storeu_si256(reinterpret_cast<__m256i_u *>(payload_a_pointer), _mm256_blendv_epi8(payload_a, payload_b, swap));
+                        _mm256_storeu_si256(reinterpret_cast<__m256i_u *>(payload_b_pointer), _mm256_blendv_epi8(payload_b, payload_a, swap));
+                    } else if constexpr (PayloadSize > 0) {
+                        std::uint64_t swap_bits;
+                        if constexpr (sizeof(Key) == 8) {
+                            swap_bits = static_cast<std::uint64_t>(_mm256_movemask_pd(_mm256_castsi256_pd(swap)));
+                        } else {
+                            swap_bits = static_cast<std::uint64_t>(_mm256_movemask_ps(_mm256_castsi256_ps(swap)));
+                        }
+                        swap_lane_payloads<PayloadSize>(payloads, index, distance, swap_bits, num_keys_per_256_vector, payload_size);
+                    }
+                }
+            }
+            #endif
+
+            const Key direction = ascending ? 0 : std::numeric_limits<Key>::max();
+            for (; index < count; index++) {
+                Key key_a = keys[index];
+                Key key_b = keys[index + distance];
+                Key swap = (Key(0) - static_cast<Key>(key_a > key_b)) ^ direction;
+                Key key_difference = (key_a ^ key_b) & swap;
+                keys[index] = key_a ^ key_difference;
+                keys[index + distance] = key_b ^ key_difference;
+                if constexpr (PayloadSize > 0) {
+                    conditional_swap(0UL - static_cast<std::uint64_t>(swap & 1), payload_at<PayloadSize>(payloads, index, payload_size), payload_at<PayloadSize>(payloads, index + distance, payload_size), payload_bytes<PayloadSize>(payload_size));
+                }
+            }
+        }
+
+        template <SortKey Key, std::size_t PayloadSize>
+        void bitonic_merge(Key *keys, byte_t *payloads, std::size_t count, bool ascending, std::size_t payload_size) {
+            if (count < 2) {
+                return;
+            }
+            // the largest power of two below count
+            const std::size_t distance = std::bit_floor(count - 1);
+            compare_exchange<Key, PayloadSize>(keys, payloads, count - distance, distance, ascending, payload_size);
+            bitonic_merge<Key, PayloadSize>(keys, payloads, distance, ascending, payload_size);
+            bitonic_merge<Key, PayloadSize>(keys + distance, payload_at<PayloadSize>(payloads, distance, payload_size), count - distance, ascending, payload_size);
+        }
+
+        template <SortKey Key, std::size_t PayloadSize>
+        void bitonic_sort(Key *keys, byte_t *payloads, std::size_t count, bool ascending, std::size_t payload_size) {
+            if (count < 2) {
+                return;
+            }
+            const std::size_t half = count / 2;
+            bitonic_sort<Key, PayloadSize>(keys, payloads, half, !ascending, payload_size);
+            bitonic_sort<Key, PayloadSize>(keys + half, payload_at<PayloadSize>(payloads, half, payload_size), count - half, ascending, payload_size);
+            bitonic_merge<Key, PayloadSize>(keys, payloads, count, ascending, payload_size);
+        }
+    }
+
+    /**
+     * @brief Compare-exchanges element i with element i + distance for every i in [0, count), so that the smaller
+     * key ends up first if ascending and last otherwise. count has to be at most distance.
+     */
+    template <SortKey Key, std::size_t PayloadSize>
+    void compare_exchange(Key *keys, byte_t *payloads, std::size_t count, std::size_t distance, bool ascending) {
+        detail::compare_exchange<Key, PayloadSize>(keys, payloads, count, distance, ascending, PayloadSize);
+    }
+
+    /**
+     * @brief Merges a bitonic sequence of count elements, count does not need to be a power of two.
+     */
+    template <SortKey Key, std::size_t PayloadSize>
+    void bitonic_merge(Key *keys, byte_t *payloads, std::size_t count, bool ascending) {
+        detail::bitonic_merge<Key, PayloadSize>(keys, payloads, count, ascending, PayloadSize);
+    }
+
+    /**
+     * @brief Sorts count elements by key with a bitonic network, O(n log^2 n) compare-exchanges. The sort is not
+     * stable, add the position to the key if the order of equal keys matters.
+     */
+    template <SortKey Key, std::size_t PayloadSize>
+    void bitonic_sort(Key *keys, byte_t *payloads, std::size_t count, bool ascending = true) {
+        detail::bitonic_sort<Key, PayloadSize>(keys, payloads, count, ascending, PayloadSize);
+    }
+
+    /**
+     * @brief bitonic_sort for payloads whose size is only known at run time, e.g. whole requests.
+     */
+    template <SortKey Key>
+    void bitonic_sort(Key *keys, byte_t *payloads, std::size_t count, std::size_t payload_size, bool ascending = true) {
+        detail::bitonic_sort<Key, detail::dynamic_payload_size>(keys, payloads, count, ascending, payload_size);
+    }
+
+    /**
+     * @brief Sorts count elements by ascending key with Batcher's odd-even merge sort. It needs about a quarter
+     * fewer compare-exchanges than bitonic_sort, but the runs between them are shorter.
+     */
+    template <SortKey Key, std::size_t PayloadSize>
+    void odd_even_merge_sort(Key *keys, byte_t *payloads, std::size_t count) {
+        for (std::size_t merge_size = 1; merge_size < count; merge_size <<= 1) {
+            const std::size_t block_size = 2 * merge_size;
+            for (std::size_t distance = merge_size; distance > 0; distance >>= 1) {
+                for (std::size_t start = distance % merge_size; start + distance < count; start += 2 * distance) {
+                    std::size_t end = start + std::min(distance, count - start - distance);
+                    // only pairs inside one block of block_size are compared
+                    for (std::size_t first = start; first < end;) {
+                        std::size_t block_end = (first / block_size + 1) * block_size;
+                        std::size_t run_end = std::min(end, block_end - distance);
+                        if (first < run_end) {
+                            compare_exchange<Key, PayloadSize>(keys + first, detail::payload_at<PayloadSize>(payloads, first, PayloadSize), run_end - first, distance, true);
+                        }
+                        first = block_end;
+                    }
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Moves the elements with a non-zero mark to the front and keeps their order, with O(n log n) swaps
+     * (ORCompact by Sasy, Johnson and Goldberg). The marks move with their elements and are 0 or 1. Returns the
+     * number of marked elements.
+     */
+    template <SortKey Key, std::size_t PayloadSize>
+    std::size_t compact(Key *keys, byte_t *payloads, std::uint8_t *marks, std::size_t count) {
+        return detail::compact<Key, PayloadSize>(keys, payloads, marks, count, PayloadSize);
+    }
+
+    /**
+     * @brief compact for payloads whose size is only known at run time, e.g. the entries of a buffer.
+     */
+    template <SortKey Key>
+    std::size_t compact(Key *keys, byte_t *payloads, std::uint8_t *marks, std::size_t count, std::size_t payload_size) {
+        return detail::compact<Key, detail::dynamic_payload_size>(keys, payloads, marks, count, payload_size);
+    }
+
+    /**
+     * @brief Copies the key and payload of element index to key and payload, touching every element so that
+     * the index stays hidden.
+     */
+    template <SortKey Key, std::size_t PayloadSize>
+    void select(const Key *keys, const byte_t *payloads, std::size_t count, std::size_t index, Key &key, byte_t *payload) {
+        for (std::size_t i = 0; i < count; i++) {
+            Key mask = Key(0) - static_cast<Key>(i == index);
+            key = (key & ~mask) | (keys[i] & mask);
+            if constexpr (PayloadSize > 0) {
+                conditional_memcpy(i == index, payload, payloads + i * PayloadSize, PayloadSize);
+            }
+        }
+    }
+}
@@ -4,6 +4,8 @@
 #include <stdint.h>
 
 int create_oram_entry_point(int argc, const char** argv);
+int resize_oram_entry_point(int argc, const char** argv);
+int rebuild_oram_entry_point(int argc, const char** argv);
 
 unique_memory_t createBinaryPathOram(
     uint64_t size, uint64_t block_size, uint64_t blocks_per_bucket,
@@ -30,7 +32,11 @@ unique_memory_t createPageOptimizedRAWOram(
     double max_load_factor = 1.0,
     uint64_t tree_order = 16,
     bool fast_init = false,
-    std::string_view crypto_module_name = "PlainText"
+    std::string_view crypto_module_name = "PlainText",
+    std::string_view name_prefix = "",
+    uint64_t evictions_per_batch = 1,
+    bool prefetch_eviction_paths = false,
+    uint64_t valid_bit_cache_size = 0
 );
 
 unique_memory_t createBinaryPathOram2(
@@ -41,5 +47,41 @@ unique_memory_t createBinaryPathOram2(
     double max_load_factor = 1.0,
     bool fast_init = false,
     uint64_t levels_per_page = 1,
+    std::string_view crypto_module_name = "PlainText",
+    uint64_t tree_order = 2
+);
+unique_memory_t createRingOram(
+    uint64_t size, uint64_t block_size, uint64_t blocks_per_bucket,
+    uint64_t dummies_per_bucket,
+    uint64_t num_accesses_per_eviction,
+    uint64_t stash_capacity,
+    uint64_t max_position_map_size = 32768UL, bool recursive = false,
+    uint64_t page_size = 4096,
+    double max_load_factor = 1.0,
+    std::string_view crypto_module_name = "PlainText"
+);
+unique_memory_t createCircuitOram(
+    uint64_t size, uint64_t block_size, uint64_t page_size = 4096,
+    uint64_t stash_capacity = 32,
+    uint64_t evictions_per_access = 2,
+    uint64_t max_position_map_size = 32768UL, bool recursive = false,
+    double max_load_factor = 1.0,
+    bool fast_init = false,
+    uint64_t levels_per_page = 1,
+    std::string_view crypto_module_name = "PlainText",
+    uint64_t tree_order = 2
+);
+
+unique_memory_t createShardedOram(
+    uint64_t size, uint64_t block_size,
+    uint64_t num_shards, uint64_t shard_batch_size,
+    uint64_t blocks_per_bucket,
+    uint64_t num_accesses_per_eviction,
+    uint64_t stash_capacity,
+    uint64_t max_position_map_size = 32768UL, bool recursive = false,
+    uint64_t page_size = 4096,
+    double max_load_factor = 1.0,
+    uint64_t tree_order = 16,
+    bool fast_init = false,
     std::string_view crypto_module_name = "PlainText"
 );
\ No newline at end of file
@@ -9,6 +9,8 @@
 #include <valid_bit_tree.hpp>
 #include <crypto_module.hpp>
 #include <low_level_path_oram_interface.hpp>
+#include <future>
+#include <mutex>
 
 class PageOptimizedRAWOram: public Memory, public LLPathOramInterface {
 
@@ -26,7 +28,9 @@ class PageOptimizedRAWOram: public Memory, public LLPathOramInterface {
         uint64_t stash_capacity,
         double max_load_factor = 1.0,
         bool bypass_path_read_on_stash_hit = false,
-        bool unsecure_eviction_buffer = false
+        bool unsecure_eviction_buffer = false,
+        uint64_t evictions_per_batch = 1,
+        bool prefetch_eviction_paths = false
     );
 
     struct ComputedParameters {
@@ -70,37 +74,57 @@ class PageOptimizedRAWOram: public Memory, public LLPathOramInterface {
         path_index_size(path_index_size), block_index_size(block_index_size)
         {}
 
+        // the accessors take the index sizes as template arguments when they are known at compile
+        // time, 0 uses the runtime size
+        template <std::size_t BlockIndexSize = 0, std::size_t PathIndexSize = 0>
         [[nodiscard]] inline std::size_t metadata_size() const noexcept {
-            return path_index_size + block_index_size;
+            return this->get_block_index_size<BlockIndexSize>() + this->get_path_index_size<PathIndexSize>();
         }
 
+        template <std::size_t BlockIndexSize = 0, std::size_t PathIndexSize = 0>
         [[nodiscard]] inline addr_t get_path_index(const byte_t * metadata) const noexcept{
             addr_t path_index = 0;
-            std::memcpy(&path_index, metadata + this->block_index_size, this->path_index_size);
+            std::memcpy(&path_index, metadata + this->get_block_index_size<BlockIndexSize>(), this->get_path_index_size<PathIndexSize>());
             return path_index;
         }
 
-         inline void set_path_index(byte_t * metadata, addr_t path_index) const noexcept {
-            std::memcpy(metadata + this->block_index_size, &path_index, this->path_index_size);
+        template <std::size_t BlockIndexSize = 0, std::size_t PathIndexSize = 0>
+        inline void set_path_index(byte_t * metadata, addr_t path_index) const noexcept {
+            std::memcpy(metadata + this->get_block_index_size<BlockIndexSize>(), &path_index, this->get_path_index_size<PathIndexSize>());
         }
 
+        template <std::size_t BlockIndexSize = 0>
         [[nodiscard]] inline addr_t get_block_index(const byte_t * metadata) const noexcept{
             addr_t block_index = 0;
-            std::memcpy(&block_index, metadata, this->block_index_size);
+            std::memcpy(&block_index, metadata, this->get_block_index_size<BlockIndexSize>());
             return block_index;
         }
 
+        template <std::size_t BlockIndexSize = 0>
         inline void set_block_index(byte_t * metadata, addr_t block_index) const noexcept {
-            std::memcpy(metadata, &block_index, this->block_index_size);
+            std::memcpy(metadata, &block_index, this->get_block_index_size<BlockIndexSize>());
         }
 
+        template <std::size_t BlockIndexSize = 0, std::size_t PathIndexSize = 0>
         [[nodiscard]] BlockMetadata inline to_block_metadata(const byte_t * metadata, bool valid=true) const noexcept {
-            return BlockMetadata(this->get_block_index(metadata), this->get_path_index(metadata), valid);
+            return BlockMetadata(this->get_block_index<BlockIndexSize>(metadata), this->get_path_index<BlockIndexSize, PathIndexSize>(metadata), valid);
         }
 
+        template <std::size_t BlockIndexSize = 0, std::size_t PathIndexSize = 0>
         void from_block_metadata(byte_t * metadata, const BlockMetadata &source) const noexcept {
-            this->set_block_index(metadata, source.get_block_index());
-            this->set_path_index(metadata, source.get_path());
+            this->set_block_index<BlockIndexSize>(metadata, source.get_block_index());
+            this->set_path_index<BlockIndexSize, PathIndexSize>(metadata, source.get_path());
+        }
+
+        private:
+        template <std::size_t BlockIndexSize>
+        [[nodiscard]] inline std::size_t get_block_index_size() const noexcept {
+            return BlockIndexSize != 0 ? BlockIndexSize : this->block_index_size;
+        }
+
+        template <std::size_t PathIndexSize>
+        [[nodiscard]] inline std::size_t get_path_index_size() const noexcept {
+            return PathIndexSize != 0 ? PathIndexSize : this->path_index_size;
         }
     };
 
@@ -118,6 +142,8 @@ class PageOptimizedRAWOram: public Memory, public LLPathOramInterface {
         bool bypass_path_read_on_stash_hit,
         bool unsecure_eviction_buffer,
         uint64_t stash_capacity,
+        uint64_t evictions_per_batch,
+        bool prefetch_eviction_paths,
         BinaryPathOramStatistics *statistics
     );
     PageOptimizedRAWOram(
@@ -149,6 +175,42 @@ class PageOptimizedRAWOram: public Memory, public LLPathOramInterface {
 
     virtual void barrier() override;
 
+    /**
+     * @brief Largest number of blocks the current tree can hold while staying under max_load_factor
+     */
+    uint64_t max_num_blocks(double max_load_factor) const;
+
+    /**
+     * @brief Grow the ORAM to new_num_blocks without rebuilding the tree.
+     * 
+     * The tree has to have enough free slots already, see max_num_blocks(). The position map is
+     * replaced by new_position_map, existing entries are copied over and the new blocks are assigned
+     * random paths. Like after init(), the new blocks have to be written before they can be read.
+     * 
+     * @param new_num_blocks total number of blocks after growing
+     * @param max_load_factor load factor the tree must not exceed
+     * @param new_position_map uninitialized memory large enough for new_num_blocks position map entries
+     */
+    void grow(uint64_t new_num_blocks, double max_load_factor, unique_memory_t &&new_position_map);
+
+    /**
+     * @brief Scratch memory oblivious_rebuild() needs for a given chunk size
+     */
+    uint64_t rebuild_scratch_size(uint64_t records_per_chunk, uint64_t scratch_page_size) const;
+
+    /**
+     * @brief Reshuffle every block into a freshly encrypted tree without using the access path.
+     * 
+     * The tree is read sequentially and every slot and stash entry becomes a record. The records are
+     * shuffled with an external bitonic sort over encrypted chunks in scratch_memory, then written back
+     * sequentially to the tree on new random paths, under a new key and with all counters reset.
+     * The I/O only depends on the size of the ORAM, not on its contents. The stash is empty afterwards.
+     * 
+     * @param scratch_memory memory of at least rebuild_scratch_size() bytes
+     * @param records_per_chunk records sorted in memory at once, has to be a power of two
+     */
+    void oblivious_rebuild(Memory *scratch_memory, uint64_t records_per_chunk);
+
     // LLPathOramInterface
     virtual std::uint64_t read_and_update_position_map(uint64_t logical_block_address, uint64_t new_path, bool is_dummy = false) override;
     virtual std::uint64_t read_and_update_position_map_function(uint64_t logical_block_address, positionmap_updater updater, bool is_dummy = false) override;
@@ -164,16 +226,48 @@ class PageOptimizedRAWOram: public Memory, public LLPathOramInterface {
     virtual toml::table to_toml_self() const;
 
     protected:
-    virtual void access_block(MemoryRequestType access_type, uint64_t block_address, unsigned char *buffer, uint64_t offset = 0, uint64_t length = UINT64_MAX);
+    virtual void access_block(MemoryRequestType access_type, uint64_t block_address, unsigned char *buffer, uint64_t offset = 0, uint64_t length = UINT64_MAX, const memory_update_function *update_function = nullptr);
     void read_path(uint64_t path);
-    void write_path();
     void eviction_access();
+    void evict_loaded_path(uint64_t path);
+    void prepare_eviction_buckets(const std::vector<addr_t> &paths);
+    void read_eviction_buckets();
+    void start_eviction_prefetch();
+    void wait_for_eviction_prefetch();
     // StashEntry find_block_on_path(addr_t logical_block_address);
     bool find_and_remove_block_on_path_buffer(addr_t logical_block_address, BlockMetadata* metadata_buffer, byte_t *block_buffer);
     std::size_t try_evict_block_from_path_buffer(std::size_t max_count, uint64_t ignored_bits, uint64_t path, BlockMetadata *metadatas, byte_t *data_blocks, uint64_t level_limit = std::numeric_limits<uint64_t>::max());
+    void write_back_eviction_buffer(addr_t level, addr_t num_blocks_evicted);
+
+    /**
+     * @brief Path buffer loops with the block size and the metadata index sizes fixed at compile time,
+     * so the slot copies and metadata decodes become fixed width loads and stores. A size of 0 uses
+     * the runtime value, PathKernels<0, 0, 0> is the generic fallback.
+     */
+    template <std::size_t BlockSize, std::size_t BlockIndexSize, std::size_t PathIndexSize>
+    bool find_and_remove_block_on_path_buffer_kernel(addr_t logical_block_address, BlockMetadata* metadata_buffer, byte_t *block_buffer);
+    template <std::size_t BlockSize, std::size_t BlockIndexSize, std::size_t PathIndexSize>
+    std::size_t try_evict_block_from_path_buffer_kernel(std::size_t max_count, uint64_t ignored_bits, uint64_t path, BlockMetadata *metadatas, byte_t *data_blocks, uint64_t level_limit);
+    template <std::size_t BlockSize, std::size_t BlockIndexSize, std::size_t PathIndexSize>
+    void write_back_eviction_buffer_kernel(addr_t level, addr_t num_blocks_evicted);
+
+    struct PathKernels {
+        bool (PageOptimizedRAWOram::*find_and_remove_block_on_path_buffer)(addr_t, BlockMetadata*, byte_t*);
+        std::size_t (PageOptimizedRAWOram::*try_evict_block_from_path_buffer)(std::size_t, uint64_t, uint64_t, BlockMetadata*, byte_t*, uint64_t);
+        void (PageOptimizedRAWOram::*write_back_eviction_buffer)(addr_t, addr_t);
+    };
+
+    template <std::size_t BlockSize, std::size_t BlockIndexSize, std::size_t PathIndexSize>
+    bool select_path_kernels_if_matching();
+    template <std::size_t BlockSize>
+    bool select_path_kernels_for_block_size();
+    /**
+     * @brief Use the specialized kernels if this ORAM has one of the common shapes, the generic ones otherwise
+     */
+    void select_path_kernels();
 
     inline byte_t *get_metadata(addr_t level, addr_t block_index) {
-        return (this->decrypted_path.data() + this->untrusted_memory_page_size * level + block_size * blocks_per_bucket + this->metadata_layout.metadata_size() * block_index);
+        return (this->path_buckets[level] + block_size * blocks_per_bucket + this->metadata_layout.metadata_size() * block_index);
     }
 
     inline byte_t *get_metadata(const PathLocation &location) {
@@ -181,11 +275,20 @@ class PageOptimizedRAWOram: public Memory, public LLPathOramInterface {
     }
 
     inline byte_t *get_data_block(addr_t level, addr_t block_index) {
-        return this->decrypted_path.data() + this->untrusted_memory_page_size * level + block_size * block_index;
+        return this->path_buckets[level] + block_size * block_index;
     }
 
     inline byte_t *get_data_block(const PathLocation &location) {
-        return this->decrypted_path.data() + this->untrusted_memory_page_size * location.level + block_size * location.block_index;
+        return this->get_data_block(location.level, location.block_index);
+    }
+
+    // number of times the bucket was written after root_counter evictions in reverse lexicographic order
+    inline std::uint64_t get_bucket_counter(addr_t level, addr_t level_offset, std::uint64_t root_counter) const {
+        std::uint64_t counter = root_counter / (1UL << level);
+        if (reverse_bits(level_offset, level) < root_counter % (1UL << level)) {
+            counter += 1;
+        }
+        return counter;
     }
 
     inline std::uint64_t get_position_map_address(std::uint64_t logical_block_address) {
@@ -215,7 +318,7 @@ class PageOptimizedRAWOram: public Memory, public LLPathOramInterface {
     
     const uint64_t block_size;
     const uint64_t block_size_bits;
-    const uint64_t num_blocks;
+    uint64_t num_blocks;
     const uint64_t tree_bits;
 
     const addr_t levels;
@@ -228,14 +331,19 @@ class PageOptimizedRAWOram: public Memory, public LLPathOramInterface {
     const bool unsecure_eviction_buffer;
 
     const uint64_t num_accesses_per_eviction;
+    // evictions done together every num_accesses_per_eviction * evictions_per_batch accesses
+    const uint64_t evictions_per_batch;
+    // read the buckets of the next eviction in the background right after an eviction
+    const bool prefetch_eviction_paths;
 
     const uint64_t random_nonce_bytes;
     const uint64_t auth_tag_bytes;
     const uint64_t untrusted_memory_page_size;
-    const uint64_t position_map_page_size;
-    const uint64_t num_position_map_entries_per_page;
+    uint64_t position_map_page_size;
+    uint64_t num_position_map_entries_per_page;
 
     const MetadataLayout metadata_layout;
+    PathKernels path_kernels;
 
     BinaryPathOramStatistics *oram_statistics;
 
@@ -246,18 +354,37 @@ class PageOptimizedRAWOram: public Memory, public LLPathOramInterface {
     // the stash
     Stash stash;
     absl::BitGen bit_gen;
+    // pages written per batch by init and fast_init
+    static constexpr uint64_t init_batch_pages = 64;
     // path buffers
     std::vector<MemoryRequest> path_access;
     std::optional<addr_t> currently_loaded_path;
-    bytes_t decrypted_path;
+    // plain text of each bucket on the loaded path, decrypted in place in the buffer it was read into
+    std::vector<byte_t *> path_buckets;
     bytes_t nonce_buffer;
+    // pages of one path or eviction that are encrypted or decrypted together
+    CryptoBatch crypto_batch;
     // std::vector<MemoryRequest> valid_bitfield_access;
     std::vector<BlockMetadata> eviction_metadata_buffer;
     bytes_t eviction_data_block_buffer;
 
+    // union of the buckets on the paths of the next eviction, and where each path's buckets are in it
+    std::vector<addr_t> eviction_paths;
+    std::vector<MemoryRequest> eviction_bucket_access;
+    std::vector<addr_t> eviction_bucket_levels;
+    std::vector<addr_t> eviction_bucket_offsets;
+    std::vector<std::size_t> eviction_path_buckets;
+
     LLPathOramInterface *ll_posmap;
     StashEntry posmap_block_buffer;
 
+    // bumped on every write to the tree, a prefetch issued at an older version has to be read again
+    uint64_t tree_version;
+    std::optional<uint64_t> prefetched_tree_version;
+    // untrusted memory is not thread safe, the prefetch and the foreground take turns
+    std::mutex untrusted_memory_mutex;
+    std::future<void> eviction_prefetch;
+
     #ifdef PROFILE_TREE_LOAD_EXTENDED
     uint64_t extended_tree_load_log_counter;
     void log_extended_tree_load();
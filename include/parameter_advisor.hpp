@@ -0,0 +1,3 @@
+#pragma once
+
+int advise_entry_point(int argc, const char** argv);
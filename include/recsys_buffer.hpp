@@ -1,14 +1,23 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
+#include <cstring>
+#include <limits>
 #include <memory_defs.hpp>
 #include <vector>
 #include <stash.hpp>
+#include <shard_router.hpp>
 #include <memory_interface.hpp>
 #include <conditional_memcpy.hpp>
+#include <gradient_aggregator.hpp>
 #include <chrono>
 #include <absl/random/random.h>
 #include <low_level_path_oram_interface.hpp>
+#include <barrier>
+#include <exception>
+#include <functional>
+#include <thread>
 
 class RecSysBuffer {
     public:
@@ -23,10 +32,36 @@ class RecSysBuffer {
     
     virtual void reserve(std::uint64_t entry_id) {};
     virtual void load_entries() {};
+
+    /**
+     * @brief download or aggregate of this id is a dummy: it accesses the buffer and the memory like a
+     * real entry, with random paths or a DUMMY_POP, but changes no entry. Used to pad batches.
+     */
+    static constexpr std::uint64_t dummy_entry_id = std::numeric_limits<std::uint64_t>::max();
+
     virtual void download(std::uint64_t entry_id) = 0;
     virtual void aggregate(std::uint64_t entry_id) = 0;
     virtual void update_flush_buffer() = 0;
 
+    /**
+     * @brief Downloads the entries of several concurrent requests, in order. Buffers that can hand
+     * the whole batch to the memory override this, the default downloads one entry at a time.
+     */
+    virtual void download_batch(const std::vector<std::uint64_t> &entry_ids) {
+        for (auto entry_id : entry_ids) {
+            this->download(entry_id);
+        }
+    }
+
+    /**
+     * @brief Aggregates the entries of several concurrent requests, in order.
+     */
+    virtual void aggregate_batch(const std::vector<std::uint64_t> &entry_ids) {
+        for (auto entry_id : entry_ids) {
+            this->aggregate(entry_id);
+        }
+    }
+
     virtual void save_buffer_stats() {};
 
     virtual std::chrono::nanoseconds get_overall_time() {
@@ -78,7 +113,8 @@ class LinearScanBuffer : public RecSysBuffer{
     LinearScanBuffer(
         unique_memory_t &&memory,
         std::uint64_t max_size,
-        bool enable_non_secure_mode
+        bool enable_non_secure_mode,
+        const GradientAggregationConfig &aggregation = GradientAggregationConfig()
     );
 
     virtual std::uint64_t num_entries() const;
@@ -125,12 +161,14 @@ class LinearScanBuffer : public RecSysBuffer{
         {}
     };
 
+    // the id of a dummy is also the id of the free slots, so dummies match no slot
     inline bool find_and_remove_block_from_buffer(BufferEntry &entry) {
         bool found = false;
+        bool is_dummy = (entry.entry_id == dummy_entry_id);
         std::uint64_t invalid_entry_id = std::numeric_limits<std::uint64_t>::max();
         std::uint64_t scan_end = this->enable_non_secure_mode ? this->num_entries_in_buffer : this->num_entries_downloaded;
         for (std::uint64_t index = 0; index < scan_end; index++) {
-            bool is_target = (this->entry_id_buffer[index] == entry.entry_id);
+            bool is_target = (this->entry_id_buffer[index] == entry.entry_id) && !is_dummy;
             conditional_memcpy(is_target, entry.data.data(), this->data_buffer.data() + this->_entry_size * index, _entry_size);
             conditional_memcpy(is_target, entry.gradient.data(), this->gradient_buffer.data() + this->_entry_size * index, _entry_size);
             conditional_memcpy(is_target, &entry.counter, &(this->counter_buffer[index]), sizeof(std::uint16_t));
@@ -142,18 +180,16 @@ class LinearScanBuffer : public RecSysBuffer{
     }
 
     inline bool update_gradient(uint64_t entry_id) {
-        bytes_t update_result_buffer(this->_entry_size);
+        FlushDenormalsScope denormals;
         bool found = false;
+        bool is_dummy = (entry_id == dummy_entry_id);
         std::uint64_t scan_end = this->enable_non_secure_mode ? this->num_entries_in_buffer : this->num_entries_downloaded;
         for (std::uint64_t index = 0; index < scan_end; index++) {
-            bool is_target = (this->entry_id_buffer[index] == entry_id);
+            bool is_target = (this->entry_id_buffer[index] == entry_id) && !is_dummy;
             std::uint16_t new_count = this->counter_buffer[index] + 1;
-            std::memcpy(update_result_buffer.data(), this->gradient_buffer.data() + this->_entry_size * index, this->_entry_size);
 
             // updating gradient
-            update_result_buffer[0] ++;
-
-            conditional_memcpy(is_target, this->gradient_buffer.data() + this->_entry_size * index, update_result_buffer.data(), _entry_size);
+            this->aggregator.accumulate(is_target, this->gradient_buffer.data() + this->_entry_size * index);
             conditional_memcpy(is_target, &this->counter_buffer[index], &new_count, sizeof(std::uint16_t));
 
             found |= is_target;
@@ -164,10 +200,11 @@ class LinearScanBuffer : public RecSysBuffer{
 
     inline void place_block_on_buffer(const BufferEntry &entry) {
         bool completed = false;
+        bool is_dummy = (entry.entry_id == dummy_entry_id);
         std::uint64_t scan_end = this->enable_non_secure_mode ? this->num_entries_in_buffer : this->num_entries_downloaded;
         for (std::uint64_t index = 0; index < scan_end; index++) {
             bool is_free = (this->entry_id_buffer[index] == std::numeric_limits<std::uint64_t>::max());
-            bool do_place = is_free && !completed;
+            bool do_place = is_free && !completed && !is_dummy;
             conditional_memcpy(do_place, this->data_buffer.data() + this->_entry_size * index, entry.data.data(), _entry_size);
             conditional_memcpy(do_place, this->gradient_buffer.data() + this->_entry_size * index, entry.gradient.data(), this->_entry_size);
             conditional_memcpy(do_place, &this->counter_buffer[index], &entry.counter, sizeof(std::uint16_t));
@@ -175,13 +212,14 @@ class LinearScanBuffer : public RecSysBuffer{
             completed |= do_place;
         }
 
-        if (!completed) {
+        if (!completed && !is_dummy) {
             throw std::runtime_error("Buffer is full!");
         }
     }
 
     const std::uint64_t max_size;
     const std::uint64_t _entry_size;
+    GradientAggregator aggregator;
     const bool enable_non_secure_mode;
     std::uint64_t num_entries_in_buffer;
     std::uint64_t num_entries_downloaded;
@@ -192,6 +230,178 @@ class LinearScanBuffer : public RecSysBuffer{
     std::vector<std::uint64_t> entry_id_buffer;
 };
 
+/**
+ * @brief Replacement for LinearScanBuffer that keeps the entries in an oblivious two-tier hash table, so that
+ * download and aggregate scan 2 * bucket_size + stash_size slots instead of all max_size of them.
+ *
+ * An entry lives in one of two buckets chosen by a keyed hash (SipHash) of its id, in the one with more free
+ * slots when it is placed, or in the stash when both are full. Every operation scans both buckets and the whole
+ * stash with conditional copies, so an observer only learns the two buckets, which look random for distinct ids.
+ * Requests for the same id within a round do touch the same buckets, so unlike LinearScanBuffer the equality
+ * pattern of the round's requests is visible, but never the ids themselves. The hash key changes after every
+ * flush, so buckets can't be linked across rounds.
+ *
+ * The flush compacts the occupied slots obliviously and pushes exactly max_size entries, like LinearScanBuffer.
+ */
+class HashBuffer : public RecSysBuffer {
+    public:
+    static constexpr std::uint64_t default_bucket_size = 8;
+    static constexpr std::uint64_t default_stash_size = 64;
+
+    HashBuffer(
+        unique_memory_t &&memory,
+        std::uint64_t max_size,
+        bool enable_non_secure_mode,
+        std::uint64_t bucket_size = default_bucket_size,
+        std::uint64_t stash_size = default_stash_size,
+        const GradientAggregationConfig &aggregation = GradientAggregationConfig()
+    );
+
+    virtual std::uint64_t num_entries() const;
+    virtual std::uint64_t entry_size() const;
+
+    virtual Memory *underlying_memory() override {
+        return this->memory.get();
+    }
+
+    virtual void download(std::uint64_t entry_id);
+    virtual void aggregate(std::uint64_t entry_id);
+    virtual void update_flush_buffer();
+
+    virtual ~HashBuffer() = default;
+
+    protected:
+    struct BufferEntry {
+        std::uint64_t entry_id;
+        bytes_t data;
+        bytes_t gradient;
+        std::uint16_t counter;
+
+        BufferEntry(uint64_t entry_size) :
+        entry_id(std::numeric_limits<std::uint64_t>::max()),
+        data(entry_size),
+        gradient(entry_size),
+        counter(0)
+        {}
+    };
+
+    // the buckets an entry id may be in, the second one differs from the first if there is more than one bucket
+    struct CandidateBuckets {
+        std::uint64_t buckets[2];
+        std::uint64_t count;
+    };
+
+    static constexpr std::uint64_t stash_tier = 2;
+
+    CandidateBuckets candidate_buckets(std::uint64_t entry_id) const;
+    void choose_new_hash_key();
+
+    // a slot holds the data, then the gradient, then the counter of one entry
+    inline byte_t *slot_data(std::uint64_t index) {
+        return this->slot_buffer.data() + this->slot_size * index;
+    }
+    inline byte_t *slot_gradient(std::uint64_t index) {
+        return this->slot_data(index) + this->_entry_size;
+    }
+    inline byte_t *slot_counter(std::uint64_t index) {
+        return this->slot_data(index) + 2 * this->_entry_size;
+    }
+
+    // calls visit(slot index, tier) for every slot of both candidate buckets, tier 0 and 1, and then of the stash
+    template <typename F>
+    inline void scan_candidate_slots(const CandidateBuckets &candidates, F &&visit) {
+        for (std::uint64_t tier = 0; tier < candidates.count; tier++) {
+            std::uint64_t bucket_start = candidates.buckets[tier] * this->bucket_size;
+            for (std::uint64_t index = bucket_start; index < bucket_start + this->bucket_size; index++) {
+                visit(index, tier);
+            }
+        }
+        std::uint64_t stash_start = this->num_buckets * this->bucket_size;
+        for (std::uint64_t index = stash_start; index < stash_start + this->stash_size; index++) {
+            visit(index, stash_tier);
+        }
+    }
+
+    // free slots hold the dummy id too, so a dummy is kept from matching them
+    inline bool find_and_remove_block_from_buffer(BufferEntry &entry, const CandidateBuckets &candidates) {
+        bool found = false;
+        bool is_dummy = (entry.entry_id == dummy_entry_id);
+        std::uint64_t invalid_entry_id = std::numeric_limits<std::uint64_t>::max();
+        this->scan_candidate_slots(candidates, [&](std::uint64_t index, std::uint64_t) {
+            bool is_target = (this->entry_id_buffer[index] == entry.entry_id) && !is_dummy;
+            conditional_memcpy(is_target, entry.data.data(), this->slot_data(index), this->_entry_size);
+            conditional_memcpy(is_target, entry.gradient.data(), this->slot_gradient(index), this->_entry_size);
+            conditional_memcpy(is_target, &entry.counter, this->slot_counter(index), sizeof(std::uint16_t));
+            conditional_memcpy(is_target, &this->entry_id_buffer[index], &invalid_entry_id, sizeof(std::uint64_t));
+            found |= is_target;
+        });
+        return found;
+    }
+
+    inline bool update_gradient(uint64_t entry_id, const CandidateBuckets &candidates) {
+        FlushDenormalsScope denormals;
+        bool found = false;
+        bool is_dummy = (entry_id == dummy_entry_id);
+        this->scan_candidate_slots(candidates, [&](std::uint64_t index, std::uint64_t) {
+            bool is_target = (this->entry_id_buffer[index] == entry_id) && !is_dummy;
+            std::uint16_t new_count;
+            std::memcpy(&new_count, this->slot_counter(index), sizeof(std::uint16_t));
+            new_count++;
+
+            // updating gradient
+            this->aggregator.accumulate(is_target, this->slot_gradient(index));
+            conditional_memcpy(is_target, this->slot_counter(index), &new_count, sizeof(std::uint16_t));
+
+            found |= is_target;
+        });
+
+        return found;
+    }
+
+    inline void place_block_on_buffer(const BufferEntry &entry, const CandidateBuckets &candidates) {
+        // the free slots of the second bucket stay 0 if there is only one
+        std::uint64_t free_slots[2] = {0, 0};
+        this->scan_candidate_slots(candidates, [&](std::uint64_t index, std::uint64_t tier) {
+            if (tier != stash_tier) {
+                free_slots[tier] += (this->entry_id_buffer[index] == std::numeric_limits<std::uint64_t>::max());
+            }
+        });
+        std::uint64_t chosen_tier = static_cast<std::uint64_t>(free_slots[0] < free_slots[1]);
+
+        bool completed = false;
+        bool is_dummy = (entry.entry_id == dummy_entry_id);
+        this->scan_candidate_slots(candidates, [&](std::uint64_t index, std::uint64_t tier) {
+            bool is_free = (this->entry_id_buffer[index] == std::numeric_limits<std::uint64_t>::max());
+            bool do_place = is_free && !completed && !is_dummy && (tier == chosen_tier || tier == stash_tier);
+            conditional_memcpy(do_place, this->slot_data(index), entry.data.data(), this->_entry_size);
+            conditional_memcpy(do_place, this->slot_gradient(index), entry.gradient.data(), this->_entry_size);
+            conditional_memcpy(do_place, this->slot_counter(index), &entry.counter, sizeof(std::uint16_t));
+            conditional_memcpy(do_place, &this->entry_id_buffer[index], &entry.entry_id, sizeof(std::uint64_t));
+            completed |= do_place;
+        });
+
+        if (!completed && !is_dummy) {
+            throw std::runtime_error("Buffer stash is full!");
+        }
+    }
+
+    const std::uint64_t max_size;
+    const std::uint64_t _entry_size;
+    GradientAggregator aggregator;
+    const bool enable_non_secure_mode;
+    const std::uint64_t bucket_size;
+    const std::uint64_t stash_size;
+    const std::uint64_t num_buckets;
+    const std::uint64_t slot_size;
+    std::uint64_t num_entries_in_buffer;
+    unique_memory_t memory;
+    std::array<byte_t, 16> hash_key;
+    bytes_t slot_buffer;
+    std::vector<std::uint64_t> entry_id_buffer;
+    // flush marks of the slots, kept between rounds
+    std::vector<std::uint8_t> occupied;
+};
+
 class NoBuffer : public RecSysBuffer{
     public:
     NoBuffer(
@@ -215,8 +425,7 @@ class NoBuffer : public RecSysBuffer{
     
     virtual void download(std::uint64_t entry_id) {
         auto start = std::chrono::steady_clock::now();
-        this->request.address = entry_id * this->_entry_size;
-        this->request.type = MemoryRequestType::READ;
+        this->set_request(this->request, entry_id, MemoryRequestType::READ);
 
         auto oram_start = std::chrono::steady_clock::now();
         this->memory->access(this->request);
@@ -229,8 +438,7 @@ class NoBuffer : public RecSysBuffer{
 
     virtual void aggregate(std::uint64_t entry_id) {
         auto start = std::chrono::steady_clock::now();
-        this->request.address = entry_id * this->_entry_size;
-        this->request.type = MemoryRequestType::WRITE;
+        this->set_request(this->request, entry_id, MemoryRequestType::WRITE);
 
         auto oram_start = std::chrono::steady_clock::now();
         this->memory->access(this->request);
@@ -241,14 +449,52 @@ class NoBuffer : public RecSysBuffer{
         this->overall_time += (end - start);
     }
 
+    virtual void download_batch(const std::vector<std::uint64_t> &entry_ids) override {
+        this->access_batch(entry_ids, MemoryRequestType::READ);
+    }
+
+    virtual void aggregate_batch(const std::vector<std::uint64_t> &entry_ids) override {
+        this->access_batch(entry_ids, MemoryRequestType::WRITE);
+    }
+
     virtual void update_flush_buffer() {}
 
     virtual ~NoBuffer() = default;
 
     protected:
+    // a dummy is a DUMMY_POP, the padding ShardedOram uses for reads and writes alike
+    inline void set_request(MemoryRequest &request, std::uint64_t entry_id, MemoryRequestType type) {
+        bool is_dummy = (entry_id == dummy_entry_id);
+        const MemoryRequestType dummy_pop = MemoryRequestType::DUMMY_POP;
+        request.address = (is_dummy ? 0 : entry_id) * this->_entry_size;
+        request.type = type;
+        conditional_memcpy(is_dummy, &request.type, &dummy_pop, sizeof(MemoryRequestType));
+    }
+
+    // one batch_access for all entries, e.g. a ShardedOram spreads them over its shards
+    void access_batch(const std::vector<std::uint64_t> &entry_ids, MemoryRequestType type) {
+        auto start = std::chrono::steady_clock::now();
+        // the request buffers are kept between batches
+        if (this->batch_requests.size() < entry_ids.size()) {
+            this->batch_requests.resize(entry_ids.size(), MemoryRequest(MemoryRequestType::READ, 0, this->_entry_size));
+        }
+        this->batch_requests.resize(entry_ids.size());
+        for (std::size_t i = 0; i < entry_ids.size(); i++) {
+            this->set_request(this->batch_requests[i], entry_ids[i], type);
+        }
+
+        auto oram_start = std::chrono::steady_clock::now();
+        this->memory->batch_access(this->batch_requests);
+        auto oram_end = std::chrono::steady_clock::now();
+        this->oram_time += (oram_end - oram_start);
+
+        auto end = std::chrono::steady_clock::now();
+        this->overall_time += (end - start);
+    }
 
     const std::uint64_t _entry_size;
     MemoryRequest request;
+    std::vector<MemoryRequest> batch_requests;
     unique_memory_t memory;
 };
 
@@ -265,7 +511,8 @@ class OramBuffer: public RecSysBuffer {
         std::uint64_t max_size,
         bool enable_non_secure_mode,
         UpdateMode update_mode = EMPTY_ORAM,
-        unique_memory_t &&buffer_oram = nullptr
+        unique_memory_t &&buffer_oram = nullptr,
+        const GradientAggregationConfig &aggregation = GradientAggregationConfig()
     );
 
     virtual std::uint64_t num_entries() const {
@@ -299,6 +546,7 @@ class OramBuffer: public RecSysBuffer {
     const std::uint64_t max_size;
     const bool enable_non_secure_mode;
     const std::uint64_t _entry_size;
+    GradientAggregator aggregator;
     const std::uint64_t buffer_entry_size;
     const UpdateMode update_mode;
     const std::uint64_t entry_id_size;
@@ -324,7 +572,8 @@ class OramBuffer3: public RecSysBuffer {
         unique_memory_t &&memory,
         std::uint64_t max_size,
         bool enable_non_secure_mode,
-        BufferORAMType buffer_oram_type = BufferORAMType::PathORAM
+        BufferORAMType buffer_oram_type = BufferORAMType::PathORAM,
+        const GradientAggregationConfig &aggregation = GradientAggregationConfig()
     );
 
     virtual std::uint64_t num_entries() const {
@@ -357,6 +606,7 @@ class OramBuffer3: public RecSysBuffer {
     const std::uint64_t max_size;
     const bool enable_non_secure_mode;
     const std::uint64_t _entry_size;
+    GradientAggregator aggregator;
     const std::uint64_t buffer_entry_size;
     const std::uint64_t entry_id_size;
     std::uint64_t in_buffer_mask;
@@ -388,7 +638,8 @@ class OramBufferDP: public RecSysBuffer {
         std::uint64_t max_size,
         std::uint64_t chunk_size,
         float eps,
-        BufferORAMType buffer_oram_type = BufferORAMType::PathORAM
+        BufferORAMType buffer_oram_type = BufferORAMType::PathORAM,
+        const GradientAggregationConfig &aggregation = GradientAggregationConfig()
     );
 
     virtual std::uint64_t num_entries() const {
@@ -424,6 +675,7 @@ class OramBufferDP: public RecSysBuffer {
 
     const std::uint64_t max_size;
     const std::uint64_t _entry_size;
+    GradientAggregator aggregator;
     const std::uint64_t buffer_entry_size;
     const std::uint64_t chunk_size;
     const float eps;
@@ -463,7 +715,8 @@ class OramBufferDPLinearScan: public RecSysBuffer {
         std::uint64_t max_size,
         std::uint64_t chunk_size,
         float eps,
-        BufferORAMType buffer_oram_type = BufferORAMType::PathORAM
+        BufferORAMType buffer_oram_type = BufferORAMType::PathORAM,
+        const GradientAggregationConfig &aggregation = GradientAggregationConfig()
     );
 
     virtual std::uint64_t num_entries() const {
@@ -503,6 +756,7 @@ class OramBufferDPLinearScan: public RecSysBuffer {
 
     const std::uint64_t max_size;
     const std::uint64_t _entry_size;
+    GradientAggregator aggregator;
     const std::uint64_t buffer_entry_size;
     const std::uint64_t chunk_size;
     const float eps;
@@ -526,4 +780,122 @@ class OramBufferDPLinearScan: public RecSysBuffer {
     size_t num_entries_in_buffer_oram;
 
     absl::BitGen bit_gen;
-};
\ No newline at end of file
+};
+
+/**
+ * @brief Drives one buffer per shard of a ShardedOram, each shard from its own worker thread.
+ *
+ * Entry e is entry e / num_shards of shard e % num_shards, the same split as ShardedOram. The batch
+ * calls and the load and flush phases run on all shards in parallel, reservations stay on the
+ * calling thread.
+ *
+ * Like ShardedOram, a batch of n entries gives every shard exactly shard_batch_size(n) entries, padded
+ * with dummy_entry_id, and a ShardRouter routes the entries to the shards with an oblivious sort and
+ * compaction, so neither the split of a batch nor the routing depends on the entries.
+ * shard_batch_size(n) is the size ShardRouter::padded_slots_per_shard gives for n entries. A batch that
+ * overflows it anyway, e.g. because it has many copies of one entry, does not fail: every shard gets as
+ * many entries as the busiest one, which reveals that the batch overflowed. A single download or
+ * aggregate runs on the calling thread and touches every shard once, the other shards with a dummy.
+ *
+ * Reservations are not routed this way and are not oblivious. reserve hands every entry straight to its
+ * shard, so the number of reservations of a shard, and with it the size of its selection and of its
+ * load, shows how the entries of a round spread over the shards. Padding them would put dummies into
+ * the union the DP buffers sample their entries from.
+ *
+ * The ORAM time of a parallel phase is the longest ORAM time of any shard in it. Every phase also
+ * keeps its wall time and the sum of the busy time of the workers, that sum over the wall time of all
+ * workers is their utilization.
+ */
+class ShardedRecSysBuffer : public RecSysBuffer {
+    public:
+    enum Phase {
+        RESERVE,
+        LOAD,
+        DOWNLOAD,
+        AGGREGATE,
+        FLUSH,
+        NUM_PHASES
+    };
+
+    ShardedRecSysBuffer(std::vector<std::unique_ptr<RecSysBuffer>> &&shards);
+    virtual ~ShardedRecSysBuffer();
+
+    virtual std::uint64_t num_entries() const override;
+    virtual std::uint64_t entry_size() const override;
+
+    // the memory of the first shard, save_buffer_stats covers the others
+    virtual Memory *underlying_memory() override {
+        return this->shards.front()->underlying_memory();
+    }
+
+    virtual void reserve(std::uint64_t entry_id) override;
+    virtual void load_entries() override;
+    virtual void download(std::uint64_t entry_id) override;
+    virtual void aggregate(std::uint64_t entry_id) override;
+    virtual void download_batch(const std::vector<std::uint64_t> &entry_ids) override;
+    virtual void aggregate_batch(const std::vector<std::uint64_t> &entry_ids) override;
+    virtual void update_flush_buffer() override;
+
+    virtual void save_buffer_stats() override;
+
+    virtual std::size_t get_total_requests() override;
+    virtual std::size_t get_k_union_sum() override;
+    virtual std::size_t get_k_sum() override;
+    virtual std::size_t get_num_dropped_entries() override;
+    virtual std::size_t get_num_dropped_requests() override;
+
+    std::size_t num_shards() const {
+        return this->shards.size();
+    }
+
+    std::chrono::nanoseconds get_phase_wall_time(Phase phase) const {
+        return this->phase_wall_times[phase];
+    }
+
+    std::chrono::nanoseconds get_phase_worker_time(Phase phase) const {
+        return this->phase_worker_times[phase];
+    }
+
+    // the number of entries every shard gets for a batch of batch_size entries
+    std::uint64_t shard_batch_size(std::uint64_t batch_size);
+
+    protected:
+    // runs task(shard, shard_index) on every shard in parallel and waits for all of them
+    void run_on_shards(Phase phase, std::function<void(RecSysBuffer *, std::size_t)> &&task);
+    void run_batch(Phase phase, const std::vector<std::uint64_t> &entry_ids);
+    void run_single(Phase phase, std::uint64_t entry_id);
+    void worker_loop(std::size_t shard_index);
+
+    template<typename F>
+    std::size_t sum_over_shards(F &&get) {
+        std::size_t sum = 0;
+        for (auto &shard : this->shards) {
+            sum += get(shard.get());
+        }
+        return sum;
+    }
+
+    std::vector<std::unique_ptr<RecSysBuffer>> shards;
+    // the local entry ids of the current batch for every shard, padded with dummy_entry_id
+    std::vector<std::vector<std::uint64_t>> shard_entries;
+
+    // the oblivious routing of the local entry ids, reused across batches
+    ShardRouter router;
+    std::vector<std::uint64_t> route_shards;
+    std::vector<std::uint64_t> shard_loads;
+
+    // shard_batch_size of the last batch size, the batches of a run all have the same size
+    std::uint64_t last_batch_size = 0;
+    std::uint64_t last_shard_batch_size = 0;
+
+    std::function<void(RecSysBuffer *, std::size_t)> task;
+    std::vector<std::chrono::nanoseconds> worker_times;
+    std::vector<std::chrono::nanoseconds> phase_wall_times;
+    std::vector<std::chrono::nanoseconds> phase_worker_times;
+
+    std::barrier<> phase_start;
+    std::barrier<> phase_end;
+    bool stopping;
+    std::vector<std::exception_ptr> worker_errors;
+    std::vector<std::jthread> workers;
+};
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include <toml++/toml.h>
+#include <recsys_buffer.hpp>
+
+int recsys_server_entry_point(int argc, const char** argv);
+int recsys_load_entry_point(int argc, const char** argv);
+
+/**
+ * @brief Wire format between recsys_server and its clients, host byte order over a local socket.
+ *
+ * After accepting a connection the server sends one ServerInfo. Every request is a RequestHeader
+ * followed by count 64-bit entry ids, AGGREGATE requests then carry count * entry_size bytes of
+ * gradients. Requests on one connection are answered in order, every answer is a ResponseHeader
+ * followed by length bytes: the entries for DOWNLOAD, the error message for Status::ERROR and
+ * nothing otherwise.
+ */
+namespace recsys_protocol {
+    enum class Op : std::uint8_t {
+        RESERVE = 1,
+        DOWNLOAD = 2,
+        AGGREGATE = 3,
+        END_ROUND = 4,
+        SHUTDOWN = 5
+    };
+
+    enum class Status : std::uint8_t {
+        OK = 0,
+        ERROR = 1
+    };
+
+    struct ServerInfo {
+        std::uint64_t num_entries;
+        std::uint64_t entry_size;
+    };
+
+    struct RequestHeader {
+        Op op;
+        std::uint8_t padding[3];
+        std::uint32_t count;
+    };
+
+    struct ResponseHeader {
+        Status status;
+        std::uint8_t padding[3];
+        std::uint32_t length;
+    };
+
+    static_assert(sizeof(ServerInfo) == 16);
+    static_assert(sizeof(RequestHeader) == 8);
+    static_assert(sizeof(ResponseHeader) == 8);
+
+    // largest number of entries in one request
+    constexpr std::uint32_t max_request_count = 1U << 20;
+}
+
+/**
+ * @brief Serves the download, aggregate and round end operations of a RecSysBuffer to many
+ * concurrent clients over a Unix domain socket.
+ *
+ * A single thread waits on all connections with epoll, so the buffer and the ORAM below it are
+ * never used concurrently. Every wakeup reads everything the clients have sent, then consecutive
+ * requests with the same operation are handed to the buffer as one batch of up to max_batch_size
+ * entries. With many clients waiting, the batches grow on their own while the previous batch runs.
+ */
+class RecSysServer {
+    public:
+    RecSysServer(
+        std::unique_ptr<RecSysBuffer> &&buffer,
+        const std::filesystem::path &socket_path,
+        bool use_reserve,
+        std::uint64_t max_batch_size,
+        bool verbose = false
+    );
+    ~RecSysServer();
+
+    /**
+     * @brief Serves requests until a client sends SHUTDOWN.
+     */
+    void run();
+
+    RecSysBuffer *get_buffer() {
+        return this->buffer.get();
+    }
+
+    toml::table statistics_to_toml() const;
+
+    protected:
+    struct Connection {
+        int fd;
+        bytes_t input;
+        bytes_t output;
+        std::size_t output_offset;
+        // EPOLLOUT is watched while the answers do not fit in the socket
+        bool writable_wanted;
+        bool closed;
+    };
+
+    struct PendingRequest {
+        std::size_t connection;
+        recsys_protocol::Op op;
+        std::size_t entries_begin;
+        std::uint32_t count;
+        // answered with this error instead of being run
+        const char *error;
+    };
+
+    struct OpStatistics {
+        std::uint64_t requests = 0;
+        std::uint64_t entries = 0;
+        std::uint64_t batches = 0;
+        std::uint64_t max_batch_entries = 0;
+        std::chrono::nanoseconds time = std::chrono::nanoseconds::zero();
+    };
+
+    void accept_connections();
+    void read_from(std::size_t connection);
+    void write_to(std::size_t connection);
+    void process_pending();
+    void run_batch(recsys_protocol::Op op, std::size_t begin, std::size_t end);
+    void respond(std::size_t connection, recsys_protocol::Status status, const byte_t *data, std::size_t length);
+    void set_writable_wanted(std::size_t connection, bool wanted);
+    void close_connection(std::size_t connection);
+
+    // epoll data of the listening socket, connections use their index
+    static constexpr std::uint64_t listen_tag = std::numeric_limits<std::uint64_t>::max();
+
+    std::unique_ptr<RecSysBuffer> buffer;
+    const std::filesystem::path socket_path;
+    const bool use_reserve;
+    const std::uint64_t max_batch_size;
+    const bool verbose;
+    int listen_fd;
+    int epoll_fd;
+
+    // closed connections keep their slot until a new connection reuses it, so indices stay valid
+    std::vector<Connection> connections;
+    std::vector<std::size_t> free_connections;
+    // connections that got answers since the last flush
+    std::vector<std::size_t> connections_with_output;
+    std::vector<PendingRequest> pending;
+    // entry ids of all pending requests
+    std::vector<std::uint64_t> pending_entries;
+    std::vector<std::uint64_t> batch_entries;
+    // DOWNLOAD answers carry the entries, the simulated buffers do not keep contents
+    bytes_t entry_payload;
+
+    // load_entries has run for the reservations of this round
+    bool entries_loaded;
+    bool shutdown_requested;
+    std::uint64_t rounds;
+    std::uint64_t open_connections;
+    std::uint64_t max_connections;
+    std::vector<OpStatistics> op_statistics;
+    // every recv lands here first, the connections only keep what was received
+    bytes_t receive_buffer;
+};
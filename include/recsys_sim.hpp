@@ -1,3 +1,29 @@
 #pragma once
 
-int recsys_sim_entry_point(int argc, const char** argv);
\ No newline at end of file
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <recsys_buffer.hpp>
+
+/**
+ * @brief Loads the memory in memory_directory and wraps it in the buffer called buffer_name, returns nullptr
+ * for unknown names. use_reserve is set for the buffers that need the reserve and load phases in every round.
+ * With more than one thread the memory has to be a ShardedOram with one shard per thread, every shard
+ * gets its own buffer in a ShardedRecSysBuffer. The buffers aggregate the client gradients as configured
+ * by aggregation.
+ */
+std::unique_ptr<RecSysBuffer>
+create_recsys_buffer(
+    const std::string &buffer_name,
+    const std::filesystem::path &memory_directory,
+    std::uint64_t samples_per_round,
+    bool unsafe_opt,
+    std::uint64_t k_union,
+    float epsilon,
+    bool &use_reserve,
+    std::uint64_t threads = 1,
+    const GradientAggregationConfig &aggregation = GradientAggregationConfig()
+);
+
+int recsys_sim_entry_point(int argc, const char** argv);
@@ -0,0 +1,314 @@
+#pragma once
+#include <oram_defs.hpp>
+#include <memory_interface.hpp>
+#include <oram.hpp>
+#include <util.hpp>
+#include <eviction_path_generator.hpp>
+#include <conditional_memcpy.hpp>
+#include <valid_bit_tree.hpp>
+#include <crypto_module.hpp>
+#include <low_level_path_oram_interface.hpp>
+
+/**
+ * @brief Ring ORAM on top of the valid bit tree.
+ *
+ * Each bucket has Z real and S dummy slots, every slot is its own untrusted memory page.
+ * The per-bucket metadata (valid bits, permutation, access count, block ids and paths) lives in the
+ * valid bit tree, so an online access only fetches one slot per level.
+ *
+ */
+class RingOram: public Memory, public LLPathOramInterface {
+
+    public:
+    static unique_memory_t create(
+        std::string_view name,
+        unique_memory_t &&position_map, unique_memory_t &&untrusted_memory,
+        std::unique_ptr<ValidBitTreeController> &&valid_bit_tree_controller,
+        unique_memory_t &&valid_bit_tree_memory,
+        std::unique_ptr<CryptoModule> &&crypto_module,
+        uint64_t block_size,
+        uint64_t num_blocks,
+        uint64_t blocks_per_bucket,
+        uint64_t dummies_per_bucket,
+        uint64_t num_accesses_per_eviction,
+        uint64_t stash_capacity,
+        double max_load_factor = 1.0
+    );
+
+    struct ComputedParameters {
+        addr_t levels;
+        addr_t blocks_per_bucket;
+        addr_t dummies_per_bucket;
+        addr_t num_paths;
+        addr_t untrusted_memory_size;
+        addr_t block_index_size;
+        addr_t path_index_size;
+        addr_t untrusted_memory_page_size;
+        addr_t bucket_metadata_size;
+    };
+    static ComputedParameters compute_parameters(
+        addr_t untrusted_memory_page_size,
+        addr_t block_size,
+        addr_t num_blocks,
+        addr_t blocks_per_bucket,
+        addr_t dummies_per_bucket,
+        CryptoModule *crypto_module,
+        double max_load_factor = 0.75
+    );
+
+    virtual ~RingOram() = default;
+
+    protected:
+    /**
+     * @brief Layout of the metadata of one bucket inside the valid bit tree
+     * [valid bits][occupied bits][access count][write counter][permutation][block indices][path indices]
+     *
+     * Valid bits are indexed by physical slot and come first, so the helpers in ValidBitTreeController work on them directly.
+     * Occupied bits, block indices and path indices are indexed by logical real slot.
+     * The permutation maps logical slots (reals first, then dummies) to physical slots.
+     */
+    class BucketMetadataLayout {
+        public:
+        const std::size_t blocks_per_bucket;
+        const std::size_t dummies_per_bucket;
+        const std::size_t block_index_size;
+        const std::size_t path_index_size;
+
+        public:
+        inline BucketMetadataLayout(std::size_t blocks_per_bucket, std::size_t dummies_per_bucket, std::size_t block_index_size, std::size_t path_index_size) :
+        blocks_per_bucket(blocks_per_bucket), dummies_per_bucket(dummies_per_bucket),
+        block_index_size(block_index_size), path_index_size(path_index_size)
+        {}
+
+        [[nodiscard]] inline std::size_t slots_per_bucket() const noexcept {
+            return this->blocks_per_bucket + this->dummies_per_bucket;
+        }
+
+        [[nodiscard]] inline std::size_t occupied_bits_offset() const noexcept {
+            return divide_round_up(this->slots_per_bucket(), 8UL);
+        }
+
+        [[nodiscard]] inline std::size_t access_count_offset() const noexcept {
+            return this->occupied_bits_offset() + divide_round_up(this->blocks_per_bucket, 8UL);
+        }
+
+        [[nodiscard]] inline std::size_t write_counter_offset() const noexcept {
+            return this->access_count_offset() + sizeof(std::uint8_t);
+        }
+
+        [[nodiscard]] inline std::size_t permutation_offset() const noexcept {
+            return this->write_counter_offset() + sizeof(std::uint64_t);
+        }
+
+        [[nodiscard]] inline std::size_t block_index_offset(std::size_t slot) const noexcept {
+            return this->permutation_offset() + this->slots_per_bucket() + slot * this->block_index_size;
+        }
+
+        [[nodiscard]] inline std::size_t path_index_offset(std::size_t slot) const noexcept {
+            return this->block_index_offset(this->blocks_per_bucket) + slot * this->path_index_size;
+        }
+
+        [[nodiscard]] inline std::size_t metadata_size() const noexcept {
+            return this->path_index_offset(this->blocks_per_bucket);
+        }
+
+        [[nodiscard]] inline bool get_occupied(const byte_t *metadata, std::size_t slot) const noexcept {
+            return (metadata[this->occupied_bits_offset() + slot / 8UL] & (1 << (slot % 8UL))) != 0;
+        }
+
+        inline void set_occupied(byte_t *metadata, std::size_t slot, bool occupied) const noexcept {
+            byte_t mask = 1 << (slot % 8UL);
+            byte_t *target = metadata + this->occupied_bits_offset() + slot / 8UL;
+            *target = occupied ? (*target | mask) : (*target & ~mask);
+        }
+
+        [[nodiscard]] inline std::uint8_t get_access_count(const byte_t *metadata) const noexcept {
+            return metadata[this->access_count_offset()];
+        }
+
+        inline void set_access_count(byte_t *metadata, std::uint8_t count) const noexcept {
+            metadata[this->access_count_offset()] = count;
+        }
+
+        [[nodiscard]] inline std::uint64_t get_write_counter(const byte_t *metadata) const noexcept {
+            std::uint64_t counter;
+            std::memcpy(&counter, metadata + this->write_counter_offset(), sizeof(std::uint64_t));
+            return counter;
+        }
+
+        inline void set_write_counter(byte_t *metadata, std::uint64_t counter) const noexcept {
+            std::memcpy(metadata + this->write_counter_offset(), &counter, sizeof(std::uint64_t));
+        }
+
+        [[nodiscard]] inline std::uint8_t get_physical_slot(const byte_t *metadata, std::size_t logical_slot) const noexcept {
+            return metadata[this->permutation_offset() + logical_slot];
+        }
+
+        inline void set_physical_slot(byte_t *metadata, std::size_t logical_slot, std::uint8_t physical_slot) const noexcept {
+            metadata[this->permutation_offset() + logical_slot] = physical_slot;
+        }
+
+        [[nodiscard]] inline addr_t get_block_index(const byte_t *metadata, std::size_t slot) const noexcept {
+            addr_t block_index = 0;
+            std::memcpy(&block_index, metadata + this->block_index_offset(slot), this->block_index_size);
+            return block_index;
+        }
+
+        inline void set_block_index(byte_t *metadata, std::size_t slot, addr_t block_index) const noexcept {
+            std::memcpy(metadata + this->block_index_offset(slot), &block_index, this->block_index_size);
+        }
+
+        [[nodiscard]] inline addr_t get_path_index(const byte_t *metadata, std::size_t slot) const noexcept {
+            addr_t path_index = 0;
+            std::memcpy(&path_index, metadata + this->path_index_offset(slot), this->path_index_size);
+            return path_index;
+        }
+
+        inline void set_path_index(byte_t *metadata, std::size_t slot, addr_t path_index) const noexcept {
+            std::memcpy(metadata + this->path_index_offset(slot), &path_index, this->path_index_size);
+        }
+    };
+
+    RingOram(
+        std::string_view type, std::string_view name,
+        unique_memory_t &&position_map, unique_memory_t &&untrusted_memory,
+        std::unique_ptr<ValidBitTreeController> &&valid_bit_tree_controller,
+        unique_memory_t &&valid_bit_tree_memory,
+        std::unique_ptr<CryptoModule> &&crypto_module,
+        const ComputedParameters &computed_parameters,
+        uint64_t block_size,
+        uint64_t num_blocks,
+        uint64_t num_accesses_per_eviction,
+        uint64_t stash_capacity,
+        BinaryPathOramStatistics *statistics
+    );
+    RingOram(
+        std::string_view type, const toml::table &table,
+        unique_memory_t &&position_map, unique_memory_t &&untrusted_memory,
+        unique_memory_t &&valid_bit_tree_memory,
+        BinaryPathOramStatistics *statistics
+    );
+    public:
+    virtual void init() override;
+    virtual uint64_t size() const override;
+    virtual bool isBacked() const override;
+    virtual void access(MemoryRequest &request);
+    virtual bool is_request_type_supported(MemoryRequestType type) const override;
+    virtual void start_logging(bool append = false) override;
+    virtual void stop_logging() override;
+
+    virtual uint64_t page_size() const override;
+
+    virtual toml::table to_toml() const override;
+    virtual void save_to_disk(const std::filesystem::path &location) const override;
+
+    static unique_memory_t load_from_disk(const std::filesystem::path &location);
+    static unique_memory_t load_from_disk(const std::filesystem::path &location, const toml::table &table);
+
+    virtual void reset_statistics(bool from_file = false) override;
+    virtual void save_statistics() override;
+
+    virtual void barrier() override;
+
+    // LLPathOramInterface
+    virtual std::uint64_t read_and_update_position_map(uint64_t logical_block_address, uint64_t new_path, bool is_dummy = false) override;
+    virtual void find_and_remove_block_from_path(BlockMetadata *metadata, byte_t * data) override;
+    virtual void place_block_on_path(const BlockMetadata *metadata, const byte_t * data) override;
+    virtual std::uint64_t num_paths() const noexcept override;
+
+    protected:
+    virtual toml::table to_toml_self() const;
+
+    protected:
+    virtual void access_block(MemoryRequestType access_type, uint64_t block_address, unsigned char *buffer, uint64_t offset = 0, uint64_t length = UINT64_MAX);
+    bool read_block_from_path(addr_t logical_block_address, BlockMetadata *metadata_buffer, byte_t *block_buffer);
+    void read_buckets(const std::vector<addr_t> &bucket_levels);
+    void write_buckets(const std::vector<addr_t> &bucket_levels);
+    void eviction_access();
+    std::size_t try_evict_block_from_bucket_buffer(std::size_t max_count, uint64_t ignored_bits, uint64_t path, BlockMetadata *metadatas, byte_t *data_blocks, uint64_t level_limit);
+    void shuffle_bucket_metadata(byte_t *bucket_metadata);
+
+    inline byte_t *get_bucket_metadata(addr_t level) {
+        return this->valid_bit_tree_controller->get_bitfield_for_bucket(level);
+    }
+
+    inline addr_t get_slot_address(addr_t level, addr_t physical_slot) const {
+        addr_t bucket_index = (1UL << level) - 1 + (this->currently_loaded_path.value() >> (this->levels - 1 - level));
+        return (bucket_index * this->bucket_layout.slots_per_bucket() + physical_slot) * this->untrusted_memory_page_size;
+    }
+
+    inline byte_t *get_bucket_block(addr_t level, addr_t slot) {
+        return this->bucket_blocks.data() + (level * this->blocks_per_bucket + slot) * this->block_size;
+    }
+
+    inline BlockMetadata *get_bucket_block_metadata(addr_t level, addr_t slot) {
+        return this->bucket_block_metadata.data() + level * this->blocks_per_bucket + slot;
+    }
+
+    inline std::uint64_t get_position_map_address(std::uint64_t logical_block_address) const {
+        std::uint64_t position_map_page = logical_block_address / this->num_position_map_entries_per_page;
+        std::uint64_t offset = (logical_block_address % this->num_position_map_entries_per_page) * this->path_index_size;
+        return position_map_page * this->position_map_page_size + offset;
+    }
+
+    inline void prepare_nonce(addr_t address, std::uint64_t counter) {
+        std::memcpy(this->nonce_buffer.data() + this->random_nonce_bytes, &address, sizeof(std::uint64_t));
+        std::memcpy(this->nonce_buffer.data() + this->random_nonce_bytes + sizeof(std::uint64_t), &counter, sizeof(std::uint64_t));
+    }
+
+    protected:
+    // crypto stuff
+    std::unique_ptr<CryptoModule> crypto_module;
+    bytes_t key;
+
+    // memories
+    unique_memory_t position_map;
+    unique_memory_t untrusted_memory;
+    std::unique_ptr<ValidBitTreeController> valid_bit_tree_controller;
+    unique_memory_t valid_bit_tree_memory;
+
+    const uint64_t block_size;
+    const uint64_t num_blocks;
+
+    const addr_t levels;
+    const addr_t blocks_per_bucket;
+    const addr_t dummies_per_bucket;
+    const addr_t _num_paths;
+
+    const uint64_t num_accesses_per_eviction;
+
+    const uint64_t random_nonce_bytes;
+    const uint64_t auth_tag_bytes;
+    const uint64_t untrusted_memory_page_size;
+    const uint64_t path_index_size;
+    const uint64_t position_map_page_size;
+    const uint64_t num_position_map_entries_per_page;
+
+    const BucketMetadataLayout bucket_layout;
+
+    BinaryPathOramStatistics *oram_statistics;
+
+    EvictionPathGenerator eviction_path_gen;
+    uint64_t access_counter;
+
+    // the stash
+    Stash stash;
+    absl::BitGen bit_gen;
+
+    std::optional<addr_t> currently_loaded_path;
+    bytes_t nonce_buffer;
+    bytes_t slot_buffer;
+    bytes_t dummy_block;
+
+    // one slot per level for online reads
+    std::vector<MemoryRequest> online_read_requests;
+    std::vector<bool> online_read_hits;
+
+    // real blocks of the buckets on the loaded path
+    bytes_t bucket_blocks;
+    std::vector<BlockMetadata> bucket_block_metadata;
+
+    std::vector<BlockMetadata> eviction_metadata_buffer;
+    bytes_t eviction_data_block_buffer;
+    std::vector<std::uint8_t> permutation_buffer;
+};
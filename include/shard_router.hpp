@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <memory_defs.hpp>
+
+/**
+ * @brief Routes a batch of elements to shards with an oblivious sort and compaction, for ShardedOram and
+ * ShardedRecSysBuffer.
+ *
+ * Every shard gets the same number of slots, slots_per_shard: its elements in their order in the batch, then
+ * copies of a dummy record. Neither the memory accesses nor the time depend on which shard an element goes to.
+ * The caller has to pick slots_per_shard at least as large as max_shard_load, padded_slots_per_shard gives the
+ * size that only depends on the batch and holds any batch whose elements are spread uniformly at random with
+ * probability 1 - 2^-overflow_security_parameter.
+ */
+class ShardRouter {
+    public:
+    static constexpr std::uint64_t overflow_security_parameter = 40;
+
+    // keys of the routing: the shard, whether it is a dummy, and the position in the batch or in the shard's slots
+    static constexpr std::uint64_t dummy_bit = 1UL << 32;
+    static constexpr std::uint64_t shard_shift = 33;
+    static constexpr std::uint64_t position_mask = dummy_bit - 1;
+
+    // the largest batch, or number of slots of all shards, the keys can hold
+    static constexpr std::uint64_t max_elements = position_mask;
+
+    /**
+     * @brief The smallest number of slots per shard that count elements overflow with probability below
+     * 2^-overflow_security_parameter if each of them picks one of num_shards shards uniformly at random.
+     */
+    static std::uint64_t padded_slots_per_shard(std::uint64_t num_shards, std::uint64_t count);
+
+    /**
+     * @brief The largest number of elements, at least slots_per_shard, that overflow slots_per_shard slots of
+     * one of num_shards shards with probability below 2^-overflow_security_parameter.
+     */
+    static std::uint64_t max_padded_elements(std::uint64_t num_shards, std::uint64_t slots_per_shard);
+
+    /**
+     * @brief Counts the elements of every shard into loads without branching on the shards and returns the
+     * largest count.
+     */
+    static std::uint64_t max_shard_load(const std::uint64_t *shard_indices, std::uint64_t count, std::uint64_t num_shards, std::vector<std::uint64_t> &loads);
+
+    /**
+     * @brief Makes room for count records of record_size bytes, the caller fills them in before route.
+     */
+    byte_t *reset(std::uint64_t count, std::size_t record_size);
+
+    /**
+     * @brief Routes the records of the last reset, record i to shard shard_indices[i], and pads every shard with
+     * copies of dummy_record. Throws if an element would be dropped, so slots_per_shard has to be at least
+     * max_shard_load.
+     */
+    void route(const std::uint64_t *shard_indices, std::uint64_t num_shards, std::uint64_t slots_per_shard, const byte_t *dummy_record);
+
+    // slot i of shard s is slot s * slots_per_shard + i
+    const byte_t *slot_record(std::uint64_t slot) const {
+        return this->records.data() + slot * this->record_size;
+    }
+
+    bool is_dummy(std::uint64_t slot) const {
+        return (this->keys[slot] & dummy_bit) != 0;
+    }
+
+    // the position of the element in the batch
+    std::uint64_t position(std::uint64_t slot) const {
+        return this->keys[slot] & position_mask;
+    }
+
+    std::uint64_t num_slots() const {
+        return this->routed_slots;
+    }
+
+    /**
+     * @brief Sorts results, one of result_size bytes for every slot of the last route, back into the order of
+     * the batch. The results of the count elements come first, the ones of the dummies after them. The slots can
+     * not be read afterwards.
+     */
+    void restore_order(byte_t *results, std::size_t result_size);
+
+    private:
+    std::vector<std::uint64_t> keys;
+    bytes_t records;
+    std::vector<std::uint8_t> marks;
+    std::size_t record_size = 0;
+    std::uint64_t count = 0;
+    std::uint64_t routed_slots = 0;
+};
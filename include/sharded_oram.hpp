@@ -0,0 +1,136 @@
+#pragma once
+
+#include <memory_interface.hpp>
+#include <shard_router.hpp>
+#include <absl/random/random.h>
+#include <barrier>
+#include <thread>
+#include <exception>
+
+class ShardedOramStatistics : public MemoryStatistics {
+    public:
+    int64_t rounds;
+    int64_t overflow_rounds;
+    std::vector<int64_t> real_requests_per_shard;
+    std::vector<int64_t> dummy_requests_per_shard;
+    virtual void clear() override;
+    virtual toml::table to_toml() const override;
+    virtual void from_toml(const toml::table &table) override;
+    virtual ~ShardedOramStatistics() = default;
+};
+
+/**
+ * @brief Splits the block space over several independent ORAMs, each driven by its own thread.
+ *
+ * Block b lives in shard b % num_shards. Requests are dispatched in rounds, every round takes the
+ * next requests_per_round requests of the batch and sends exactly shard_batch_size requests to every
+ * shard, padding with dummy accesses to random paths of the shard. The number of rounds only depends
+ * on the size of the batch.
+ *
+ * The requests are routed to the shards by a ShardRouter, an oblivious sort and compaction, so neither the
+ * dispatcher's memory accesses nor the rounds depend on the addresses. requests_per_round is the
+ * largest number of requests that overflows a shard's batch with probability below
+ * 2^-ShardRouter::overflow_security_parameter when the blocks are spread uniformly over the shards. A
+ * round that overflows anyway, e.g. because it requests one block many times, does not fail but runs
+ * its requests in ceil(max_load / shard_batch_size) rounds of the shards, max_load being the most
+ * requests of the round for one shard. These extra rounds are the only thing that depends on the
+ * addresses: they reveal that a round overflowed and by how many batches, the statistics count them as
+ * overflow_rounds. The update function of an UPDATE request is still copied from its position in the batch.
+ *
+ * access() runs a full round for a single request, use batch_access() to get any parallelism.
+ */
+class ShardedOram : public Memory {
+    public:
+    static unique_memory_t create(
+        std::string_view name,
+        std::vector<unique_memory_t> &&shards,
+        uint64_t block_size, uint64_t num_blocks,
+        uint64_t shard_batch_size
+    );
+
+    protected:
+    ShardedOram(
+        std::string_view type, std::string_view name,
+        std::vector<unique_memory_t> &&shards,
+        uint64_t block_size, uint64_t num_blocks,
+        uint64_t shard_batch_size,
+        ShardedOramStatistics *statistics
+    );
+    ShardedOram(
+        std::string_view type, const toml::table &table,
+        std::vector<unique_memory_t> &&shards,
+        ShardedOramStatistics *statistics
+    );
+
+    public:
+    virtual ~ShardedOram();
+
+    virtual void init() override;
+    void fast_init();
+    virtual uint64_t size() const override;
+    virtual bool isBacked() const override;
+    virtual uint64_t page_size() const override;
+    virtual void access(MemoryRequest &request) override;
+    virtual void batch_access(std::vector<MemoryRequest> &requests) override;
+    virtual bool is_request_type_supported(MemoryRequestType type) const override;
+    virtual void start_logging(bool append = false) override;
+    virtual void stop_logging() override;
+    virtual void barrier() override;
+
+    virtual toml::table to_toml() const override;
+    virtual void save_to_disk(const std::filesystem::path &location) const override;
+
+    static unique_memory_t load_from_disk(const std::filesystem::path &location);
+    static unique_memory_t load_from_disk(const std::filesystem::path &location, const toml::table &table);
+
+    virtual void reset_statistics(bool from_file = false) override;
+    virtual void save_statistics() override;
+
+    /**
+     * @brief Stops the workers and hands out the shards, e.g. to drive each of them from a thread of
+     * the caller. Block b is block b / num_shards of shard b % num_shards. The ShardedOram can not
+     * be accessed afterwards.
+     */
+    std::vector<unique_memory_t> release_shards();
+
+    protected:
+    virtual toml::table to_toml_self() const;
+
+    void stop_workers();
+
+    void run_round();
+    void worker_loop(std::size_t shard_index);
+
+    // routes the requests of a round and returns the number of rounds of the shards it needs
+    uint64_t route_round(std::vector<MemoryRequest> &requests, uint64_t start, uint64_t count);
+    void run_shard_round(std::vector<MemoryRequest> &requests, uint64_t start, uint64_t count, uint64_t shard_round, uint64_t slots_per_shard);
+    void collect_round(std::vector<MemoryRequest> &requests, uint64_t start, uint64_t count);
+
+    std::vector<unique_memory_t> shards;
+    const uint64_t block_size;
+    const uint64_t num_blocks;
+    const uint64_t blocks_per_shard;
+    const uint64_t shard_batch_size;
+    const uint64_t requests_per_round;
+
+    ShardedOramStatistics *sharded_statistics;
+    absl::BitGen bit_gen;
+
+    // requests handed to each shard in the current round
+    std::vector<std::vector<MemoryRequest>> shard_requests;
+    std::vector<MemoryRequest> single_request;
+
+    // the oblivious routing of the current round, reused across rounds
+    ShardRouter router;
+    std::vector<uint64_t> route_shards;
+    std::vector<uint64_t> shard_loads;
+    bytes_t route_results;
+    // dummies touch a random path without needing the block to exist, so they are also safe while the shards are being filled
+    bytes_t dummy_record;
+
+    std::barrier<> round_start;
+    std::barrier<> round_end;
+    bool stopping;
+    std::vector<std::exception_ptr> worker_errors;
+    std::vector<std::jthread> workers;
+};
@@ -34,6 +34,9 @@ class Stash {
     // void add_new_block(uint64_t logical_block_address, uint64_t path);
     // std::vector<StashEntry> try_evict_blocks(uint64_t max_count , uint16_t ignored_bits, uint64_t path);
     std::size_t try_evict_blocks(uint64_t max_count, uint64_t ignored_bits, uint64_t path, BlockMetadata *metadatas, byte_t *data_blocks);
+    // deepest level on the given path any block in the stash can be placed at, -1 if the stash is empty
+    int64_t deepest_level(uint64_t path, uint64_t levels, uint64_t tree_bits = 1) const;
+    bool conditional_remove_deepest_block(bool do_remove, uint64_t path, uint64_t levels, BlockMetadata *metadata, byte_t *data, uint64_t tree_bits = 1);
     inline std::size_t size() const noexcept {
         return this->num_blocks_in_stash;
     }
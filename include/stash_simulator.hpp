@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <absl/random/random.h>
+#include <eviction_path_generator.hpp>
+#include <toml++/toml.h>
+
+int simulate_stash_entry_point(int argc, const char** argv);
+
+/**
+ * @brief Functional model of the tree and stash of PageOptimizedRAWOram and BinaryPathOram2.
+ *
+ * Every slot only keeps the path of the block it holds, there is no data, crypto, untrusted memory
+ * or position map ORAM. Evictions move paths exactly like the real ORAMs move blocks, so the stash
+ * occupancy follows the same distribution while running tens of millions of accesses per second.
+ *
+ * Accesses are uniformly random, so instead of tracking block ids the accessed block is drawn
+ * directly: it is in the stash with probability stash_size / num_blocks, otherwise it is in a
+ * uniformly random occupied slot of the tree.
+ */
+class StashSimulator {
+    public:
+    enum class EvictionPolicy {
+        // RAW ORAM: accesses only remove the block, every num_accesses_per_eviction accesses the
+        // next reverse lexicographic path is evicted, PageOptimizedRAWOram
+        READ_ONLY_ACCESS,
+        // Path ORAM: the accessed path is evicted after every access, BinaryPathOram2
+        ACCESSED_PATH
+    };
+
+    StashSimulator(
+        EvictionPolicy policy,
+        uint64_t num_blocks,
+        uint64_t levels,
+        uint64_t top_level_order,
+        uint64_t blocks_per_bucket,
+        uint64_t num_accesses_per_eviction = 1,
+        uint64_t evictions_per_batch = 1,
+        uint64_t tree_bits = 1
+    );
+
+    /**
+     * @brief Places every block into a random slot of the tree, same as fast_init of the real ORAMs.
+     */
+    void fast_init();
+    void access();
+    void run(uint64_t count);
+
+    void clear_statistics();
+    toml::table to_toml() const;
+
+    uint64_t stash_size() const;
+    uint64_t max_stash_size() const;
+
+    protected:
+    uint64_t bucket_of(uint64_t level, uint64_t path) const;
+    uint64_t random_path_in_bucket(uint64_t level, uint64_t level_offset);
+    uint64_t deepest_level(uint32_t block_path, uint64_t path) const;
+    void sort_by_depth(const uint32_t *blocks, uint64_t count, uint64_t path, std::vector<uint32_t> &sorted, std::vector<uint64_t> &depth_end) const;
+    void evict_path(uint64_t path);
+    void log_stash_size(std::vector<uint64_t> &histogram, uint64_t size);
+
+    protected:
+    static constexpr uint32_t invalid_path = UINT32_MAX;
+
+    const EvictionPolicy policy;
+    const uint64_t num_blocks;
+    const uint64_t levels;
+    const uint64_t top_level_order;
+    const uint64_t blocks_per_bucket;
+    const uint64_t num_accesses_per_eviction;
+    const uint64_t evictions_per_batch;
+    // every bucket below the root has 2^tree_bits children
+    const uint64_t tree_bits;
+    const uint64_t num_paths;
+
+    std::vector<uint64_t> level_start;
+    // path of the block in every slot, invalid_path for a free slot
+    std::vector<uint32_t> slots;
+    std::vector<uint32_t> stash;
+
+    EvictionPathGenerator eviction_path_gen;
+    uint64_t access_counter;
+    uint64_t next_eviction_path;
+    uint64_t next_slot;
+
+    // eviction scratch, the blocks read from the path and the stash sorted by how deep they can go
+    std::vector<uint32_t> path_blocks;
+    std::vector<uint32_t> sorted_path_blocks;
+    std::vector<uint64_t> path_depth_end;
+    std::vector<uint32_t> sorted_stash_blocks;
+    std::vector<uint64_t> stash_depth_end;
+
+    // stash size right after each eviction, and right before it
+    std::vector<uint64_t> stash_load;
+    std::vector<uint64_t> peak_stash_load;
+    uint64_t accesses;
+    uint64_t evictions;
+    uint64_t _max_stash_size;
+
+    absl::InsecureBitGen bit_gen;
+};
@@ -1,7 +1,11 @@
 #pragma once
 
 #include <stdint.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
 #include <conditional_memcpy.hpp>
+#include <oblivious.hpp>
 
 template <class T>
 uint64_t union_linear_scanning(const T* input, T*output, uint64_t input_count) {
@@ -22,4 +26,60 @@ uint64_t union_linear_scanning(const T* input, T*output, uint64_t input_count) {
     }
 
     return output_index;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Oblivious replacement for union_linear_scanning with O(n log^2 n) compare-exchanges instead of O(n^2)
+ * conditional copies. Writes the distinct values of input to the front of output in the order of their first
+ * occurrence, the same as union_linear_scanning, and leaves the rest of output unchanged.
+ *
+ * The values are sorted with their positions as payload. One pass then keeps the last element of every run of
+ * equal values, with the first position of the run, and marks the others. A second sort by mark and position
+ * moves the kept values to the front in their original order.
+ */
+template <class T>
+uint64_t union_bitonic_sort(const T* input, T* output, uint64_t input_count) {
+    static_assert(std::is_unsigned_v<T> && sizeof(T) <= sizeof(uint64_t), "union_bitonic_sort works on unsigned integers");
+    if (input_count == 0) {
+        return 0;
+    }
+
+    std::vector<uint64_t> keys(input_count);
+    std::vector<uint64_t> payloads(input_count);
+    for (uint64_t i = 0; i < input_count; i++) {
+        keys[i] = input[i];
+        payloads[i] = i;
+    }
+
+    oblivious::bitonic_sort<uint64_t, sizeof(uint64_t)>(keys.data(), reinterpret_cast<byte_t *>(payloads.data()), input_count);
+
+    // the mark goes into the top bit of the new key, positions are far smaller than that
+    constexpr uint64_t duplicate_mark = 1UL << 63;
+    uint64_t output_count = 0;
+    uint64_t first_position = 0;
+    for (uint64_t i = 0; i < input_count; i++) {
+        uint64_t value = keys[i];
+        uint64_t position = payloads[i];
+        uint64_t same_as_previous = static_cast<uint64_t>(i > 0) & static_cast<uint64_t>(value == keys[i - (i > 0)]);
+        uint64_t same_as_next = static_cast<uint64_t>(i + 1 < input_count) & static_cast<uint64_t>(value == keys[i + (i + 1 < input_count)]);
+
+        // the sort is not stable, so the first position of a run is the smallest one in it
+        uint64_t run_mask = 0UL - same_as_previous;
+        uint64_t smaller = 0UL - static_cast<uint64_t>(first_position < position);
+        first_position = (run_mask & ((smaller & first_position) | (~smaller & position))) | (~run_mask & position);
+
+        payloads[i] = (same_as_next * duplicate_mark) | first_position;
+        output_count += same_as_next ^ 1UL;
+    }
+    // the keys are only read ahead of i above, so they are swapped with the payloads afterwards
+    std::swap(keys, payloads);
+
+    oblivious::bitonic_sort<uint64_t, sizeof(uint64_t)>(keys.data(), reinterpret_cast<byte_t *>(payloads.data()), input_count);
+
+    for (uint64_t i = 0; i < input_count; i++) {
+        T value = static_cast<T>(payloads[i]);
+        conditional_memcpy(i < output_count, output + i, &value, sizeof(T));
+    }
+
+    return output_count;
+}
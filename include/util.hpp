@@ -4,6 +4,7 @@
 #include <memory_interface.hpp>
 #include <filesystem>
 #include <stdint.h>
+#include <bit>
 #include <toml++/toml.h>
 
 // address range checking
@@ -24,6 +25,17 @@ constexpr uint64_t num_bits(uint64_t value) {
     return bit_count;
 }
 
+// number of buckets in the first levels of a tree with 2^tree_bits children per bucket
+constexpr uint64_t heap_level_start(uint64_t levels, uint64_t tree_bits = 1) {
+    return ((1UL << (levels * tree_bits)) - 1) / ((1UL << tree_bits) - 1);
+}
+
+// deepest level (root is level 0) shared by two leaf paths in a tree with the given number of levels,
+// every level below the root takes tree_bits bits of the path
+constexpr uint64_t deepest_common_level(uint64_t path_a, uint64_t path_b, uint64_t levels, uint64_t tree_bits = 1) {
+    return levels - 1 - (std::bit_width(path_a ^ path_b) + tree_bits - 1) / tree_bits;
+}
+
 template <typename T>
 T divide_round_up(T dividend, T divisor) {
     return dividend / divisor + (dividend % divisor != 0 ? 1 : 0);
@@ -11,9 +11,22 @@ public:
     virtual void read_path(byte_t *key, addr_t path) = 0;
     virtual void write_path(byte_t *key) = 0;
 
+    // read_path and write_path in two halves, the memory requests are in flight in between so that the
+    // caller can issue its own requests to the tree in the meantime
+    virtual void submit_read_path(byte_t *key, addr_t path) {
+        this->read_path(key, path);
+    }
+    virtual void complete_read_path(byte_t *key) {}
+    virtual void submit_write_path(byte_t *key) {
+        this->write_path(key);
+    }
+    virtual void complete_write_path() {}
+
     virtual addr_t get_address_of(addr_t level, addr_t bucket_index) const noexcept= 0;
     virtual void encrypt_contents(byte_t *key) = 0;
     virtual void decrypt_contents(byte_t *key) = 0;
+    // write back anything kept in trusted memory, call before the memory is saved
+    virtual void flush(const byte_t *key) {}
 
     virtual ~ValidBitTreeController() = default;
 
@@ -25,32 +38,45 @@ public:
     }
 
     inline bool is_valid(addr_t level, addr_t slot_index) const noexcept {
+        return is_valid_in_bucket(this->get_bitfield_for_bucket(level), slot_index);
+    }
+
+    inline void set_valid(addr_t level, addr_t slot_index, bool valid) noexcept {
+        set_valid_in_bucket(this->get_bitfield_for_bucket(level), slot_index, valid);
+    }
+
+    inline void conditional_set_valid(addr_t level, addr_t slot_index, bool valid, bool condition) noexcept {
+        conditional_set_valid_in_bucket(this->get_bitfield_for_bucket(level), slot_index, valid, condition);
+    }
+
+    // same as above on a bitfield from get_bitfield_for_bucket, saves the virtual call per slot in bucket loops
+    static inline bool is_valid_in_bucket(const byte_t *bitfield, addr_t slot_index) noexcept {
         auto byte_offset = slot_index / 8UL;
         auto bit_index = slot_index % 8UL;
 
         byte_t mask = 1 << bit_index;
-        return (this->get_bitfield_for_bucket(level)[byte_offset] & mask) != 0;
+        return (bitfield[byte_offset] & mask) != 0;
     }
 
-    inline void set_valid(addr_t level, addr_t slot_index, bool valid) noexcept {
+    static inline void set_valid_in_bucket(byte_t *bitfield, addr_t slot_index, bool valid) noexcept {
         auto byte_offset = slot_index / 8UL;
         auto bit_index = slot_index % 8UL;
 
         if (valid) {
             byte_t mask = 1 << bit_index;
-            this->get_bitfield_for_bucket(level)[byte_offset] |= mask;
+            bitfield[byte_offset] |= mask;
         } else {
             byte_t mask = ~(1 << bit_index);
-            this->get_bitfield_for_bucket(level)[byte_offset] &= mask;
+            bitfield[byte_offset] &= mask;
         }
     }
 
-    inline void conditional_set_valid(addr_t level, addr_t slot_index, bool valid, bool condition) noexcept {
+    static inline void conditional_set_valid_in_bucket(byte_t *bitfield, addr_t slot_index, bool valid, bool condition) noexcept {
         auto byte_offset = slot_index / 8UL;
         auto bit_index = slot_index % 8UL;
 
         // compute what the byte should be if the modification is made
-        byte_t modified_byte = this->get_bitfield_for_bucket(level)[byte_offset];
+        byte_t modified_byte = bitfield[byte_offset];
 
         if (valid) {
             byte_t mask = 1 << bit_index;
@@ -61,7 +87,7 @@ public:
         }
 
         // conditionally apply the modification
-        conditional_memcpy(condition, this->get_bitfield_for_bucket(level) + byte_offset, &modified_byte, 1);
+        conditional_memcpy(condition, bitfield + byte_offset, &modified_byte, 1);
     }
 };
 
@@ -116,9 +142,16 @@ class ParentCounterValidBitTreeController : public ValidBitTreeController {
         // addr_t non_leaf_entry_size;
         addr_t required_memory_size;
         addr_t random_nonce_bytes;
+        // number of top page levels kept decrypted in trusted memory
+        addr_t cached_page_levels;
     };
 
-    static Parameters compute_parameters(CryptoModule *crypto, addr_t levels, addr_t page_size, addr_t valid_bits_per_bucket);
+    /**
+     * @brief cache_size bytes of trusted memory hold as many of the top non-leaf page levels as fit.
+     * The cached pages are shared by all paths, read_path and write_path only do I/O and crypto for
+     * the pages below them.
+     */
+    static Parameters compute_parameters(CryptoModule *crypto, addr_t levels, addr_t page_size, addr_t valid_bits_per_bucket, addr_t cache_size = 0);
 
     ParentCounterValidBitTreeController(Parameters parameters, CryptoModule *crypto_module, Memory* memory);
 
@@ -128,17 +161,30 @@ class ParentCounterValidBitTreeController : public ValidBitTreeController {
 
     virtual void read_path(byte_t *key, addr_t path) override;
     virtual void write_path(byte_t *key) override;
+    virtual void submit_read_path(byte_t *key, addr_t path) override;
+    virtual void complete_read_path(byte_t *key) override;
+    virtual void submit_write_path(byte_t *key) override;
+    virtual void complete_write_path() override;
 
     virtual void encrypt_contents(byte_t *key) override;
     virtual void decrypt_contents(byte_t *key) override;
+    virtual void flush(const byte_t *key) override;
     virtual addr_t get_address_of(addr_t level, addr_t bucket_index) const noexcept override;
     virtual toml::table to_toml() const noexcept override;
 
     virtual ~ParentCounterValidBitTreeController() = default;
 
     private:
+    void load_cache(const byte_t *key);
+    void init_cache();
+
+    // pages are decrypted in place, between read_path and write_path the read buffers hold the plain text
     inline const byte_t* get_decrypted_page(std::uint64_t level) const {
-        return this->decrypted_buffer.data() + level * this->parameters.page_size;
+        return this->loaded_pages[level];
+    }
+
+    inline byte_t* get_cached_page(std::uint64_t page_level, std::uint64_t page_index) {
+        return this->cached_pages.data() + (this->cached_level_start[page_level] + page_index) * this->parameters.page_size;
     }
 
     inline byte_t* get_decrypted_page(std::uint64_t level) {
@@ -214,11 +260,20 @@ class ParentCounterValidBitTreeController : public ValidBitTreeController {
     const Parameters parameters;
 
     bytes_t nonce_buffer;
+    CryptoBatch crypto_batch;
 
-    bytes_t decrypted_buffer;
+    // requests for the uncached page levels, the first one is page level cached_page_levels
     std::vector<MemoryRequest> path_access_requests;
+    // plain text page of every page level on the loaded path, in the cache or in a request buffer
+    std::vector<byte_t *> loaded_pages;
     bool content_encrypted;
 
+    // decrypted pages of the cached page levels, level by level, newer than the memory until flush()
+    bytes_t cached_pages;
+    std::vector<addr_t> cached_level_start;
+    bool cache_loaded;
+    bool cache_dirty;
+
     uint64_t root_counter;
 
     Memory * memory;
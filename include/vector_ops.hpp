@@ -1,3 +1,5 @@
+#pragma once
+
 #if defined(__AVX__)
 #include <immintrin.h>
 #endif
@@ -6,6 +8,8 @@
 #include <xmmintrin.h>
 #endif
 
+#include <cstdint>
+#include <cstring>
 #include <type_traits>
 #include <math.h>
 #include <numeric>
@@ -30,7 +34,7 @@ inline float vector_reduce_sum_f(const float *data, size_t count) {
     #endif
 
     #if defined(__AVX512F__)
-    for (;index < count - num_floats_per_512_vector + 1; index += num_floats_per_512_vector) {
+    for (;index + num_floats_per_512_vector <= count; index += num_floats_per_512_vector) {
         __m512 input = _mm512_loadu_ps(data + index);
         accumulator512 = _mm512_add_ps(accumulator512, input);
     }
@@ -45,7 +49,7 @@ inline float vector_reduce_sum_f(const float *data, size_t count) {
     #endif
 
     #if defined(__AVX__)
-    for (;index < count - num_floats_per_256_vector + 1; index += num_floats_per_256_vector) {
+    for (;index + num_floats_per_256_vector <= count; index += num_floats_per_256_vector) {
         __m256 input = _mm256_loadu_ps(data + index);
         accumulator256 = _mm256_add_ps(accumulator256, input);
     }
@@ -60,7 +64,7 @@ inline float vector_reduce_sum_f(const float *data, size_t count) {
 
     #if defined(__SSE__)
         
-    for (;index < count - num_floats_per_128_vector + 1; index += num_floats_per_128_vector) {
+    for (;index + num_floats_per_128_vector <= count; index += num_floats_per_128_vector) {
         __m128 input = _mm_loadu_ps(data + index);
         accumulator128 = _mm_add_ps(accumulator128, input);
     }
@@ -111,7 +115,7 @@ inline double vector_reduce_sum_d(const double *data, size_t count) {
     #endif
 
     #if defined(__AVX512F__)
-    for (;index < count - num_doubles_per_512_vector + 1; index += num_doubles_per_512_vector) {
+    for (;index + num_doubles_per_512_vector <= count; index += num_doubles_per_512_vector) {
         __m512d input = _mm512_loadu_pd(data + index);
         accumulator512 = _mm512_add_pd(accumulator512, input);
     }
@@ -126,7 +130,7 @@ inline double vector_reduce_sum_d(const double *data, size_t count) {
     #endif
 
     #if defined(__AVX__)
-    for (;index < count - num_doubles_per_256_vector + 1; index += num_doubles_per_256_vector) {
+    for (;index + num_doubles_per_256_vector <= count; index += num_doubles_per_256_vector) {
         __m256d input = _mm256_loadu_pd(data + index);
         accumulator256 = _mm256_add_pd(accumulator256, input);
     }
@@ -141,7 +145,7 @@ inline double vector_reduce_sum_d(const double *data, size_t count) {
 
     #if defined(__SSE__)
         
-    for (;index < count - num_doubles_per_128_vector + 1; index += num_doubles_per_128_vector) {
+    for (;index + num_doubles_per_128_vector <= count; index += num_doubles_per_128_vector) {
         __m128d input = _mm_loadu_pd(data + index);
         accumulator128 = _mm_add_pd(accumulator128, input);
     }
@@ -221,7 +225,7 @@ inline void vector_range_float(float * data, size_t count, size_t inital_offset)
     #if defined(__AVX512F__)
     __m512 accumulator512 = _mm512_set1_ps(accumulator);
 
-    for (;index < count - num_floats_per_512_vector + 1; index += num_floats_per_512_vector) {
+    for (;index + num_floats_per_512_vector <= count; index += num_floats_per_512_vector) {
         __m512 output = _mm512_add_ps(accumulator512, offset512);
         _mm512_storeu_ps(data + index, output);
         accumulator512 = _mm512_add_ps(accumulator512, step512);
@@ -236,7 +240,7 @@ inline void vector_range_float(float * data, size_t count, size_t inital_offset)
         __m256 accumulator256 = _mm256_set1_ps(accumulator);
     #endif
 
-    for (;index < count - num_floats_per_256_vector + 1; index += num_floats_per_256_vector) {
+    for (;index + num_floats_per_256_vector <= count; index += num_floats_per_256_vector) {
         __m256 output = _mm256_add_ps(accumulator256, offset256);
         _mm256_storeu_ps(data + index, output);
         accumulator256 = _mm256_add_ps(accumulator256, step256);
@@ -251,7 +255,7 @@ inline void vector_range_float(float * data, size_t count, size_t inital_offset)
         __m128 accumulator128 = _mm_set1_ps(accumulator);
     #endif
         
-    for (;index < count - num_floats_per_128_vector + 1; index += num_floats_per_128_vector) {
+    for (;index + num_floats_per_128_vector <= count; index += num_floats_per_128_vector) {
         __m128 output = _mm_add_ps(accumulator128, offset128);
         _mm_storeu_ps(data + index, output);
         accumulator128 = _mm_add_ps(accumulator128, step128);
@@ -273,4 +277,254 @@ inline void vector_range(T * data, size_t count, size_t inital_offset = 0) {
     } else {
         vector_range_default(data, count, inital_offset);
     }
-}
\ No newline at end of file
+}
+
+// the gradient kernels below have no data dependent branches, they take the same time for any values as long as
+// denormals are flushed to zero
+
+// accumulator[i] += input[i] for i in [0, count) if enable, the same instructions run either way
+inline void vector_masked_add_f(float *accumulator, const float *input, size_t count, bool enable) {
+    size_t index = 0;
+
+    #if defined(__AVX512F__)
+    constexpr size_t num_floats_per_512_vector = 512 / (8 * sizeof(float));
+    const __mmask16 mask512 = static_cast<__mmask16>(0U - static_cast<unsigned>(enable));
+    for (;index + num_floats_per_512_vector <= count; index += num_floats_per_512_vector) {
+        __m512 sum = _mm512_loadu_ps(accumulator + index);
+        sum = _mm512_mask_add_ps(sum, mask512, sum, _mm512_loadu_ps(input + index));
+        _mm512_storeu_ps(accumulator + index, sum);
+    }
+    #endif
+
+    #if defined(__AVX__)
+    constexpr size_t num_floats_per_256_vector = 256 / (8 * sizeof(float));
+    const __m256 mask256 = _mm256_castsi256_ps(_mm256_set1_epi32(-static_cast<int>(enable)));
+    for (;index + num_floats_per_256_vector <= count; index += num_floats_per_256_vector) {
+        __m256 old_value = _mm256_loadu_ps(accumulator + index);
+        __m256 sum = _mm256_add_ps(old_value, _mm256_loadu_ps(input + index));
+        _mm256_storeu_ps(accumulator + index, _mm256_blendv_ps(old_value, sum, mask256));
+    }
+    #endif
+
+    const std::uint32_t mask = 0U - static_cast<std::uint32_t>(enable);
+    for (;index < count; index++) {
+        float sum = accumulator[index] + input[index];
+        std::uint32_t old_bits, sum_bits;
+        std::memcpy(&old_bits, accumulator + index, sizeof(float));
+        std::memcpy(&sum_bits, &sum, sizeof(float));
+        old_bits ^= (old_bits ^ sum_bits) & mask;
+        std::memcpy(accumulator + index, &old_bits, sizeof(float));
+    }
+}
+
+// bf16 is the upper half of a float
+inline void vector_bf16_to_f(float *output, const std::uint16_t *input, size_t count) {
+    size_t index = 0;
+
+    #if defined(__AVX512F__)
+    constexpr size_t num_floats_per_512_vector = 512 / (8 * sizeof(float));
+    for (;index + num_floats_per_512_vector <= count; index += num_floats_per_512_vector) {
+        __m512i widened = _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(input + index)));
+        _mm512_storeu_ps(output + index, _mm512_castsi512_ps(_mm512_slli_epi32(widened, 16)));
+    }
+    #endif
+
+    #if defined(__AVX2__)
+    constexpr size_t num_floats_per_256_vector = 256 / (8 * sizeof(float));
+    for (;index + num_floats_per_256_vector <= count; index += num_floats_per_256_vector) {
+        __m256i widened = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(input + index)));
+        _mm256_storeu_ps(output + index, _mm256_castsi256_ps(_mm256_slli_epi32(widened, 16)));
+    }
+    #endif
+
+    for (;index < count; index++) {
+        std::uint32_t bits = static_cast<std::uint32_t>(input[index]) << 16;
+        std::memcpy(output + index, &bits, sizeof(float));
+    }
+}
+
+// rounds to the nearest bf16, ties to even
+inline void vector_f_to_bf16(std::uint16_t *output, const float *input, size_t count) {
+    size_t index = 0;
+
+    #if defined(__AVX512F__)
+    constexpr size_t num_floats_per_512_vector = 512 / (8 * sizeof(float));
+    const __m512i rounding_bias512 = _mm512_set1_epi32(0x7FFF);
+    const __m512i one512 = _mm512_set1_epi32(1);
+    for (;index + num_floats_per_512_vector <= count; index += num_floats_per_512_vector) {
+        __m512i bits = _mm512_castps_si512(_mm512_loadu_ps(input + index));
+        __m512i odd = _mm512_and_si512(_mm512_srli_epi32(bits, 16), one512);
+        bits = _mm512_srli_epi32(_mm512_add_epi32(bits, _mm512_add_epi32(rounding_bias512, odd)), 16);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(output + index), _mm512_cvtepi32_epi16(bits));
+    }
+    #endif
+
+    #if defined(__AVX2__)
+    constexpr size_t num_floats_per_256_vector = 256 / (8 * sizeof(float));
+    const __m256i rounding_bias256 = _mm256_set1_epi32(0x7FFF);
+    const __m256i one256 = _mm256_set1_epi32(1);
+    for (;index + num_floats_per_256_vector <= count; index += num_floats_per_256_vector) {
+        __m256i bits = _mm256_castps_si256(_mm256_loadu_ps(input + index));
+        __m256i odd = _mm256_and_si256(_mm256_srli_epi32(bits, 16), one256);
+        bits = _mm256_srli_epi32(_mm256_add_epi32(bits, _mm256_add_epi32(rounding_bias256, odd)), 16);
+        // the values fit in 16 bits, so the saturating pack keeps them, the permute undoes the lane interleaving
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(bits, bits), 0b1000);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(output + index), _mm256_castsi256_si128(packed));
+    }
+    #endif
+
+    for (;index < count; index++) {
+        std::uint32_t bits;
+        std::memcpy(&bits, input + index, sizeof(float));
+        bits += 0x7FFF + ((bits >> 16) & 1);
+        output[index] = static_cast<std::uint16_t>(bits >> 16);
+    }
+}
+
+// data[i] *= scale
+inline void vector_scale_f(float *data, float scale, size_t count) {
+    size_t index = 0;
+
+    #if defined(__AVX512F__)
+    constexpr size_t num_floats_per_512_vector = 512 / (8 * sizeof(float));
+    const __m512 scale512 = _mm512_set1_ps(scale);
+    for (;index + num_floats_per_512_vector <= count; index += num_floats_per_512_vector) {
+        _mm512_storeu_ps(data + index, _mm512_mul_ps(_mm512_loadu_ps(data + index), scale512));
+    }
+    #endif
+
+    #if defined(__AVX__)
+    constexpr size_t num_floats_per_256_vector = 256 / (8 * sizeof(float));
+    const __m256 scale256 = _mm256_set1_ps(scale);
+    for (;index + num_floats_per_256_vector <= count; index += num_floats_per_256_vector) {
+        _mm256_storeu_ps(data + index, _mm256_mul_ps(_mm256_loadu_ps(data + index), scale256));
+    }
+    #endif
+
+    for (;index < count; index++) {
+        data[index] *= scale;
+    }
+}
+
+// data[i] += scale * input[i]
+inline void vector_scaled_add_f(float *data, const float *input, float scale, size_t count) {
+    size_t index = 0;
+
+    #if defined(__AVX512F__)
+    constexpr size_t num_floats_per_512_vector = 512 / (8 * sizeof(float));
+    const __m512 scale512 = _mm512_set1_ps(scale);
+    for (;index + num_floats_per_512_vector <= count; index += num_floats_per_512_vector) {
+        __m512 scaled = _mm512_mul_ps(_mm512_loadu_ps(input + index), scale512);
+        _mm512_storeu_ps(data + index, _mm512_add_ps(_mm512_loadu_ps(data + index), scaled));
+    }
+    #endif
+
+    #if defined(__AVX__)
+    constexpr size_t num_floats_per_256_vector = 256 / (8 * sizeof(float));
+    const __m256 scale256 = _mm256_set1_ps(scale);
+    for (;index + num_floats_per_256_vector <= count; index += num_floats_per_256_vector) {
+        __m256 scaled = _mm256_mul_ps(_mm256_loadu_ps(input + index), scale256);
+        _mm256_storeu_ps(data + index, _mm256_add_ps(_mm256_loadu_ps(data + index), scaled));
+    }
+    #endif
+
+    for (;index < count; index++) {
+        data[index] += scale * input[index];
+    }
+}
+
+// sum_of_squares += gradient^2, weights -= learning_rate * gradient / (sqrt(sum_of_squares) + epsilon)
+inline void vector_adagrad_step_f(float *weights, float *sum_of_squares, const float *gradient, float learning_rate, float epsilon, size_t count) {
+    size_t index = 0;
+
+    #if defined(__AVX512F__)
+    constexpr size_t num_floats_per_512_vector = 512 / (8 * sizeof(float));
+    const __m512 learning_rate512 = _mm512_set1_ps(learning_rate);
+    const __m512 epsilon512 = _mm512_set1_ps(epsilon);
+    for (;index + num_floats_per_512_vector <= count; index += num_floats_per_512_vector) {
+        __m512 g = _mm512_loadu_ps(gradient + index);
+        __m512 squares = _mm512_add_ps(_mm512_loadu_ps(sum_of_squares + index), _mm512_mul_ps(g, g));
+        __m512 step = _mm512_div_ps(_mm512_mul_ps(learning_rate512, g), _mm512_add_ps(_mm512_sqrt_ps(squares), epsilon512));
+        _mm512_storeu_ps(sum_of_squares + index, squares);
+        _mm512_storeu_ps(weights + index, _mm512_sub_ps(_mm512_loadu_ps(weights + index), step));
+    }
+    #endif
+
+    #if defined(__AVX__)
+    constexpr size_t num_floats_per_256_vector = 256 / (8 * sizeof(float));
+    const __m256 learning_rate256 = _mm256_set1_ps(learning_rate);
+    const __m256 epsilon256 = _mm256_set1_ps(epsilon);
+    for (;index + num_floats_per_256_vector <= count; index += num_floats_per_256_vector) {
+        __m256 g = _mm256_loadu_ps(gradient + index);
+        __m256 squares = _mm256_add_ps(_mm256_loadu_ps(sum_of_squares + index), _mm256_mul_ps(g, g));
+        __m256 step = _mm256_div_ps(_mm256_mul_ps(learning_rate256, g), _mm256_add_ps(_mm256_sqrt_ps(squares), epsilon256));
+        _mm256_storeu_ps(sum_of_squares + index, squares);
+        _mm256_storeu_ps(weights + index, _mm256_sub_ps(_mm256_loadu_ps(weights + index), step));
+    }
+    #endif
+
+    for (;index < count; index++) {
+        float g = gradient[index];
+        sum_of_squares[index] += g * g;
+        weights[index] -= (learning_rate * g) / (sqrtf(sum_of_squares[index]) + epsilon);
+    }
+}
+
+// one Adam step, bias_correction1 and bias_correction2 are 1 - beta1^t and 1 - beta2^t of step t
+inline void vector_adam_step_f(
+    float *weights, float *first_moment, float *second_moment, const float *gradient,
+    float learning_rate, float beta1, float beta2, float epsilon, float bias_correction1, float bias_correction2, size_t count
+) {
+    size_t index = 0;
+    const float step_size = learning_rate / bias_correction1;
+    const float second_moment_scale = 1.0f / bias_correction2;
+
+    #if defined(__AVX512F__)
+    constexpr size_t num_floats_per_512_vector = 512 / (8 * sizeof(float));
+    const __m512 beta1_512 = _mm512_set1_ps(beta1);
+    const __m512 one_minus_beta1_512 = _mm512_set1_ps(1.0f - beta1);
+    const __m512 beta2_512 = _mm512_set1_ps(beta2);
+    const __m512 one_minus_beta2_512 = _mm512_set1_ps(1.0f - beta2);
+    const __m512 epsilon512 = _mm512_set1_ps(epsilon);
+    const __m512 step_size512 = _mm512_set1_ps(step_size);
+    const __m512 second_moment_scale512 = _mm512_set1_ps(second_moment_scale);
+    for (;index + num_floats_per_512_vector <= count; index += num_floats_per_512_vector) {
+        __m512 g = _mm512_loadu_ps(gradient + index);
+        __m512 m = _mm512_add_ps(_mm512_mul_ps(beta1_512, _mm512_loadu_ps(first_moment + index)), _mm512_mul_ps(one_minus_beta1_512, g));
+        __m512 v = _mm512_add_ps(_mm512_mul_ps(beta2_512, _mm512_loadu_ps(second_moment + index)), _mm512_mul_ps(one_minus_beta2_512, _mm512_mul_ps(g, g)));
+        __m512 denominator = _mm512_add_ps(_mm512_sqrt_ps(_mm512_mul_ps(v, second_moment_scale512)), epsilon512);
+        __m512 step = _mm512_div_ps(_mm512_mul_ps(step_size512, m), denominator);
+        _mm512_storeu_ps(first_moment + index, m);
+        _mm512_storeu_ps(second_moment + index, v);
+        _mm512_storeu_ps(weights + index, _mm512_sub_ps(_mm512_loadu_ps(weights + index), step));
+    }
+    #endif
+
+    #if defined(__AVX__)
+    constexpr size_t num_floats_per_256_vector = 256 / (8 * sizeof(float));
+    const __m256 beta1_256 = _mm256_set1_ps(beta1);
+    const __m256 one_minus_beta1_256 = _mm256_set1_ps(1.0f - beta1);
+    const __m256 beta2_256 = _mm256_set1_ps(beta2);
+    const __m256 one_minus_beta2_256 = _mm256_set1_ps(1.0f - beta2);
+    const __m256 epsilon256 = _mm256_set1_ps(epsilon);
+    const __m256 step_size256 = _mm256_set1_ps(step_size);
+    const __m256 second_moment_scale256 = _mm256_set1_ps(second_moment_scale);
+    for (;index + num_floats_per_256_vector <= count; index += num_floats_per_256_vector) {
+        __m256 g = _mm256_loadu_ps(gradient + index);
+        __m256 m = _mm256_add_ps(_mm256_mul_ps(beta1_256, _mm256_loadu_ps(first_moment + index)), _mm256_mul_ps(one_minus_beta1_256, g));
+        __m256 v = _mm256_add_ps(_mm256_mul_ps(beta2_256, _mm256_loadu_ps(second_moment + index)), _mm256_mul_ps(one_minus_beta2_256, _mm256_mul_ps(g, g)));
+        __m256 denominator = _mm256_add_ps(_mm256_sqrt_ps(_mm256_mul_ps(v, second_moment_scale256)), epsilon256);
+        __m256 step = _mm256_div_ps(_mm256_mul_ps(step_size256, m), denominator);
+        _mm256_storeu_ps(first_moment + index, m);
+        _mm256_storeu_ps(second_moment + index, v);
+        _mm256_storeu_ps(weights + index, _mm256_sub_ps(_mm256_loadu_ps(weights + index), step));
+    }
+    #endif
+
+    for (;index < count; index++) {
+        float g = gradient[index];
+        first_moment[index] = beta1 * first_moment[index] + (1.0f - beta1) * g;
+        second_moment[index] = beta2 * second_moment[index] + (1.0f - beta2) * (g * g);
+        weights[index] -= (step_size * first_moment[index]) / (sqrtf(second_moment[index] * second_moment_scale) + epsilon);
+    }
+}
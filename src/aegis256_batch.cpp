@@ -0,0 +1,296 @@
+#include <aegis256_batch.hpp>
+#include <immintrin.h>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+const byte_t aegis256_c0[16] = {0x00, 0x01, 0x01, 0x02, 0x03, 0x05, 0x08, 0x0d, 0x15, 0x22, 0x37, 0x59, 0x90, 0xe9, 0x79, 0x62};
+const byte_t aegis256_c1[16] = {0xdb, 0x3d, 0x18, 0x55, 0x6d, 0xc2, 0x2f, 0xf1, 0x20, 0x11, 0x31, 0x42, 0x73, 0xb5, 0x28, 0xdd};
+
+#if defined(__AES__)
+// one message per 128 bit vector, used for what is left over after the wider lanes
+struct Lanes128 {
+    using vector_t = __m128i;
+    static constexpr std::size_t count = 1;
+
+    static inline vector_t load(const byte_t *const *pointers, std::size_t offset) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i_u *>(pointers[0] + offset));
+    }
+    static inline void store(byte_t *const *pointers, std::size_t offset, vector_t value) {
+        _mm_storeu_si128(reinterpret_cast<__m128i_u *>(pointers[0] + offset), value);
+    }
+    static inline vector_t broadcast(const byte_t *block) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i_u *>(block));
+    }
+    static inline vector_t aes_round(vector_t state, vector_t round_key) {
+        return _mm_aesenc_si128(state, round_key);
+    }
+    static inline vector_t xor_(vector_t a, vector_t b) {
+        return _mm_xor_si128(a, b);
+    }
+    static inline vector_t and_(vector_t a, vector_t b) {
+        return _mm_and_si128(a, b);
+    }
+};
+#endif
+
+#if defined(__VAES__) && defined(__AVX2__)
+// two messages per 256 bit vector
+struct Lanes256 {
+    using vector_t = __m256i;
+    static constexpr std::size_t count = 2;
+
+    static inline vector_t load(const byte_t *const *pointers, std::size_t offset) {
+        return _mm256_loadu2_m128i(
+            reinterpret_cast<const __m128i_u *>(pointers[1] + offset),
+            reinterpret_cast<const __m128i_u *>(pointers[0] + offset)
+        );
+    }
+    static inline void store(byte_t *const *pointers, std::size_t offset, vector_t value) {
+        _mm256_storeu2_m128i(
+            reinterpret_cast<__m128i_u *>(pointers[1] + offset),
+            reinterpret_cast<__m128i_u *>(pointers[0] + offset),
+            value
+        );
+    }
+    static inline vector_t broadcast(const byte_t *block) {
+        return _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i_u *>(block)));
+    }
+    static inline vector_t aes_round(vector_t state, vector_t round_key) {
+        return _mm256_aesenc_epi128(state, round_key);
+    }
+    static inline vector_t xor_(vector_t a, vector_t b) {
+        return _mm256_xor_si256(a, b);
+    }
+    static inline vector_t and_(vector_t a, vector_t b) {
+        return _mm256_and_si256(a, b);
+    }
+};
+#endif
+
+#if defined(__VAES__) && defined(__AVX512F__)
+// four messages per 512 bit vector
+struct Lanes512 {
+    using vector_t = __m512i;
+    static constexpr std::size_t count = 4;
+
+    static inline vector_t load(const byte_t *const *pointers, std::size_t offset) {
+        __m512i value = _mm512_castsi128_si512(_mm_loadu_si128(reinterpret_cast<const __m128i_u *>(pointers[0] + offset)));
+        value = _mm512_inserti32x4(value, _mm_loadu_si128(reinterpret_cast<const __m128i_u *>(pointers[1] + offset)), 1);
+        value = _mm512_inserti32x4(value, _mm_loadu_si128(reinterpret_cast<const __m128i_u *>(pointers[2] + offset)), 2);
+        value = _mm512_inserti32x4(value, _mm_loadu_si128(reinterpret_cast<const __m128i_u *>(pointers[3] + offset)), 3);
+        return value;
+    }
+    static inline void store(byte_t *const *pointers, std::size_t offset, vector_t value) {
+        _mm_storeu_si128(reinterpret_cast<__m128i_u *>(pointers[0] + offset), _mm512_castsi512_si128(value));
+        _mm_storeu_si128(reinterpret_cast<__m128i_u *>(pointers[1] + offset), _mm512_extracti32x4_epi32(value, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i_u *>(pointers[2] + offset), _mm512_extracti32x4_epi32(value, 2));
+        _mm_storeu_si128(reinterpret_cast<__m128i_u *>(pointers[3] + offset), _mm512_extracti32x4_epi32(value, 3));
+    }
+    static inline vector_t broadcast(const byte_t *block) {
+        return _mm512_broadcast_i32x4(_mm_loadu_si128(reinterpret_cast<const __m128i_u *>(block)));
+    }
+    static inline vector_t aes_round(vector_t state, vector_t round_key) {
+        return _mm512_aesenc_epi128(state, round_key);
+    }
+    static inline vector_t xor_(vector_t a, vector_t b) {
+        return _mm512_xor_si512(a, b);
+    }
+    static inline vector_t and_(vector_t a, vector_t b) {
+        return _mm512_and_si512(a, b);
+    }
+};
+#endif
+
+// Lanes::count AEGIS-256 states side by side, lane i holds message i
+template <typename Lanes>
+struct AEGIS256State {
+    using vector_t = typename Lanes::vector_t;
+    vector_t s[6];
+
+    inline void update(vector_t message) {
+        vector_t tmp = this->s[5];
+        this->s[5] = Lanes::aes_round(this->s[4], this->s[5]);
+        this->s[4] = Lanes::aes_round(this->s[3], this->s[4]);
+        this->s[3] = Lanes::aes_round(this->s[2], this->s[3]);
+        this->s[2] = Lanes::aes_round(this->s[1], this->s[2]);
+        this->s[1] = Lanes::aes_round(this->s[0], this->s[1]);
+        this->s[0] = Lanes::xor_(Lanes::aes_round(tmp, this->s[0]), message);
+    }
+
+    inline vector_t keystream() const {
+        return Lanes::xor_(Lanes::xor_(this->s[1], this->s[4]), Lanes::xor_(this->s[5], Lanes::and_(this->s[2], this->s[3])));
+    }
+
+    inline void init(const byte_t *key, const byte_t *const *nonces) {
+        const vector_t k0 = Lanes::broadcast(key);
+        const vector_t k1 = Lanes::broadcast(key + 16);
+        const vector_t c0 = Lanes::broadcast(aegis256_c0);
+        const vector_t c1 = Lanes::broadcast(aegis256_c1);
+        const vector_t k0_n0 = Lanes::xor_(k0, Lanes::load(nonces, 0));
+        const vector_t k1_n1 = Lanes::xor_(k1, Lanes::load(nonces, 16));
+
+        this->s[0] = k0_n0;
+        this->s[1] = k1_n1;
+        this->s[2] = c1;
+        this->s[3] = c0;
+        this->s[4] = Lanes::xor_(k0, c0);
+        this->s[5] = Lanes::xor_(k1, c1);
+        for (int i = 0; i < 4; i++) {
+            this->update(k0);
+            this->update(k1);
+            this->update(k0_n0);
+            this->update(k1_n1);
+        }
+    }
+
+    // 32 byte tag of every lane into tags[lane]
+    inline void finalize(std::size_t length, byte_t *const *tags) {
+        byte_t lengths[16];
+        std::uint64_t ad_bits = 0;
+        std::uint64_t message_bits = static_cast<std::uint64_t>(length) * 8;
+        std::memcpy(lengths, &ad_bits, sizeof(std::uint64_t));
+        std::memcpy(lengths + 8, &message_bits, sizeof(std::uint64_t));
+
+        vector_t tmp = Lanes::xor_(Lanes::broadcast(lengths), this->s[3]);
+        for (int i = 0; i < 7; i++) {
+            this->update(tmp);
+        }
+        Lanes::store(tags, 0, Lanes::xor_(Lanes::xor_(this->s[0], this->s[1]), this->s[2]));
+        Lanes::store(tags, 16, Lanes::xor_(Lanes::xor_(this->s[3], this->s[4]), this->s[5]));
+    }
+};
+
+template <typename Lanes>
+inline void aegis256_encrypt_lanes(const byte_t *key, const byte_t *const *nonces, byte_t *const *buffers, std::size_t length, byte_t *const *auth_tags) {
+    AEGIS256State<Lanes> state;
+    state.init(key, nonces);
+
+    std::size_t offset = 0;
+    for (; offset + 16 <= length; offset += 16) {
+        auto message = Lanes::load(buffers, offset);
+        Lanes::store(buffers, offset, Lanes::xor_(message, state.keystream()));
+        state.update(message);
+    }
+
+    if (offset < length) {
+        // zero padded last block
+        byte_t padded[Lanes::count][16] = {};
+        byte_t *padded_pointers[Lanes::count];
+        for (std::size_t lane = 0; lane < Lanes::count; lane++) {
+            std::memcpy(padded[lane], buffers[lane] + offset, length - offset);
+            padded_pointers[lane] = padded[lane];
+        }
+        auto message = Lanes::load(padded_pointers, 0);
+        Lanes::store(padded_pointers, 0, Lanes::xor_(message, state.keystream()));
+        for (std::size_t lane = 0; lane < Lanes::count; lane++) {
+            std::memcpy(buffers[lane] + offset, padded[lane], length - offset);
+        }
+        state.update(message);
+    }
+
+    state.finalize(length, auth_tags);
+}
+
+template <typename Lanes>
+inline bool aegis256_decrypt_lanes(const byte_t *key, const byte_t *const *nonces, byte_t *const *buffers, std::size_t length, const byte_t *const *auth_tags) {
+    AEGIS256State<Lanes> state;
+    state.init(key, nonces);
+
+    std::size_t offset = 0;
+    for (; offset + 16 <= length; offset += 16) {
+        auto message = Lanes::xor_(Lanes::load(buffers, offset), state.keystream());
+        Lanes::store(buffers, offset, message);
+        state.update(message);
+    }
+
+    if (offset < length) {
+        // the state absorbs the zero padded message, not the key stream past the end
+        byte_t padded[Lanes::count][16] = {};
+        byte_t *padded_pointers[Lanes::count];
+        for (std::size_t lane = 0; lane < Lanes::count; lane++) {
+            std::memcpy(padded[lane], buffers[lane] + offset, length - offset);
+            padded_pointers[lane] = padded[lane];
+        }
+        Lanes::store(padded_pointers, 0, Lanes::xor_(Lanes::load(padded_pointers, 0), state.keystream()));
+        for (std::size_t lane = 0; lane < Lanes::count; lane++) {
+            std::memset(padded[lane] + length - offset, 0, 16 - (length - offset));
+            std::memcpy(buffers[lane] + offset, padded[lane], length - offset);
+        }
+        state.update(Lanes::load(padded_pointers, 0));
+    }
+
+    byte_t computed_tags[Lanes::count][32];
+    byte_t *computed_tag_pointers[Lanes::count];
+    for (std::size_t lane = 0; lane < Lanes::count; lane++) {
+        computed_tag_pointers[lane] = computed_tags[lane];
+    }
+    state.finalize(length, computed_tag_pointers);
+
+    // constant time compare
+    byte_t difference = 0;
+    for (std::size_t lane = 0; lane < Lanes::count; lane++) {
+        for (std::size_t i = 0; i < 32; i++) {
+            difference |= computed_tags[lane][i] ^ auth_tags[lane][i];
+        }
+    }
+    return difference == 0;
+}
+
+}
+
+std::size_t
+aegis256_batch_lanes() noexcept {
+    #if defined(__VAES__) && defined(__AVX512F__)
+    return Lanes512::count;
+    #elif defined(__VAES__) && defined(__AVX2__)
+    return Lanes256::count;
+    #elif defined(__AES__)
+    return Lanes128::count;
+    #else
+    return 0;
+    #endif
+}
+
+void
+aegis256_encrypt_batch(const byte_t *key, std::size_t count, const byte_t *const *nonces, byte_t *const *buffers, std::size_t length, byte_t *const *auth_tags) noexcept {
+    std::size_t i = 0;
+    #if defined(__VAES__) && defined(__AVX512F__)
+    for (; i + Lanes512::count <= count; i += Lanes512::count) {
+        aegis256_encrypt_lanes<Lanes512>(key, nonces + i, buffers + i, length, auth_tags + i);
+    }
+    #endif
+    #if defined(__VAES__) && defined(__AVX2__)
+    for (; i + Lanes256::count <= count; i += Lanes256::count) {
+        aegis256_encrypt_lanes<Lanes256>(key, nonces + i, buffers + i, length, auth_tags + i);
+    }
+    #endif
+    #if defined(__AES__)
+    for (; i < count; i++) {
+        aegis256_encrypt_lanes<Lanes128>(key, nonces + i, buffers + i, length, auth_tags + i);
+    }
+    #endif
+}
+
+bool
+aegis256_decrypt_batch(const byte_t *key, std::size_t count, const byte_t *const *nonces, byte_t *const *buffers, std::size_t length, const byte_t *const *auth_tags) noexcept {
+    bool verified = true;
+    std::size_t i = 0;
+    #if defined(__VAES__) && defined(__AVX512F__)
+    for (; i + Lanes512::count <= count; i += Lanes512::count) {
+        verified &= aegis256_decrypt_lanes<Lanes512>(key, nonces + i, buffers + i, length, auth_tags + i);
+    }
+    #endif
+    #if defined(__VAES__) && defined(__AVX2__)
+    for (; i + Lanes256::count <= count; i += Lanes256::count) {
+        verified &= aegis256_decrypt_lanes<Lanes256>(key, nonces + i, buffers + i, length, auth_tags + i);
+    }
+    #endif
+    #if defined(__AES__)
+    for (; i < count; i++) {
+        verified &= aegis256_decrypt_lanes<Lanes128>(key, nonces + i, buffers + i, length, auth_tags + i);
+    }
+    #endif
+    return verified;
+}
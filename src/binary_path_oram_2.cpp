@@ -10,8 +10,14 @@ BinaryPathOram2::Parameters
 BinaryPathOram2::compute_parameters_known_oram_size(
     uint64_t block_size, uint64_t page_size, uint64_t levels_per_page,
     uint64_t num_blocks, CryptoModule * crypto_module,
-    uint64_t min_num_slots, bool strict_bucket_size
+    uint64_t min_num_slots, bool strict_bucket_size,
+    uint64_t tree_order
 ) {
+    if (tree_order < 2 || !std::has_single_bit(tree_order)) {
+        throw std::invalid_argument(absl::StrFormat("Tree order %lu is not a power of two", tree_order));
+    }
+    const std::size_t tree_bits = std::countr_zero(tree_order);
+
     // compute block index size
     std::size_t block_index_size = num_bytes(num_blocks - 1);
     std::cout << absl::StreamFormat("To index %lu blocks would require %lu bytes\n", num_blocks, block_index_size);
@@ -20,12 +26,16 @@ BinaryPathOram2::compute_parameters_known_oram_size(
     std::size_t nonce_size = crypto_module->nonce_size();
     std::size_t random_nonce_bytes = nonce_size - 2 * sizeof(std::uint64_t);
 
-    const std::size_t child_counter_size = (1UL << levels_per_page) * sizeof(std::uint64_t);
+    // every page keeps the counters of the pages below its bottom level
+    const std::size_t child_counter_size = (1UL << (levels_per_page * tree_bits)) * sizeof(std::uint64_t);
 
     //compute bucket size
-    const std::size_t num_buckets_per_page = (1UL << levels_per_page) - 1;
-    std::cout << absl::StreamFormat("%lu levels per page means %lu buckets per page\n", levels_per_page, num_buckets_per_page);
+    const std::size_t num_buckets_per_page = heap_level_start(levels_per_page, tree_bits);
+    std::cout << absl::StreamFormat("%lu levels per page of a tree of order %lu means %lu buckets per page\n", levels_per_page, tree_order, num_buckets_per_page);
 
+    if (page_size < auth_tag_size + child_counter_size + num_buckets_per_page) {
+        throw std::invalid_argument(absl::StrFormat("Page of %lu bytes can not hold %lu child counters and %lu buckets", page_size, child_counter_size / sizeof(std::uint64_t), num_buckets_per_page));
+    }
     std::size_t bucket_size = (page_size - auth_tag_size - child_counter_size) / num_buckets_per_page;
 
     std::cout << absl::StreamFormat("Maximum bucket size is %lu\n", bucket_size);
@@ -34,6 +44,9 @@ BinaryPathOram2::compute_parameters_known_oram_size(
     // preliminary calculation, assume path index is the same size as block index
     std::size_t num_blocks_per_bucket = bucket_size / (block_size + 2 * block_index_size + 1);
     std::cout << absl::StreamFormat("Preliminary blocks per bucket: %lu\n", num_blocks_per_bucket);
+    if (num_blocks_per_bucket == 0) {
+        throw std::invalid_argument(absl::StrFormat("Bucket of %lu bytes can not hold a block of %lu bytes", bucket_size, block_size));
+    }
 
     // load factor
     std::size_t required_number_of_slots = min_num_slots;
@@ -41,22 +54,25 @@ BinaryPathOram2::compute_parameters_known_oram_size(
     std::cout << absl::StreamFormat("To have a minimum of %lu slots the tree needs %lu buckets\n", required_number_of_slots, required_number_of_buckets);
 
     // compute height of tree
-    std::size_t levels = num_bits(required_number_of_buckets);
+    std::size_t levels = 1;
+    while (heap_level_start(levels, tree_bits) < required_number_of_buckets) {
+        levels++;
+    }
     std::cout << absl::StreamFormat("Tree height is %lu \n", levels);
 
     const std::size_t page_levels = divide_round_up(levels, levels_per_page);
     std::cout << absl::StreamFormat("Tree has %lu page levels\n", page_levels);
 
     // compute path index size
-    std::size_t path_index_size = divide_round_up(std::max(1UL, levels - 1) + 1, 8UL);
+    std::size_t path_index_size = divide_round_up(std::max(1UL, (levels - 1) * tree_bits) + 1, 8UL);
     std::cout << absl::StreamFormat("Path index size is %lu \n", path_index_size);
 
     // recompute number of blocks per bucket
     num_blocks_per_bucket = bucket_size / (block_size + block_index_size + path_index_size + 1);
-    std::cout << absl::StreamFormat("Each bucket of %lu bytes can hold %lu slots, 2x64-bit child counters, and one %lu byte auth tag\n", bucket_size, num_blocks_per_bucket, auth_tag_size);
+    std::cout << absl::StreamFormat("Each bucket of %lu bytes can hold %lu slots, each page also has %lu 64-bit child counters and one %lu byte auth tag\n", bucket_size, num_blocks_per_bucket, child_counter_size / sizeof(std::uint64_t), auth_tag_size);
 
     // compute total number of slots
-    std::size_t total_number_of_buckets = (1UL << levels) - 1;
+    std::size_t total_number_of_buckets = heap_level_start(levels, tree_bits);
     std::size_t total_number_of_slots = total_number_of_buckets * num_blocks_per_bucket;
     double actual_load_factor = static_cast<double>(num_blocks) / static_cast<double>(total_number_of_slots);
     std::cout << absl::StreamFormat("Tree has %lu buckets or %lu total slots, actual load factor is %lf\n", total_number_of_buckets, total_number_of_slots, actual_load_factor);
@@ -73,7 +89,7 @@ BinaryPathOram2::compute_parameters_known_oram_size(
 
     for (std::uint64_t i = 0; i < page_levels; i++) {
         page_level_start += page_level_size;
-        page_level_size = page_level_size << levels_per_page;
+        page_level_size = page_level_size << (levels_per_page * tree_bits);
     }
 
     std::cout << absl::StrFormat("BinaryPathORAM requires %sB of unsafe memory\n", size_to_string(page_level_start * page_size));
@@ -84,6 +100,7 @@ BinaryPathOram2::compute_parameters_known_oram_size(
         .bucket_size = bucket_size,
         .blocks_per_bucket = num_blocks_per_bucket,
         .levels_per_page = levels_per_page,
+        .tree_bits = tree_bits,
         .levels = levels,
         .page_levels = page_levels,
         .num_blocks = num_blocks,
@@ -102,12 +119,13 @@ BinaryPathOram2::Parameters
 BinaryPathOram2::compute_parameters(
     uint64_t block_size, uint64_t page_size, uint64_t levels_per_page, 
     uint64_t num_blocks, CryptoModule * crypto_module,
-    double max_load_factor, bool strict_bucket_size
+    double max_load_factor, bool strict_bucket_size,
+    uint64_t tree_order
 ) {
     std::uint64_t min_number_of_slots = static_cast<std::uint64_t>(static_cast<double>(num_blocks) / max_load_factor);
     std::cout << absl::StreamFormat("To maintain a max load factor of %lf while holding %lu real blocks, %lu slots are needed\n", max_load_factor, num_blocks, min_number_of_slots);
     return compute_parameters_known_oram_size(
-        block_size, page_size, levels_per_page, num_blocks, crypto_module, min_number_of_slots, strict_bucket_size
+        block_size, page_size, levels_per_page, num_blocks, crypto_module, min_number_of_slots, strict_bucket_size, tree_order
     );
 }
 
@@ -121,7 +139,7 @@ BinaryPathOram2::create(
         bool bypass_path_read_on_stash_hit
 ) {
     return std::unique_ptr<Memory>(new BinaryPathOram2(
-        name,
+        "BinaryPathOram2", name,
         std::move(position_map),
         std::move(untrusted_memory),
         std::move(crypto_module),
@@ -134,7 +152,7 @@ BinaryPathOram2::create(
 
 
 BinaryPathOram2::BinaryPathOram2(
-        std::string_view name,
+        std::string_view type, std::string_view name,
         unique_memory_t &&position_map, unique_memory_t &&untrusted_memory,
         std::unique_ptr<CryptoModule> &&crypto_module,
         BinaryPathOramStatistics *statistics,
@@ -142,7 +160,7 @@ BinaryPathOram2::BinaryPathOram2(
         uint64_t max_stash_size,
         bool bypass_path_read_on_stash_hit
 ) :
-Memory("BinaryPathOram2", name, parameters.block_size * parameters.num_blocks, statistics) ,
+Memory(type, name, parameters.block_size * parameters.num_blocks, statistics) ,
 position_map(std::move(position_map)),
 untrusted_memory(std::move(untrusted_memory)),
 crypto_module(std::move(crypto_module)),
@@ -158,19 +176,23 @@ root_counter(0),
 nonce_buffer(parameters.nonce_size),
 key(this->crypto_module->key_size()),
 decrypted_path(parameters.page_levels * parameters.page_size),
-currently_loaded_path(std::nullopt)
+currently_loaded_path(std::nullopt),
+write_back_in_flight(false),
+last_written_path(std::nullopt)
 {
     for (addr_t i = 0; i < this->parameters.page_levels; i++) {
         this->path_access.emplace_back(MemoryRequestType::READ, 0, this->parameters.page_size);
+        this->write_back_access.emplace_back(MemoryRequestType::WRITE, 0, this->parameters.page_size);
         // this->valid_bitfield_access.emplace_back(MemoryRequestType::READ, 0, this->valid_bits_per_bucket);
     }
+    this->path_read_access.reserve(this->parameters.page_levels);
 
     // generate random key
     this->key.resize(this->crypto_module->key_size());
     this->crypto_module->random(this->key.data(), this->crypto_module->key_size());
     this->nonce_buffer.resize(this->crypto_module->nonce_size());
     this->crypto_module->random(this->nonce_buffer.data(), this->parameters.random_nonce_bytes);
-    this->decrypted_path.resize(parameters.levels * parameters.bucket_size);
+    this->decrypted_path.resize(parameters.page_levels * parameters.page_size);
 }
 
 BinaryPathOram2::BinaryPathOram2(
@@ -188,6 +210,8 @@ parameters(Parameters {
     .bucket_size = parse_size(table["bucket_size"]),
     .blocks_per_bucket = parse_size(table["blocks_per_bucket"]),
     .levels_per_page = parse_size(table["levels_per_page"]),
+    // binary trees were saved without it
+    .tree_bits = table.contains("tree_bits") ? parse_size(table["tree_bits"]) : 1,
     .levels = parse_size(table["levels"]),
     .page_levels = parse_size(table["page_levels"]),
     .num_blocks = parse_size(table["num_blocks"]),
@@ -208,23 +232,37 @@ root_counter(parse_size(table["root_counter"])),
 // access_counter(0),
 nonce_buffer(parameters.nonce_size),
 key(this->crypto_module->key_size()),
-decrypted_path(parameters.levels * parameters.page_size),
-currently_loaded_path(std::nullopt)
+decrypted_path(parameters.page_levels * parameters.page_size),
+currently_loaded_path(std::nullopt),
+write_back_in_flight(false),
+last_written_path(std::nullopt)
 {
     for (addr_t i = 0; i < this->parameters.page_levels; i++) {
         this->path_access.emplace_back(MemoryRequestType::READ, 0, this->parameters.page_size);
+        this->write_back_access.emplace_back(MemoryRequestType::WRITE, 0, this->parameters.page_size);
         // this->valid_bitfield_access.emplace_back(MemoryRequestType::READ, 0, this->valid_bits_per_bucket);
     }
+    this->path_read_access.reserve(this->parameters.page_levels);
 
     this->key.resize(this->crypto_module->key_size());
     hex_string_to_bytes(table["key"].value<std::string_view>().value(), this->key.data(), this->crypto_module->key_size());
     this->nonce_buffer.resize(this->crypto_module->nonce_size());
     hex_string_to_bytes(table["random_nonce"].value<std::string_view>().value(), this->nonce_buffer.data(), this->parameters.random_nonce_bytes);
-    this->decrypted_path.resize(this->parameters.bucket_size * this->parameters.levels);
+    this->decrypted_path.resize(this->parameters.page_levels * this->parameters.page_size);
+}
+
+BinaryPathOram2::~BinaryPathOram2() {
+    try {
+        this->complete_write_back();
+    } catch (const std::exception &e) {
+        std::cout << absl::StreamFormat("Path write failed while destroying the ORAM: %s\n", e.what());
+    }
 }
 
 void 
 BinaryPathOram2::init() {
+    this->complete_write_back();
+    this->last_written_path = std::nullopt;
     this->position_map->init();
     this->untrusted_memory->init();
     MemoryRequest position_map_access(MemoryRequestType::WRITE, 0, this->parameters.path_index_size);
@@ -294,15 +332,17 @@ BinaryPathOram2::init() {
             this->untrusted_memory->access(untrusted_memory_request);
         }
         page_level_start += page_level_size;
-        page_level_size = page_level_size << this->parameters.levels_per_page;
+        page_level_size = page_level_size << (this->parameters.levels_per_page * this->parameters.tree_bits);
     }
 }
 
 void 
 BinaryPathOram2::fast_init() {
+    this->complete_write_back();
+    this->last_written_path = std::nullopt;
     this->root_counter = 0;
     std::cout << "Staring PageOptimizedRAWOram fast initialization\n";
-    uint64_t total_buckets = (1UL << this->parameters.levels) - 1;
+    uint64_t total_buckets = heap_level_start(this->parameters.levels, this->parameters.tree_bits);
     uint64_t total_pages = this->untrusted_memory->size() / this->parameters.page_size;
     std::cout << absl::StreamFormat("ORAM has %lu buckets\n", total_buckets);
 
@@ -363,7 +403,7 @@ BinaryPathOram2::fast_init() {
             sub_tree_height = this->parameters.levels_per_page;
         }
 
-        uint64_t page_path_reminding_bits = (this->parameters.levels - 1 - this->parameters.levels_per_page * page_level);
+        uint64_t page_path_reminding_bits = (this->parameters.levels - 1 - this->parameters.levels_per_page * page_level) * this->parameters.tree_bits;
         for (uint64_t page_offset = 0; page_offset < page_level_size; page_offset++)
         {
             uint64_t page_id = (page_level_start_offset + page_offset);
@@ -384,7 +424,7 @@ BinaryPathOram2::fast_init() {
                 for (std::uint64_t subtree_offset = 0; subtree_offset < subtree_level_size; subtree_offset++) {
                     byte_t *bucket = data_buffer.data() + (subtree_level_start_offset + subtree_offset) * this->parameters.bucket_size;
 
-                    std::uint64_t bucket_path_remaining_bits = page_path_reminding_bits - sub_tree_level;
+                    std::uint64_t bucket_path_remaining_bits = page_path_reminding_bits - sub_tree_level * this->parameters.tree_bits;
                     std::uint64_t bucket_path = page_path | (subtree_offset << bucket_path_remaining_bits);
 
                     for (uint64_t i = 0; i < this->parameters.blocks_per_bucket; i++)
@@ -425,7 +465,7 @@ BinaryPathOram2::fast_init() {
                 }
 
                 subtree_level_start_offset += subtree_level_size;
-                subtree_level_size *= 2;
+                subtree_level_size <<= this->parameters.tree_bits;
             }
 
             if ((page_id + 1) % 10000UL == 0) {
@@ -455,7 +495,7 @@ BinaryPathOram2::fast_init() {
             this->untrusted_memory->access(untrusted_memory_request);
         }
         page_level_start_offset += page_level_size;
-        page_level_size = page_level_size << this->parameters.levels_per_page;
+        page_level_size = page_level_size << (this->parameters.levels_per_page * this->parameters.tree_bits);
     }
     // this->valid_bit_tree_controller->encrypt_contents(this->key.data());
 }
@@ -538,6 +578,7 @@ BinaryPathOram2::to_toml_self() const {
     table.emplace("bucket_size", size_to_string(this->parameters.bucket_size));
     table.emplace("blocks_per_bucket", size_to_string(this->parameters.blocks_per_bucket));
     table.emplace("levels_per_page", size_to_string(this->parameters.levels_per_page));
+    table.emplace("tree_bits", size_to_string(this->parameters.tree_bits));
     table.emplace("levels", size_to_string(this->parameters.levels));
     table.emplace("page_levels", size_to_string(this->parameters.page_levels));
     table.emplace("num_blocks", size_to_string(this->parameters.num_blocks));
@@ -569,6 +610,8 @@ BinaryPathOram2::to_toml() const {
 
 void 
 BinaryPathOram2::save_to_disk(const std::filesystem::path &location) const {
+    this->complete_write_back();
+
     // write config file
     std::ofstream config_file(location / "config.toml");
     config_file << this->to_toml_self() << "\n";
@@ -637,6 +680,7 @@ BinaryPathOram2::save_statistics() {
 
 void 
 BinaryPathOram2::barrier() {
+    this->complete_write_back();
     this->Memory::barrier();
     this->untrusted_memory->barrier();
     this->position_map->barrier();
@@ -843,39 +887,48 @@ BinaryPathOram2::read_path(uint64_t path) {
     // set up read access
     this->oram_statistics->increment_path_read();
     this->currently_loaded_path = path;
-    addr_t current_page_level_size = 1;
-    addr_t page_level_start_offset = 0;
-    // addr_t reversed_path = reverse_bits(path, this->tree_bits * this->levels);
-    // addr_t mask = (1UL << this->tree_bits) - 1UL;
-    for (addr_t page_level = 0; page_level < this->parameters.page_levels; page_level++) {
-        addr_t current_level_offset = path >> (this->parameters.levels - 1 - page_level * this->parameters.levels_per_page);
-        addr_t address = (page_level_start_offset + current_level_offset) * this->parameters.page_size;
-        this->path_access[page_level].type = MemoryRequestType::READ;
-        this->path_access[page_level].address = address;
 
-        page_level_start_offset += current_page_level_size;
-        current_page_level_size = current_page_level_size << this->parameters.levels_per_page;
+    // the top pages shared with the path still being written are current in decrypted_path, reading them
+    // could also return the old contents while the write is in flight
+    addr_t shared_page_levels = 0;
+    if (this->last_written_path.has_value()) {
+        while (
+            shared_page_levels < this->parameters.page_levels
+            && this->get_page_address(path, shared_page_levels) == this->write_back_access[shared_page_levels].address
+        ) {
+            shared_page_levels++;
+        }
+    }
+    this->last_written_path = std::nullopt;
+
+    this->path_read_access.clear();
+    for (addr_t page_level = shared_page_levels; page_level < this->parameters.page_levels; page_level++) {
+        this->path_access[page_level].type = MemoryRequestType::READ;
+        this->path_access[page_level].address = this->get_page_address(path, page_level);
+        this->path_read_access.emplace_back(std::move(this->path_access[page_level]));
     }
 
     auto path_read_start = std::chrono::high_resolution_clock::now();
-    this->untrusted_memory->batch_access(this->path_access);
-    // this->untrusted_memory->barrier();
+    // the last path write overlaps with the reads
+    this->untrusted_memory->submit_batch_access(this->path_read_access);
+    this->complete_write_back();
+    this->untrusted_memory->complete_batch_access(this->path_read_access);
     auto path_read_end = std::chrono::high_resolution_clock::now();
     this->oram_statistics->add_path_read_time(path_read_end - path_read_start);
 
-    
-    // this->valid_bit_tree_memory->barrier();
+    for (addr_t page_level = shared_page_levels; page_level < this->parameters.page_levels; page_level++) {
+        this->path_access[page_level] = std::move(this->path_read_access[page_level - shared_page_levels]);
+    }
 
     // decrypt path
     auto crypto_start = std::chrono::steady_clock::now();
-    for (addr_t page_level = 0; page_level < this->parameters.page_levels; page_level++) {
+    for (addr_t page_level = shared_page_levels; page_level < this->parameters.page_levels; page_level++) {
         // prepare counter
-        addr_t current_level_offset = path >> (this->parameters.levels - 1 - page_level * this->parameters.levels_per_page);
         addr_t counter;
         if (page_level == 0) {
             counter = this->root_counter;
         } else {
-            counter = get_counter(page_level - 1, current_level_offset % (1UL << this->parameters.levels_per_page));
+            counter = get_counter(page_level - 1, this->get_child_index(path, page_level));
         }
         
         // prepare nonce
@@ -902,22 +955,22 @@ BinaryPathOram2::read_path(uint64_t path) {
 
 void 
 BinaryPathOram2::evict_and_write_path() {
-    this->oram_statistics->increment_path_write();
-    addr_t path = this->currently_loaded_path.value();
     // evict blocks
     for (addr_t i = 0; i < this->parameters.levels; i++) {
         addr_t level = this->parameters.levels - 1 - i;
         BlockMetadata *metadata_ptr = this->eviction_metadata_buffer.data();
         byte_t *data_ptr = this->eviction_data_block_buffer.data();
         auto slots_available = this->parameters.blocks_per_bucket;
-        auto num_evicted_from_path = this->try_evict_block_from_path_buffer(slots_available, (this->parameters.levels - 1 - level), this->currently_loaded_path.value(), metadata_ptr, data_ptr, level);
+        // a block can go to this level if its path agrees on every level above
+        const addr_t ignored_bits = (this->parameters.levels - 1 - level) * this->parameters.tree_bits;
+        auto num_evicted_from_path = this->try_evict_block_from_path_buffer(slots_available, ignored_bits, this->currently_loaded_path.value(), metadata_ptr, data_ptr, level);
         metadata_ptr += num_evicted_from_path;
         // std::cout << absl::StreamFormat("%lu blocks evicted from path\n", num_evicted_from_path);
         data_ptr += (num_evicted_from_path * this->parameters.block_size);
         slots_available -= num_evicted_from_path;
 
         auto stash_access_start = std::chrono::high_resolution_clock::now();
-        auto num_evicted_from_stash = this->stash.try_evict_blocks(slots_available, (this->parameters.levels - 1 - level), this->currently_loaded_path.value(), metadata_ptr, data_ptr);
+        auto num_evicted_from_stash = this->stash.try_evict_blocks(slots_available, ignored_bits, this->currently_loaded_path.value(), metadata_ptr, data_ptr);
         auto stash_access_end = std::chrono::high_resolution_clock::now();
         // std::cout << absl::StreamFormat("%lu blocks evicted from stash\n", num_evicted_from_stash);
         this->oram_statistics->add_stash_access_time(stash_access_end - stash_access_start);
@@ -941,7 +994,15 @@ BinaryPathOram2::evict_and_write_path() {
         std::cout << absl::StreamFormat("%lu blocks in stash\n", this->stash.size());
     }
 
-    // write path
+    this->write_path();
+}
+
+void 
+BinaryPathOram2::write_path() {
+    this->oram_statistics->increment_path_write();
+    addr_t path = this->currently_loaded_path.value();
+    // normally already completed by the read of this path
+    this->complete_write_back();
 
     // encrypt
     auto crypto_start = std::chrono::steady_clock::now();
@@ -949,24 +1010,23 @@ BinaryPathOram2::evict_and_write_path() {
         
         // prepare counter
         std::uint64_t page_level = this->parameters.page_levels - 1 - i;
-        this->path_access[page_level].type = MemoryRequestType::WRITE;
-        addr_t current_level_offset = path >> (this->parameters.levels - 1 - page_level * this->parameters.levels_per_page);
+        this->write_back_access[page_level].address = this->get_page_address(path, page_level);
         addr_t counter;
         if (page_level == 0) {
             counter = this->root_counter;
         } else {
-            counter = get_counter(page_level - 1, current_level_offset % (1UL << this->parameters.levels_per_page));
+            counter = get_counter(page_level - 1, this->get_child_index(path, page_level));
         }
         counter += 1;
 
         if (page_level == 0) {
             this->root_counter = counter;
         } else {
-            set_counter(page_level - 1, current_level_offset % (1UL << this->parameters.levels_per_page), counter);
+            set_counter(page_level - 1, this->get_child_index(path, page_level), counter);
         }
         
         // prepare nonce
-        std::memcpy(this->nonce_buffer.data() + this->parameters.random_nonce_bytes, &(this->path_access[page_level].address), sizeof(std::uint64_t));
+        std::memcpy(this->nonce_buffer.data() + this->parameters.random_nonce_bytes, &(this->write_back_access[page_level].address), sizeof(std::uint64_t));
         std::memcpy(this->nonce_buffer.data() + this->parameters.random_nonce_bytes + sizeof(std::uint64_t), &counter, sizeof(std::uint64_t));
 
         // encrypt page
@@ -975,21 +1035,114 @@ BinaryPathOram2::evict_and_write_path() {
             this->nonce_buffer.data(),
             this->decrypted_path.data() + page_level * this->parameters.page_size,
             this->parameters.page_size - this->parameters.auth_tag_size,
-            this->path_access[page_level].data.data(),
-            this->path_access[page_level].data.data() + this->parameters.page_size - this->parameters.auth_tag_size
+            this->write_back_access[page_level].data.data(),
+            this->write_back_access[page_level].data.data() + this->parameters.page_size - this->parameters.auth_tag_size
         );
     }
     auto crypto_end = std::chrono::steady_clock::now();
     this->oram_statistics->add_crypto_time(crypto_end - crypto_start);
     auto path_write_start = std::chrono::high_resolution_clock::now();
     
-    this->untrusted_memory->batch_access(this->path_access);
-    // this->untrusted_memory->barrier();
+    // completed by the next path read, or complete_write_back
+    this->untrusted_memory->submit_batch_access(this->write_back_access);
+    this->write_back_in_flight = true;
+    this->last_written_path = path;
     this->currently_loaded_path = std::nullopt;
 
     auto path_write_end = std::chrono::high_resolution_clock::now();
     this->oram_statistics->add_path_write_time(path_write_end - path_write_start);
-    // this->valid_bitfield->batch_access(this->valid_bitfield_access);
+}
+
+void 
+BinaryPathOram2::complete_write_back() const {
+    if (!this->write_back_in_flight) {
+        return;
+    }
+    this->write_back_in_flight = false;
+    this->untrusted_memory->complete_batch_access(this->write_back_access);
+}
+
+uint64_t 
+BinaryPathOram2::max_num_blocks(double max_load_factor) const {
+    uint64_t total_slots = heap_level_start(this->parameters.levels, this->parameters.tree_bits) * this->parameters.blocks_per_bucket;
+    uint64_t max_blocks = static_cast<uint64_t>(std::floor(static_cast<double>(total_slots) * max_load_factor));
+
+    // block indices are stored with a fixed width in the tree
+    if (this->metadata_layout.block_index_size < sizeof(uint64_t)) {
+        max_blocks = std::min(max_blocks, 1UL << (this->metadata_layout.block_index_size * 8));
+    }
+    return max_blocks;
+}
+
+void 
+BinaryPathOram2::grow(uint64_t new_num_blocks, double max_load_factor, unique_memory_t &&new_position_map) {
+    if (new_num_blocks < this->parameters.num_blocks) {
+        throw std::invalid_argument(absl::StrFormat("Can not shrink ORAM from %lu to %lu blocks", this->parameters.num_blocks, new_num_blocks));
+    }
+
+    uint64_t max_blocks = this->max_num_blocks(max_load_factor);
+    if (new_num_blocks > max_blocks) {
+        throw std::invalid_argument(absl::StrFormat(
+            "Tree can hold at most %lu blocks with a load factor of %lf, %lu requested, the ORAM has to be rebuilt",
+            max_blocks, max_load_factor, new_num_blocks
+        ));
+    }
+
+    if (this->currently_loaded_path.has_value()) {
+        throw std::runtime_error("Can not grow ORAM while a path is loaded");
+    }
+
+    const uint64_t path_index_size = this->parameters.path_index_size;
+    const uint64_t old_page_size = this->position_map->page_size();
+    const uint64_t old_entries_per_page = old_page_size / path_index_size;
+    const uint64_t new_page_size = new_position_map->page_size();
+    const uint64_t new_entries_per_page = new_page_size / path_index_size;
+    const uint64_t required_position_map_size = divide_round_up(new_num_blocks, new_entries_per_page) * new_page_size;
+
+    if (new_position_map->size() < required_position_map_size) {
+        throw std::invalid_argument(absl::StrFormat(
+            "Position map of %lu bytes is too small, %lu bytes are needed for %lu blocks",
+            new_position_map->size(), required_position_map_size, new_num_blocks
+        ));
+    }
+
+    std::cout << absl::StreamFormat("Growing ORAM from %lu to %lu blocks\n", this->parameters.num_blocks, new_num_blocks);
+    new_position_map->init();
+
+    // copy existing entries, whole pages at a time if both position maps use the same layout
+    if (new_page_size == old_page_size) {
+        MemoryRequest page_request(MemoryRequestType::READ, 0, old_page_size);
+        uint64_t num_pages = divide_round_up(this->parameters.num_blocks, old_entries_per_page);
+        for (uint64_t page_id = 0; page_id < num_pages; page_id++) {
+            page_request.type = MemoryRequestType::READ;
+            page_request.address = page_id * old_page_size;
+            this->position_map->access(page_request);
+            page_request.type = MemoryRequestType::WRITE;
+            new_position_map->access(page_request);
+        }
+    } else {
+        MemoryRequest entry_request(MemoryRequestType::READ, 0, path_index_size);
+        for (uint64_t i = 0; i < this->parameters.num_blocks; i++) {
+            entry_request.type = MemoryRequestType::READ;
+            entry_request.address = (i / old_entries_per_page) * old_page_size + (i % old_entries_per_page) * path_index_size;
+            this->position_map->access(entry_request);
+            entry_request.type = MemoryRequestType::WRITE;
+            entry_request.address = (i / new_entries_per_page) * new_page_size + (i % new_entries_per_page) * path_index_size;
+            new_position_map->access(entry_request);
+        }
+    }
+
+    // new blocks start out on random paths, the same as after init()
+    MemoryRequest position_map_access(MemoryRequestType::WRITE, 0, path_index_size);
+    for (uint64_t i = this->parameters.num_blocks; i < new_num_blocks; i++) {
+        position_map_access.address = (i / new_entries_per_page) * new_page_size + (i % new_entries_per_page) * path_index_size;
+        uint64_t path = absl::Uniform(this->bit_gen, 0UL, this->num_paths());
+        std::memcpy(position_map_access.data.data(), &path, path_index_size);
+        new_position_map->access(position_map_access);
+    }
+
+    this->position_map = std::move(new_position_map);
+    this->parameters.num_blocks = new_num_blocks;
 }
 
 uint64_t 
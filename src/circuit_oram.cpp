@@ -0,0 +1,255 @@
+#include <circuit_oram.hpp>
+#include <util.hpp>
+#include <memory_loader.hpp>
+#include <conditional_memcpy.hpp>
+#include <absl/strings/str_format.h>
+
+unique_memory_t
+CircuitOram::create(
+    std::string_view name,
+    unique_memory_t &&position_map, unique_memory_t &&untrusted_memory,
+    std::unique_ptr<CryptoModule> &&crypto_module,
+    Parameters parameters,
+    uint64_t max_stash_size,
+    uint64_t evictions_per_access
+) {
+    return std::unique_ptr<Memory>(new CircuitOram(
+        name,
+        std::move(position_map),
+        std::move(untrusted_memory),
+        std::move(crypto_module),
+        new BinaryPathOramStatistics(),
+        parameters,
+        max_stash_size,
+        evictions_per_access
+    ));
+}
+
+CircuitOram::CircuitOram(
+    std::string_view name,
+    unique_memory_t &&position_map, unique_memory_t &&untrusted_memory,
+    std::unique_ptr<CryptoModule> &&crypto_module,
+    BinaryPathOramStatistics *statistics,
+    Parameters parameters,
+    uint64_t max_stash_size,
+    uint64_t evictions_per_access
+) :
+BinaryPathOram2(
+    "CircuitOram", name,
+    std::move(position_map), std::move(untrusted_memory),
+    std::move(crypto_module),
+    statistics,
+    parameters,
+    max_stash_size,
+    false
+),
+evictions_per_access(evictions_per_access),
+eviction_path_gen(std::vector<int64_t>(parameters.levels - 1, 1L << parameters.tree_bits)),
+deepest(parameters.levels),
+target(parameters.levels),
+has_empty_slot(parameters.levels),
+hold_block(parameters.block_size),
+to_write_block(parameters.block_size)
+{}
+
+CircuitOram::CircuitOram(
+    std::string_view type, const toml::table &table,
+    unique_memory_t &&position_map, unique_memory_t &&untrusted_memory,
+    BinaryPathOramStatistics *statistics
+) :
+BinaryPathOram2(type, table, std::move(position_map), std::move(untrusted_memory), statistics),
+evictions_per_access(parse_size(table["evictions_per_access"])),
+eviction_path_gen(table["eviction_path_gen"].as_table()),
+deepest(this->parameters.levels),
+target(this->parameters.levels),
+has_empty_slot(this->parameters.levels),
+hold_block(this->parameters.block_size),
+to_write_block(this->parameters.block_size)
+{}
+
+toml::table
+CircuitOram::to_toml_self() const {
+    auto table = this->BinaryPathOram2::to_toml_self();
+    table.emplace("evictions_per_access", size_to_string(this->evictions_per_access));
+    table.emplace("eviction_path_gen", this->eviction_path_gen.to_toml());
+    return table;
+}
+
+unique_memory_t
+CircuitOram::load_from_disk(const std::filesystem::path &location) {
+    auto table = toml::parse_file((location / "config.toml").string());
+    return CircuitOram::load_from_disk(location, table);
+}
+
+unique_memory_t
+CircuitOram::load_from_disk(const std::filesystem::path &location, const toml::table &table) {
+    unique_memory_t position_map = MemoryLoader::load(location / "position_map");
+    unique_memory_t untrusted_memory = MemoryLoader::load(location / "untrusted_memory");
+
+    CircuitOram *oram = new CircuitOram(
+        "CircuitOram", table,
+        std::move(position_map), std::move(untrusted_memory),
+        new BinaryPathOramStatistics()
+    );
+    oram->stash.load_stash(location);
+
+    return unique_memory_t(oram);
+}
+
+void
+CircuitOram::evict_and_write_path() {
+    // the path that was just read has to be written back anyway, evict along it as well
+    this->evict_along_loaded_path();
+    this->write_path();
+
+    for (uint64_t i = 0; i < this->evictions_per_access; i++) {
+        this->read_path(this->eviction_path_gen.next_path());
+        this->evict_along_loaded_path();
+        this->write_path();
+    }
+
+    if (this->stash.size() > this->stash.capacity() * 3 / 4) {
+        std::cout << absl::StreamFormat("%lu blocks in stash\n", this->stash.size());
+    }
+}
+
+void
+CircuitOram::evict_along_loaded_path() {
+    const uint64_t path = this->currently_loaded_path.value();
+    const int64_t levels = static_cast<int64_t>(this->parameters.levels);
+
+    // find the block that can go the deepest when passing through each level
+    int64_t src = no_level;
+    int64_t goal = -1;
+
+    auto stash_access_start = std::chrono::steady_clock::now();
+    int64_t stash_goal = this->stash.deepest_level(path, this->parameters.levels, this->parameters.tree_bits);
+    auto stash_access_end = std::chrono::steady_clock::now();
+    this->oram_statistics->add_stash_access_time(stash_access_end - stash_access_start);
+
+    conditional_memcpy(stash_goal >= 0, &src, &stash_level, sizeof(int64_t));
+    conditional_memcpy(stash_goal >= 0, &goal, &stash_goal, sizeof(int64_t));
+
+    auto path_scan_start = std::chrono::steady_clock::now();
+    for (int64_t level = 0; level < levels; level++) {
+        this->deepest[level] = no_level;
+        conditional_memcpy(goal >= level, &this->deepest[level], &src, sizeof(int64_t));
+
+        bool has_empty_slot = false;
+        int64_t bucket_goal = this->deepest_level_in_bucket(level, path, &has_empty_slot);
+        this->has_empty_slot[level] = has_empty_slot;
+
+        bool is_deeper = bucket_goal > goal;
+        conditional_memcpy(is_deeper, &goal, &bucket_goal, sizeof(int64_t));
+        conditional_memcpy(is_deeper, &src, &level, sizeof(int64_t));
+    }
+
+    // going from the leaf up, decide which level each picked up block is dropped at
+    int64_t dest = no_level;
+    src = no_level;
+    for (int64_t level = levels - 1; level >= 0; level--) {
+        this->target[level] = no_level;
+
+        bool is_src = (src == level);
+        conditional_memcpy(is_src, &this->target[level], &dest, sizeof(int64_t));
+        conditional_memcpy(is_src, &dest, &no_level, sizeof(int64_t));
+        conditional_memcpy(is_src, &src, &no_level, sizeof(int64_t));
+
+        bool can_receive = (dest == no_level && this->has_empty_slot[level]) || this->target[level] != no_level;
+        bool do_pick = can_receive && this->deepest[level] != no_level;
+        conditional_memcpy(do_pick, &src, &this->deepest[level], sizeof(int64_t));
+        conditional_memcpy(do_pick, &dest, &level, sizeof(int64_t));
+    }
+
+    int64_t stash_target = no_level;
+    conditional_memcpy(src == stash_level, &stash_target, &dest, sizeof(int64_t));
+
+    // single pass from the root down, carrying at most one block at a time
+    const BlockMetadata invalid;
+    this->hold_metadata = invalid;
+    stash_access_start = std::chrono::steady_clock::now();
+    this->stash.conditional_remove_deepest_block(stash_target != no_level, path, this->parameters.levels, &this->hold_metadata, this->hold_block.data(), this->parameters.tree_bits);
+    stash_access_end = std::chrono::steady_clock::now();
+    this->oram_statistics->add_stash_access_time(stash_access_end - stash_access_start);
+    dest = stash_target;
+
+    for (int64_t level = 0; level < levels; level++) {
+        bool do_drop = this->hold_metadata.is_valid() && (dest == level);
+        this->to_write_metadata = invalid;
+        conditional_memcpy(do_drop, &this->to_write_metadata, &this->hold_metadata, block_metadata_size);
+        conditional_memcpy(do_drop, this->to_write_block.data(), this->hold_block.data(), this->parameters.block_size);
+        conditional_memcpy(do_drop, &this->hold_metadata, &invalid, block_metadata_size);
+        conditional_memcpy(do_drop, &dest, &no_level, sizeof(int64_t));
+
+        bool do_pick = this->target[level] != no_level;
+        this->conditional_remove_deepest_from_bucket(do_pick, level, path, &this->hold_metadata, this->hold_block.data());
+        conditional_memcpy(do_pick, &dest, &this->target[level], sizeof(int64_t));
+
+        this->conditional_place_in_bucket(do_drop, level, &this->to_write_metadata, this->to_write_block.data());
+    }
+    auto path_scan_end = std::chrono::steady_clock::now();
+    this->oram_statistics->add_path_scan_time(path_scan_end - path_scan_start);
+}
+
+int64_t
+CircuitOram::deepest_level_in_bucket(uint64_t level, uint64_t path, bool *has_empty_slot) {
+    int64_t deepest = -1;
+    bool empty_found = false;
+    for (uint64_t slot_index = 0; slot_index < this->parameters.blocks_per_bucket; slot_index++) {
+        BlockMetadata metadata = this->metadata_layout.to_block_metadata(this->get_metadata(level, slot_index));
+        int64_t slot_level = static_cast<int64_t>(deepest_common_level(metadata.get_path(), path, this->parameters.levels, this->parameters.tree_bits));
+        bool is_deeper = metadata.is_valid() && slot_level > deepest;
+        conditional_memcpy(is_deeper, &deepest, &slot_level, sizeof(int64_t));
+        empty_found = empty_found || !metadata.is_valid();
+    }
+    *has_empty_slot = empty_found;
+    return deepest;
+}
+
+void
+CircuitOram::conditional_remove_deepest_from_bucket(bool do_remove, uint64_t level, uint64_t path, BlockMetadata *metadata, byte_t *data) {
+    int64_t deepest = -1;
+    uint64_t deepest_slot = 0;
+    for (uint64_t slot_index = 0; slot_index < this->parameters.blocks_per_bucket; slot_index++) {
+        BlockMetadata slot_metadata = this->metadata_layout.to_block_metadata(this->get_metadata(level, slot_index));
+        int64_t slot_level = static_cast<int64_t>(deepest_common_level(slot_metadata.get_path(), path, this->parameters.levels, this->parameters.tree_bits));
+        bool is_deeper = slot_metadata.is_valid() && slot_level > deepest;
+        conditional_memcpy(is_deeper, &deepest, &slot_level, sizeof(int64_t));
+        conditional_memcpy(is_deeper, &deepest_slot, &slot_index, sizeof(uint64_t));
+    }
+
+    const bool f = false;
+    for (uint64_t slot_index = 0; slot_index < this->parameters.blocks_per_bucket; slot_index++) {
+        byte_t *slot_metadata = this->get_metadata(level, slot_index);
+        BlockMetadata slot_block_metadata = this->metadata_layout.to_block_metadata(slot_metadata);
+        bool is_target = do_remove && (deepest >= 0) && (slot_index == deepest_slot);
+        bool block_valid = slot_block_metadata.is_valid();
+
+        conditional_memcpy(is_target, metadata, &slot_block_metadata, block_metadata_size);
+        conditional_memcpy(is_target, data, this->get_data_block(level, slot_index), this->parameters.block_size);
+        conditional_memcpy(is_target, &block_valid, &f, sizeof(bool));
+
+        this->metadata_layout.set_valid(slot_metadata, block_valid);
+    }
+}
+
+void
+CircuitOram::conditional_place_in_bucket(bool do_place, uint64_t level, const BlockMetadata *metadata, const byte_t *data) {
+    bool done = !do_place;
+    for (uint64_t slot_index = 0; slot_index < this->parameters.blocks_per_bucket; slot_index++) {
+        byte_t *slot_metadata = this->get_metadata(level, slot_index);
+        bool is_free = !this->metadata_layout.get_valid(slot_metadata);
+        bool do_copy = (!done) && is_free;
+
+        BlockMetadata slot_block_metadata = this->metadata_layout.to_block_metadata(slot_metadata);
+        conditional_memcpy(do_copy, &slot_block_metadata, metadata, block_metadata_size);
+        this->metadata_layout.from_block_metadata(slot_metadata, slot_block_metadata);
+        conditional_memcpy(do_copy, this->get_data_block(level, slot_index), data, this->parameters.block_size);
+
+        done = done || is_free;
+    }
+
+    if (!done) {
+        throw std::runtime_error(absl::StrFormat("Circuit ORAM eviction found no free slot at level %lu", level));
+    }
+}
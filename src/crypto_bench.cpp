@@ -0,0 +1,177 @@
+#include <crypto_bench.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <cxxopts.hpp>
+#include <absl/strings/str_format.h>
+#include <toml++/toml.h>
+#include <crypto_module.hpp>
+#include <util.hpp>
+
+namespace {
+
+struct CryptoThroughput {
+    uint64_t page_size;
+    // payload bytes per second, the auth tag is not counted
+    double encrypt_bytes_per_second;
+    double decrypt_bytes_per_second;
+};
+
+// times whole batches until min_duration has passed, returns the number of batches per second
+template<typename F>
+double
+batches_per_second(std::chrono::milliseconds min_duration, F &&run_batch) {
+    // one untimed batch to fault in the buffers and expand the key
+    run_batch();
+
+    uint64_t count = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto end = start;
+    while (end - start < min_duration) {
+        run_batch();
+        count++;
+        end = std::chrono::steady_clock::now();
+    }
+    return static_cast<double>(count) * 1e9 / static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+/**
+ * @brief Measures one crypto module on pages of the given sizes, laid out the way the ORAMs store them: the
+ * cipher text followed by the auth tag. Each batch encrypts or decrypts batch_size different pages with
+ * different nonces in one encrypt_batch or decrypt_batch call, like the buckets of a path.
+ */
+std::vector<CryptoThroughput>
+measure_crypto_module(CryptoModule *crypto_module, const std::vector<uint64_t> &page_sizes, uint64_t batch_size, std::chrono::milliseconds min_duration) {
+    std::vector<CryptoThroughput> results;
+
+    bytes_t key(crypto_module->key_size());
+    crypto_module->random(key.data(), key.size());
+
+    for (uint64_t page_size : page_sizes) {
+        if (page_size <= crypto_module->auth_tag_size()) {
+            std::cout << absl::StreamFormat("%s page %lu is too small for the auth tag, skipping\n", crypto_module->name(), page_size);
+            continue;
+        }
+        uint64_t length = page_size - crypto_module->auth_tag_size();
+
+        bytes_t pages(batch_size * page_size);
+        crypto_module->random(pages.data(), pages.size());
+
+        CryptoBatch crypto_batch(crypto_module->nonce_size());
+        // address and counter, same as the ORAMs, the top bytes stay 0
+        bytes_t nonce(crypto_module->nonce_size(), 0);
+        uint64_t random_nonce_bytes = crypto_module->nonce_size() - 2 * sizeof(uint64_t);
+        crypto_module->random(nonce.data(), random_nonce_bytes);
+        for (uint64_t i = 0; i < batch_size; i++) {
+            uint64_t address = i * page_size;
+            std::memcpy(nonce.data() + random_nonce_bytes, &address, sizeof(uint64_t));
+            crypto_batch.add(nonce.data(), pages.data() + i * page_size, pages.data() + i * page_size + length);
+        }
+
+        double encrypt_rate = batches_per_second(min_duration, [&]() {
+            crypto_batch.encrypt(crypto_module, key.data(), length);
+        });
+
+        // decryption is in place, every round restores the cipher text first and the copy is subtracted
+        crypto_batch.encrypt(crypto_module, key.data(), length);
+        bytes_t cipher_text = pages;
+        double decrypt_rate = batches_per_second(min_duration, [&]() {
+            std::memcpy(pages.data(), cipher_text.data(), pages.size());
+            if (!crypto_batch.decrypt(crypto_module, key.data(), length)) {
+                throw std::runtime_error("Benchmark cipher text failed to authenticate");
+            }
+        });
+        double copy_rate = batches_per_second(min_duration, [&]() {
+            std::memcpy(pages.data(), cipher_text.data(), pages.size());
+        });
+        double decrypt_seconds = std::max(1.0 / decrypt_rate - 1.0 / copy_rate, 1e-12);
+
+        CryptoThroughput result;
+        result.page_size = page_size;
+        result.encrypt_bytes_per_second = encrypt_rate * static_cast<double>(batch_size * length);
+        result.decrypt_bytes_per_second = static_cast<double>(batch_size * length) / decrypt_seconds;
+        results.emplace_back(result);
+
+        std::cout << absl::StreamFormat(
+            "%-10s page %6lu: encrypt %7.2f GB/s, decrypt %7.2f GB/s\n",
+            crypto_module->name(), page_size, result.encrypt_bytes_per_second / 1e9, result.decrypt_bytes_per_second / 1e9
+        );
+    }
+
+    return results;
+}
+
+}
+
+int crypto_bench_entry_point(int argc, const char** argv) {
+    cxxopts::Options crypto_bench_options("CryptoBench", "Measures the throughput of the crypto modules on ORAM pages");
+
+    crypto_bench_options.add_options()
+    ("subcommand", "ignore", cxxopts::value<std::string>())
+    ("c,crypto_modules", "Crypto modules to measure", cxxopts::value<std::vector<std::string>>()->default_value("AEGIS256,AEGIS128L,AES256GCM"))
+    ("P,page_sizes", "Page sizes to measure, including the auth tag", cxxopts::value<std::vector<std::string>>()->default_value("512B,4KiB,8KiB,16KiB,32KiB,64KiB"))
+    ("n,batch_size", "Number of pages encrypted or decrypted per call, e.g. the number of buckets on a path", cxxopts::value<uint64_t>()->default_value("16"))
+    ("m,duration", "Minimum time spent on each measurement in milliseconds", cxxopts::value<uint64_t>()->default_value("200"))
+    ("o,output_file", "Write the measurements to this TOML file", cxxopts::value<std::string>())
+    ("h,help", "show help text");
+
+    crypto_bench_options.parse_positional("subcommand");
+
+    auto result = crypto_bench_options.parse(argc, argv);
+
+    if (result.count("subcommand") != 1 || result["subcommand"].as<std::string>() != "crypto_bench") {
+        std::cout << "Incorrect sub command!\n";
+        return -1;
+    }
+
+    if (result.count("help") > 0) {
+        std::cout << crypto_bench_options.help();
+        return 0;
+    }
+
+    uint64_t batch_size = result["batch_size"].as<uint64_t>();
+    if (batch_size == 0) {
+        std::cout << "batch_size has to be at least 1!\n";
+        return -1;
+    }
+    std::chrono::milliseconds min_duration(result["duration"].as<uint64_t>());
+
+    std::vector<uint64_t> page_sizes;
+    for (const auto &page_size : result["page_sizes"].as<std::vector<std::string>>()) {
+        page_sizes.emplace_back(parse_size(page_size));
+    }
+    std::sort(page_sizes.begin(), page_sizes.end());
+
+    toml::table table;
+    for (const auto &crypto_module_name : result["crypto_modules"].as<std::vector<std::string>>()) {
+        std::unique_ptr<CryptoModule> crypto_module;
+        try {
+            crypto_module = get_crypto_module_by_name(crypto_module_name);
+        } catch (const std::runtime_error &e) {
+            // e.g. AES256GCM on a CPU without AES-NI
+            std::cout << absl::StreamFormat("Can not measure %s: %s, skipping\n", crypto_module_name, e.what());
+            continue;
+        }
+
+        auto results = measure_crypto_module(crypto_module.get(), page_sizes, batch_size, min_duration);
+
+        toml::table module_table;
+        for (const auto &measurement : results) {
+            module_table.emplace(std::to_string(measurement.page_size), toml::table{
+                {"encrypt_bytes_per_second", measurement.encrypt_bytes_per_second},
+                {"decrypt_bytes_per_second", measurement.decrypt_bytes_per_second}
+            });
+        }
+        table.emplace(crypto_module->name(), std::move(module_table));
+    }
+
+    if (result.count("output_file") > 0) {
+        table.emplace("batch_size", static_cast<int64_t>(batch_size));
+        std::ofstream output_file(result["output_file"].as<std::string>());
+        output_file << table << std::endl;
+    }
+
+    return 0;
+}
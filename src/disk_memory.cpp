@@ -15,10 +15,22 @@
 
 constexpr int file_mode = O_DIRECT | O_RDWR;
 
-std::filesystem::path disk_memory_temp_file_directory;
+std::vector<std::filesystem::path> disk_memory_temp_file_directories = {"."};
+std::size_t next_disk_memory_temp_file_directory = 0;
 
 void set_disk_memory_temp_file_directory(const std::filesystem::path path) {
-    disk_memory_temp_file_directory = path;
+    // several directories (e.g. one per SSD) can be given separated by commas
+    disk_memory_temp_file_directories.clear();
+    next_disk_memory_temp_file_directory = 0;
+    std::string_view paths(path.native());
+    while (true) {
+        std::size_t comma = paths.find(',');
+        disk_memory_temp_file_directories.emplace_back(paths.substr(0, comma));
+        if (comma == std::string_view::npos) {
+            break;
+        }
+        paths.remove_prefix(comma + 1);
+    }
 }
 
 uint64_t additional_cache = 0;
@@ -28,6 +40,10 @@ void set_additional_cache_amount(uint64_t cache) {
 }
 
 static std::filesystem::path generate_temp_file_path() {
+    // spread new files over the temp directories round robin
+    const std::filesystem::path &disk_memory_temp_file_directory = disk_memory_temp_file_directories[next_disk_memory_temp_file_directory];
+    next_disk_memory_temp_file_directory = (next_disk_memory_temp_file_directory + 1) % disk_memory_temp_file_directories.size();
+
     std::filesystem::path temp_file_path;
     do {
         // keep generating new file names until we find one that isn't being used
@@ -545,15 +561,15 @@ io_context(io_context),
 fd(fd),
 file_size(size),
 _page_size(page_size),
-fs_block_size(fs_block_size),
-allocated_buffer_size(0),
-buffer(nullptr)
+fs_block_size(fs_block_size)
 {}
 
 BlockDiskMemoryLibAIO::~BlockDiskMemoryLibAIO() noexcept {
     io_destroy(this->io_context);
     close(this->fd);
-    std::free(this->buffer);
+    for (auto &batch : this->batches) {
+        std::free(batch->buffer);
+    }
     try{
         std::filesystem::remove(this->file_location);
     } catch (...){
@@ -581,6 +597,12 @@ BlockDiskMemoryLibAIO::access(MemoryRequest &request) {
 
 void 
 BlockDiskMemoryLibAIO::batch_access(std::vector<MemoryRequest> &requests) {
+    this->submit_batch_access(requests);
+    this->complete_batch_access(requests);
+}
+
+void 
+BlockDiskMemoryLibAIO::submit_batch_access(std::vector<MemoryRequest> &requests) {
 
     // check that all requests are page-aligned
     for (const auto &request : requests) {
@@ -593,25 +615,32 @@ BlockDiskMemoryLibAIO::batch_access(std::vector<MemoryRequest> &requests) {
         this->Memory::log_request(request);
     }
 
-    // set up async io for the batch
-    // std::vector<aiocb> aio_control_blocks;
+    // find a free slot, other batches may still be in flight
+    InFlightBatch *batch = nullptr;
+    for (auto &slot : this->batches) {
+        if (slot->requests == nullptr) {
+            batch = slot.get();
+            break;
+        }
+    }
+    if (batch == nullptr) {
+        batch = this->batches.emplace_back(std::make_unique<InFlightBatch>()).get();
+    }
 
-    if (requests.size() > this->allocated_buffer_size) {
-        this->io_control_blocks.resize(requests.size());
-        this->io_control_block_pointers.resize(requests.size());
-        this->io_events.resize(requests.size());
-        std::free(this->buffer);
-        this->buffer = static_cast<char*>(std::aligned_alloc(this->fs_block_size, requests.size() * this->_page_size));
+    if (requests.size() > batch->allocated_buffer_size) {
+        batch->io_control_blocks.resize(requests.size());
+        batch->io_control_block_pointers.resize(requests.size());
+        std::free(batch->buffer);
+        batch->buffer = static_cast<char*>(std::aligned_alloc(this->fs_block_size, requests.size() * this->_page_size));
 
         for (std::size_t i = 0; i < requests.size(); i++) {
-            this->io_control_block_pointers[i] = &(this->io_control_blocks[i]);
+            batch->io_control_block_pointers[i] = &(batch->io_control_blocks[i]);
         }
 
-        this->allocated_buffer_size = requests.size();
+        batch->allocated_buffer_size = requests.size();
     }
 
-    // unsigned char *request_buffers = (unsigned char *)aligned_alloc(this->fs_block_size, requests.size() * this->fs_block_size);
-    memset(this->buffer, 0, requests.size() * this->_page_size);
+    memset(batch->buffer, 0, requests.size() * this->_page_size);
 
     uint64_t buffer_offset = 0;
     uint64_t read_page_count = 0;
@@ -620,14 +649,16 @@ BlockDiskMemoryLibAIO::batch_access(std::vector<MemoryRequest> &requests) {
         auto &request = requests[i];
 
         if (request.type == MemoryRequestType::READ) {
-            io_prep_pread(&(this->io_control_blocks[i]), this->fd, this->buffer + buffer_offset, this->_page_size, request.address);
+            io_prep_pread(&(batch->io_control_blocks[i]), this->fd, batch->buffer + buffer_offset, this->_page_size, request.address);
         } else {
-            io_prep_pwrite(&(this->io_control_blocks[i]), this->fd, this->buffer + buffer_offset, this->_page_size, request.address);
+            io_prep_pwrite(&(batch->io_control_blocks[i]), this->fd, batch->buffer + buffer_offset, this->_page_size, request.address);
         }
+        // completions of all batches arrive on the same context, this tells them apart
+        batch->io_control_blocks[i].data = batch;
 
         if (request.type != MemoryRequestType::READ) {
             // copy write requests into the buffer
-            memcpy(this->buffer + buffer_offset, request.data.data(), this->_page_size);
+            memcpy(batch->buffer + buffer_offset, request.data.data(), this->_page_size);
             write_page_count++;
         } else {
             read_page_count++;
@@ -636,46 +667,75 @@ BlockDiskMemoryLibAIO::batch_access(std::vector<MemoryRequest> &requests) {
         buffer_offset += this->_page_size; // increment buffer
     }
 
-    int ret_value = io_submit(this->io_context, requests.size(), this->io_control_block_pointers.data());
+    int ret_value = io_submit(this->io_context, requests.size(), batch->io_control_block_pointers.data());
     if (ret_value < 0 ){
         throw std::runtime_error(absl::StrFormat("io_submit failed with code %d: %s", -ret_value, strerror(-ret_value)));
     }
+    batch->requests = &requests;
+    batch->outstanding = requests.size();
+    batch->failed = 0;
 
-    // wait for completion
-    ret_value = io_getevents(this->io_context, requests.size(), requests.size(), this->io_events.data(), NULL);
-    if (ret_value < 0 ){
-        throw std::runtime_error(absl::StrFormat("io_getevents failed with code %d: %s", -ret_value, strerror(-ret_value)));
+    this->statistics->add_read_write(
+        read_page_count * this->_page_size,
+        write_page_count * this->_page_size
+    );
+}
+
+void 
+BlockDiskMemoryLibAIO::complete_batch_access(std::vector<MemoryRequest> &requests) {
+    InFlightBatch *batch = nullptr;
+    for (auto &slot : this->batches) {
+        if (slot->requests == &requests) {
+            batch = slot.get();
+            break;
+        }
+    }
+    if (batch == nullptr) {
+        throw std::runtime_error("complete_batch_access called on requests that were not submitted");
     }
 
-    std::size_t fail_count = 0;
-    for (std::size_t i = 0; i < requests.size(); i++) {
-        auto &event = this->io_events[i];
-        if (event.res != this->page_size()) {
-            size_t index = (event.obj - this->io_control_blocks.data()) / sizeof(struct iocb);
-            std::cout << absl::StreamFormat("IO request %lu failed, returned %lu bytes out of expected %lu\n", index, event.res, this->page_size());
-            fail_count++;
+    // wait for completion, events of other batches in flight are counted against their own batch
+    while (batch->outstanding > 0) {
+        uint64_t in_flight = 0;
+        for (const auto &slot : this->batches) {
+            in_flight += slot->outstanding;
+        }
+        if (this->io_events.size() < in_flight) {
+            this->io_events.resize(in_flight);
+        }
+
+        int ret_value = io_getevents(this->io_context, 1, in_flight, this->io_events.data(), NULL);
+        if (ret_value < 0 ){
+            throw std::runtime_error(absl::StrFormat("io_getevents failed with code %d: %s", -ret_value, strerror(-ret_value)));
+        }
+
+        for (int i = 0; i < ret_value; i++) {
+            auto &event = this->io_events[i];
+            InFlightBatch *owner = static_cast<InFlightBatch*>(event.data);
+            owner->outstanding--;
+            if (event.res != this->page_size()) {
+                size_t index = event.obj - owner->io_control_blocks.data();
+                std::cout << absl::StreamFormat("IO request %lu failed, returned %lu bytes out of expected %lu\n", index, event.res, this->page_size());
+                owner->failed++;
+            }
         }
     }
+    batch->requests = nullptr;
 
-    if (fail_count > 0) {
+    if (batch->failed > 0) {
         std::cout.flush();
         throw std::runtime_error("Some IO requests failed!");
     }
 
     // now we will finish the read requests
-    buffer_offset = 0UL;
+    uint64_t buffer_offset = 0UL;
     for (auto &request : requests) {
         if (request.type == MemoryRequestType::READ) {
-            char *buffer = this->buffer + buffer_offset;
+            char *buffer = batch->buffer + buffer_offset;
             memcpy(request.data.data(), buffer, this->_page_size);
         }
         buffer_offset += this->_page_size;
     }
-
-    this->statistics->add_read_write(
-        read_page_count * this->_page_size,
-        write_page_count * this->_page_size
-    );
 }
 
 void 
@@ -56,8 +56,9 @@ int trace_runner_entry_point(int argc, const char** argv){
     ("l,log", "Enable access logging", cxxopts::value<bool>()->default_value("false"))
     ("v,verbose", "Enable verbose output.", cxxopts::value<bool>()->default_value("false"))
     ("V, verify", "Check contents.", cxxopts::value<bool>()->default_value("false"))
-    ("d, temp_dir", "Change directory where temp files for disk memory are stored.", cxxopts::value<std::string>()->default_value("."))
+    ("d, temp_dir", "Change directory where temp files for disk memory are stored, separate several directories with commas.", cxxopts::value<std::string>()->default_value("."))
     ("T, threads", "Number of threads to run.", cxxopts::value<std::size_t>()->default_value("1"))
+    ("B, batch_size", "Number of requests handed to the memory in each batch_access call.", cxxopts::value<std::size_t>()->default_value("1"))
     ("s, stat_file", "File dump stats.", cxxopts::value<std::string>())
     ("h,help", "show help text");
 
@@ -86,6 +87,7 @@ int trace_runner_entry_point(int argc, const char** argv){
     bool verbose = result["verbose"].as<bool>();
     bool verify = result["verify"].as<bool>();
     const std::size_t num_threads = result["threads"].as<std::size_t>();
+    const std::size_t batch_size = std::max<std::size_t>(1, result["batch_size"].as<std::size_t>());
 
     // std::cout << absl::StrFormat("Temp dir set to %s\n", temp_dir.c_str());
     
@@ -125,7 +127,7 @@ int trace_runner_entry_point(int argc, const char** argv){
     {
         std::vector<std::jthread> threads;
         for (std::size_t i = 0; i < num_threads; i++) {
-            threads.emplace_back([&limit, &verify, &verbose](std::stop_token stop_token, RunnerInfo *info) {
+            threads.emplace_back([&limit, &verify, &verbose, &batch_size](std::stop_token stop_token, RunnerInfo *info) {
                 timer::time_point start, stop;
                 timer::time_point end_last_access;
 
@@ -135,34 +137,67 @@ int trace_runner_entry_point(int argc, const char** argv){
                 start = timer::now();
                 end_last_access = start;
 
-                MemoryRequest request;
-                
-                for (info->actual_count = 0; info->actual_count < limit; info->actual_count++){
-                    if (!(info->request_stream->next())) {
+                std::vector<MemoryRequest> batch(batch_size);
+
+                for (info->actual_count = 0; info->actual_count < limit;){
+                    // gather the next batch, a batch size of 1 issues requests one at a time
+                    batch.resize(batch_size);
+                    std::size_t batch_count = 0;
+                    while (batch_count < batch_size && info->actual_count + batch_count < limit && info->request_stream->next()) {
+                        info->request_stream->inplace_get(batch[batch_count]);
+                        batch_count++;
+                    }
+
+                    if (batch_count == 0) {
                         break;
                     }
 
-                    info->request_stream->inplace_get(request);
-
-                    info->memory->access(request);
-                    
-                    if (verify) {
-                        uint64_t value;
-                        if (request.size >= 8) {
-                            value = *(uint64_t *)request.data.data();
-                        } else if (request.size >= 4) {
-                            value = *(uint32_t *)request.data.data();
-                        } else if (request.size >= 2) {
-                            value = *(uint16_t *)request.data.data();
-                        } else {
-                            value = *(uint8_t *)request.data.data();
-                        }
+                    if (batch_size == 1) {
+                        info->memory->access(batch[0]);
+                    } else {
+                        batch.resize(batch_count);
+                        info->memory->batch_access(batch);
+                    }
 
+                    for (std::size_t i = 0; i < batch_count; i++) {
+                        const MemoryRequest &request = batch[i];
+                        if (verify) {
+                            uint64_t value;
+                            if (request.size >= 8) {
+                                value = *(uint64_t *)request.data.data();
+                            } else if (request.size >= 4) {
+                                value = *(uint32_t *)request.data.data();
+                            } else if (request.size >= 2) {
+                                value = *(uint16_t *)request.data.data();
+                            } else {
+                                value = *(uint8_t *)request.data.data();
+                            }
+
+
+                            if (value == (request.address / request.size)) {
+                                info->correct_count++;
+                            } else {
+                                std::cout << absl::StrFormat("@ 0x%08lX, Expecting %lu got %lu\n", request.address, request.address / request.size, value);
+                            }
+                        }
 
-                        if (value == (request.address / request.size)) {
-                            info->correct_count++;
-                        } else {
-                            std::cout << absl::StrFormat("@ 0x%08lX, Expecting %lu got %lu\n", request.address, request.address / request.size, value);
+                        if (verbose) {
+                            std::string_view long_op_type;
+                            switch (request.type) {
+                                case MemoryRequestType::READ:
+                                    long_op_type = "R";
+                                    break;
+                                case MemoryRequestType::WRITE:
+                                    long_op_type = "W";
+                                    break;
+                                case MemoryRequestType::READ_WRITE:
+                                    long_op_type = "RW";
+                                    break;
+                                default:
+                                    long_op_type = "UNKNOWN";
+                                    break;
+                            }
+                            std::cout << absl::StrFormat("%lu %s 0x%08lX %lu bytes\n", info->actual_count + i, long_op_type, request.address, request.size);
                         }
                     }
 
@@ -170,24 +205,7 @@ int trace_runner_entry_point(int argc, const char** argv){
                     // access_times.emplace_back(std::chrono::duration<int64_t, std::nano>(current_time - end_last_access).count());
                     end_last_access = current_time;
 
-                    if (verbose) {
-                        std::string_view long_op_type;
-                        switch (request.type) {
-                            case MemoryRequestType::READ:
-                                long_op_type = "R";
-                                break;
-                            case MemoryRequestType::WRITE:
-                                long_op_type = "W";
-                                break;
-                            case MemoryRequestType::READ_WRITE:
-                                long_op_type = "RW";
-                                break;
-                            default:
-                                long_op_type = "UNKNOWN";
-                                break;
-                        }
-                        std::cout << absl::StrFormat("%lu %s 0x%08lX %lu bytes\n", info->actual_count, long_op_type, request.address, request.size);
-                    }
+                    info->actual_count += batch_count;
                 }
                 
                 stop = timer::now();
@@ -1,5 +1,6 @@
 #include <eviction_path_generator.hpp>
 #include <util.hpp>
+#include <algorithm>
 
 EvictionPathGenerator::EvictionPathGenerator(std::vector<int64_t> &&level_sizes) :
 level_sizes(std::move(level_sizes)),
@@ -37,6 +38,11 @@ EvictionPathGenerator::next_path(){
     return path;
 }
 
+void 
+EvictionPathGenerator::reset() {
+    std::fill(this->level_indices.begin(), this->level_indices.end(), 0);
+}
+
 toml::table 
 EvictionPathGenerator::to_toml() const {
     toml::table table;
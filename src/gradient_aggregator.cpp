@@ -0,0 +1,179 @@
+#include <gradient_aggregator.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <xmmintrin.h>
+#include <absl/random/random.h>
+#include <absl/strings/str_format.h>
+#include <conditional_memcpy.hpp>
+#include <vector_ops.hpp>
+
+namespace {
+
+// flush-to-zero is bit 15 of MXCSR, denormals-are-zero bit 6
+constexpr unsigned int flush_denormals_bits = 0x8040;
+
+std::uint64_t
+weight_size_of(GradientPrecision precision) {
+    return precision == GradientPrecision::FP32 ? sizeof(float) : sizeof(std::uint16_t);
+}
+
+std::uint64_t
+optimizer_state_floats(GradientOptimizer optimizer, std::uint64_t dimension) {
+    switch (optimizer) {
+        case GradientOptimizer::ADAGRAD: return dimension;
+        // both moments and the step count
+        case GradientOptimizer::ADAM: return 2 * dimension + 1;
+        default: return 0;
+    }
+}
+
+// the most weights that fit into the entry together with their optimizer state, and whose FP32 accumulator
+// fits into the entry_size bytes the buffers keep for the gradient
+std::uint64_t
+dimension_of(std::uint64_t entry_size, const GradientAggregationConfig &config) {
+    std::uint64_t fixed_state_size = sizeof(float) * optimizer_state_floats(config.optimizer, 0);
+    std::uint64_t size_per_weight = weight_size_of(config.precision) + sizeof(float) * optimizer_state_floats(config.optimizer, 1) - fixed_state_size;
+    if (entry_size <= fixed_state_size) {
+        return 0;
+    }
+    return std::min((entry_size - fixed_state_size) / size_per_weight, entry_size / sizeof(float));
+}
+
+}
+
+GradientPrecision
+gradient_precision_from_name(const std::string &name) {
+    if (name == "FP32") {
+        return GradientPrecision::FP32;
+    } else if (name == "BF16") {
+        return GradientPrecision::BF16;
+    }
+    throw std::invalid_argument(absl::StrFormat("Unknown gradient precision \"%s\", has to be FP32 or BF16", name));
+}
+
+GradientOptimizer
+gradient_optimizer_from_name(const std::string &name) {
+    if (name == "FedAvg") {
+        return GradientOptimizer::FED_AVG;
+    } else if (name == "Adagrad") {
+        return GradientOptimizer::ADAGRAD;
+    } else if (name == "Adam") {
+        return GradientOptimizer::ADAM;
+    }
+    throw std::invalid_argument(absl::StrFormat("Unknown optimizer \"%s\", has to be FedAvg, Adagrad or Adam", name));
+}
+
+FlushDenormalsScope::FlushDenormalsScope() :
+saved_mxcsr(_mm_getcsr())
+{
+    if ((this->saved_mxcsr & flush_denormals_bits) != flush_denormals_bits) {
+        _mm_setcsr(this->saved_mxcsr | flush_denormals_bits);
+    }
+}
+
+FlushDenormalsScope::~FlushDenormalsScope() {
+    if (_mm_getcsr() != this->saved_mxcsr) {
+        _mm_setcsr(this->saved_mxcsr);
+    }
+}
+
+GradientAggregator::GradientAggregator(
+    std::uint64_t entry_size,
+    const GradientAggregationConfig &config
+) :
+config(config),
+entry_size(entry_size),
+weight_size(weight_size_of(config.precision)),
+_dimension(dimension_of(entry_size, config)),
+updated_entry(entry_size),
+weights(this->_dimension),
+average_gradient(this->_dimension),
+optimizer_state(optimizer_state_floats(config.optimizer, this->_dimension)),
+bf16_weights(this->_dimension)
+{
+    if (this->_dimension == 0) {
+        throw std::invalid_argument(absl::StrFormat("Entries of %lu bytes are too small for one weight and its optimizer state", entry_size));
+    }
+
+    absl::BitGen bit_gen;
+    this->client_gradient.resize(this->_dimension);
+    this->client_gradient[0] = 1.0f;
+    for (std::uint64_t i = 1; i < this->_dimension; i++) {
+        this->client_gradient[i] = absl::Uniform(bit_gen, -0.01f, 0.01f);
+    }
+
+    // BF16 clients send rounded gradients, they are widened once per request and not in every scanned slot
+    if (this->config.precision == GradientPrecision::BF16) {
+        vector_f_to_bf16(this->bf16_weights.data(), this->client_gradient.data(), this->_dimension);
+        vector_bf16_to_f(this->client_gradient.data(), this->bf16_weights.data(), this->_dimension);
+    }
+}
+
+void
+GradientAggregator::accumulate(bool enable, byte_t *accumulator) const {
+    FlushDenormalsScope denormals;
+    vector_masked_add_f(reinterpret_cast<float *>(accumulator), this->client_gradient.data(), this->_dimension, enable);
+}
+
+void
+GradientAggregator::apply(byte_t *entry, const byte_t *accumulator, std::uint16_t count) {
+    FlushDenormalsScope denormals;
+    std::memcpy(this->updated_entry.data(), entry, this->entry_size);
+
+    const std::uint64_t weights_bytes = this->_dimension * this->weight_size;
+    if (this->config.precision == GradientPrecision::FP32) {
+        std::memcpy(this->weights.data(), this->updated_entry.data(), weights_bytes);
+    } else {
+        std::memcpy(this->bf16_weights.data(), this->updated_entry.data(), weights_bytes);
+        vector_bf16_to_f(this->weights.data(), this->bf16_weights.data(), this->_dimension);
+    }
+    const std::uint64_t state_bytes = this->optimizer_state.size() * sizeof(float);
+    std::memcpy(this->optimizer_state.data(), this->updated_entry.data() + weights_bytes, state_bytes);
+
+    // FedAvg, an empty accumulator is averaged over 1 instead of branching, the result is dropped below
+    std::memcpy(this->average_gradient.data(), accumulator, this->_dimension * sizeof(float));
+    float divisor = static_cast<float>(count) + static_cast<float>(count == 0);
+    vector_scale_f(this->average_gradient.data(), 1.0f / divisor, this->_dimension);
+
+    switch (this->config.optimizer) {
+        case GradientOptimizer::FED_AVG:
+            vector_scaled_add_f(this->weights.data(), this->average_gradient.data(), -this->config.learning_rate, this->_dimension);
+            break;
+        case GradientOptimizer::ADAGRAD:
+            vector_adagrad_step_f(
+                this->weights.data(), this->optimizer_state.data(), this->average_gradient.data(),
+                this->config.learning_rate, epsilon, this->_dimension
+            );
+            break;
+        case GradientOptimizer::ADAM: {
+            float &step = this->optimizer_state[2 * this->_dimension];
+            step += 1.0f;
+            vector_adam_step_f(
+                this->weights.data(), this->optimizer_state.data(), this->optimizer_state.data() + this->_dimension,
+                this->average_gradient.data(), this->config.learning_rate, beta1, beta2, epsilon,
+                1.0f - std::pow(beta1, step), 1.0f - std::pow(beta2, step), this->_dimension
+            );
+            break;
+        }
+    }
+
+    if (this->config.precision == GradientPrecision::FP32) {
+        std::memcpy(this->updated_entry.data(), this->weights.data(), weights_bytes);
+    } else {
+        vector_f_to_bf16(this->bf16_weights.data(), this->weights.data(), this->_dimension);
+        std::memcpy(this->updated_entry.data(), this->bf16_weights.data(), weights_bytes);
+    }
+    std::memcpy(this->updated_entry.data() + weights_bytes, this->optimizer_state.data(), state_bytes);
+
+    conditional_memcpy(count != 0, entry, this->updated_entry.data(), this->entry_size);
+}
+
+bool
+GradientAggregator::is_valid(const byte_t *accumulator, std::uint16_t count) const {
+    float first;
+    std::memcpy(&first, accumulator, sizeof(float));
+    return first == static_cast<float>(count);
+}
@@ -17,6 +17,12 @@
 #include <page_optimized_raw_oram.hpp>
 #include <eviction_path_generator.hpp>
 #include <recsys_sim.hpp>
+#include <stash_simulator.hpp>
+#include <parameter_advisor.hpp>
+#include <crypto_bench.hpp>
+#include <union_bench.hpp>
+#include <oblivious_bench.hpp>
+#include <recsys_server.hpp>
 
 #include <cxxopts.hpp>
 
@@ -28,8 +34,17 @@ int scratch_pad(int argc, const char** argv);
 
 std::unordered_map<std::string, int (*)(int, const char**)> subcommand_entry_points = {
     {"create", create_oram_entry_point},
+    {"resize", resize_oram_entry_point},
+    {"rebuild", rebuild_oram_entry_point},
     {"run_trace", trace_runner_entry_point},
-    {"recsys_sim", recsys_sim_entry_point}
+    {"recsys_sim", recsys_sim_entry_point},
+    {"simulate_stash", simulate_stash_entry_point},
+    {"advise", advise_entry_point},
+    {"crypto_bench", crypto_bench_entry_point},
+    {"union_bench", union_bench_entry_point},
+    {"oblivious_bench", oblivious_bench_entry_point},
+    {"recsys_server", recsys_server_entry_point},
+    {"recsys_load", recsys_load_entry_point}
 };
 
 int main(int argc, char** argv) {
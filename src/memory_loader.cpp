@@ -10,6 +10,9 @@
 #include "cache.hpp"
 #include <page_optimized_raw_oram.hpp>
 #include <binary_path_oram_2.hpp>
+#include <ring_oram.hpp>
+#include <circuit_oram.hpp>
+#include <sharded_oram.hpp>
 
 #include <absl/strings/str_format.h>
 
@@ -28,7 +31,10 @@ std::unordered_map<std::string, unique_memory_t (*)(const std::filesystem::path
     {"BlockDiskMemoryLibAIO", BlockDiskMemoryLibAIO::load_from_disk},
     {"BinaryPathOram2", BinaryPathOram2::load_from_disk},
     {"LinearScannedMemory", LinearScannedMemory::load_from_disk},
-    {"BlockDiskMemoryLibAIOCached", BlockDiskMemoryLibAIOCached::load_from_disk}
+    {"BlockDiskMemoryLibAIOCached", BlockDiskMemoryLibAIOCached::load_from_disk},
+    {"RingOram", RingOram::load_from_disk},
+    {"CircuitOram", CircuitOram::load_from_disk},
+    {"ShardedOram", ShardedOram::load_from_disk}
 };
 
 unique_memory_t MemoryLoader::load(const std::filesystem::path &location) {
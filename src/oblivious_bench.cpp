@@ -0,0 +1,172 @@
+#include <oblivious_bench.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <vector>
+#include <cxxopts.hpp>
+#include <absl/random/random.h>
+#include <absl/strings/str_format.h>
+#include <toml++/toml.h>
+#include <oblivious.hpp>
+#include <util.hpp>
+
+namespace {
+
+struct PrimitiveTiming {
+    std::string primitive;
+    uint64_t count;
+    double seconds;
+};
+
+// runs the primitive until min_duration has passed, at least once, returns the mean time of one run
+template<typename F>
+double
+seconds_per_run(std::chrono::milliseconds min_duration, F &&run) {
+    uint64_t count = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto end = start;
+    do {
+        run();
+        count++;
+        end = std::chrono::steady_clock::now();
+    } while (end - start < min_duration);
+    return std::chrono::duration<double>(end - start).count() / static_cast<double>(count);
+}
+
+/**
+ * @brief Times every primitive of oblivious.hpp on random elements of every count. The primitives do the same
+ * work for any input, so the arrays are reused between runs without being refilled.
+ */
+template <oblivious::SortKey Key, std::size_t PayloadSize>
+std::vector<PrimitiveTiming>
+measure_primitives(const std::vector<uint64_t> &counts, std::chrono::milliseconds min_duration, absl::BitGen &bit_gen) {
+    std::vector<PrimitiveTiming> results;
+    for (uint64_t count : counts) {
+        std::vector<Key> keys(count);
+        bytes_t payloads(count * PayloadSize);
+        std::vector<std::uint8_t> marks(count);
+        for (uint64_t i = 0; i < count; i++) {
+            keys[i] = absl::Uniform<Key>(bit_gen);
+            marks[i] = absl::Uniform(bit_gen, 0, 2);
+        }
+        for (auto &byte : payloads) {
+            byte = absl::Uniform<byte_t>(bit_gen);
+        }
+
+        results.emplace_back("bitonic_sort", count, seconds_per_run(min_duration, [&]() {
+            oblivious::bitonic_sort<Key, PayloadSize>(keys.data(), payloads.data(), count);
+        }));
+        results.emplace_back("odd_even_merge_sort", count, seconds_per_run(min_duration, [&]() {
+            oblivious::odd_even_merge_sort<Key, PayloadSize>(keys.data(), payloads.data(), count);
+        }));
+        results.emplace_back("compact", count, seconds_per_run(min_duration, [&]() {
+            oblivious::compact<Key, PayloadSize>(keys.data(), payloads.data(), marks.data(), count);
+        }));
+
+        Key key = 0;
+        bytes_t payload(PayloadSize);
+        results.emplace_back("select", count, seconds_per_run(min_duration, [&]() {
+            oblivious::select<Key, PayloadSize>(keys.data(), payloads.data(), count, absl::Uniform(bit_gen, 0UL, count), key, payload.data());
+        }));
+    }
+    return results;
+}
+
+template <oblivious::SortKey Key>
+std::vector<PrimitiveTiming>
+measure_primitives(uint64_t payload_size, const std::vector<uint64_t> &counts, std::chrono::milliseconds min_duration, absl::BitGen &bit_gen) {
+    switch (payload_size) {
+        case 0: return measure_primitives<Key, 0>(counts, min_duration, bit_gen);
+        case 4: return measure_primitives<Key, 4>(counts, min_duration, bit_gen);
+        case 8: return measure_primitives<Key, 8>(counts, min_duration, bit_gen);
+        case 16: return measure_primitives<Key, 16>(counts, min_duration, bit_gen);
+        case 32: return measure_primitives<Key, 32>(counts, min_duration, bit_gen);
+        case 64: return measure_primitives<Key, 64>(counts, min_duration, bit_gen);
+        default:
+            throw std::invalid_argument(absl::StrFormat("Payload size %lu is not one of 0, 4, 8, 16, 32 or 64", payload_size));
+    }
+}
+
+}
+
+int oblivious_bench_entry_point(int argc, const char** argv) {
+    cxxopts::Options oblivious_bench_options("ObliviousBench", "Measures the oblivious sort, compaction and select primitives");
+
+    oblivious_bench_options.add_options()
+    ("subcommand", "ignore", cxxopts::value<std::string>())
+    ("c,counts", "Number of elements", cxxopts::value<std::vector<std::string>>()->default_value("1Ki,16Ki,256Ki"))
+    ("k,key_bits", "Key widths to measure, 32 or 64", cxxopts::value<std::vector<uint64_t>>()->default_value("32,64"))
+    ("p,payload_sizes", "Payload sizes in bytes to measure, 0, 4, 8, 16, 32 or 64", cxxopts::value<std::vector<uint64_t>>()->default_value("0,8,64"))
+    ("m,duration", "Minimum time spent on each measurement in milliseconds", cxxopts::value<uint64_t>()->default_value("200"))
+    ("o,output_file", "Write the measurements to this TOML file", cxxopts::value<std::string>())
+    ("h,help", "show help text");
+
+    oblivious_bench_options.parse_positional("subcommand");
+
+    auto result = oblivious_bench_options.parse(argc, argv);
+
+    if (result.count("subcommand") != 1 || result["subcommand"].as<std::string>() != "oblivious_bench") {
+        std::cout << "Incorrect sub command!\n";
+        return -1;
+    }
+
+    if (result.count("help") > 0) {
+        std::cout << oblivious_bench_options.help();
+        return 0;
+    }
+
+    std::chrono::milliseconds min_duration(result["duration"].as<uint64_t>());
+    std::vector<uint64_t> counts;
+    for (const auto &count : result["counts"].as<std::vector<std::string>>()) {
+        counts.emplace_back(parse_size(count));
+    }
+    std::sort(counts.begin(), counts.end());
+
+    absl::BitGen bit_gen;
+    toml::table table;
+    for (uint64_t key_bits : result["key_bits"].as<std::vector<uint64_t>>()) {
+        if (key_bits != 32 && key_bits != 64) {
+            std::cout << absl::StreamFormat("Key width %lu is not 32 or 64!\n", key_bits);
+            return -1;
+        }
+        for (uint64_t payload_size : result["payload_sizes"].as<std::vector<uint64_t>>()) {
+            std::vector<PrimitiveTiming> timings;
+            try {
+                if (key_bits == 32) {
+                    timings = measure_primitives<std::uint32_t>(payload_size, counts, min_duration, bit_gen);
+                } else {
+                    timings = measure_primitives<std::uint64_t>(payload_size, counts, min_duration, bit_gen);
+                }
+            } catch (const std::invalid_argument &e) {
+                std::cout << e.what() << "!\n";
+                return -1;
+            }
+
+            std::string configuration = absl::StrFormat("key%lu_payload%lu", key_bits, payload_size);
+            std::map<std::string, toml::table> primitive_tables;
+            for (const auto &timing : timings) {
+                std::cout << absl::StreamFormat(
+                    "%-20s %-20s %8lu elements: %12.3f us, %8.2f ns per element\n",
+                    configuration, timing.primitive, timing.count, timing.seconds * 1e6,
+                    timing.seconds * 1e9 / static_cast<double>(std::max(timing.count, 1UL))
+                );
+                primitive_tables[timing.primitive].emplace(std::to_string(timing.count), timing.seconds);
+            }
+            toml::table configuration_table;
+            for (auto &[primitive, primitive_table] : primitive_tables) {
+                configuration_table.emplace(primitive, std::move(primitive_table));
+            }
+            table.emplace(configuration, std::move(configuration_table));
+        }
+    }
+
+    if (result.count("output_file") > 0) {
+        std::ofstream output_file(result["output_file"].as<std::string>());
+        output_file << table << std::endl;
+    }
+
+    return 0;
+}
@@ -15,6 +15,39 @@
 #include <valid_bit_tree.hpp>
 #include <crypto_module.hpp>
 #include <binary_path_oram_2.hpp>
+#include <ring_oram.hpp>
+#include <circuit_oram.hpp>
+#include <sharded_oram.hpp>
+#include <memory_loader.hpp>
+
+// writes the block address into the first bytes of every block in [begin, end)
+static void write_initial_blocks(Memory *oram, uint64_t begin, uint64_t end, uint64_t block_size) {
+    // write the initial contents in batches so memories that dispatch batches (e.g. ShardedOram) stay busy
+    const uint64_t init_batch_size = 4096;
+    std::vector<MemoryRequest> requests;
+    for (uint64_t block_address = begin; block_address < end; block_address++) {
+        MemoryRequest request = {MemoryRequestType::WRITE, 0, block_size, bytes_t(block_size, 0)};
+        if (block_size >= 8) {
+            *((uint64_t*)request.data.data()) = block_address;
+        } else if (block_size >= 4) {
+            *((uint32_t*)request.data.data()) = block_address & 0xFFFFFFFFUL;
+        } else if (block_size >= 2) {
+            *((uint16_t*)request.data.data()) = block_address & 0xFFFFUL;
+        } else if (block_size >= 1){
+            *((uint8_t*)request.data.data()) = block_address & 0xFFUL;
+        }
+        request.address = block_address * block_size;
+
+        if (block_address % 100000 == 0) {
+            std::cout << absl::StrFormat("Writing Block %lu of %lu\n", block_address + 1, end);
+        }
+        requests.push_back(std::move(request));
+        if (requests.size() == init_batch_size || block_address + 1 == end) {
+            oram->batch_access(requests);
+            requests.clear();
+        }
+    }
+}
 
 int create_oram_entry_point(int argc, const char** argv) {
     cxxopts::Options oram_options("Create ORAM", "Sets up an oram");
@@ -32,12 +65,19 @@ int create_oram_entry_point(int argc, const char** argv) {
     ("f,initializer_file", "content to initialize the ORAM with.", cxxopts::value<std::string>())
     ("o,output", "the location to store the ORAM.", cxxopts::value<std::string>())
     ("L,load_factor", "The maximum load factor the tree can have", cxxopts::value<double>()->default_value("0.75"))
-    ("O,tree_order", "The order of the tree in PageOptimizedOram", cxxopts::value<uint64_t>()->default_value("2"))
-    ("d, temp_dir", "Change directory where temp files for disk memory are stored.", cxxopts::value<std::string>()->default_value("."))
+    ("O,tree_order", "The order of the tree, a power of two for BinaryPathOram2 and CircuitOram", cxxopts::value<uint64_t>()->default_value("2"))
+    ("d, temp_dir", "Change directory where temp files for disk memory are stored, separate several directories with commas.", cxxopts::value<std::string>()->default_value("."))
     ("F, fast_init", "Use fast init mode", cxxopts::value<bool>()->default_value("false"))
     ("S, stash_capacity", "Capacity of stash in blocks", cxxopts::value<std::string>()->default_value("200"))
     ("c, crypto_module", "Type of Crypto to use", cxxopts::value<std::string>()->default_value("PlainText"))
     ("e, levels_per_page", "How many levels of buckets to fit on each page, BinaryPathOram2 only", cxxopts::value<std::string>()->default_value("1"))
+    ("D, dummies_per_bucket", "The number of dummy slots in each bucket, RingOram only", cxxopts::value<uint64_t>()->default_value("6"))
+    ("evictions_per_access", "Number of extra eviction paths per access, CircuitOram only", cxxopts::value<uint64_t>()->default_value("2"))
+    ("evictions_per_batch", "Number of eviction paths read and written together, PageOptimizedRAWOram only", cxxopts::value<uint64_t>()->default_value("1"))
+    ("prefetch_eviction", "Read the next eviction paths in the background, PageOptimizedRAWOram only", cxxopts::value<bool>()->default_value("false"))
+    ("valid_bit_cache_size", "Trusted memory for keeping the top valid bit tree pages decrypted, PageOptimizedRAWOram only", cxxopts::value<std::string>()->default_value("0"))
+    ("num_shards", "Number of PageOptimizedRAWOram shards, ShardedOram only", cxxopts::value<uint64_t>()->default_value("4"))
+    ("shard_batch_size", "Number of requests sent to every shard per round, ShardedOram only", cxxopts::value<uint64_t>()->default_value("16"))
     ("h,help", "show help text");
     
     oram_options.parse_positional("subcommand");
@@ -64,6 +104,14 @@ int create_oram_entry_point(int argc, const char** argv) {
     uint64_t max_position_map_size = parse_size(result["position_map_size"].as<std::string>());
     uint64_t num_accesses_per_eviction = result["num_accesses_per_eviction"].as<uint64_t>();
     uint64_t levels_per_page = parse_size(result["levels_per_page"].as<std::string>());
+    uint64_t dummies_per_bucket = result["dummies_per_bucket"].as<uint64_t>();
+    uint64_t stash_capacity = parse_size(result["stash_capacity"].as<std::string>());
+    uint64_t evictions_per_access = result["evictions_per_access"].as<uint64_t>();
+    uint64_t evictions_per_batch = result["evictions_per_batch"].as<uint64_t>();
+    bool prefetch_eviction = result["prefetch_eviction"].as<bool>();
+    uint64_t valid_bit_cache_size = parse_size(result["valid_bit_cache_size"].as<std::string>());
+    uint64_t num_shards = result["num_shards"].as<uint64_t>();
+    uint64_t shard_batch_size = result["shard_batch_size"].as<uint64_t>();
     bool fast_init = result["fast_init"].as<bool>();
 
     std::string type = result["type"].as<std::string>();
@@ -90,14 +138,30 @@ int create_oram_entry_point(int argc, const char** argv) {
     } else if (type == "RAWOram") {
         // oram = createRAWOram(size, block_size, blocks_per_bucket, num_accesses_per_eviction, max_position_map_size, true, layout_type, page_size);
     } else if (type == "PageOptimizedRAWOram") {
-        oram = createPageOptimizedRAWOram(size, block_size, blocks_per_bucket, num_accesses_per_eviction, 4 * num_accesses_per_eviction, max_position_map_size, true, page_size, max_load_factor, tree_order, fast_init, crypto_module_type);
+        oram = createPageOptimizedRAWOram(size, block_size, blocks_per_bucket, num_accesses_per_eviction, 4 * num_accesses_per_eviction * evictions_per_batch, max_position_map_size, true, page_size, max_load_factor, tree_order, fast_init, crypto_module_type, "", evictions_per_batch, prefetch_eviction, valid_bit_cache_size);
     } else if (type == "BinaryPathOram2") {
         oram = createBinaryPathOram2(
-            size, block_size, page_size, true, max_position_map_size, true, 0, max_load_factor, fast_init, levels_per_page, crypto_module_type
+            size, block_size, page_size, true, max_position_map_size, true, 0, max_load_factor, fast_init, levels_per_page, crypto_module_type, tree_order
         );
     } else if (type == "BinaryPathOram2L") {
         oram = createBinaryPathOram2(
-            size, block_size, page_size, false, max_position_map_size, true, 0, max_load_factor, fast_init, levels_per_page, crypto_module_type
+            size, block_size, page_size, false, max_position_map_size, true, 0, max_load_factor, fast_init, levels_per_page, crypto_module_type, tree_order
+        );
+    } else if (type == "RingOram") {
+        oram = createRingOram(
+            size, block_size, blocks_per_bucket, dummies_per_bucket, num_accesses_per_eviction, stash_capacity,
+            max_position_map_size, true, page_size, max_load_factor, crypto_module_type
+        );
+    } else if (type == "CircuitOram") {
+        oram = createCircuitOram(
+            size, block_size, page_size, stash_capacity, evictions_per_access,
+            max_position_map_size, true, max_load_factor, fast_init, levels_per_page, crypto_module_type, tree_order
+        );
+    } else if (type == "ShardedOram") {
+        oram = createShardedOram(
+            size, block_size, num_shards, shard_batch_size,
+            blocks_per_bucket, num_accesses_per_eviction, stash_capacity,
+            max_position_map_size, true, page_size, max_load_factor, tree_order, fast_init, crypto_module_type
         );
     } else if (type == "LinearScannedMemory") {
         oram = LinearScannedMemory::create("linear_scanned_memory", size, block_size);
@@ -121,8 +185,10 @@ int create_oram_entry_point(int argc, const char** argv) {
     if (fast_init) {
         if (type == "PageOptimizedRAWOram") {
             dynamic_cast<PageOptimizedRAWOram*>(oram.get())->fast_init();
-        } else if (type == "BinaryPathOram2" || type=="BinaryPathOram2L") {
+        } else if (type == "BinaryPathOram2" || type=="BinaryPathOram2L" || type == "CircuitOram") {
             dynamic_cast<BinaryPathOram2*>(oram.get())->fast_init();
+        } else if (type == "ShardedOram") {
+            dynamic_cast<ShardedOram*>(oram.get())->fast_init();
         } else if (type == "LinearScannedMemory") {
             dynamic_cast<LinearScannedMemory*>(oram.get())->fast_init();
         }
@@ -133,24 +199,7 @@ int create_oram_entry_point(int argc, const char** argv) {
     } else {
         oram->init();
 
-        MemoryRequest request = {MemoryRequestType::WRITE, 0, block_size, bytes_t(block_size, 0)};
-        for (uint64_t block_address = 0; block_address < num_valid_blocks; block_address++) {
-            if (block_size >= 8) {
-                *((uint64_t*)request.data.data()) = block_address;
-            } else if (block_size >= 4) {
-                *((uint32_t*)request.data.data()) = block_address & 0xFFFFFFFFUL;
-            } else if (block_size >= 2) {
-                *((uint16_t*)request.data.data()) = block_address & 0xFFFFUL;
-            } else if (block_size >= 1){
-                *((uint8_t*)request.data.data()) = block_address & 0xFFUL;
-            }
-            request.address = block_address * block_size;
-
-            if (block_address % 100000 == 0) {
-                std::cout << absl::StrFormat("Writing Block %lu of %lu\n", block_address + 1, num_valid_blocks);
-            }
-            oram->access(request);
-        }
+        write_initial_blocks(oram.get(), 0, num_valid_blocks, block_size);
     }
 
     if (std::filesystem::exists(oram_dir)) {
@@ -162,6 +211,169 @@ int create_oram_entry_point(int argc, const char** argv) {
     return 0;
 }
 
+// position map for an ORAM that is being grown, same shape as the ones built by the builders below
+static unique_memory_t createPositionMap(
+    uint64_t num_entries, uint64_t path_index_size,
+    uint64_t max_position_map_size, bool recursive,
+    std::string_view crypto_module_name
+) {
+    std::uint64_t position_map_page_size = 64;
+    std::uint64_t num_position_map_entires_per_page = position_map_page_size / path_index_size;
+    position_map_page_size = num_position_map_entires_per_page * path_index_size;
+    std::uint64_t num_position_map_pages = divide_round_up(num_entries, num_position_map_entires_per_page);
+    uint64_t position_map_size = num_position_map_pages * position_map_page_size;
+    std::cout << absl::StreamFormat("Position map needs %lu pages totaling %lu bytes to hold %lu entries\n", num_position_map_pages, position_map_size, num_entries);
+
+    if (recursive && position_map_size > max_position_map_size) {
+        return createBinaryPathOram2(
+            position_map_size, position_map_page_size, 512, false, max_position_map_size, true, 1, 0.75, false, 1, crypto_module_name
+        );
+    }
+    return LinearScannedMemory::create(absl::StrFormat("level-%lu_position_map", 0), position_map_size, path_index_size);
+}
+
+int resize_oram_entry_point(int argc, const char** argv) {
+    cxxopts::Options resize_options("Resize ORAM", "Grows an existing ORAM in place of rebuilding it");
+
+    resize_options.add_options()
+    ("subcommand", "ignore", cxxopts::value<std::string>())
+    ("m,memory", "Directory to load the ORAM from", cxxopts::value<std::string>())
+    ("s,size", "The new size of the ORAM", cxxopts::value<std::string>())
+    ("o,output", "The location to store the grown ORAM, defaults to the input directory", cxxopts::value<std::string>())
+    ("L,load_factor", "The maximum load factor the tree can have after growing", cxxopts::value<double>()->default_value("0.75"))
+    ("p,position_map_size", "The size of secure storage available for position map", cxxopts::value<std::string>()->default_value("32KiB"))
+    ("d, temp_dir", "Change directory where temp files for disk memory are stored, separate several directories with commas.", cxxopts::value<std::string>()->default_value("."))
+    ("h,help", "show help text");
+
+    resize_options.parse_positional("subcommand");
+
+    auto result = resize_options.parse(argc, argv);
+
+    if (result.count("subcommand") != 1 || result["subcommand"].as<std::string>() != "resize") {
+        std::cout << "Incorrect sub command!\n";
+        exit(-1);
+    }
+
+    if (result.count("help") != 0) {
+        std::cout << resize_options.help();
+        exit(0);
+    }
+
+    if (result.count("memory") != 1 || result.count("size") != 1) {
+        std::cout << "Need to specify a memory directory and the new size!\n";
+        return -1;
+    }
+
+    const std::filesystem::path temp_dir(result["temp_dir"].as<std::string>());
+    set_disk_memory_temp_file_directory(temp_dir);
+
+    const std::filesystem::path memory_directory(result["memory"].as<std::string>());
+    std::filesystem::path oram_dir = memory_directory;
+    if (result.count("output") == 1) {
+        oram_dir = result["output"].as<std::string>();
+    }
+
+    uint64_t size = parse_size(result["size"].as<std::string>());
+    uint64_t max_position_map_size = parse_size(result["position_map_size"].as<std::string>());
+    double max_load_factor = result["load_factor"].as<double>();
+
+    unique_memory_t oram = MemoryLoader::load(memory_directory);
+    uint64_t block_size = oram->page_size();
+    uint64_t num_blocks = oram->size() / block_size;
+    uint64_t new_num_blocks = divide_round_up(size, block_size);
+
+    const auto table = oram->to_toml();
+    auto raw_oram = dynamic_cast<PageOptimizedRAWOram *>(oram.get());
+    auto binary_path_oram = dynamic_cast<BinaryPathOram2 *>(oram.get());
+    if (raw_oram == nullptr && binary_path_oram == nullptr) {
+        std::cerr << absl::StreamFormat("%s does not support resizing!\n", table["type"].value<std::string_view>().value()) << std::endl;
+        return -1;
+    }
+
+    uint64_t path_index_size = parse_size(table["path_index_size"]);
+    std::string crypto_module_name(table["crypto_module"].value<std::string_view>().value());
+    unique_memory_t position_map = createPositionMap(new_num_blocks, path_index_size, max_position_map_size, true, crypto_module_name);
+
+    if (raw_oram != nullptr) {
+        raw_oram->grow(new_num_blocks, max_load_factor, std::move(position_map));
+    } else {
+        binary_path_oram->grow(new_num_blocks, max_load_factor, std::move(position_map));
+    }
+
+    write_initial_blocks(oram.get(), num_blocks, new_num_blocks, block_size);
+
+    if (std::filesystem::exists(oram_dir)) {
+        std::filesystem::remove_all(oram_dir);
+    }
+    std::filesystem::create_directories(oram_dir);
+    oram->save_to_disk(oram_dir.string());
+
+    return 0;
+}
+
+int rebuild_oram_entry_point(int argc, const char** argv) {
+    cxxopts::Options rebuild_options("Rebuild ORAM", "Obliviously reshuffles an existing ORAM into a fresh tree");
+
+    rebuild_options.add_options()
+    ("subcommand", "ignore", cxxopts::value<std::string>())
+    ("m,memory", "Directory to load the ORAM from", cxxopts::value<std::string>())
+    ("o,output", "The location to store the rebuilt ORAM, defaults to the input directory", cxxopts::value<std::string>())
+    ("c,chunk_records", "Number of records sorted in memory at once, has to be a power of two", cxxopts::value<std::string>()->default_value("64Ki"))
+    ("d, temp_dir", "Change directory where temp files for disk memory are stored, separate several directories with commas.", cxxopts::value<std::string>()->default_value("."))
+    ("h,help", "show help text");
+
+    rebuild_options.parse_positional("subcommand");
+
+    auto result = rebuild_options.parse(argc, argv);
+
+    if (result.count("subcommand") != 1 || result["subcommand"].as<std::string>() != "rebuild") {
+        std::cout << "Incorrect sub command!\n";
+        exit(-1);
+    }
+
+    if (result.count("help") != 0) {
+        std::cout << rebuild_options.help();
+        exit(0);
+    }
+
+    if (result.count("memory") != 1) {
+        std::cout << "Need to specify a memory directory!\n";
+        return -1;
+    }
+
+    const std::filesystem::path temp_dir(result["temp_dir"].as<std::string>());
+    set_disk_memory_temp_file_directory(temp_dir);
+
+    const std::filesystem::path memory_directory(result["memory"].as<std::string>());
+    std::filesystem::path oram_dir = memory_directory;
+    if (result.count("output") == 1) {
+        oram_dir = result["output"].as<std::string>();
+    }
+
+    uint64_t records_per_chunk = parse_size(result["chunk_records"].as<std::string>());
+
+    unique_memory_t oram = MemoryLoader::load(memory_directory);
+    auto raw_oram = dynamic_cast<PageOptimizedRAWOram *>(oram.get());
+    if (raw_oram == nullptr) {
+        std::cerr << absl::StreamFormat("%s does not support oblivious rebuilds!\n", oram->to_toml()["type"].value<std::string_view>().value()) << std::endl;
+        return -1;
+    }
+
+    // the sort runs go to a temp file next to the other disk memories
+    constexpr uint64_t scratch_page_size = 4096;
+    unique_memory_t scratch_memory = BlockDiskMemoryLibAIO::create("rebuild_scratch", raw_oram->rebuild_scratch_size(records_per_chunk, scratch_page_size), scratch_page_size);
+    raw_oram->oblivious_rebuild(scratch_memory.get(), records_per_chunk);
+    scratch_memory.reset();
+
+    if (std::filesystem::exists(oram_dir)) {
+        std::filesystem::remove_all(oram_dir);
+    }
+    std::filesystem::create_directories(oram_dir);
+    oram->save_to_disk(oram_dir.string());
+
+    return 0;
+}
+
 unique_memory_t createBinaryPathOram(
     uint64_t size, uint64_t block_size, uint64_t blocks_per_bucket,
     uint64_t max_position_map_size, bool recursive,
@@ -258,7 +470,11 @@ unique_memory_t createPageOptimizedRAWOram(
     double max_load_factor,
     uint64_t tree_order,
     bool fast_init,
-    std::string_view crypto_module_name
+    std::string_view crypto_module_name,
+    std::string_view name_prefix,
+    uint64_t evictions_per_batch,
+    bool prefetch_eviction_paths,
+    uint64_t valid_bit_cache_size
 ) {
     uint64_t num_blocks = divide_round_up(size, block_size);
     // TODO: change to not hardcoded crypto module
@@ -268,7 +484,8 @@ unique_memory_t createPageOptimizedRAWOram(
         crypto_module.get(), 
         parameters.levels, 
         512, 
-        parameters.blocks_per_bucket
+        parameters.blocks_per_bucket,
+        valid_bit_cache_size
     );
     unique_memory_t valid_bit_tree_memory = BackedMemory::create("Valid bit tree memory", valid_bit_tree_parameters.required_memory_size);
     std::unique_ptr<ValidBitTreeController> valid_bit_tree_controller = std::make_unique<ParentCounterValidBitTreeController>(valid_bit_tree_parameters, crypto_module.get(), valid_bit_tree_memory.get());
@@ -286,9 +503,9 @@ unique_memory_t createPageOptimizedRAWOram(
 
     unique_memory_t untrusted_memory;
     if (fast_init) {
-        untrusted_memory = BlockDiskMemoryLibAIO::create(absl::StrFormat("level-%lu_untrusted_memory", 0), parameters.untrusted_memory_size, page_size);
+        untrusted_memory = BlockDiskMemoryLibAIO::create(absl::StrFormat("%slevel-%lu_untrusted_memory", name_prefix, 0), parameters.untrusted_memory_size, page_size);
     } else {
-        untrusted_memory = BackedMemory::create(absl::StrFormat("level-%lu_untrusted_memory", 0), parameters.untrusted_memory_size, page_size);
+        untrusted_memory = BackedMemory::create(absl::StrFormat("%slevel-%lu_untrusted_memory", name_prefix, 0), parameters.untrusted_memory_size, page_size);
     }
 
     unique_memory_t position_map;
@@ -300,19 +517,22 @@ unique_memory_t createPageOptimizedRAWOram(
         );
     } else {
         // position_map = BackedMemory::create(absl::StrFormat("level-%lu_position_map", 0), position_map_size, position_map_page_size);
-        position_map = LinearScannedMemory::create(absl::StrFormat("level-%lu_position_map", 0), position_map_size, parameters.path_index_size);
+        position_map = LinearScannedMemory::create(absl::StrFormat("%slevel-%lu_position_map", name_prefix, 0), position_map_size, parameters.path_index_size);
     }
 
     // unique_memory_t bitfield = BitfieldAdapter::create("level-0_bitfield", BackedMemory::create("level-0_bitfield_memory", divide_round_up(parameters.valid_bitfield_size, 8UL), 64));
 
     unique_memory_t oram = PageOptimizedRAWOram::create(
-        "page_optimized_raw_oram",
+        absl::StrFormat("%spage_optimized_raw_oram", name_prefix),
         std::move(position_map), std::move(untrusted_memory), 
         std::move(valid_bit_tree_controller), std::move(valid_bit_tree_memory),
         std::move(crypto_module),
         block_size, num_blocks, num_accesses_per_eviction, tree_order,
         stash_capacity,
-        max_load_factor
+        max_load_factor,
+        false, false,
+        evictions_per_batch,
+        prefetch_eviction_paths
     );
 
     std::cout << absl::StrFormat("level-%lu ORAM size %lu bytes, untrusted memory %lu bytes, postion map %lu bytes \n", 0, size, parameters.untrusted_memory_size, position_map_size);
@@ -329,7 +549,8 @@ unique_memory_t createBinaryPathOram2(
     double max_load_factor,
     bool fast_init,
     uint64_t levels_per_page,
-    std::string_view crypto_module_name
+    std::string_view crypto_module_name,
+    uint64_t tree_order
 ) {
     // uint64_t num_blocks = divide_round_up(size, block_size);
     // uint64_t num_buckets = divide_round_up(num_blocks, blocks_per_bucket);
@@ -340,7 +561,7 @@ unique_memory_t createBinaryPathOram2(
 
     auto parameters = BinaryPathOram2::compute_parameters(
         block_size, page_size, levels_per_page, divide_round_up(size, block_size),
-        crypto_module.get(), max_load_factor, is_page_size_strict
+        crypto_module.get(), max_load_factor, is_page_size_strict, tree_order
     );
 
     uint64_t untrusted_memory_size = parameters.untrusted_memory_size;
@@ -392,4 +613,150 @@ unique_memory_t createBinaryPathOram2(
 
     return oram;
 
-}
\ No newline at end of file
+}
+
+unique_memory_t createRingOram(
+    uint64_t size, uint64_t block_size, uint64_t blocks_per_bucket,
+    uint64_t dummies_per_bucket,
+    uint64_t num_accesses_per_eviction,
+    uint64_t stash_capacity,
+    uint64_t max_position_map_size, bool recursive,
+    uint64_t page_size,
+    double max_load_factor,
+    std::string_view crypto_module_name
+) {
+    uint64_t num_blocks = divide_round_up(size, block_size);
+    std::unique_ptr<CryptoModule> crypto_module = get_crypto_module_by_name(crypto_module_name);
+    // every slot gets its own page, so online reads only transfer one block per level
+    auto parameters = RingOram::compute_parameters(page_size, block_size, num_blocks, blocks_per_bucket, dummies_per_bucket, crypto_module.get(), max_load_factor);
+    // the valid bit tree holds the whole bucket metadata, make sure a page fits a few levels of it
+    std::uint64_t valid_bit_tree_page_size = std::max<std::uint64_t>(512, 4 * (parameters.bucket_metadata_size + sizeof(std::uint64_t)));
+    auto valid_bit_tree_parameters = ParentCounterValidBitTreeController::compute_parameters(
+        crypto_module.get(),
+        parameters.levels,
+        valid_bit_tree_page_size,
+        parameters.bucket_metadata_size * 8
+    );
+    unique_memory_t valid_bit_tree_memory = BackedMemory::create("Valid bit tree memory", valid_bit_tree_parameters.required_memory_size);
+    std::unique_ptr<ValidBitTreeController> valid_bit_tree_controller = std::make_unique<ParentCounterValidBitTreeController>(valid_bit_tree_parameters, crypto_module.get(), valid_bit_tree_memory.get());
+
+    std::uint64_t position_map_page_size = 64;
+    std::uint64_t num_position_map_entires_per_page = position_map_page_size / parameters.path_index_size;
+    position_map_page_size = num_position_map_entires_per_page * parameters.path_index_size;
+    std::uint64_t num_position_map_pages = divide_round_up(num_blocks, num_position_map_entires_per_page);
+    uint64_t position_map_size = num_position_map_pages * position_map_page_size;
+    std::cout << absl::StreamFormat("Position map needs %lu pages totaling %lu bytes to hold %lu entries\n", num_position_map_pages, position_map_size, num_blocks);
+
+    unique_memory_t untrusted_memory = BackedMemory::create(absl::StrFormat("level-%lu_untrusted_memory", 0), parameters.untrusted_memory_size, page_size);
+
+    unique_memory_t position_map;
+    if (recursive && position_map_size > max_position_map_size) {
+        position_map = createBinaryPathOram2(
+            position_map_size, position_map_page_size, 512, false, max_position_map_size, true, 1, max_load_factor, false, 1, crypto_module_name
+        );
+    } else {
+        position_map = LinearScannedMemory::create(absl::StrFormat("level-%lu_position_map", 0), position_map_size, parameters.path_index_size);
+    }
+
+    unique_memory_t oram = RingOram::create(
+        "ring_oram",
+        std::move(position_map), std::move(untrusted_memory),
+        std::move(valid_bit_tree_controller), std::move(valid_bit_tree_memory),
+        std::move(crypto_module),
+        block_size, num_blocks, blocks_per_bucket, dummies_per_bucket,
+        num_accesses_per_eviction, stash_capacity,
+        max_load_factor
+    );
+
+    std::cout << absl::StrFormat("level-%lu ORAM size %lu bytes, untrusted memory %lu bytes, postion map %lu bytes \n", 0, size, parameters.untrusted_memory_size, position_map_size);
+
+    return oram;
+}
+
+unique_memory_t createCircuitOram(
+    uint64_t size, uint64_t block_size, uint64_t page_size,
+    uint64_t stash_capacity,
+    uint64_t evictions_per_access,
+    uint64_t max_position_map_size, bool recursive,
+    double max_load_factor,
+    bool fast_init,
+    uint64_t levels_per_page,
+    std::string_view crypto_module_name,
+    uint64_t tree_order
+) {
+    std::unique_ptr<CryptoModule> crypto_module = get_crypto_module_by_name(crypto_module_name);
+
+    // same tree and page format as BinaryPathOram2, only the eviction differs
+    auto parameters = BinaryPathOram2::compute_parameters(
+        block_size, page_size, levels_per_page, divide_round_up(size, block_size),
+        crypto_module.get(), max_load_factor, true, tree_order
+    );
+
+    unique_memory_t untrusted_memory;
+    if (fast_init) {
+        untrusted_memory = BlockDiskMemoryLibAIO::create(absl::StrFormat("level-%lu_untrusted_memory", 0), parameters.untrusted_memory_size, page_size);
+    } else {
+        untrusted_memory = BackedMemory::create(absl::StrFormat("level-%lu_untrusted_memory", 0), parameters.untrusted_memory_size, page_size);
+    }
+
+    std::uint64_t position_map_page_size = 64;
+    std::uint64_t num_position_map_entires_per_page = position_map_page_size / parameters.path_index_size;
+    position_map_page_size = num_position_map_entires_per_page * parameters.path_index_size;
+    std::uint64_t num_position_map_pages = divide_round_up(parameters.num_blocks, num_position_map_entires_per_page);
+    uint64_t position_map_size = num_position_map_pages * position_map_page_size;
+    std::cout << absl::StreamFormat("Position map needs %lu pages totaling %lu bytes to hold %lu entries\n", num_position_map_pages, position_map_size, parameters.num_blocks);
+
+    unique_memory_t position_map;
+    if (recursive && position_map_size > max_position_map_size) {
+        position_map = createBinaryPathOram2(
+            position_map_size, position_map_page_size, 512, false, max_position_map_size, true, 1, 0.75, false, 1, crypto_module_name
+        );
+    } else {
+        position_map = LinearScannedMemory::create(absl::StrFormat("level-%lu_position_map", 0), position_map_size, parameters.path_index_size);
+    }
+
+    unique_memory_t oram = CircuitOram::create(
+        "circuit_oram",
+        std::move(position_map), std::move(untrusted_memory),
+        std::move(crypto_module),
+        parameters,
+        stash_capacity,
+        evictions_per_access
+    );
+
+    std::cout << absl::StrFormat("level-%lu ORAM size %lu bytes, untrusted memory %lu bytes, postion map %lu bytes \n", 0, size, parameters.untrusted_memory_size, position_map_size);
+
+    return oram;
+}
+
+unique_memory_t createShardedOram(
+    uint64_t size, uint64_t block_size,
+    uint64_t num_shards, uint64_t shard_batch_size,
+    uint64_t blocks_per_bucket,
+    uint64_t num_accesses_per_eviction,
+    uint64_t stash_capacity,
+    uint64_t max_position_map_size, bool recursive,
+    uint64_t page_size,
+    double max_load_factor,
+    uint64_t tree_order,
+    bool fast_init,
+    std::string_view crypto_module_name
+) {
+    uint64_t num_blocks = divide_round_up(size, block_size);
+    uint64_t blocks_per_shard = divide_round_up(num_blocks, num_shards);
+
+    // every shard is a complete ORAM with its own stash, position map and disk file
+    std::vector<unique_memory_t> shards;
+    for (uint64_t i = 0; i < num_shards; i++) {
+        std::cout << absl::StreamFormat("Creating shard %lu of %lu\n", i + 1, num_shards);
+        shards.emplace_back(createPageOptimizedRAWOram(
+            blocks_per_shard * block_size, block_size, blocks_per_bucket,
+            num_accesses_per_eviction, stash_capacity,
+            max_position_map_size, recursive, page_size, max_load_factor, tree_order,
+            fast_init, crypto_module_name,
+            absl::StrFormat("shard-%lu_", i)
+        ));
+    }
+
+    return ShardedOram::create("sharded_oram", std::move(shards), block_size, num_blocks, shard_batch_size);
+}
@@ -6,6 +6,7 @@
 #include <vector>
 #include <algorithm>
 #include <limits>
+#include <bit>
 
 EvictionPathGenerator get_eviction_path_gen(addr_t levels, addr_t order, addr_t first_level_order = std::numeric_limits<addr_t>::max()) {
     std::vector<int64_t> level_sizes;
@@ -111,7 +112,9 @@ PageOptimizedRAWOram::create(
     uint64_t stash_capacity,
     double max_load_factor,
     bool bypass_path_read_on_stash_hit,
-    bool unsecure_eviction_buffer
+    bool unsecure_eviction_buffer,
+    uint64_t evictions_per_batch,
+    bool prefetch_eviction_paths
 ) {
 
     auto computed_parameters = PageOptimizedRAWOram::compute_parameters(
@@ -144,6 +147,8 @@ PageOptimizedRAWOram::create(
             bypass_path_read_on_stash_hit,
             unsecure_eviction_buffer,
             stash_capacity,
+            evictions_per_batch,
+            prefetch_eviction_paths,
             new BinaryPathOramStatistics
         )
     );
@@ -163,6 +168,8 @@ PageOptimizedRAWOram::PageOptimizedRAWOram(
     bool bypass_path_read_on_stash_hit,
     bool unsecure_eviction_buffer,
     uint64_t stash_capacity,
+    uint64_t evictions_per_batch,
+    bool prefetch_eviction_paths,
     BinaryPathOramStatistics *statistics
 ) : 
 Memory(type, name, num_blocks * block_size, statistics),
@@ -183,6 +190,8 @@ valid_bits_per_bucket(blocks_per_bucket / 8UL * 8UL),
 bypass_path_read_on_stash_hit(bypass_path_read_on_stash_hit),
 unsecure_eviction_buffer(unsecure_eviction_buffer),
 num_accesses_per_eviction(num_accesses_per_eviction),
+evictions_per_batch(evictions_per_batch),
+prefetch_eviction_paths(prefetch_eviction_paths),
 random_nonce_bytes(this->crypto_module->nonce_size() - 2 * sizeof(std::uint64_t)),
 auth_tag_bytes(this->crypto_module->auth_tag_size()),
 untrusted_memory_page_size(this->untrusted_memory->page_size()),
@@ -194,10 +203,12 @@ eviction_path_gen(get_eviction_path_gen(computed_parameters.levels, tree_order,
 root_counter(0),
 access_counter(0),
 stash(block_size, stash_capacity),
+crypto_batch(this->crypto_module->nonce_size()),
 eviction_metadata_buffer(this->blocks_per_bucket),
 eviction_data_block_buffer(this->blocks_per_bucket * this->block_size),
 ll_posmap(dynamic_cast<LLPathOramInterface *>(this->position_map.get())),
-posmap_block_buffer(position_map_page_size)
+posmap_block_buffer(position_map_page_size),
+tree_version(0)
 {
     for (addr_t i = 0; i < this->levels; i++) {
         this->path_access.emplace_back(MemoryRequestType::READ, 0, this->untrusted_memory_page_size);
@@ -209,7 +220,8 @@ posmap_block_buffer(position_map_page_size)
     this->crypto_module->random(this->key.data(), this->crypto_module->key_size());
     this->nonce_buffer.resize(this->crypto_module->nonce_size());
     this->crypto_module->random(this->nonce_buffer.data(), this->random_nonce_bytes);
-    this->decrypted_path.resize(this->untrusted_memory_page_size * this->levels);
+    this->path_buckets.resize(this->levels);
+    this->select_path_kernels();
 }
 
 PageOptimizedRAWOram::PageOptimizedRAWOram(
@@ -236,6 +248,8 @@ valid_bits_per_bucket(parse_size(*table["valid_bits_per_bucket"].node())),
 bypass_path_read_on_stash_hit(table["bypass_path_read_on_stash_hit"].value<bool>().value_or(false)),
 unsecure_eviction_buffer(table["unsecure_eviction_buffer"].value<bool>().value_or(false)),
 num_accesses_per_eviction(parse_size(*table["num_accesses_per_eviction"].node())),
+evictions_per_batch(parse_size_or(table["evictions_per_batch"], 1)),
+prefetch_eviction_paths(table["prefetch_eviction_paths"].value<bool>().value_or(false)),
 random_nonce_bytes(this->crypto_module->nonce_size() - 2 * sizeof(std::uint64_t)),
 auth_tag_bytes(this->crypto_module->auth_tag_size()),
 untrusted_memory_page_size(this->untrusted_memory->page_size()),
@@ -247,10 +261,12 @@ eviction_path_gen(table["eviction_path_gen"].as_table()),
 root_counter(parse_size(table["root_counter"])),
 access_counter(table["access_counter"].value<int64_t>().value_or(0)),
 stash(block_size, parse_size_or(table["stash_capacity"], num_accesses_per_eviction * 3)),
+crypto_batch(this->crypto_module->nonce_size()),
 eviction_metadata_buffer(this->blocks_per_bucket),
 eviction_data_block_buffer(this->blocks_per_bucket * this->block_size),
 ll_posmap(dynamic_cast<LLPathOramInterface *>(this->position_map.get())),
-posmap_block_buffer(position_map_page_size)
+posmap_block_buffer(position_map_page_size),
+tree_version(0)
 {
     for (addr_t i = 0; i < this->levels; i++) {
         this->path_access.emplace_back(MemoryRequestType::READ, 0, this->untrusted_memory_page_size);
@@ -261,11 +277,14 @@ posmap_block_buffer(position_map_page_size)
     hex_string_to_bytes(table["key"].value<std::string_view>().value(), this->key.data(), this->crypto_module->key_size());
     this->nonce_buffer.resize(this->crypto_module->nonce_size());
     hex_string_to_bytes(table["random_nonce"].value<std::string_view>().value(), this->nonce_buffer.data(), this->random_nonce_bytes);
-    this->decrypted_path.resize(this->untrusted_memory_page_size * this->levels);
+    this->path_buckets.resize(this->levels);
+    this->select_path_kernels();
 }
 
 void 
 PageOptimizedRAWOram::init() {
+    this->wait_for_eviction_prefetch();
+    this->tree_version++;
     this->position_map->init();
     this->untrusted_memory->init();
 
@@ -283,8 +302,16 @@ PageOptimizedRAWOram::init() {
         this->position_map->access(position_map_write);
     }
 
-    MemoryRequest untrusted_memory_request(MemoryRequestType::WRITE, 0, this->untrusted_memory_page_size);
-    bytes_t data_buffer(this->untrusted_memory_page_size); // just zeros
+    // pages are encrypted and written init_batch_pages at a time
+    std::vector<MemoryRequest> untrusted_memory_requests;
+    untrusted_memory_requests.reserve(init_batch_pages);
+    auto write_pages = [&]() {
+        this->crypto_batch.encrypt(this->crypto_module.get(), this->key.data(), this->untrusted_memory_page_size - this->auth_tag_bytes);
+        this->untrusted_memory->batch_access(untrusted_memory_requests);
+        untrusted_memory_requests.clear();
+        this->crypto_batch.clear();
+    };
+    this->crypto_batch.clear();
 
     uint64_t level_start_offset = 0;
     uint64_t level_size = 1;
@@ -295,12 +322,8 @@ PageOptimizedRAWOram::init() {
         for (uint64_t level_offset = 0; level_offset < level_size; level_offset++)
         {
             uint64_t page_id = (level_start_offset + level_offset);
-            untrusted_memory_request.address = page_id * this->untrusted_memory_page_size;
-
-            // clear both memory requests and buffer
-            std::memset(untrusted_memory_request.data.data(), 0, untrusted_memory_request.size);
-            // std::memset(data_buffer.data(), 0, data_buffer.size());
-            // std::memset(bitfield_request.data.data(), 0, bitfield_request.size);
+            // just zeros
+            auto &untrusted_memory_request = untrusted_memory_requests.emplace_back(MemoryRequestType::WRITE, page_id * this->untrusted_memory_page_size, this->untrusted_memory_page_size);
 
             if ((page_id + 1) % 10000UL == 0) {
                 std::cout << absl::StreamFormat("Writing page %lu of %lu\n", page_id + 1, total_buckets);
@@ -315,25 +338,28 @@ PageOptimizedRAWOram::init() {
             std::memcpy(this->nonce_buffer.data() + this->random_nonce_bytes + sizeof(std::uint64_t), &counter, sizeof(std::uint64_t));
 
             // encrypt page
-            this->crypto_module->encrypt(
-                this->key.data(),
+            this->crypto_batch.add(
                 this->nonce_buffer.data(),
-                data_buffer.data(),
-                this->untrusted_memory_page_size - this->auth_tag_bytes,
                 untrusted_memory_request.data.data(),
                 untrusted_memory_request.data.data() + this->untrusted_memory_page_size - this->auth_tag_bytes
             );
-            
-            // write page
-            this->untrusted_memory->access(untrusted_memory_request);
+
+            if (untrusted_memory_requests.size() == init_batch_pages) {
+                write_pages();
+            }
         }
         level_start_offset += level_size;
         level_size = (level == 0 ? level_size * this->top_level_order : level_size << this->tree_bits);
     }
+    if (!untrusted_memory_requests.empty()) {
+        write_pages();
+    }
 }
 
 void 
 PageOptimizedRAWOram::fast_init() {
+    this->wait_for_eviction_prefetch();
+    this->tree_version++;
     this->root_counter = 0;
     std::cout << "Staring PageOptimizedRAWOram fast initialization\n";
     uint64_t total_buckets = this->untrusted_memory->size() / this->untrusted_memory_page_size;
@@ -364,9 +390,18 @@ PageOptimizedRAWOram::fast_init() {
     std::cout << "Done initializing position map.\n";
 
     MemoryRequest bitfield_request(MemoryRequestType::WRITE, 0, divide_round_up(this->blocks_per_bucket, 8UL));
-    MemoryRequest untrusted_memory_request(MemoryRequestType::WRITE, 0, this->untrusted_memory_page_size);
     MemoryRequest position_map_request(MemoryRequestType::WRITE, 0, this->metadata_layout.path_index_size);
-    bytes_t data_buffer(this->untrusted_memory_page_size);
+
+    // pages are built in their write requests, then encrypted and written init_batch_pages at a time
+    std::vector<MemoryRequest> untrusted_memory_requests;
+    untrusted_memory_requests.reserve(init_batch_pages);
+    auto write_pages = [&]() {
+        this->crypto_batch.encrypt(this->crypto_module.get(), this->key.data(), this->untrusted_memory_page_size - this->auth_tag_bytes);
+        this->untrusted_memory->batch_access(untrusted_memory_requests);
+        untrusted_memory_requests.clear();
+        this->crypto_batch.clear();
+    };
+    this->crypto_batch.clear();
 
     uint64_t page_metadata_offset = this->block_size * this->blocks_per_bucket;
     uint64_t data_size;
@@ -390,15 +425,14 @@ PageOptimizedRAWOram::fast_init() {
             uint64_t page_id = (level_start_offset + level_offset);
             uint64_t page_block_id_offset = page_id * this->blocks_per_bucket;
             bitfield_request.address = this->valid_bit_tree_controller->get_address_of(level, level_offset);
-            untrusted_memory_request.address = page_id * this->untrusted_memory_page_size;
+            auto &untrusted_memory_request = untrusted_memory_requests.emplace_back(MemoryRequestType::WRITE, page_id * this->untrusted_memory_page_size, this->untrusted_memory_page_size);
+            byte_t *data_buffer = untrusted_memory_request.data.data();
 
             // compute path
             uint64_t path_upper = level_offset << ((this->levels - 1 - level) * this->tree_bits);
             uint64_t path_lower_limit = 1UL << ((this->levels - 1 - level) * this->tree_bits);
 
-            // clear both memory requests and buffer
-            std::memset(untrusted_memory_request.data.data(), 0, untrusted_memory_request.size);
-            std::memset(data_buffer.data(), 0, data_buffer.size());
+            // clear the bitfield, the new page is zeroed already
             std::memset(bitfield_request.data.data(), 0, bitfield_request.size);
             for (uint64_t i = 0; i < this->blocks_per_bucket; i++)
             {
@@ -407,10 +441,10 @@ PageOptimizedRAWOram::fast_init() {
                 {
                     uint64_t path = path_upper | absl::Uniform(this->bit_gen, 0UL, path_lower_limit);
                     // write data block;
-                    std::memcpy(data_buffer.data() + (i * this->block_size), &block_id, data_size);
+                    std::memcpy(data_buffer + (i * this->block_size), &block_id, data_size);
 
                     // write metadata block;
-                    byte_t *metadata = data_buffer.data() + page_metadata_offset + i * this->metadata_layout.metadata_size();
+                    byte_t *metadata = data_buffer + page_metadata_offset + i * this->metadata_layout.metadata_size();
                     // *metadata = BlockMetadata(block_id, path, true);
                     this->metadata_layout.set_block_index(metadata, block_id);
                     this->metadata_layout.set_path_index(metadata, path);
@@ -440,22 +474,24 @@ PageOptimizedRAWOram::fast_init() {
             std::memcpy(this->nonce_buffer.data() + this->random_nonce_bytes + sizeof(std::uint64_t), &counter, sizeof(std::uint64_t));
 
             // encrypt page
-            this->crypto_module->encrypt(
-                this->key.data(),
+            this->crypto_batch.add(
                 this->nonce_buffer.data(),
-                data_buffer.data(),
-                this->untrusted_memory_page_size - this->auth_tag_bytes,
                 untrusted_memory_request.data.data(),
                 untrusted_memory_request.data.data() + this->untrusted_memory_page_size - this->auth_tag_bytes
             );
             
             // write page
             this->valid_bit_tree_memory->access(bitfield_request);
-            this->untrusted_memory->access(untrusted_memory_request);
+            if (untrusted_memory_requests.size() == init_batch_pages) {
+                write_pages();
+            }
         }
         level_start_offset += level_size;
         level_size = (level == 0 ? level_size * this->top_level_order : level_size << this->tree_bits);
     }
+    if (!untrusted_memory_requests.empty()) {
+        write_pages();
+    }
     this->valid_bit_tree_controller->encrypt_contents(this->key.data());
 }
 
@@ -489,7 +525,7 @@ PageOptimizedRAWOram::access(MemoryRequest &request) {
 
     uint64_t access_offset = request.address - logical_block_address * block_size;
 
-    this->access_block(request.type, logical_block_address, request.data.data(), access_offset, request.size);
+    this->access_block(request.type, logical_block_address, request.data.data(), access_offset, request.size, &request.update_function);
     auto end_time = std::chrono::steady_clock::now();
     this->oram_statistics->add_overall_time(end_time - start_time);
 }
@@ -505,6 +541,7 @@ PageOptimizedRAWOram::is_request_type_supported(MemoryRequestType type) const {
     case MemoryRequestType::DUMMY_POP:
     case MemoryRequestType::PUSH:
     case MemoryRequestType::DUMMY_PUSH:
+    case MemoryRequestType::UPDATE:
         return true;
         break;
     default:
@@ -515,6 +552,7 @@ PageOptimizedRAWOram::is_request_type_supported(MemoryRequestType type) const {
 
 void 
 PageOptimizedRAWOram::start_logging(bool append) {
+    this->wait_for_eviction_prefetch();
     this->Memory::start_logging(append);
     this->untrusted_memory->start_logging(append);
     this->position_map->start_logging(append);
@@ -523,6 +561,7 @@ PageOptimizedRAWOram::start_logging(bool append) {
 
 void 
 PageOptimizedRAWOram::stop_logging() {
+    this->wait_for_eviction_prefetch();
     this->Memory::stop_logging();
     this->untrusted_memory->stop_logging();
     this->position_map->stop_logging();
@@ -540,6 +579,8 @@ PageOptimizedRAWOram::to_toml_self() const {
     table.emplace("bypass_path_read_on_stash_hit", this->bypass_path_read_on_stash_hit);
     table.emplace("unsecure_eviction_buffer", this->unsecure_eviction_buffer);
     table.emplace("num_accesses_per_eviction", size_to_string(this->num_accesses_per_eviction));
+    table.emplace("evictions_per_batch", size_to_string(this->evictions_per_batch));
+    table.emplace("prefetch_eviction_paths", this->prefetch_eviction_paths);
     table.emplace("top_level_order", size_to_string(this->top_level_order));
     table.emplace("num_paths", size_to_string(this->_num_paths));
     table.emplace("tree_bits", size_to_string(this->tree_bits));
@@ -567,6 +608,12 @@ PageOptimizedRAWOram::to_toml() const {
 
 void 
 PageOptimizedRAWOram::save_to_disk(const std::filesystem::path &location) const {
+    if (this->eviction_prefetch.valid()) {
+        this->eviction_prefetch.wait();
+    }
+    // cached valid bit tree pages bump the root counter when written back, so flush before the config
+    this->valid_bit_tree_controller->flush(this->key.data());
+
     // write config file
     std::ofstream config_file(location / "config.toml");
     config_file << this->to_toml_self() << "\n";
@@ -616,6 +663,7 @@ PageOptimizedRAWOram::load_from_disk(const std::filesystem::path &location, cons
 
 void 
 PageOptimizedRAWOram::reset_statistics(bool from_file) {
+    this->wait_for_eviction_prefetch();
     this->Memory::reset_statistics(from_file);
     this->untrusted_memory->reset_statistics(from_file);
     this->valid_bit_tree_memory->reset_statistics(from_file);
@@ -630,6 +678,7 @@ PageOptimizedRAWOram::reset_statistics(bool from_file) {
 
 void 
 PageOptimizedRAWOram::save_statistics() {
+    this->wait_for_eviction_prefetch();
     this->Memory::save_statistics();
     this->untrusted_memory->save_statistics();
     this->valid_bit_tree_memory->save_statistics();
@@ -642,16 +691,488 @@ PageOptimizedRAWOram::save_statistics() {
 
 void 
 PageOptimizedRAWOram::barrier() {
+    this->wait_for_eviction_prefetch();
     this->Memory::barrier();
     this->untrusted_memory->barrier();
     this->valid_bit_tree_memory->barrier();
     this->position_map->barrier();
 }
 
+uint64_t 
+PageOptimizedRAWOram::max_num_blocks(double max_load_factor) const {
+    uint64_t total_slots = (this->untrusted_memory->size() / this->untrusted_memory_page_size) * this->blocks_per_bucket;
+    uint64_t max_blocks = static_cast<uint64_t>(std::floor(static_cast<double>(total_slots) * max_load_factor));
+
+    // block indices are stored with a fixed width in the tree
+    if (this->metadata_layout.block_index_size < sizeof(uint64_t)) {
+        max_blocks = std::min(max_blocks, 1UL << (this->metadata_layout.block_index_size * 8));
+    }
+    return max_blocks;
+}
+
+void 
+PageOptimizedRAWOram::grow(uint64_t new_num_blocks, double max_load_factor, unique_memory_t &&new_position_map) {
+    if (new_num_blocks < this->num_blocks) {
+        throw std::invalid_argument(absl::StrFormat("Can not shrink ORAM from %lu to %lu blocks", this->num_blocks, new_num_blocks));
+    }
+
+    uint64_t max_blocks = this->max_num_blocks(max_load_factor);
+    if (new_num_blocks > max_blocks) {
+        throw std::invalid_argument(absl::StrFormat(
+            "Tree can hold at most %lu blocks with a load factor of %lf, %lu requested, the ORAM has to be rebuilt",
+            max_blocks, max_load_factor, new_num_blocks
+        ));
+    }
+
+    const uint64_t path_index_size = this->metadata_layout.path_index_size;
+    const uint64_t new_position_map_page_size = new_position_map->page_size();
+    const uint64_t new_entries_per_page = new_position_map_page_size / path_index_size;
+    const uint64_t required_position_map_size = divide_round_up(new_num_blocks, new_entries_per_page) * new_position_map_page_size;
+
+    if (new_position_map->size() < required_position_map_size) {
+        throw std::invalid_argument(absl::StrFormat(
+            "Position map of %lu bytes is too small, %lu bytes are needed for %lu blocks",
+            new_position_map->size(), required_position_map_size, new_num_blocks
+        ));
+    }
+
+    std::cout << absl::StreamFormat("Growing ORAM from %lu to %lu blocks\n", this->num_blocks, new_num_blocks);
+    new_position_map->init();
+
+    // copy existing entries, whole pages at a time if both position maps use the same layout
+    if (new_position_map_page_size == this->position_map_page_size) {
+        MemoryRequest page_request(MemoryRequestType::READ, 0, this->position_map_page_size);
+        uint64_t num_pages = divide_round_up(this->num_blocks, this->num_position_map_entries_per_page);
+        for (uint64_t page_id = 0; page_id < num_pages; page_id++) {
+            page_request.type = MemoryRequestType::READ;
+            page_request.address = page_id * this->position_map_page_size;
+            this->position_map->access(page_request);
+            page_request.type = MemoryRequestType::WRITE;
+            new_position_map->access(page_request);
+        }
+    } else {
+        MemoryRequest entry_request(MemoryRequestType::READ, 0, path_index_size);
+        for (uint64_t i = 0; i < this->num_blocks; i++) {
+            entry_request.type = MemoryRequestType::READ;
+            entry_request.address = this->get_position_map_address(i);
+            this->position_map->access(entry_request);
+            entry_request.type = MemoryRequestType::WRITE;
+            entry_request.address = (i / new_entries_per_page) * new_position_map_page_size + (i % new_entries_per_page) * path_index_size;
+            new_position_map->access(entry_request);
+        }
+    }
+
+    this->position_map = std::move(new_position_map);
+    this->position_map_page_size = new_position_map_page_size;
+    this->num_position_map_entries_per_page = new_entries_per_page;
+    this->ll_posmap = dynamic_cast<LLPathOramInterface *>(this->position_map.get());
+    this->posmap_block_buffer = StashEntry(this->position_map_page_size);
+
+    // new blocks start out on random paths, the same as after init()
+    MemoryRequest position_map_write(MemoryRequestType::WRITE, 0, path_index_size);
+    for (uint64_t i = this->num_blocks; i < new_num_blocks; i++) {
+        position_map_write.address = this->get_position_map_address(i);
+        uint64_t path = absl::Uniform(this->bit_gen, 0UL, this->_num_paths);
+        std::memcpy(position_map_write.data.data(), &path, path_index_size);
+        this->position_map->access(position_map_write);
+    }
+
+    this->num_blocks = new_num_blocks;
+}
+
+namespace {
+
+// records of oblivious_rebuild: [sort key][block id][data]
+constexpr uint64_t rebuild_record_header_size = 2 * sizeof(uint64_t);
+
+inline void
+oblivious_compare_exchange(byte_t *a, byte_t *b, bool ascending, byte_t *tmp, uint64_t record_size) {
+    uint64_t key_a, key_b;
+    std::memcpy(&key_a, a, sizeof(uint64_t));
+    std::memcpy(&key_b, b, sizeof(uint64_t));
+    bool do_swap = (key_a > key_b) == ascending;
+    std::memcpy(tmp, a, record_size);
+    conditional_memcpy(do_swap, a, b, record_size);
+    conditional_memcpy(do_swap, b, tmp, record_size);
+}
+
+// bitonic merge steps j, j/2, ..., 1 of stage k on a chunk held in memory
+void
+bitonic_steps_in_chunk(byte_t *chunk, uint64_t chunk_index, uint64_t records_per_chunk, uint64_t k, uint64_t j, byte_t *tmp, uint64_t record_size) {
+    for (; j > 0; j /= 2) {
+        for (uint64_t i = 0; i < records_per_chunk; i++) {
+            uint64_t partner = i ^ j;
+            if (partner > i) {
+                bool ascending = (((chunk_index * records_per_chunk) + i) & k) == 0;
+                oblivious_compare_exchange(chunk + i * record_size, chunk + partner * record_size, ascending, tmp, record_size);
+            }
+        }
+    }
+}
+
+// chunks of records stored encrypted under a one time key in the scratch memory
+class RebuildScratch {
+    public:
+    RebuildScratch(Memory *memory, CryptoModule *crypto_module, uint64_t chunk_size, uint64_t num_chunks) :
+    memory(memory),
+    crypto_module(crypto_module),
+    chunk_size(chunk_size),
+    auth_tag_size(crypto_module->auth_tag_size()),
+    pages_per_chunk(divide_round_up(chunk_size + crypto_module->auth_tag_size(), memory->page_size())),
+    random_nonce_bytes(crypto_module->nonce_size() - 2 * sizeof(uint64_t)),
+    write_counters(num_chunks, 0),
+    key(crypto_module->key_size()),
+    nonce(crypto_module->nonce_size()),
+    cipher_text(pages_per_chunk * memory->page_size())
+    {
+        this->crypto_module->random(this->key.data(), this->key.size());
+        this->crypto_module->random(this->nonce.data(), this->random_nonce_bytes);
+    }
+
+    static uint64_t chunk_stride(uint64_t chunk_size, uint64_t auth_tag_size, uint64_t page_size) {
+        return divide_round_up(chunk_size + auth_tag_size, page_size) * page_size;
+    }
+
+    void load(const std::vector<uint64_t> &chunk_ids, byte_t *buffer) {
+        this->prepare_requests(chunk_ids, MemoryRequestType::READ);
+        this->memory->batch_access(this->requests);
+        for (std::size_t i = 0; i < chunk_ids.size(); i++) {
+            for (uint64_t page = 0; page < this->pages_per_chunk; page++) {
+                const auto &request = this->requests[i * this->pages_per_chunk + page];
+                std::memcpy(this->cipher_text.data() + page * request.size, request.data.data(), request.size);
+            }
+            this->set_nonce(chunk_ids[i]);
+            bool verification_result = this->crypto_module->decrypt(
+                this->key.data(),
+                this->nonce.data(),
+                this->cipher_text.data(),
+                this->chunk_size,
+                this->cipher_text.data() + this->chunk_size,
+                buffer + i * this->chunk_size
+            );
+            if (!verification_result) {
+                throw std::runtime_error("Auth Tag verification Failed");
+            }
+        }
+    }
+
+    void store(const std::vector<uint64_t> &chunk_ids, const byte_t *buffer) {
+        this->prepare_requests(chunk_ids, MemoryRequestType::WRITE);
+        for (std::size_t i = 0; i < chunk_ids.size(); i++) {
+            this->write_counters[chunk_ids[i]]++;
+            this->set_nonce(chunk_ids[i]);
+            this->crypto_module->encrypt(
+                this->key.data(),
+                this->nonce.data(),
+                buffer + i * this->chunk_size,
+                this->chunk_size,
+                this->cipher_text.data(),
+                this->cipher_text.data() + this->chunk_size
+            );
+            for (uint64_t page = 0; page < this->pages_per_chunk; page++) {
+                auto &request = this->requests[i * this->pages_per_chunk + page];
+                std::memcpy(request.data.data(), this->cipher_text.data() + page * request.size, request.size);
+            }
+        }
+        this->memory->batch_access(this->requests);
+    }
+
+    private:
+    void prepare_requests(const std::vector<uint64_t> &chunk_ids, MemoryRequestType type) {
+        const uint64_t page_size = this->memory->page_size();
+        this->requests.resize(chunk_ids.size() * this->pages_per_chunk, MemoryRequest(type, 0, page_size));
+        for (std::size_t i = 0; i < chunk_ids.size(); i++) {
+            for (uint64_t page = 0; page < this->pages_per_chunk; page++) {
+                auto &request = this->requests[i * this->pages_per_chunk + page];
+                request.type = type;
+                request.address = (chunk_ids[i] * this->pages_per_chunk + page) * page_size;
+            }
+        }
+    }
+
+    void set_nonce(uint64_t chunk_id) {
+        std::memcpy(this->nonce.data() + this->random_nonce_bytes, &chunk_id, sizeof(uint64_t));
+        std::memcpy(this->nonce.data() + this->random_nonce_bytes + sizeof(uint64_t), &this->write_counters[chunk_id], sizeof(uint64_t));
+    }
+
+    Memory *memory;
+    CryptoModule *crypto_module;
+    const uint64_t chunk_size;
+    const uint64_t auth_tag_size;
+    const uint64_t pages_per_chunk;
+    const uint64_t random_nonce_bytes;
+    std::vector<uint64_t> write_counters;
+    bytes_t key;
+    bytes_t nonce;
+    bytes_t cipher_text;
+    std::vector<MemoryRequest> requests;
+};
+
+}
+
+uint64_t 
+PageOptimizedRAWOram::rebuild_scratch_size(uint64_t records_per_chunk, uint64_t scratch_page_size) const {
+    uint64_t total_slots = (this->untrusted_memory->size() / this->untrusted_memory_page_size) * this->blocks_per_bucket;
+    uint64_t num_records = std::max(std::bit_ceil(total_slots + this->stash.capacity()), records_per_chunk);
+    uint64_t record_size = rebuild_record_header_size + this->block_size;
+    return (num_records / records_per_chunk) * RebuildScratch::chunk_stride(records_per_chunk * record_size, this->auth_tag_bytes, scratch_page_size);
+}
+
+void 
+PageOptimizedRAWOram::oblivious_rebuild(Memory *scratch_memory, uint64_t records_per_chunk) {
+    if (records_per_chunk == 0 || !std::has_single_bit(records_per_chunk)) {
+        throw std::invalid_argument(absl::StrFormat("Records per chunk has to be a power of two, got %lu", records_per_chunk));
+    }
+    if (scratch_memory->size() < this->rebuild_scratch_size(records_per_chunk, scratch_memory->page_size())) {
+        throw std::invalid_argument(absl::StrFormat(
+            "Scratch memory of %lu bytes is too small, %lu bytes are needed",
+            scratch_memory->size(), this->rebuild_scratch_size(records_per_chunk, scratch_memory->page_size())
+        ));
+    }
+
+    const uint64_t total_buckets = this->untrusted_memory->size() / this->untrusted_memory_page_size;
+    const uint64_t total_slots = total_buckets * this->blocks_per_bucket;
+    const uint64_t num_records = std::max(std::bit_ceil(total_slots + this->stash.capacity()), records_per_chunk);
+    const uint64_t num_chunks = num_records / records_per_chunk;
+    const uint64_t record_size = rebuild_record_header_size + this->block_size;
+    const uint64_t chunk_size = records_per_chunk * record_size;
+    const uint64_t buckets_per_batch = std::max(records_per_chunk / this->blocks_per_bucket, 1UL);
+    const uint64_t page_metadata_offset = this->block_size * this->blocks_per_bucket;
+    const uint64_t bitfield_size = divide_round_up(this->blocks_per_bucket, 8UL);
+
+    this->wait_for_eviction_prefetch();
+    this->tree_version++;
+
+    std::cout << absl::StreamFormat("Rebuilding ORAM with %lu slots using %lu chunks of %lu records\n", total_slots, num_chunks, records_per_chunk);
+
+    RebuildScratch scratch(scratch_memory, this->crypto_module.get(), chunk_size, num_chunks);
+    bytes_t chunk_buffer(2 * chunk_size);
+    bytes_t record_tmp(record_size);
+    std::vector<MemoryRequest> bucket_requests;
+    MemoryRequest bitfield_request(MemoryRequestType::READ, 0, bitfield_size);
+    bytes_t decrypted_bucket(this->untrusted_memory_page_size);
+
+    // all extra records have to be dropped at the end, mark that many dummies to sort to the back
+    const uint64_t to_drop = num_records - total_slots;
+    uint64_t dropped = 0;
+    uint64_t emitted = 0;
+    auto emit_record = [&](uint64_t block_id, bool is_dummy, const byte_t *data) {
+        byte_t *record = chunk_buffer.data() + (emitted % records_per_chunk) * record_size;
+        bool is_excess = is_dummy && (dropped < to_drop);
+        dropped += is_excess;
+        uint64_t sort_key = (absl::Uniform<uint64_t>(this->bit_gen) >> 1) | (static_cast<uint64_t>(is_excess) << 63);
+        uint64_t invalid = INVALID_BLOCK_ID;
+        conditional_memcpy(is_dummy, &block_id, &invalid, sizeof(uint64_t));
+
+        std::memcpy(record, &sort_key, sizeof(uint64_t));
+        std::memcpy(record + sizeof(uint64_t), &block_id, sizeof(uint64_t));
+        std::memcpy(record + rebuild_record_header_size, data, this->block_size);
+
+        emitted++;
+        if (emitted % records_per_chunk == 0) {
+            scratch.store({emitted / records_per_chunk - 1}, chunk_buffer.data());
+        }
+    };
+
+    // read the tree sequentially, one record per slot
+    auto read_start = std::chrono::steady_clock::now();
+    this->valid_bit_tree_controller->decrypt_contents(this->key.data());
+    uint64_t level = 0;
+    uint64_t level_offset = 0;
+    uint64_t level_size = 1;
+    for (uint64_t batch_start = 0; batch_start < total_buckets; batch_start += buckets_per_batch) {
+        uint64_t batch_size = std::min(buckets_per_batch, total_buckets - batch_start);
+        bucket_requests.resize(batch_size, MemoryRequest(MemoryRequestType::READ, 0, this->untrusted_memory_page_size));
+        for (uint64_t i = 0; i < batch_size; i++) {
+            bucket_requests[i].type = MemoryRequestType::READ;
+            bucket_requests[i].address = (batch_start + i) * this->untrusted_memory_page_size;
+        }
+        this->untrusted_memory->batch_access(bucket_requests);
+
+        for (uint64_t i = 0; i < batch_size; i++) {
+            uint64_t counter = this->get_bucket_counter(level, level_offset, this->root_counter);
+            std::memcpy(this->nonce_buffer.data() + this->random_nonce_bytes, &(bucket_requests[i].address), sizeof(std::uint64_t));
+            std::memcpy(this->nonce_buffer.data() + this->random_nonce_bytes + sizeof(std::uint64_t), &counter, sizeof(std::uint64_t));
+            auto verification_result = this->crypto_module->decrypt(
+                this->key.data(),
+                this->nonce_buffer.data(),
+                bucket_requests[i].data.data(),
+                this->untrusted_memory_page_size - this->auth_tag_bytes,
+                bucket_requests[i].data.data() + this->untrusted_memory_page_size - this->auth_tag_bytes,
+                decrypted_bucket.data()
+            );
+            if (!verification_result) {
+                throw std::runtime_error("Auth Tag verification Failed");
+            }
+
+            bitfield_request.address = this->valid_bit_tree_controller->get_address_of(level, level_offset);
+            this->valid_bit_tree_memory->access(bitfield_request);
+
+            for (uint64_t slot = 0; slot < this->blocks_per_bucket; slot++) {
+                const byte_t *metadata = decrypted_bucket.data() + page_metadata_offset + slot * this->metadata_layout.metadata_size();
+                bool valid = (bitfield_request.data[slot / 8] >> (slot % 8)) & 1;
+                emit_record(this->metadata_layout.get_block_index(metadata), !valid, decrypted_bucket.data() + slot * this->block_size);
+            }
+
+            level_offset++;
+            if (level_offset == level_size) {
+                level_offset = 0;
+                level_size = (level == 0 ? level_size * this->top_level_order : level_size << this->tree_bits);
+                level++;
+            }
+        }
+    }
+
+    this->stash.empty_stash([&](const BlockMetadata *metadata, const byte_t *data) {
+        emit_record(metadata->get_block_index(), !metadata->is_valid(), data);
+    });
+
+    bytes_t zero_block(this->block_size);
+    while (emitted < num_records) {
+        emit_record(INVALID_BLOCK_ID, true, zero_block.data());
+    }
+    auto read_end = std::chrono::steady_clock::now();
+    std::cout << absl::StreamFormat("Read %lu records in %.2fs\n", emitted, std::chrono::duration<double>(read_end - read_start).count());
+
+    // external bitonic sort, steps that cross chunks work on pairs of chunks
+    auto sort_start = std::chrono::steady_clock::now();
+    for (uint64_t chunk = 0; chunk < num_chunks; chunk++) {
+        scratch.load({chunk}, chunk_buffer.data());
+        for (uint64_t k = 2; k <= records_per_chunk; k *= 2) {
+            bitonic_steps_in_chunk(chunk_buffer.data(), chunk, records_per_chunk, k, k / 2, record_tmp.data(), record_size);
+        }
+        scratch.store({chunk}, chunk_buffer.data());
+    }
+    for (uint64_t k = 2 * records_per_chunk; k <= num_records; k *= 2) {
+        for (uint64_t j = k / 2; j >= records_per_chunk; j /= 2) {
+            uint64_t chunk_distance = j / records_per_chunk;
+            for (uint64_t chunk = 0; chunk < num_chunks; chunk++) {
+                if ((chunk & chunk_distance) != 0) {
+                    continue;
+                }
+                std::vector<uint64_t> chunk_pair = {chunk, chunk | chunk_distance};
+                scratch.load(chunk_pair, chunk_buffer.data());
+                bool ascending = ((chunk * records_per_chunk) & k) == 0;
+                for (uint64_t i = 0; i < records_per_chunk; i++) {
+                    oblivious_compare_exchange(chunk_buffer.data() + i * record_size, chunk_buffer.data() + chunk_size + i * record_size, ascending, record_tmp.data(), record_size);
+                }
+                scratch.store(chunk_pair, chunk_buffer.data());
+            }
+        }
+        for (uint64_t chunk = 0; chunk < num_chunks; chunk++) {
+            scratch.load({chunk}, chunk_buffer.data());
+            bitonic_steps_in_chunk(chunk_buffer.data(), chunk, records_per_chunk, k, records_per_chunk / 2, record_tmp.data(), record_size);
+            scratch.store({chunk}, chunk_buffer.data());
+        }
+    }
+    auto sort_end = std::chrono::steady_clock::now();
+    std::cout << absl::StreamFormat("Sorted records in %.2fs\n", std::chrono::duration<double>(sort_end - sort_start).count());
+
+    // write the first total_slots records back as a fresh tree, same as fast_init()
+    auto write_start = std::chrono::steady_clock::now();
+    this->crypto_module->random(this->key.data(), this->crypto_module->key_size());
+    this->crypto_module->random(this->nonce_buffer.data(), this->random_nonce_bytes);
+    this->root_counter = 0;
+
+    MemoryRequest position_map_request(MemoryRequestType::WRITE, 0, this->metadata_layout.path_index_size);
+    bytes_t page_buffer(this->untrusted_memory_page_size);
+    bitfield_request.type = MemoryRequestType::WRITE;
+    std::memset(bitfield_request.data.data(), 0, bitfield_size);
+    std::memset(page_buffer.data(), 0, page_buffer.size());
+    uint64_t num_pending_buckets = 0;
+
+    level = 0;
+    level_offset = 0;
+    level_size = 1;
+    uint64_t record_index = 0;
+    for (uint64_t chunk = 0; chunk < num_chunks && record_index < total_slots; chunk++) {
+        scratch.load({chunk}, chunk_buffer.data());
+        for (uint64_t i = 0; i < records_per_chunk && record_index < total_slots; i++, record_index++) {
+            const byte_t *record = chunk_buffer.data() + i * record_size;
+            uint64_t block_id;
+            std::memcpy(&block_id, record + sizeof(uint64_t), sizeof(uint64_t));
+            bool is_dummy = block_id == INVALID_BLOCK_ID;
+            uint64_t slot = record_index % this->blocks_per_bucket;
+
+            uint64_t path_upper = level_offset << ((this->levels - 1 - level) * this->tree_bits);
+            uint64_t path_lower_limit = std::min(1UL << ((this->levels - 1 - level) * this->tree_bits), this->_num_paths);
+            uint64_t path = path_upper | absl::Uniform(this->bit_gen, 0UL, path_lower_limit);
+
+            std::memcpy(page_buffer.data() + slot * this->block_size, record + rebuild_record_header_size, this->block_size);
+            byte_t *metadata = page_buffer.data() + page_metadata_offset + slot * this->metadata_layout.metadata_size();
+            this->metadata_layout.set_block_index(metadata, block_id);
+            this->metadata_layout.set_path_index(metadata, path);
+            bitfield_request.data[slot / 8] |= static_cast<byte_t>(!is_dummy) << (slot % 8);
+
+            // dummies read the first entry so real and dummy records look the same to the position map
+            MemoryRequestType position_map_request_type = MemoryRequestType::WRITE;
+            MemoryRequestType dummy_request_type = MemoryRequestType::READ;
+            uint64_t position_map_address = this->get_position_map_address(block_id);
+            uint64_t dummy_address = 0;
+            conditional_memcpy(is_dummy, &position_map_request_type, &dummy_request_type, sizeof(MemoryRequestType));
+            conditional_memcpy(is_dummy, &position_map_address, &dummy_address, sizeof(uint64_t));
+            position_map_request.type = position_map_request_type;
+            position_map_request.address = position_map_address;
+            std::memcpy(position_map_request.data.data(), &path, this->metadata_layout.path_index_size);
+            this->position_map->access(position_map_request);
+
+            if (slot != this->blocks_per_bucket - 1) {
+                continue;
+            }
+
+            // bucket is complete, encrypt it with counter 0 under the new key
+            uint64_t page_id = record_index / this->blocks_per_bucket;
+            if (num_pending_buckets == bucket_requests.size()) {
+                bucket_requests.emplace_back(MemoryRequestType::WRITE, 0, this->untrusted_memory_page_size);
+            }
+            auto &bucket_request = bucket_requests[num_pending_buckets++];
+            bucket_request.type = MemoryRequestType::WRITE;
+            bucket_request.address = page_id * this->untrusted_memory_page_size;
+
+            uint64_t counter = 0;
+            std::memcpy(this->nonce_buffer.data() + this->random_nonce_bytes, &(bucket_request.address), sizeof(std::uint64_t));
+            std::memcpy(this->nonce_buffer.data() + this->random_nonce_bytes + sizeof(std::uint64_t), &counter, sizeof(std::uint64_t));
+            this->crypto_module->encrypt(
+                this->key.data(),
+                this->nonce_buffer.data(),
+                page_buffer.data(),
+                this->untrusted_memory_page_size - this->auth_tag_bytes,
+                bucket_request.data.data(),
+                bucket_request.data.data() + this->untrusted_memory_page_size - this->auth_tag_bytes
+            );
+
+            bitfield_request.address = this->valid_bit_tree_controller->get_address_of(level, level_offset);
+            this->valid_bit_tree_memory->access(bitfield_request);
+            std::memset(bitfield_request.data.data(), 0, bitfield_size);
+            std::memset(page_buffer.data(), 0, page_buffer.size());
+
+            if (num_pending_buckets == buckets_per_batch || page_id == total_buckets - 1) {
+                bucket_requests.resize(num_pending_buckets);
+                this->untrusted_memory->batch_access(bucket_requests);
+                num_pending_buckets = 0;
+            }
+
+            level_offset++;
+            if (level_offset == level_size) {
+                level_offset = 0;
+                level_size = (level == 0 ? level_size * this->top_level_order : level_size << this->tree_bits);
+                level++;
+            }
+        }
+    }
+    this->valid_bit_tree_controller->encrypt_contents(this->key.data());
+
+    this->eviction_path_gen.reset();
+    this->access_counter = 0;
+    this->currently_loaded_path.reset();
+    auto write_end = std::chrono::steady_clock::now();
+    std::cout << absl::StreamFormat("Wrote new tree in %.2fs\n", std::chrono::duration<double>(write_end - write_start).count());
+}
+
 void 
 PageOptimizedRAWOram::access_block(
     MemoryRequestType request_type, uint64_t logical_block_address, unsigned char *buffer, 
-    uint64_t offset, uint64_t length
+    uint64_t offset, uint64_t length, const memory_update_function *update_function
 ) {
     bool place_block_in_stash = true;
     bool force_bypass_read = false;
@@ -758,6 +1279,13 @@ PageOptimizedRAWOram::access_block(
         // move original contents from temp buffer back into the request
         std::memcpy(buffer, temp_buffer.data(), length);
         break;
+    case MemoryRequestType::UPDATE:
+        // modify the block while it is in trusted memory, saves a second access for read-modify-write
+        if (update_function == nullptr || !(*update_function)) {
+            throw std::invalid_argument("UPDATE request without an update function");
+        }
+        (*update_function)(target_block.block.data() + offset, buffer);
+        break;
     default:
         throw std::invalid_argument("unkown memory request type");
         break;
@@ -850,7 +1378,7 @@ PageOptimizedRAWOram::place_block_on_path(const BlockMetadata *metadata, const b
 
     access_counter++;
 
-    if (this->access_counter >= this->num_accesses_per_eviction) {
+    if (this->access_counter >= this->num_accesses_per_eviction * this->evictions_per_batch) {
         // check if an eviction need to happen
         this->eviction_access();
         this->access_counter = 0;
@@ -884,101 +1412,50 @@ PageOptimizedRAWOram::read_path(uint64_t path) {
         current_level_size = (level == 0 ? current_level_size * this->top_level_order : current_level_size << this->tree_bits);
     }
 
+    // the valid bits are read while the buckets are in flight, the path costs one round trip instead of two
     auto path_read_start = std::chrono::steady_clock::now();
-    this->untrusted_memory->batch_access(this->path_access);
+    {
+        std::scoped_lock lock(this->untrusted_memory_mutex);
+        this->untrusted_memory->submit_batch_access(this->path_access);
+        this->valid_bit_tree_controller->submit_read_path(this->key.data(), path);
+        this->untrusted_memory->complete_batch_access(this->path_access);
+    }
     // this->untrusted_memory->barrier();
     auto path_read_end = std::chrono::steady_clock::now();
     this->oram_statistics->add_path_read_time(path_read_end - path_read_start);
 
     auto valid_bit_tree_start = std::chrono::steady_clock::now();
-    this->valid_bit_tree_controller->read_path(this->key.data(), path);
+    this->valid_bit_tree_controller->complete_read_path(this->key.data());
     // this->valid_bit_tree_memory->barrier();
     auto valid_bit_tree_end = std::chrono::steady_clock::now();
     this->oram_statistics->add_valid_bit_tree_time(valid_bit_tree_end - valid_bit_tree_start);
 
     // decrypt path
     auto crypto_start = std::chrono::steady_clock::now();
+    this->crypto_batch.clear();
     for (addr_t level = 0; level < this->levels; level++) {
         // prepare counter
-        addr_t counter = this->root_counter / (1UL << level);
         addr_t current_level_offset = path >> ((this->levels - 1 - level) * this->tree_bits);
-        if (reverse_bits(current_level_offset, level) < this->root_counter % (1UL << level)) {
-            counter += 1;
-        }
+        addr_t counter = this->get_bucket_counter(level, current_level_offset, this->root_counter);
         
         // prepare nonce
         std::memcpy(this->nonce_buffer.data() + this->random_nonce_bytes, &(this->path_access[level].address), sizeof(std::uint64_t));
         std::memcpy(this->nonce_buffer.data() + this->random_nonce_bytes + sizeof(std::uint64_t), &counter, sizeof(std::uint64_t));
 
-        // decrypt page
-        auto verification_result = this->crypto_module->decrypt(
-            this->key.data(),
+        // decrypt page in place, the read buffer becomes the path buffer
+        this->crypto_batch.add(
             this->nonce_buffer.data(),
             this->path_access[level].data.data(),
-            this->untrusted_memory_page_size - this->auth_tag_bytes,
-            this->path_access[level].data.data() + this->untrusted_memory_page_size - this->auth_tag_bytes,
-            this->decrypted_path.data() + level * this->untrusted_memory_page_size
-        );
-
-        if (!verification_result) {
-            throw std::runtime_error("Auth Tag verification Failed");
-        }
-    }
-    auto crypto_end = std::chrono::steady_clock::now();
-    this->oram_statistics->add_crypto_time(crypto_end - crypto_start);
-
-}
-
-void 
-PageOptimizedRAWOram::write_path() {
-    this->oram_statistics->increment_path_write();
-    addr_t path = this->currently_loaded_path.value();
-    for (addr_t level = 0; level < this->levels; level++) {
-        this->path_access[level].type = MemoryRequestType::WRITE;
-        // this->valid_bitfield_access[level].type = MemoryRequestType::WRITE;
-    }
-
-    // encrypt
-    auto crypto_start = std::chrono::steady_clock::now();
-    for (addr_t level = 0; level < this->levels; level++) {
-        // prepare counter
-        addr_t counter = this->root_counter / (1UL << level);
-        addr_t current_level_offset = path >> ((this->levels - 1 - level) * this->tree_bits);
-        if (reverse_bits(current_level_offset, level) < this->root_counter % (1UL << level)) {
-            counter += 1;
-        }
-        counter += 1;
-        
-        // prepare nonce
-        std::memcpy(this->nonce_buffer.data() + this->random_nonce_bytes, &(this->path_access[level].address), sizeof(std::uint64_t));
-        std::memcpy(this->nonce_buffer.data() + this->random_nonce_bytes + sizeof(std::uint64_t), &counter, sizeof(std::uint64_t));
-
-        // encrypt page
-        this->crypto_module->encrypt(
-            this->key.data(),
-            this->nonce_buffer.data(),
-            this->decrypted_path.data() + level * this->untrusted_memory_page_size,
-            this->untrusted_memory_page_size - this->auth_tag_bytes,
-            this->path_access[level].data.data(),
             this->path_access[level].data.data() + this->untrusted_memory_page_size - this->auth_tag_bytes
         );
+        this->path_buckets[level] = this->path_access[level].data.data();
+    }
+    if (!this->crypto_batch.decrypt(this->crypto_module.get(), this->key.data(), this->untrusted_memory_page_size - this->auth_tag_bytes)) {
+        throw std::runtime_error("Auth Tag verification Failed");
     }
     auto crypto_end = std::chrono::steady_clock::now();
     this->oram_statistics->add_crypto_time(crypto_end - crypto_start);
-    auto path_write_start = std::chrono::steady_clock::now();
-    this->untrusted_memory->batch_access(this->path_access);
-    // this->valid_bitfield->batch_access(this->valid_bitfield_access);
-    
 
-    // this->untrusted_memory->barrier();
-    auto path_write_end = std::chrono::steady_clock::now();
-    this->oram_statistics->add_path_write_time(path_write_end - path_write_start);
-
-    auto valid_bit_tree_start = std::chrono::steady_clock::now();
-    this->valid_bit_tree_controller->write_path(this->key.data());
-    // this->valid_bit_tree_memory->barrier();
-    auto valid_bit_tree_end = std::chrono::steady_clock::now();
-    this->oram_statistics->add_valid_bit_tree_time(valid_bit_tree_end - valid_bit_tree_start);
 }
 
 uint64_t 
@@ -1067,17 +1544,31 @@ PageOptimizedRAWOram::read_and_update_position_map_function(uint64_t logical_blo
 
 std::size_t 
 PageOptimizedRAWOram::try_evict_block_from_path_buffer(std::size_t max_count, uint64_t ignored_bits, uint64_t path, BlockMetadata *metadatas, byte_t *data_blocks, uint64_t level_limit) {
-    std::size_t num_blocks_evicted = 0;
     auto path_scan_start = std::chrono::steady_clock::now();
+    std::size_t num_blocks_evicted = (this->*this->path_kernels.try_evict_block_from_path_buffer)(max_count, ignored_bits, path, metadatas, data_blocks, level_limit);
+    auto path_scan_end = std::chrono::steady_clock::now();
+    this->oram_statistics->add_path_scan_time(path_scan_end - path_scan_start);
+    return num_blocks_evicted;
+}
+
+template <std::size_t BlockSize, std::size_t BlockIndexSize, std::size_t PathIndexSize>
+std::size_t 
+PageOptimizedRAWOram::try_evict_block_from_path_buffer_kernel(std::size_t max_count, uint64_t ignored_bits, uint64_t path, BlockMetadata *metadatas, byte_t *data_blocks, uint64_t level_limit) {
+    const std::size_t block_size = BlockSize != 0 ? BlockSize : this->block_size;
+    const std::size_t metadata_size = this->metadata_layout.metadata_size<BlockIndexSize, PathIndexSize>();
+    std::size_t num_blocks_evicted = 0;
     // BlockMetadata invalid;
     BlockMetadata metadata_buffer;
     for (uint64_t i = 0; i < this->levels && i <= level_limit; i++) {
         uint64_t level = std::min(this->levels - 1, level_limit) - i;
+        byte_t *bucket_data = this->get_data_block(level, 0);
+        byte_t *bucket_metadata = this->get_metadata(level, 0);
+        byte_t *bitfield = this->valid_bit_tree_controller->get_bitfield_for_bucket(level);
         for (uint64_t slot_index = 0; slot_index < this->blocks_per_bucket; slot_index++) {
-            byte_t * metadata = this->get_metadata(level, slot_index);
-            byte_t * current_slot_data_block = this->get_data_block(level, slot_index);
-            bool block_valid = this->valid_bit_tree_controller->is_valid(level, slot_index);
-            metadata_buffer = this->metadata_layout.to_block_metadata(metadata, block_valid);
+            byte_t * metadata = bucket_metadata + metadata_size * slot_index;
+            byte_t * current_slot_data_block = bucket_data + block_size * slot_index;
+            bool block_valid = ValidBitTreeController::is_valid_in_bucket(bitfield, slot_index);
+            metadata_buffer = this->metadata_layout.to_block_metadata<BlockIndexSize, PathIndexSize>(metadata, block_valid);
             bool is_eviction_candidate = block_valid && (metadata_buffer.get_path() >> ignored_bits) == (path >> ignored_bits);
             bool do_evict = (num_blocks_evicted < max_count) && is_eviction_candidate;
             std::size_t offset = num_blocks_evicted == max_count ? max_count - 1: num_blocks_evicted;
@@ -1085,51 +1576,236 @@ PageOptimizedRAWOram::try_evict_block_from_path_buffer(std::size_t max_count, ui
             conditional_memcpy(do_evict, metadatas + offset, &metadata_buffer, block_metadata_size);
             conditional_memcpy(
                 do_evict,
-                data_blocks + (this->block_size * offset),
+                data_blocks + (block_size * offset),
                 current_slot_data_block,
-                this->block_size
+                block_size
             );
-            this->valid_bit_tree_controller->conditional_set_valid(level, slot_index, false, do_evict);
+            ValidBitTreeController::conditional_set_valid_in_bucket(bitfield, slot_index, false, do_evict);
 
             // conditional_memcpy(do_evict, metadata, &invalid, block_metadata_size);
 
             num_blocks_evicted += (do_evict ? 1: 0);
         }
     }
-    auto path_scan_end = std::chrono::steady_clock::now();
-    this->oram_statistics->add_path_scan_time(path_scan_end - path_scan_start);
     return num_blocks_evicted;
 }
 
+void 
+PageOptimizedRAWOram::write_back_eviction_buffer(addr_t level, addr_t num_blocks_evicted) {
+    (this->*this->path_kernels.write_back_eviction_buffer)(level, num_blocks_evicted);
+}
+
+template <std::size_t BlockSize, std::size_t BlockIndexSize, std::size_t PathIndexSize>
+void 
+PageOptimizedRAWOram::write_back_eviction_buffer_kernel(addr_t level, addr_t num_blocks_evicted) {
+    const std::size_t block_size = BlockSize != 0 ? BlockSize : this->block_size;
+    const std::size_t metadata_size = this->metadata_layout.metadata_size<BlockIndexSize, PathIndexSize>();
+    byte_t *bucket_data = this->get_data_block(level, 0);
+    byte_t *bucket_metadata = this->get_metadata(level, 0);
+    byte_t *bitfield = this->valid_bit_tree_controller->get_bitfield_for_bucket(level);
+    for (addr_t slot_index = 0; slot_index < this->blocks_per_bucket; slot_index++) {
+        this->metadata_layout.from_block_metadata<BlockIndexSize, PathIndexSize>(bucket_metadata + metadata_size * slot_index, this->eviction_metadata_buffer[slot_index]);
+        std::memcpy(bucket_data + block_size * slot_index, this->eviction_data_block_buffer.data() + slot_index * block_size, block_size);
+        ValidBitTreeController::set_valid_in_bucket(bitfield, slot_index, slot_index < num_blocks_evicted);
+    }
+}
+
 void 
 PageOptimizedRAWOram::eviction_access() {
-    // addr_t cycle_index = this->eviction_counter % this->num_paths;
-    // // std::cout << "CI: " << cycle_index << "\n";
-    // addr_t path_lower = reverse_bits(cycle_index % this->top_level_order, this->tree_bits);
-    // // std::cout << "PL: "<< path_lower << "\n";
-    // addr_t path_upper = (cycle_index / this->top_level_order) << this->tree_bits;
-    // // std::cout << "PU: " << path_upper << "\n";
-    // // std::cout << "PC: " << (path_upper | path_lower) << "\n";
-    // addr_t path = reverse_bits(path_upper | path_lower, (this->levels - 1) * this->tree_bits);
-    addr_t path = this->eviction_path_gen.next_path();
-
-    // std::cout << absl::StrFormat("Eviction access on path %lu, %lu\n", path, reverse_bits(path, this->levels - 1));
-
-    // read path
-    this->read_path(path);
-
-    // for (addr_t level = 0; level < this->levels; level++) {
-    //     // pull all valid blocks into stash
-    //     addr_t valid_counter = 0;
-    //     for (addr_t block_index = 0; block_index < this->blocks_per_bucket; block_index++) {
-    //         if (this->valid_bitfield_access[level].data[block_index]) {
-    //             this->stash.add_block(this->get_metadata(level, block_index), this->get_data_block(level, block_index), this->block_size);
-    //             valid_counter++;
-    //         }
-    //     }
-    //     // std::cout << absl::StrFormat("Level %lu has %lu vacancies\n", level, this->blocks_per_bucket - valid_counter);
-    // }
+    const uint64_t k = this->evictions_per_batch;
+    std::vector<addr_t> paths(k);
+    for (uint64_t i = 0; i < k; i++) {
+        paths[i] = this->eviction_path_gen.next_path();
+    }
+
+    // use the prefetched buckets if they are for these paths and the tree was not written since
+    auto path_read_start = std::chrono::steady_clock::now();
+    this->wait_for_eviction_prefetch();
+    bool prefetch_usable = this->prefetched_tree_version.has_value()
+        && this->prefetched_tree_version.value() == this->tree_version
+        && this->eviction_paths == paths;
+    this->prefetched_tree_version.reset();
+    if (!prefetch_usable) {
+        this->prepare_eviction_buckets(paths);
+    }
+    {
+        // the valid bits of the first path are read together with the buckets
+        std::scoped_lock lock(this->untrusted_memory_mutex);
+        if (!prefetch_usable) {
+            this->untrusted_memory->submit_batch_access(this->eviction_bucket_access);
+        }
+        this->valid_bit_tree_controller->submit_read_path(this->key.data(), paths[0]);
+        if (!prefetch_usable) {
+            this->untrusted_memory->complete_batch_access(this->eviction_bucket_access);
+        }
+    }
+    auto path_read_end = std::chrono::steady_clock::now();
+    this->oram_statistics->add_path_read_time(path_read_end - path_read_start);
+    for (uint64_t i = 0; i < k; i++) {
+        this->oram_statistics->increment_path_read();
+    }
+
+    const std::size_t num_buckets = this->eviction_bucket_access.size();
+
+    auto crypto_start = std::chrono::steady_clock::now();
+    this->crypto_batch.clear();
+    for (std::size_t bucket = 0; bucket < num_buckets; bucket++) {
+        addr_t counter = this->get_bucket_counter(this->eviction_bucket_levels[bucket], this->eviction_bucket_offsets[bucket], this->root_counter);
+        std::memcpy(this->nonce_buffer.data() + this->random_nonce_bytes, &(this->eviction_bucket_access[bucket].address), sizeof(std::uint64_t));
+        std::memcpy(this->nonce_buffer.data() + this->random_nonce_bytes + sizeof(std::uint64_t), &counter, sizeof(std::uint64_t));
+
+        this->crypto_batch.add(
+            this->nonce_buffer.data(),
+            this->eviction_bucket_access[bucket].data.data(),
+            this->eviction_bucket_access[bucket].data.data() + this->untrusted_memory_page_size - this->auth_tag_bytes
+        );
+    }
+    if (!this->crypto_batch.decrypt(this->crypto_module.get(), this->key.data(), this->untrusted_memory_page_size - this->auth_tag_bytes)) {
+        throw std::runtime_error("Auth Tag verification Failed");
+    }
+    auto crypto_end = std::chrono::steady_clock::now();
+    this->oram_statistics->add_crypto_time(crypto_end - crypto_start);
+
+    // evict along each path in order, later paths see the buckets as left by earlier ones
+    for (uint64_t i = 0; i < k; i++) {
+        auto valid_bit_tree_start = std::chrono::steady_clock::now();
+        if (i == 0) {
+            this->valid_bit_tree_controller->complete_read_path(this->key.data());
+        } else {
+            this->valid_bit_tree_controller->read_path(this->key.data(), paths[i]);
+        }
+        auto valid_bit_tree_end = std::chrono::steady_clock::now();
+        this->oram_statistics->add_valid_bit_tree_time(valid_bit_tree_end - valid_bit_tree_start);
 
+        // the path works directly on the shared buckets, later paths see what earlier ones left there
+        this->currently_loaded_path = paths[i];
+        for (addr_t level = 0; level < this->levels; level++) {
+            std::size_t bucket = this->eviction_path_buckets[i * this->levels + level];
+            this->path_buckets[level] = this->eviction_bucket_access[bucket].data.data();
+        }
+
+        this->evict_loaded_path(paths[i]);
+
+        valid_bit_tree_start = std::chrono::steady_clock::now();
+        if (i == k - 1) {
+            // completed together with the bucket writes below
+            this->valid_bit_tree_controller->submit_write_path(this->key.data());
+        } else {
+            this->valid_bit_tree_controller->write_path(this->key.data());
+        }
+        valid_bit_tree_end = std::chrono::steady_clock::now();
+        this->oram_statistics->add_valid_bit_tree_time(valid_bit_tree_end - valid_bit_tree_start);
+    }
+
+    // write every bucket once, with the counter it would have after k single evictions
+    crypto_start = std::chrono::steady_clock::now();
+    this->crypto_batch.clear();
+    for (std::size_t bucket = 0; bucket < num_buckets; bucket++) {
+        addr_t counter = this->get_bucket_counter(this->eviction_bucket_levels[bucket], this->eviction_bucket_offsets[bucket], this->root_counter + k);
+        this->eviction_bucket_access[bucket].type = MemoryRequestType::WRITE;
+        std::memcpy(this->nonce_buffer.data() + this->random_nonce_bytes, &(this->eviction_bucket_access[bucket].address), sizeof(std::uint64_t));
+        std::memcpy(this->nonce_buffer.data() + this->random_nonce_bytes + sizeof(std::uint64_t), &counter, sizeof(std::uint64_t));
+
+        this->crypto_batch.add(
+            this->nonce_buffer.data(),
+            this->eviction_bucket_access[bucket].data.data(),
+            this->eviction_bucket_access[bucket].data.data() + this->untrusted_memory_page_size - this->auth_tag_bytes
+        );
+    }
+    this->crypto_batch.encrypt(this->crypto_module.get(), this->key.data(), this->untrusted_memory_page_size - this->auth_tag_bytes);
+    crypto_end = std::chrono::steady_clock::now();
+    this->oram_statistics->add_crypto_time(crypto_end - crypto_start);
+
+    for (uint64_t i = 0; i < k; i++) {
+        this->oram_statistics->increment_path_write();
+    }
+    auto path_write_start = std::chrono::steady_clock::now();
+    {
+        std::scoped_lock lock(this->untrusted_memory_mutex);
+        this->untrusted_memory->submit_batch_access(this->eviction_bucket_access);
+        this->valid_bit_tree_controller->complete_write_path();
+        this->untrusted_memory->complete_batch_access(this->eviction_bucket_access);
+    }
+    this->tree_version++;
+    auto path_write_end = std::chrono::steady_clock::now();
+    this->oram_statistics->add_path_write_time(path_write_end - path_write_start);
+
+    this->oram_statistics->log_stash_size(this->stash.size());
+    if(this->stash.size() != 0) {
+        std::cout << absl::StreamFormat("%lu blocks in stash\n", this->stash.size());
+    }
+
+    this->root_counter += k;
+
+    if (this->prefetch_eviction_paths) {
+        this->start_eviction_prefetch();
+    }
+}
+
+void 
+PageOptimizedRAWOram::prepare_eviction_buckets(const std::vector<addr_t> &paths) {
+    this->eviction_paths = paths;
+    this->eviction_bucket_access.clear();
+    this->eviction_bucket_levels.clear();
+    this->eviction_bucket_offsets.clear();
+    this->eviction_path_buckets.resize(paths.size() * this->levels);
+
+    // collect the union of the buckets on the paths, consecutive eviction paths share their upper buckets
+    for (std::size_t i = 0; i < paths.size(); i++) {
+        addr_t current_level_size = 1;
+        addr_t offset = 0;
+        for (addr_t level = 0; level < this->levels; level++) {
+            addr_t current_level_offset = paths[i] >> ((this->levels - 1 - level) * this->tree_bits);
+            addr_t address = (offset + current_level_offset) * this->untrusted_memory_page_size;
+            std::size_t bucket_index = 0;
+            while (bucket_index < this->eviction_bucket_access.size() && this->eviction_bucket_access[bucket_index].address != address) {
+                bucket_index++;
+            }
+            if (bucket_index == this->eviction_bucket_access.size()) {
+                this->eviction_bucket_access.emplace_back(MemoryRequestType::READ, address, this->untrusted_memory_page_size);
+                this->eviction_bucket_levels.push_back(level);
+                this->eviction_bucket_offsets.push_back(current_level_offset);
+            }
+            this->eviction_path_buckets[i * this->levels + level] = bucket_index;
+
+            offset += current_level_size;
+            current_level_size = (level == 0 ? current_level_size * this->top_level_order : current_level_size << this->tree_bits);
+        }
+    }
+}
+
+void 
+PageOptimizedRAWOram::read_eviction_buckets() {
+    std::scoped_lock lock(this->untrusted_memory_mutex);
+    this->untrusted_memory->batch_access(this->eviction_bucket_access);
+}
+
+void 
+PageOptimizedRAWOram::start_eviction_prefetch() {
+    // the eviction paths do not depend on the data, peek at the next ones without advancing the generator
+    EvictionPathGenerator lookahead = this->eviction_path_gen;
+    std::vector<addr_t> paths(this->evictions_per_batch);
+    for (auto &path : paths) {
+        path = lookahead.next_path();
+    }
+
+    this->prepare_eviction_buckets(paths);
+    this->prefetched_tree_version = this->tree_version;
+    this->eviction_prefetch = std::async(std::launch::async, [this]() {
+        this->read_eviction_buckets();
+    });
+}
+
+void 
+PageOptimizedRAWOram::wait_for_eviction_prefetch() {
+    if (this->eviction_prefetch.valid()) {
+        // rethrows anything the read threw
+        this->eviction_prefetch.get();
+    }
+}
+
+void 
+PageOptimizedRAWOram::evict_loaded_path(uint64_t path) {
     #ifdef PROFILE_TREE_LOAD
     std::vector<int64_t> tree_loads(this->levels);
     #endif
@@ -1187,15 +1863,7 @@ PageOptimizedRAWOram::eviction_access() {
         #endif
 
         // copy results back into path buffer
-        for (addr_t slot_index = 0; slot_index < this->blocks_per_bucket; slot_index++) {
-            this->metadata_layout.from_block_metadata(this->get_metadata(level, slot_index), this->eviction_metadata_buffer[slot_index]);
-            std::memcpy(this->get_data_block(level, slot_index), this->eviction_data_block_buffer.data() + slot_index * this->block_size, this->block_size);
-            // this->valid_bitfield_access[level].data[slot_index] = 0;
-            this->valid_bit_tree_controller->set_valid(level, slot_index, slot_index < num_blocks_evicted);
-            // const byte_t valid = 1;
-            // conditional_memcpy(slot_index < (this->blocks_per_bucket - slots_available), &this->valid_bitfield_access[level].data[slot_index], &valid, sizeof(byte_t));
-            // this->valid_bit_tree_controller->conditional_set_valid(level, slot_index, true, slot_index < (this->blocks_per_bucket - slots_available));
-        }
+        this->write_back_eviction_buffer(level, num_blocks_evicted);
 
     }
 
@@ -1203,15 +1871,6 @@ PageOptimizedRAWOram::eviction_access() {
     tree_loads.shrink_to_fit();
     oram_statistics->log_tree_load(std::move(tree_loads));
     #endif
-
-    this->write_path();
-
-    this->oram_statistics->log_stash_size(this->stash.size());
-    if(this->stash.size() != 0) {
-        std::cout << absl::StreamFormat("%lu blocks in stash\n", this->stash.size());
-    }
-
-    this->root_counter++;
 }
 
 // StashEntry
@@ -1235,33 +1894,78 @@ PageOptimizedRAWOram::eviction_access() {
 
 bool 
 PageOptimizedRAWOram::find_and_remove_block_on_path_buffer(addr_t logical_block_address, BlockMetadata* metadata_buffer, byte_t *block_buffer) {
-    bool found = false;
     auto path_scan_start = std::chrono::steady_clock::now();
+    bool found = (this->*this->path_kernels.find_and_remove_block_on_path_buffer)(logical_block_address, metadata_buffer, block_buffer);
+    auto path_scan_end = std::chrono::steady_clock::now();
+    this->oram_statistics->add_path_scan_time(path_scan_end - path_scan_start);
+
+    return found;
+}
+
+template <std::size_t BlockSize, std::size_t BlockIndexSize, std::size_t PathIndexSize>
+bool 
+PageOptimizedRAWOram::find_and_remove_block_on_path_buffer_kernel(addr_t logical_block_address, BlockMetadata* metadata_buffer, byte_t *block_buffer) {
+    const std::size_t block_size = BlockSize != 0 ? BlockSize : this->block_size;
+    const std::size_t metadata_size = this->metadata_layout.metadata_size<BlockIndexSize, PathIndexSize>();
+    bool found = false;
     for (addr_t level = 0; level < this->levels; level++) {
+        byte_t *bucket_data = this->get_data_block(level, 0);
+        byte_t *bucket_metadata = this->get_metadata(level, 0);
+        byte_t *bitfield = this->valid_bit_tree_controller->get_bitfield_for_bucket(level);
         for (addr_t block = 0; block < this->blocks_per_bucket; block++) {
-            bool block_valid = this->valid_bit_tree_controller->is_valid(level, block);
-            BlockMetadata meta = this->metadata_layout.to_block_metadata(this->get_metadata(level, block), block_valid);
-            // if (block_valid) {
-            //     std::cout << absl::StreamFormat("Block %lu on level %lu\n", meta.get_block_index(), level);
-            // }
+            bool block_valid = ValidBitTreeController::is_valid_in_bucket(bitfield, block);
+            BlockMetadata meta = this->metadata_layout.to_block_metadata<BlockIndexSize, PathIndexSize>(bucket_metadata + metadata_size * block, block_valid);
             bool is_target = block_valid && meta.get_block_index() == logical_block_address;
             found = found || is_target;
-            // if (is_target){
-            //     std::cout << absl::StreamFormat("Block %lu found at level %lu in slot %lu\n", logical_block_address, level, block);
-            // }
-            // byte_t none = 0;
             conditional_memcpy(is_target, metadata_buffer, &meta, block_metadata_size);
-            conditional_memcpy(is_target, block_buffer, this->get_data_block(level, block), this->block_size);
-            // conditional_memcpy(is_target, &this->valid_bitfield_access[level].data[block], &none, 1);
-            this->valid_bit_tree_controller->conditional_set_valid(level, block, false, is_target);
+            conditional_memcpy(is_target, block_buffer, bucket_data + block_size * block, block_size);
+            ValidBitTreeController::conditional_set_valid_in_bucket(bitfield, block, false, is_target);
         }
     }
-    auto path_scan_end = std::chrono::steady_clock::now();
-    this->oram_statistics->add_path_scan_time(path_scan_end - path_scan_start);
 
     return found;
 }
 
+template <std::size_t BlockSize, std::size_t BlockIndexSize, std::size_t PathIndexSize>
+bool 
+PageOptimizedRAWOram::select_path_kernels_if_matching() {
+    bool matching = (BlockSize == 0 || this->block_size == BlockSize)
+        && (BlockIndexSize == 0 || this->metadata_layout.block_index_size == BlockIndexSize)
+        && (PathIndexSize == 0 || this->metadata_layout.path_index_size == PathIndexSize);
+    if (matching) {
+        this->path_kernels = PathKernels{
+            .find_and_remove_block_on_path_buffer = &PageOptimizedRAWOram::find_and_remove_block_on_path_buffer_kernel<BlockSize, BlockIndexSize, PathIndexSize>,
+            .try_evict_block_from_path_buffer = &PageOptimizedRAWOram::try_evict_block_from_path_buffer_kernel<BlockSize, BlockIndexSize, PathIndexSize>,
+            .write_back_eviction_buffer = &PageOptimizedRAWOram::write_back_eviction_buffer_kernel<BlockSize, BlockIndexSize, PathIndexSize>
+        };
+    }
+    return matching;
+}
+
+template <std::size_t BlockSize>
+bool 
+PageOptimizedRAWOram::select_path_kernels_for_block_size() {
+    // 2 to 5 byte block indices cover up to 1Ti blocks, 2 to 4 byte path indices up to 2Gi paths
+    return this->select_path_kernels_if_matching<BlockSize, 2, 2>()
+        || this->select_path_kernels_if_matching<BlockSize, 3, 2>()
+        || this->select_path_kernels_if_matching<BlockSize, 3, 3>()
+        || this->select_path_kernels_if_matching<BlockSize, 4, 2>()
+        || this->select_path_kernels_if_matching<BlockSize, 4, 3>()
+        || this->select_path_kernels_if_matching<BlockSize, 4, 4>()
+        || this->select_path_kernels_if_matching<BlockSize, 5, 3>()
+        || this->select_path_kernels_if_matching<BlockSize, 5, 4>();
+}
+
+void 
+PageOptimizedRAWOram::select_path_kernels() {
+    bool specialized = this->select_path_kernels_for_block_size<64>()
+        || this->select_path_kernels_for_block_size<128>()
+        || this->select_path_kernels_for_block_size<256>()
+        || this->select_path_kernels_for_block_size<512>();
+    if (!specialized) {
+        this->select_path_kernels_if_matching<0, 0, 0>();
+    }
+}
 
 #ifdef PROFILE_TREE_LOAD_EXTENDED
 void 
@@ -0,0 +1,501 @@
+#include <parameter_advisor.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <cxxopts.hpp>
+#include <absl/random/random.h>
+#include <absl/strings/str_format.h>
+#include <toml++/toml.h>
+#include <crypto_module.hpp>
+#include <disk_memory.hpp>
+#include <simple_memory.hpp>
+#include <page_optimized_raw_oram.hpp>
+#include <binary_path_oram_2.hpp>
+#include <util.hpp>
+
+namespace {
+
+// compute_parameters reports every step on stdout, which is noise when trying dozens of candidates
+class SilenceStdout {
+    public:
+    SilenceStdout() : original(std::cout.rdbuf(sink.rdbuf())) {}
+    ~SilenceStdout() { std::cout.rdbuf(this->original); }
+
+    private:
+    std::ostringstream sink;
+    std::streambuf *original;
+};
+
+struct DeviceProfile {
+    std::vector<uint64_t> queue_depths;
+    // mean time of one batch of queue_depth random requests, indexed by page size then queue depth
+    std::map<uint64_t, std::vector<double>> read_ns;
+    std::map<uint64_t, std::vector<double>> write_ns;
+
+    double batch_ns(const std::map<uint64_t, std::vector<double>> &measurements, uint64_t page_size, uint64_t batch_size) const {
+        const std::vector<double> &times = measurements.at(page_size);
+        if (batch_size <= this->queue_depths.front()) {
+            return times.front();
+        }
+        for (std::size_t i = 1; i < this->queue_depths.size(); i++) {
+            if (batch_size <= this->queue_depths[i]) {
+                double fraction = static_cast<double>(batch_size - this->queue_depths[i - 1]) / static_cast<double>(this->queue_depths[i] - this->queue_depths[i - 1]);
+                return times[i - 1] + fraction * (times[i] - times[i - 1]);
+            }
+        }
+        // past the deepest queue the device is saturated, time grows with the number of requests
+        return times.back() * static_cast<double>(batch_size) / static_cast<double>(this->queue_depths.back());
+    }
+};
+
+struct CryptoProfile {
+    std::map<uint64_t, double> encrypt_ns;
+    std::map<uint64_t, double> decrypt_ns;
+    // cost of an oblivious scan over trusted memory, position map and stash
+    double scan_ns_per_byte;
+};
+
+struct Candidate {
+    std::string type;
+    uint64_t page_size;
+    uint64_t levels_per_page;
+    uint64_t tree_order;
+    uint64_t levels;
+    uint64_t blocks_per_bucket;
+    uint64_t num_accesses_per_eviction;
+    uint64_t stash_capacity;
+    uint64_t position_map_size;
+    double io_ns;
+    double crypto_ns;
+    double trusted_memory_ns;
+
+    double total_ns() const {
+        return this->io_ns + this->crypto_ns + this->trusted_memory_ns;
+    }
+};
+
+DeviceProfile
+measure_device(const std::vector<uint64_t> &page_sizes, const std::vector<uint64_t> &queue_depths, uint64_t bench_size, uint64_t batches) {
+    DeviceProfile profile;
+    profile.queue_depths = queue_depths;
+    absl::BitGen bit_gen;
+
+    for (uint64_t page_size : page_sizes) {
+        uint64_t num_pages = bench_size / page_size;
+        unique_memory_t memory = BlockDiskMemoryLibAIO::create("advise_device_benchmark", num_pages * page_size, page_size);
+
+        // write every page first, reading never written extents does not touch the device
+        constexpr uint64_t fill_batch = 64;
+        std::vector<MemoryRequest> fill_requests(fill_batch, MemoryRequest(MemoryRequestType::WRITE, 0, page_size));
+        for (uint64_t page = 0; page < num_pages; page += fill_batch) {
+            fill_requests.resize(std::min(fill_batch, num_pages - page), MemoryRequest(MemoryRequestType::WRITE, 0, page_size));
+            for (uint64_t i = 0; i < fill_requests.size(); i++) {
+                fill_requests[i].address = (page + i) * page_size;
+            }
+            memory->batch_access(fill_requests);
+        }
+
+        for (MemoryRequestType type : {MemoryRequestType::READ, MemoryRequestType::WRITE}) {
+            auto &times = (type == MemoryRequestType::READ) ? profile.read_ns[page_size] : profile.write_ns[page_size];
+            for (uint64_t queue_depth : queue_depths) {
+                std::vector<MemoryRequest> requests(queue_depth, MemoryRequest(type, 0, page_size));
+                std::chrono::nanoseconds total_time(0);
+                for (uint64_t batch = 0; batch < batches; batch++) {
+                    for (auto &request : requests) {
+                        request.address = absl::Uniform(bit_gen, 0UL, num_pages) * page_size;
+                    }
+                    auto start = std::chrono::steady_clock::now();
+                    memory->batch_access(requests);
+                    auto end = std::chrono::steady_clock::now();
+                    total_time += end - start;
+                }
+                double batch_ns = static_cast<double>(total_time.count()) / static_cast<double>(batches);
+                times.emplace_back(batch_ns);
+                std::cout << absl::StreamFormat(
+                    "%-5s page %6lu queue depth %3lu: %9.1fus per batch, %9.0f IOPS\n",
+                    type == MemoryRequestType::READ ? "read" : "write", page_size, queue_depth,
+                    batch_ns / 1000.0, static_cast<double>(queue_depth) * 1e9 / batch_ns
+                );
+            }
+        }
+    }
+
+    return profile;
+}
+
+CryptoProfile
+measure_crypto(CryptoModule *crypto_module, const std::vector<uint64_t> &page_sizes) {
+    CryptoProfile profile;
+    constexpr auto min_duration = std::chrono::milliseconds(20);
+
+    bytes_t key(crypto_module->key_size());
+    bytes_t nonce(crypto_module->nonce_size());
+    bytes_t auth_tag(crypto_module->auth_tag_size());
+    crypto_module->random(key.data(), key.size());
+    crypto_module->random(nonce.data(), nonce.size());
+
+    for (uint64_t page_size : page_sizes) {
+        uint64_t length = page_size - crypto_module->auth_tag_size();
+        bytes_t plain_text(length);
+        bytes_t cipher_text(length);
+        crypto_module->random(plain_text.data(), plain_text.size());
+
+        uint64_t count = 0;
+        auto start = std::chrono::steady_clock::now();
+        auto end = start;
+        while (end - start < min_duration) {
+            crypto_module->encrypt(key.data(), nonce.data(), plain_text.data(), length, cipher_text.data(), auth_tag.data());
+            count++;
+            end = std::chrono::steady_clock::now();
+        }
+        profile.encrypt_ns[page_size] = static_cast<double>((end - start).count()) / static_cast<double>(count);
+
+        count = 0;
+        start = std::chrono::steady_clock::now();
+        end = start;
+        while (end - start < min_duration) {
+            if (!crypto_module->decrypt(key.data(), nonce.data(), cipher_text.data(), length, auth_tag.data(), plain_text.data())) {
+                throw std::runtime_error("Benchmark cipher text failed to authenticate");
+            }
+            count++;
+            end = std::chrono::steady_clock::now();
+        }
+        profile.decrypt_ns[page_size] = static_cast<double>((end - start).count()) / static_cast<double>(count);
+
+        std::cout << absl::StreamFormat(
+            "%s page %6lu: encrypt %8.1fus, decrypt %8.1fus\n",
+            crypto_module->name(), page_size, profile.encrypt_ns[page_size] / 1000.0, profile.decrypt_ns[page_size] / 1000.0
+        );
+    }
+
+    // the linear scanned position map is the same oblivious scan the stash uses
+    constexpr uint64_t scan_size = 1UL << 20;
+    unique_memory_t scanned_memory = LinearScannedMemory::create("advise_scan_benchmark", scan_size, 8);
+    MemoryRequest request(MemoryRequestType::READ, 0, 8);
+    uint64_t count = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto end = start;
+    while (end - start < min_duration) {
+        request.address = (count * 8) % scan_size;
+        scanned_memory->access(request);
+        count++;
+        end = std::chrono::steady_clock::now();
+    }
+    profile.scan_ns_per_byte = static_cast<double>((end - start).count()) / static_cast<double>(count * scan_size);
+    std::cout << absl::StreamFormat("Oblivious scan: %.3fns per byte\n", profile.scan_ns_per_byte);
+
+    return profile;
+}
+
+/**
+ * @brief Largest A for Z blocks per bucket that keeps the stash from overflowing, same bound as
+ * compute_max_a in generate_orams.py.
+ */
+uint64_t
+max_accesses_per_eviction(uint64_t blocks_per_bucket) {
+    const double z = static_cast<double>(blocks_per_bucket);
+    double a = 1.0;
+    for (int i = 0; i < 100; i++) {
+        double f = z * std::log((2 * z) / a) + a / 2 - z - std::log(4.0);
+        double df = -z / a + 0.5;
+        double next = std::clamp(a - f / df, 1e-3, 2 * z - 1e-3);
+        if (std::abs(next - a) < 1e-9) {
+            break;
+        }
+        a = next;
+    }
+    return std::max<uint64_t>(1, static_cast<uint64_t>(std::floor(a)));
+}
+
+/**
+ * @brief Cost of one position map lookup, the builders scan the position map if it fits into the
+ * budget and put it into a recursive BinaryPathOram2 with 512 byte pages otherwise.
+ */
+double
+position_map_ns(uint64_t num_blocks, uint64_t path_index_size, uint64_t budget, CryptoModule *crypto_module, const CryptoProfile &crypto_profile) {
+    uint64_t entries_per_page = 64 / path_index_size;
+    uint64_t page_size = entries_per_page * path_index_size;
+    uint64_t position_map_size = divide_round_up(num_blocks, entries_per_page) * page_size;
+    if (position_map_size <= budget) {
+        return static_cast<double>(position_map_size) * crypto_profile.scan_ns_per_byte;
+    }
+
+    BinaryPathOram2::Parameters parameters;
+    {
+        SilenceStdout silence;
+        parameters = BinaryPathOram2::compute_parameters(page_size, 512, 1, divide_round_up(position_map_size, page_size), crypto_module, 0.75, false);
+    }
+    double path_ns = static_cast<double>(parameters.page_levels) * (
+        crypto_profile.encrypt_ns.at(512) + crypto_profile.decrypt_ns.at(512) + 2 * 512 * crypto_profile.scan_ns_per_byte
+    );
+    return path_ns + position_map_ns(parameters.num_blocks, parameters.path_index_size, budget, crypto_module, crypto_profile);
+}
+
+std::optional<Candidate>
+evaluate_page_optimized_raw_oram(
+    uint64_t num_blocks, uint64_t block_size, uint64_t page_size, double load_factor, uint64_t trusted_memory,
+    CryptoModule *crypto_module, const DeviceProfile &device, const CryptoProfile &crypto
+) {
+    PageOptimizedRAWOram::ComputedParameters parameters;
+    {
+        SilenceStdout silence;
+        parameters = PageOptimizedRAWOram::compute_parameters(page_size, block_size, num_blocks, 2, crypto_module, load_factor);
+    }
+    if (parameters.blocks_per_bucket == 0) {
+        return std::nullopt;
+    }
+
+    Candidate candidate;
+    candidate.type = "PageOptimizedRAWOram";
+    candidate.page_size = page_size;
+    candidate.levels_per_page = 1;
+    candidate.tree_order = 2;
+    candidate.levels = parameters.levels;
+    candidate.blocks_per_bucket = parameters.blocks_per_bucket;
+    candidate.num_accesses_per_eviction = max_accesses_per_eviction(parameters.blocks_per_bucket);
+    candidate.stash_capacity = std::max<uint64_t>(200, 4 * candidate.num_accesses_per_eviction);
+    if (candidate.stash_capacity * block_size >= trusted_memory) {
+        return std::nullopt;
+    }
+    candidate.position_map_size = trusted_memory - candidate.stash_capacity * block_size;
+
+    // every access reads one page per level, every A accesses a whole path is read and written
+    const double a = static_cast<double>(candidate.num_accesses_per_eviction);
+    const double levels = static_cast<double>(parameters.levels);
+    double path_read_ns = device.batch_ns(device.read_ns, page_size, parameters.levels);
+    double path_write_ns = device.batch_ns(device.write_ns, page_size, parameters.levels);
+    candidate.io_ns = path_read_ns + (path_read_ns + path_write_ns) / a;
+    candidate.crypto_ns = levels * crypto.decrypt_ns.at(page_size) + levels * (crypto.decrypt_ns.at(page_size) + crypto.encrypt_ns.at(page_size)) / a;
+    candidate.trusted_memory_ns = static_cast<double>(candidate.stash_capacity * block_size) * crypto.scan_ns_per_byte
+        + position_map_ns(num_blocks, parameters.path_index_size, candidate.position_map_size, crypto_module, crypto);
+    return candidate;
+}
+
+std::optional<Candidate>
+evaluate_binary_path_oram_2(
+    uint64_t num_blocks, uint64_t block_size, uint64_t page_size, uint64_t levels_per_page, uint64_t tree_order, double load_factor, uint64_t trusted_memory,
+    CryptoModule *crypto_module, const DeviceProfile &device, const CryptoProfile &crypto
+) {
+    BinaryPathOram2::Parameters parameters;
+    try {
+        SilenceStdout silence;
+        parameters = BinaryPathOram2::compute_parameters(block_size, page_size, levels_per_page, num_blocks, crypto_module, load_factor, true, tree_order);
+    } catch (const std::invalid_argument &e) {
+        // the buckets and child counters of a wide tree do not fit on the page
+        return std::nullopt;
+    }
+    // Path ORAM needs at least 4 blocks per bucket to keep the stash bounded, and about one per child in wider trees
+    if (parameters.blocks_per_bucket < std::max<uint64_t>(4, tree_order)) {
+        return std::nullopt;
+    }
+
+    Candidate candidate;
+    candidate.type = "BinaryPathOram2";
+    candidate.page_size = page_size;
+    candidate.levels_per_page = levels_per_page;
+    candidate.tree_order = tree_order;
+    candidate.levels = parameters.levels;
+    candidate.blocks_per_bucket = parameters.blocks_per_bucket;
+    candidate.num_accesses_per_eviction = 1;
+    candidate.stash_capacity = 200;
+    if (candidate.stash_capacity * block_size >= trusted_memory) {
+        return std::nullopt;
+    }
+    candidate.position_map_size = trusted_memory - candidate.stash_capacity * block_size;
+
+    // every access reads and writes back one page per page level
+    const double page_levels = static_cast<double>(parameters.page_levels);
+    candidate.io_ns = device.batch_ns(device.read_ns, page_size, parameters.page_levels) + device.batch_ns(device.write_ns, page_size, parameters.page_levels);
+    candidate.crypto_ns = page_levels * (crypto.decrypt_ns.at(page_size) + crypto.encrypt_ns.at(page_size));
+    candidate.trusted_memory_ns = static_cast<double>(candidate.stash_capacity * block_size) * crypto.scan_ns_per_byte
+        + position_map_ns(num_blocks, parameters.path_index_size, candidate.position_map_size, crypto_module, crypto);
+    return candidate;
+}
+
+std::string
+create_arguments(const Candidate &candidate, uint64_t size, uint64_t block_size, double load_factor, std::string_view crypto_module_name) {
+    std::string arguments = absl::StrFormat(
+        "create --type %s --size %lu --block_size %lu --page_size %lu --load_factor %g --crypto_module %s --position_map_size %lu --stash_capacity %lu",
+        candidate.type, size, block_size, candidate.page_size, load_factor, crypto_module_name, candidate.position_map_size, candidate.stash_capacity
+    );
+    if (candidate.type == "PageOptimizedRAWOram") {
+        arguments += absl::StrFormat(" --tree_order 2 --num_accesses_per_eviction %lu", candidate.num_accesses_per_eviction);
+    } else {
+        arguments += absl::StrFormat(" --levels_per_page %lu --tree_order %lu", candidate.levels_per_page, candidate.tree_order);
+    }
+    return arguments + " --fast_init";
+}
+
+}
+
+int advise_entry_point(int argc, const char** argv) {
+    cxxopts::Options advise_options("Advise", "Benchmarks the disk and crypto and suggests the fastest ORAM parameters");
+
+    advise_options.add_options()
+    ("subcommand", "ignore", cxxopts::value<std::string>())
+    ("s,size", "The size of the table to store", cxxopts::value<std::string>()->default_value("1GiB"))
+    ("b,block_size", "The size of blocks in Oram", cxxopts::value<std::string>()->default_value("64B"))
+    ("T,trusted_memory", "Trusted memory budget for the position map and stash", cxxopts::value<std::string>()->default_value("1MiB"))
+    ("L,load_factor", "The maximum load factor the tree can have", cxxopts::value<double>()->default_value("0.75"))
+    ("c,crypto_module", "Type of Crypto to use", cxxopts::value<std::string>()->default_value("PlainText"))
+    ("t,types", "ORAM types to consider", cxxopts::value<std::vector<std::string>>()->default_value("PageOptimizedRAWOram,BinaryPathOram2"))
+    ("P,page_sizes", "Page sizes to consider", cxxopts::value<std::vector<std::string>>()->default_value("4KiB,8KiB,16KiB,32KiB,64KiB"))
+    ("e,max_levels_per_page", "Largest number of levels per page to consider, BinaryPathOram2 only", cxxopts::value<uint64_t>()->default_value("4"))
+    ("O,tree_orders", "Tree orders to consider, powers of two, BinaryPathOram2 only", cxxopts::value<std::vector<uint64_t>>()->default_value("2,4,8"))
+    ("q,queue_depths", "Queue depths to benchmark", cxxopts::value<std::vector<uint64_t>>()->default_value("1,2,4,8,16,32,64"))
+    ("B,bench_size", "Size of the file the device benchmark reads from", cxxopts::value<std::string>()->default_value("256MiB"))
+    ("n,bench_batches", "Number of batches timed per page size and queue depth", cxxopts::value<uint64_t>()->default_value("200"))
+    ("d, temp_dir", "Directory on the device to benchmark, same as the temp_dir of create.", cxxopts::value<std::string>()->default_value("."))
+    ("o,output_file", "Write the measurements and ranked configurations to this TOML file", cxxopts::value<std::string>())
+    ("h,help", "show help text");
+
+    advise_options.parse_positional("subcommand");
+
+    auto result = advise_options.parse(argc, argv);
+
+    if (result.count("subcommand") != 1 || result["subcommand"].as<std::string>() != "advise") {
+        std::cout << "Incorrect sub command!\n";
+        return -1;
+    }
+
+    if (result.count("help") > 0) {
+        std::cout << advise_options.help();
+        return 0;
+    }
+
+    const std::filesystem::path temp_dir(result["temp_dir"].as<std::string>());
+    set_disk_memory_temp_file_directory(temp_dir);
+
+    uint64_t size = parse_size(result["size"].as<std::string>());
+    uint64_t block_size = parse_size(result["block_size"].as<std::string>());
+    uint64_t num_blocks = divide_round_up(size, block_size);
+    uint64_t trusted_memory = parse_size(result["trusted_memory"].as<std::string>());
+    double load_factor = result["load_factor"].as<double>();
+    std::string crypto_module_name = result["crypto_module"].as<std::string>();
+    auto crypto_module = get_crypto_module_by_name(crypto_module_name);
+    auto types = result["types"].as<std::vector<std::string>>();
+    uint64_t max_levels_per_page = result["max_levels_per_page"].as<uint64_t>();
+    auto tree_orders = result["tree_orders"].as<std::vector<uint64_t>>();
+    auto queue_depths = result["queue_depths"].as<std::vector<uint64_t>>();
+    std::sort(queue_depths.begin(), queue_depths.end());
+    uint64_t bench_size = parse_size(result["bench_size"].as<std::string>());
+    uint64_t bench_batches = result["bench_batches"].as<uint64_t>();
+
+    std::vector<uint64_t> page_sizes;
+    for (const auto &page_size : result["page_sizes"].as<std::vector<std::string>>()) {
+        page_sizes.emplace_back(parse_size(page_size));
+    }
+    std::sort(page_sizes.begin(), page_sizes.end());
+
+    std::cout << absl::StreamFormat("Benchmarking random IO in %s\n", temp_dir.string());
+    DeviceProfile device = measure_device(page_sizes, queue_depths, bench_size, bench_batches);
+
+    // the recursive position map uses 512 byte pages
+    std::vector<uint64_t> crypto_page_sizes = page_sizes;
+    crypto_page_sizes.emplace_back(512);
+    CryptoProfile crypto = measure_crypto(crypto_module.get(), crypto_page_sizes);
+
+    std::vector<Candidate> candidates;
+    for (const auto &type : types) {
+        for (uint64_t page_size : page_sizes) {
+            if (type == "PageOptimizedRAWOram") {
+                auto candidate = evaluate_page_optimized_raw_oram(num_blocks, block_size, page_size, load_factor, trusted_memory, crypto_module.get(), device, crypto);
+                if (candidate.has_value()) {
+                    candidates.emplace_back(std::move(candidate.value()));
+                }
+            } else if (type == "BinaryPathOram2") {
+                for (uint64_t tree_order : tree_orders) {
+                    for (uint64_t levels_per_page = 1; levels_per_page <= max_levels_per_page; levels_per_page++) {
+                        auto candidate = evaluate_binary_path_oram_2(num_blocks, block_size, page_size, levels_per_page, tree_order, load_factor, trusted_memory, crypto_module.get(), device, crypto);
+                        if (candidate.has_value()) {
+                            candidates.emplace_back(std::move(candidate.value()));
+                        }
+                    }
+                }
+            } else {
+                std::cout << absl::StreamFormat("Can not advise on %s, skipping\n", type);
+                break;
+            }
+        }
+    }
+
+    if (candidates.empty()) {
+        std::cout << "No configuration fits the trusted memory budget!\n";
+        return -1;
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) {
+        return a.total_ns() < b.total_ns();
+    });
+
+    std::cout << absl::StreamFormat(
+        "\n%-22s %8s %5s %5s %7s %4s %4s %10s %10s %10s %10s\n",
+        "type", "page", "order", "lpp", "levels", "Z", "A", "io us", "crypto us", "trusted us", "total us"
+    );
+    for (const auto &candidate : candidates) {
+        std::cout << absl::StreamFormat(
+            "%-22s %8lu %5lu %5lu %7lu %4lu %4lu %10.1f %10.1f %10.1f %10.1f\n",
+            candidate.type, candidate.page_size, candidate.tree_order, candidate.levels_per_page, candidate.levels,
+            candidate.blocks_per_bucket, candidate.num_accesses_per_eviction,
+            candidate.io_ns / 1000.0, candidate.crypto_ns / 1000.0, candidate.trusted_memory_ns / 1000.0, candidate.total_ns() / 1000.0
+        );
+    }
+
+    std::cout << absl::StreamFormat("\nPredicted fastest, %.1fus per access:\n", candidates.front().total_ns() / 1000.0);
+    std::cout << create_arguments(candidates.front(), size, block_size, load_factor, crypto_module_name) << "\n";
+
+    if (result.count("output_file") > 0) {
+        toml::table device_table;
+        for (uint64_t page_size : page_sizes) {
+            toml::table page_table;
+            page_table.emplace("queue_depths", toml_array_from_vector(std::vector<int64_t>(queue_depths.begin(), queue_depths.end())));
+            page_table.emplace("read_batch_ns", toml_array_from_vector(device.read_ns.at(page_size)));
+            page_table.emplace("write_batch_ns", toml_array_from_vector(device.write_ns.at(page_size)));
+            device_table.emplace(std::to_string(page_size), std::move(page_table));
+        }
+
+        toml::table crypto_table;
+        for (const auto &[page_size, encrypt_ns] : crypto.encrypt_ns) {
+            toml::table page_table;
+            page_table.emplace("encrypt_ns", encrypt_ns);
+            page_table.emplace("decrypt_ns", crypto.decrypt_ns.at(page_size));
+            crypto_table.emplace(std::to_string(page_size), std::move(page_table));
+        }
+        crypto_table.emplace("scan_ns_per_byte", crypto.scan_ns_per_byte);
+
+        toml::array candidate_array;
+        for (const auto &candidate : candidates) {
+            candidate_array.emplace_back(toml::table{
+                {"type", candidate.type},
+                {"page_size", static_cast<int64_t>(candidate.page_size)},
+                {"levels_per_page", static_cast<int64_t>(candidate.levels_per_page)},
+                {"tree_order", static_cast<int64_t>(candidate.tree_order)},
+                {"levels", static_cast<int64_t>(candidate.levels)},
+                {"blocks_per_bucket", static_cast<int64_t>(candidate.blocks_per_bucket)},
+                {"num_accesses_per_eviction", static_cast<int64_t>(candidate.num_accesses_per_eviction)},
+                {"stash_capacity", static_cast<int64_t>(candidate.stash_capacity)},
+                {"position_map_size", static_cast<int64_t>(candidate.position_map_size)},
+                {"io_ns", candidate.io_ns},
+                {"crypto_ns", candidate.crypto_ns},
+                {"trusted_memory_ns", candidate.trusted_memory_ns},
+                {"create_arguments", create_arguments(candidate, size, block_size, load_factor, crypto_module_name)}
+            });
+        }
+
+        toml::table table;
+        table.emplace("device", std::move(device_table));
+        table.emplace("crypto", std::move(crypto_table));
+        table.emplace("candidates", std::move(candidate_array));
+
+        std::ofstream output_file(result["output_file"].as<std::string>());
+        output_file << table << std::endl;
+    }
+
+    return 0;
+}
@@ -11,17 +11,21 @@
 #include <memory_interface.hpp>
 #include <dummy_memory.hpp>
 #include <page_optimized_raw_oram.hpp>
+#include <sodium.h>
 
+#include <oblivious.hpp>
 #include <union.hpp>
 #include <exponential_dp.hpp>
 
 LinearScanBuffer::LinearScanBuffer(
     unique_memory_t &&memory,
     std::uint64_t max_size,
-    bool enable_non_secure_mode
+    bool enable_non_secure_mode,
+    const GradientAggregationConfig &aggregation
 ) : 
 max_size(max_size),
 _entry_size(memory->page_size()),
+aggregator(memory->page_size(), aggregation),
 enable_non_secure_mode(enable_non_secure_mode),
 num_entries_in_buffer(0),
 num_entries_downloaded(0),
@@ -50,13 +54,14 @@ LinearScanBuffer::download(std::uint64_t entry_id) {
     auto start = std::chrono::steady_clock::now();
     BufferEntry entry(this->_entry_size);
     entry.entry_id = entry_id;
-    MemoryRequest request(MemoryRequestType::POP, entry_id * this->_entry_size, this->_entry_size);
+    bool is_dummy = (entry_id == dummy_entry_id);
+    MemoryRequest request(MemoryRequestType::POP, (is_dummy ? 0 : entry_id) * this->_entry_size, this->_entry_size);
     const MemoryRequestType pop_dummy = MemoryRequestType::DUMMY_POP;
     bool found = find_and_remove_block_from_buffer(entry);
 
-    if (!this->enable_non_secure_mode || !found) {
+    if (!this->enable_non_secure_mode || !(found || is_dummy)) {
         auto oram_start = std::chrono::steady_clock::now();
-        conditional_memcpy(found, &request.type, &pop_dummy, sizeof(MemoryRequestType));
+        conditional_memcpy(found || is_dummy, &request.type, &pop_dummy, sizeof(MemoryRequestType));
         this->memory->access(request);
         conditional_memcpy(!found, entry.data.data(), request.data.data(), this->_entry_size);
         auto oram_end = std::chrono::steady_clock::now();
@@ -65,7 +70,7 @@ LinearScanBuffer::download(std::uint64_t entry_id) {
 
     // std::cout << absl::StreamFormat("Reading entry %lu\n", entry_id);
     this->num_entries_downloaded += 1;
-    this->num_entries_in_buffer += (found ? 0: 1);
+    this->num_entries_in_buffer += ((found || is_dummy) ? 0: 1);
     this->place_block_on_buffer(entry);
     auto end = std::chrono::steady_clock::now();
     this->overall_time += end - start;
@@ -77,7 +82,7 @@ LinearScanBuffer::aggregate(std::uint64_t entry_id) {
     auto start = std::chrono::steady_clock::now();
     bool found = this->update_gradient(entry_id);
 
-    if (!found) {
+    if (!found && entry_id != dummy_entry_id) {
         throw std::runtime_error("Update entry id not in buffer!");
     }
     // do update?
@@ -132,11 +137,13 @@ LinearScanBuffer::update_flush_buffer() {
             request.type = MemoryRequestType::PUSH;
 
             // update base on gradient
-            bool valid = (this->gradient_buffer[this->_entry_size * index] == (this->counter_buffer[index] & 0xFF));
+            const byte_t *gradient = this->gradient_buffer.data() + this->_entry_size * index;
+            bool valid = this->aggregator.is_valid(gradient, this->counter_buffer[index]);
 
             if (!(is_free || valid)) {
                 throw std::runtime_error("validation failed");
             }
+            this->aggregator.apply(request.data.data(), gradient, this->counter_buffer[index]);
 
             conditional_memcpy(is_free, &request.address, &zero, sizeof(std::uint64_t));
             conditional_memcpy(is_free, &request.type, &dummy_push, sizeof(MemoryRequestType));
@@ -169,16 +176,181 @@ LinearScanBuffer::update_flush_buffer() {
 // LinearScanBuffer::get_oram_time() {
 //     return this->oram_time;
 // } 
+
+HashBuffer::HashBuffer(
+    unique_memory_t &&memory,
+    std::uint64_t max_size,
+    bool enable_non_secure_mode,
+    std::uint64_t bucket_size,
+    std::uint64_t stash_size,
+    const GradientAggregationConfig &aggregation
+) :
+max_size(max_size),
+_entry_size(memory->page_size()),
+aggregator(memory->page_size(), aggregation),
+enable_non_secure_mode(enable_non_secure_mode),
+bucket_size(bucket_size),
+stash_size(stash_size),
+// buckets are half full on average, the two choices keep the fullest ones close to that
+num_buckets(std::max(1UL, divide_round_up(2 * max_size, std::max(1UL, bucket_size)))),
+slot_size(2 * this->_entry_size + sizeof(std::uint16_t)),
+num_entries_in_buffer(0),
+memory(std::move(memory))
+{
+    if (this->bucket_size == 0) {
+        throw std::invalid_argument("Bucket size of HashBuffer has to be at least 1");
+    }
+    if (sodium_init() == -1) {
+        throw std::runtime_error("Libsodium init failed!");
+    }
+    static_assert(std::tuple_size_v<decltype(this->hash_key)> == crypto_shorthash_KEYBYTES);
+
+    std::uint64_t num_slots = this->num_buckets * this->bucket_size + this->stash_size;
+    this->slot_buffer.resize(num_slots * this->slot_size);
+    this->entry_id_buffer.resize(num_slots, std::numeric_limits<std::uint64_t>::max());
+    this->occupied.resize(num_slots);
+    this->choose_new_hash_key();
+}
+
+std::uint64_t
+HashBuffer::num_entries() const {
+    return this->memory->size() / this->memory->page_size();
+}
+
+std::uint64_t
+HashBuffer::entry_size() const {
+    return this->memory->page_size();
+}
+
+void
+HashBuffer::choose_new_hash_key() {
+    randombytes_buf(this->hash_key.data(), this->hash_key.size());
+}
+
+HashBuffer::CandidateBuckets
+HashBuffer::candidate_buckets(std::uint64_t entry_id) const {
+    // a dummy gets the buckets of a random id, which look like those of any other distinct id
+    std::uint64_t random_id;
+    randombytes_buf(&random_id, sizeof(random_id));
+    conditional_memcpy(entry_id == dummy_entry_id, &entry_id, &random_id, sizeof(std::uint64_t));
+
+    std::uint64_t hash;
+    crypto_shorthash(reinterpret_cast<unsigned char *>(&hash), reinterpret_cast<const unsigned char *>(&entry_id), sizeof(std::uint64_t), this->hash_key.data());
+
+    CandidateBuckets candidates;
+    candidates.buckets[0] = (hash & 0xFFFFFFFF) % this->num_buckets;
+    candidates.count = 1;
+    if (this->num_buckets > 1) {
+        // a non-zero offset, so that the second bucket is never the first one
+        candidates.buckets[1] = (candidates.buckets[0] + 1 + (hash >> 32) % (this->num_buckets - 1)) % this->num_buckets;
+        candidates.count = 2;
+    }
+    return candidates;
+}
+
+void
+HashBuffer::download(std::uint64_t entry_id) {
+    auto start = std::chrono::steady_clock::now();
+    BufferEntry entry(this->_entry_size);
+    entry.entry_id = entry_id;
+    bool is_dummy = (entry_id == dummy_entry_id);
+    MemoryRequest request(MemoryRequestType::POP, (is_dummy ? 0 : entry_id) * this->_entry_size, this->_entry_size);
+    const MemoryRequestType pop_dummy = MemoryRequestType::DUMMY_POP;
+    auto candidates = this->candidate_buckets(entry_id);
+    bool found = find_and_remove_block_from_buffer(entry, candidates);
+
+    if (!this->enable_non_secure_mode || !(found || is_dummy)) {
+        auto oram_start = std::chrono::steady_clock::now();
+        conditional_memcpy(found || is_dummy, &request.type, &pop_dummy, sizeof(MemoryRequestType));
+        this->memory->access(request);
+        conditional_memcpy(!found, entry.data.data(), request.data.data(), this->_entry_size);
+        auto oram_end = std::chrono::steady_clock::now();
+        this->oram_time += (oram_end - oram_start);
+    }
+
+    this->num_entries_in_buffer += ((found || is_dummy) ? 0: 1);
+    // the flush pushes max_size entries, so the table must not hold more even though it has room for them
+    if (this->num_entries_in_buffer > this->max_size) {
+        throw std::runtime_error("Buffer is full!");
+    }
+    this->place_block_on_buffer(entry, candidates);
+    auto end = std::chrono::steady_clock::now();
+    this->overall_time += end - start;
+}
+
+void
+HashBuffer::aggregate(std::uint64_t entry_id) {
+    auto start = std::chrono::steady_clock::now();
+    bool found = this->update_gradient(entry_id, this->candidate_buckets(entry_id));
+
+    if (!found && entry_id != dummy_entry_id) {
+        throw std::runtime_error("Update entry id not in buffer!");
+    }
+    auto end = std::chrono::steady_clock::now();
+    this->overall_time += end - start;
+}
+
+void
+HashBuffer::update_flush_buffer() {
+    auto start = std::chrono::steady_clock::now();
+
+    // moves the entries to the first slots without revealing which buckets they were in
+    for (std::uint64_t index = 0; index < this->entry_id_buffer.size(); index++) {
+        this->occupied[index] = (this->entry_id_buffer[index] != std::numeric_limits<std::uint64_t>::max());
+    }
+    oblivious::compact<std::uint64_t>(this->entry_id_buffer.data(), this->slot_buffer.data(), this->occupied.data(), this->entry_id_buffer.size(), this->slot_size);
+
+    MemoryRequest request(MemoryRequestType::PUSH, 0, this->_entry_size);
+    const std::uint64_t zero = 0;
+    const MemoryRequestType dummy_push = MemoryRequestType::DUMMY_PUSH;
+    for (std::uint64_t index = 0; index < this->max_size; index++) {
+        bool is_free = (this->entry_id_buffer[index] == std::numeric_limits<std::uint64_t>::max());
+        if (!is_free || !this->enable_non_secure_mode) {
+            // push blocks back into the ORAM
+            std::memcpy(request.data.data(), this->slot_data(index), this->_entry_size);
+            request.address = this->entry_id_buffer[index] * this->_entry_size;
+            request.type = MemoryRequestType::PUSH;
+
+            // update base on gradient
+            std::uint16_t counter;
+            std::memcpy(&counter, this->slot_counter(index), sizeof(std::uint16_t));
+            bool valid = this->aggregator.is_valid(this->slot_gradient(index), counter);
+
+            if (!(is_free || valid)) {
+                throw std::runtime_error("validation failed");
+            }
+            this->aggregator.apply(request.data.data(), this->slot_gradient(index), counter);
+
+            conditional_memcpy(is_free, &request.address, &zero, sizeof(std::uint64_t));
+            conditional_memcpy(is_free, &request.type, &dummy_push, sizeof(MemoryRequestType));
+
+            auto oram_start = std::chrono::steady_clock::now();
+            this->memory->access(request);
+            auto oram_end = std::chrono::steady_clock::now();
+            this->oram_time += (oram_end - oram_start);
+        }
+    }
+
+    std::fill(this->entry_id_buffer.begin(), this->entry_id_buffer.end(), std::numeric_limits<std::uint64_t>::max());
+    this->num_entries_in_buffer = 0;
+    this->choose_new_hash_key();
+
+    auto end = std::chrono::steady_clock::now();
+    this->overall_time += end - start;
+}
+
 OramBuffer::OramBuffer(
     unique_memory_t &&memory,
     std::uint64_t max_size,
     bool enable_non_secure_mode,
     UpdateMode update_mode,
-    unique_memory_t &&buffer_oram
+    unique_memory_t &&buffer_oram,
+    const GradientAggregationConfig &aggregation
 ) : 
 max_size(max_size),
 enable_non_secure_mode(enable_non_secure_mode),
 _entry_size(memory->page_size()),
+aggregator(memory->page_size(), aggregation),
 buffer_entry_size(this->_entry_size * 2 + 2),
 update_mode(update_mode),
 entry_id_size(
@@ -213,29 +385,34 @@ OramBuffer::download(std::uint64_t entry_id) {
     auto overall_time_start = std::chrono::steady_clock::now();
     this->num_downloads ++;
 
+    // a dummy pops and pushes nothing, its flush record is a duplicate of entry 0
+    bool is_dummy = (entry_id == dummy_entry_id);
+    std::uint64_t address_id = is_dummy ? 0 : entry_id;
+    const MemoryRequestType dummy_pop = MemoryRequestType::DUMMY_POP;
+    const MemoryRequestType dummy_push = MemoryRequestType::DUMMY_PUSH;
+
     if (this->update_mode == UpdateMode::POP_N_PUSH) {
-        std::memcpy(this->entry_id_buffer.data() + this->entry_id_size * (this->num_downloads - 1), &entry_id, this->entry_id_size);
+        std::memcpy(this->entry_id_buffer.data() + this->entry_id_size * (this->num_downloads - 1), &address_id, this->entry_id_size);
     }
 
     // put entry_id into buffer
     this->buffer_request.type = POP;
-    this->buffer_request.address = entry_id * this->buffer_entry_size;
+    this->buffer_request.address = address_id * this->buffer_entry_size;
+    conditional_memcpy(is_dummy, &(this->buffer_request.type), &dummy_pop, sizeof(MemoryRequestType));
 
     std::memset(this->buffer_request.data.data(), 0, this->buffer_entry_size);
 
     this->buffer->access(buffer_request);
 
-    bool found = (buffer_request.address == entry_id * this->buffer_entry_size);
+    bool found = (buffer_request.address == address_id * this->buffer_entry_size) || is_dummy;
 
     this->num_blocks_in_buffer += (found ? 0: 1);
 
     if (!found || !this->enable_non_secure_mode) {
         this->main_oram_request.type = POP;
-        this->main_oram_request.address = entry_id * this->_entry_size;
-        
-        const MemoryRequestType dp = MemoryRequestType::DUMMY_POP;
+        this->main_oram_request.address = address_id * this->_entry_size;
 
-        conditional_memcpy(found, &(this->main_oram_request.type), &dp, sizeof(MemoryRequestType));
+        conditional_memcpy(found, &(this->main_oram_request.type), &dummy_pop, sizeof(MemoryRequestType));
 
         auto oram_start = std::chrono::steady_clock::now();
         this->memory->access(main_oram_request);
@@ -247,7 +424,8 @@ OramBuffer::download(std::uint64_t entry_id) {
     }
 
     this->buffer_request.type = PUSH;
-    this->buffer_request.address = entry_id * this->buffer_entry_size;
+    this->buffer_request.address = address_id * this->buffer_entry_size;
+    conditional_memcpy(is_dummy, &(this->buffer_request.type), &dummy_push, sizeof(MemoryRequestType));
 
     this->buffer->access(buffer_request);
 
@@ -262,39 +440,49 @@ OramBuffer::aggregation_increment(byte_t *entry, const byte_t * _dummy) {
     counter += 1;
     std::memcpy(entry + 2 * this->_entry_size, &counter, sizeof(std::uint16_t));
 
-    entry[this->_entry_size] += 1;
+    this->aggregator.accumulate(true, entry + this->_entry_size);
 }
 
 void 
 OramBuffer::aggregate(std::uint64_t entry_id) {
     auto overall_time_start = std::chrono::steady_clock::now();
-    this->buffer_request.type = UPDATE;
-    this->buffer_request.address = entry_id * this->buffer_entry_size;
-    this->buffer_request.update_function = [this](byte_t * entry, const byte_t * _dummy) {
-        this->aggregation_increment(entry, _dummy);
-    };
-
+    bool is_dummy = (entry_id == dummy_entry_id);
+    std::uint64_t address_id = is_dummy ? 0 : entry_id;
+    const MemoryRequestType dummy_pop = MemoryRequestType::DUMMY_POP;
+    const MemoryRequestType dummy_push = MemoryRequestType::DUMMY_PUSH;
+    this->buffer_request.address = address_id * this->buffer_entry_size;
     std::memset(this->buffer_request.data.data(), 0, this->buffer_entry_size);
 
-    this->buffer->access(buffer_request);
+    if (this->buffer->is_request_type_supported(UPDATE)) {
+        // aggregate inside the buffer ORAM with a single access, a dummy is a single dummy access
+        this->buffer_request.type = UPDATE;
+        this->buffer_request.update_function = [this](byte_t * entry, const byte_t * _dummy) {
+            this->aggregation_increment(entry, _dummy);
+        };
+        conditional_memcpy(is_dummy, &(this->buffer_request.type), &dummy_pop, sizeof(MemoryRequestType));
 
-    // bool found = (buffer_request.address == entry_id * this->buffer_entry_size);
+        this->buffer->access(buffer_request);
+    } else {
+        this->buffer_request.type = POP;
+        conditional_memcpy(is_dummy, &(this->buffer_request.type), &dummy_pop, sizeof(MemoryRequestType));
 
-    // if (!found) {
-    //     throw std::runtime_error("Requested Block not found in disk!");
-    // }
+        this->buffer->access(buffer_request);
 
-    // uint16_t counter = 0;
-    // std::memcpy(&counter, buffer_request.data.data() + 2 * this->_entry_size, sizeof(std::uint16_t));
-    // counter += 1;
-    // std::memcpy(buffer_request.data.data() + 2 * this->_entry_size, &counter, sizeof(std::uint16_t));
+        bool found = (buffer_request.address == address_id * this->buffer_entry_size);
 
-    // buffer_request.data[this->_entry_size] += 1;
+        if (!found && !is_dummy) {
+            throw std::runtime_error("Requested Block not found in disk!");
+        }
 
-    // this->buffer_request.type = PUSH;
-    // this->buffer_request.address = entry_id * this->buffer_entry_size;
+        this->aggregation_increment(this->buffer_request.data.data(), nullptr);
+
+        this->buffer_request.type = PUSH;
+        this->buffer_request.address = address_id * this->buffer_entry_size;
+        conditional_memcpy(is_dummy, &(this->buffer_request.type), &dummy_push, sizeof(MemoryRequestType));
+
+        this->buffer->access(buffer_request);
+    }
 
-    // this->buffer->access(buffer_request);
     auto overall_time_end = std::chrono::steady_clock::now();
     this->overall_time += (overall_time_end - overall_time_start);
 }
@@ -328,7 +516,11 @@ OramBuffer::update_flush_buffer() {
 
             conditional_memcpy(!valid, &(this->main_oram_request.type), &dp, sizeof(MemoryRequestType));
 
+            uint16_t counter = 0;
+            std::memcpy(&counter, this->buffer_request.data.data() + 2 * this->_entry_size, sizeof(std::uint16_t));
+
             std::memcpy(this->main_oram_request.data.data(), this->buffer_request.data.data(), this->_entry_size);
+            this->aggregator.apply(this->main_oram_request.data.data(), this->buffer_request.data.data() + this->_entry_size, counter);
 
             auto oram_start = std::chrono::steady_clock::now();
             this->memory->access(main_oram_request);
@@ -365,13 +557,14 @@ OramBuffer::flush_block_callback(const BlockMetadata *metadata, const byte_t * d
         uint16_t counter = 0;
         std::memcpy(&counter, data + 2 * this->_entry_size, sizeof(std::uint16_t));
 
-        bool counter_valid = (data[this->_entry_size] == (counter & 0xFF));
+        bool counter_valid = this->aggregator.is_valid(data + this->_entry_size, counter);
 
         if (!(!is_valid || counter_valid)) {
             throw std::runtime_error("validation failed");
         }
 
         std::memcpy(this->main_oram_request.data.data(), data, this->_entry_size);
+        this->aggregator.apply(this->main_oram_request.data.data(), data + this->_entry_size, counter);
 
         auto oram_start = std::chrono::steady_clock::now();
         this->memory->access(main_oram_request);
@@ -384,11 +577,13 @@ OramBuffer3::OramBuffer3(
     unique_memory_t &&memory,
     std::uint64_t max_size,
     bool enable_non_secure_mode,
-    BufferORAMType buffer_oram_type
+    BufferORAMType buffer_oram_type,
+    const GradientAggregationConfig &aggregation
 ) :
 max_size(max_size),
 enable_non_secure_mode(enable_non_secure_mode),
 _entry_size(memory->page_size()),
+aggregator(memory->page_size(), aggregation),
 buffer_entry_size(this->_entry_size * 2 + 2),
 entry_id_size(
     divide_round_up(num_bits(memory->size() / memory->page_size() - 1), 8UL)
@@ -498,7 +693,11 @@ OramBuffer3::download(std::uint64_t entry_id) {
     auto overall_time_start = std::chrono::steady_clock::now();
     this->num_downloads ++;
 
-    std::memcpy(this->entry_id_buffer.data() + this->entry_id_size * (this->num_downloads - 1), &entry_id, this->entry_id_size);
+    // a dummy searches random paths for an id no block has and is flushed like a duplicate of entry 0
+    bool is_dummy = (entry_id == dummy_entry_id);
+    std::uint64_t record_id = is_dummy ? 0 : entry_id;
+
+    std::memcpy(this->entry_id_buffer.data() + this->entry_id_size * (this->num_downloads - 1), &record_id, this->entry_id_size);
 
     // generate_new_path
     
@@ -507,14 +706,14 @@ OramBuffer3::download(std::uint64_t entry_id) {
 
     // get old path and write new path
     auto oram_start = std::chrono::steady_clock::now(); 
-    std::uint64_t old_path = this->ll_memory->read_and_update_position_map(entry_id, new_path | this->in_buffer_mask);
+    std::uint64_t old_path = this->ll_memory->read_and_update_position_map(record_id, new_path | this->in_buffer_mask, is_dummy);
     auto oram_end = std::chrono::steady_clock::now();
     this->oram_time += (oram_end - oram_start);
 
-    bool is_in_buffer = ((old_path & this->in_buffer_mask) != 0);
+    bool is_in_buffer = ((old_path & this->in_buffer_mask) != 0) && !is_dummy;
     old_path &= (~this->in_buffer_mask);
 
-    this->is_entry_duplicate[this->num_downloads - 1] = is_in_buffer;
+    this->is_entry_duplicate[this->num_downloads - 1] = is_in_buffer || is_dummy;
 
     auto random_buffer_path = absl::Uniform(this->bit_gen, 0UL, this->ll_buffer->num_paths());
     auto random_memory_path = absl::Uniform(this->bit_gen, 0UL, this->ll_memory->num_paths());
@@ -523,7 +722,7 @@ OramBuffer3::download(std::uint64_t entry_id) {
     auto memory_search_path = old_path;
 
     conditional_memcpy(!is_in_buffer, &buffer_search_path, &random_buffer_path, sizeof(buffer_search_path));
-    conditional_memcpy(is_in_buffer, &memory_search_path, &random_memory_path, sizeof(memory_search_path));
+    conditional_memcpy(is_in_buffer || is_dummy, &memory_search_path, &random_memory_path, sizeof(memory_search_path));
 
     // seach for the block in memory
     if (is_in_buffer || !this->enable_non_secure_mode) {
@@ -539,7 +738,7 @@ OramBuffer3::download(std::uint64_t entry_id) {
         }
     }
 
-    this->num_blocks_in_buffer += (is_in_buffer ? 0: 1);
+    this->num_blocks_in_buffer += ((is_in_buffer || is_dummy) ? 0: 1);
 
     if (!is_in_buffer || !this->enable_non_secure_mode) {
         // read main oram
@@ -552,7 +751,7 @@ OramBuffer3::download(std::uint64_t entry_id) {
 
         bool block_found_in_main_oram = main_oram_block_buffer.metadata.is_valid();
 
-        if (!(is_in_buffer || block_found_in_main_oram)) {
+        if (!(is_in_buffer || block_found_in_main_oram || is_dummy)) {
             throw std::runtime_error(absl::StrFormat("Failed to find entry %lu!", entry_id));
         }
 
@@ -568,7 +767,7 @@ OramBuffer3::download(std::uint64_t entry_id) {
     // }
 
     // place the block back onto the buffer
-    buffer_oram_block_buffer.metadata = BlockMetadata(entry_id, new_path, true);
+    buffer_oram_block_buffer.metadata = BlockMetadata(entry_id, new_path, !is_dummy);
     this->ll_buffer->place_block_on_path(buffer_oram_block_buffer);
 
     auto overall_time_end = std::chrono::steady_clock::now();
@@ -581,9 +780,14 @@ OramBuffer3::aggregate(std::uint64_t entry_id) {
     // generate_new_path
     std::uint64_t new_path = absl::Uniform(this->bit_gen, 0UL, this->ll_buffer->num_paths());
     // get old path and write new path
-    std::uint64_t old_path = this->ll_memory->read_and_update_position_map(entry_id, new_path | this->in_buffer_mask);
+    bool is_dummy = (entry_id == dummy_entry_id);
+    std::uint64_t old_path = this->ll_memory->read_and_update_position_map(is_dummy ? 0 : entry_id, new_path | this->in_buffer_mask, is_dummy);
     old_path &= (~this->in_buffer_mask);
 
+    // a dummy searches a random path for an id no block has
+    std::uint64_t random_path = absl::Uniform(this->bit_gen, 0UL, this->ll_buffer->num_paths());
+    conditional_memcpy(is_dummy, &old_path, &random_path, sizeof(std::uint64_t));
+
     // get block from buffer
     this->buffer_oram_block_buffer.metadata = BlockMetadata(entry_id, old_path, false);
 
@@ -591,18 +795,18 @@ OramBuffer3::aggregate(std::uint64_t entry_id) {
 
     bool block_found = this->buffer_oram_block_buffer.metadata.is_valid();
 
-    if (!block_found) {
+    if (!block_found && !is_dummy) {
         throw std::runtime_error(absl::StrFormat("Can't find block %lu in buffer for aggregation.", entry_id));
     }
 
 
-    // do "aggregation"
+    // aggregate the client gradient
     uint16_t counter = 0;
     std::memcpy(&counter, this->buffer_oram_block_buffer.block.data() + 2 * this->_entry_size, sizeof(std::uint16_t));
     counter += 1;
     std::memcpy(this->buffer_oram_block_buffer.block.data() + 2 * this->_entry_size, &counter, sizeof(std::uint16_t));
 
-    this->buffer_oram_block_buffer.block[this->_entry_size] += 1;
+    this->aggregator.accumulate(true, this->buffer_oram_block_buffer.block.data() + this->_entry_size);
 
     // place block back into the buffer
     this->buffer_oram_block_buffer.metadata.set_path(new_path);
@@ -633,10 +837,12 @@ OramBuffer3::update_flush_buffer() {
             std::uint64_t old_path = this->ll_memory->read_and_update_position_map(entry_id, new_path, is_duplicate);
             old_path &= (~this->in_buffer_mask);
 
-            // use the random path if duplicate
+            // use the random path if duplicate, and an id no block has since the entry may still be in the buffer
             conditional_memcpy(is_duplicate, &old_path, &random_path, sizeof(std::uint64_t));
+            std::uint64_t search_id = entry_id;
+            conditional_memcpy(is_duplicate, &search_id, &dummy_entry_id, sizeof(std::uint64_t));
 
-            this->buffer_oram_block_buffer.metadata = BlockMetadata(entry_id, old_path, false);
+            this->buffer_oram_block_buffer.metadata = BlockMetadata(search_id, old_path, false);
 
             this->ll_buffer->find_and_remove_block_from_path(buffer_oram_block_buffer);
 
@@ -653,7 +859,7 @@ OramBuffer3::update_flush_buffer() {
             uint16_t counter = 0;
             std::memcpy(&counter, this->buffer_oram_block_buffer.block.data() + 2 * this->_entry_size, sizeof(std::uint16_t));
 
-            bool counter_valid = (this->buffer_oram_block_buffer.block[this->_entry_size] == (counter & 0xFF));
+            bool counter_valid = this->aggregator.is_valid(this->buffer_oram_block_buffer.block.data() + this->_entry_size, counter);
 
             // std::uint64_t block_value = 0;
             // std::memcpy(&block_value, this->buffer_oram_block_buffer.block.data(), sizeof(std::uint64_t));
@@ -667,6 +873,7 @@ OramBuffer3::update_flush_buffer() {
             // setup main oram access
             this->main_oram_block_buffer.metadata = BlockMetadata(entry_id, new_path, !is_duplicate);
             std::memcpy(this->main_oram_block_buffer.block.data(), this->buffer_oram_block_buffer.block.data(), this->_entry_size);
+            this->aggregator.apply(this->main_oram_block_buffer.block.data(), this->buffer_oram_block_buffer.block.data() + this->_entry_size, counter);
 
             auto oram_start = std::chrono::steady_clock::now();
             this->ll_memory->place_block_on_path(this->main_oram_block_buffer);
@@ -690,10 +897,12 @@ OramBufferDP::OramBufferDP(
     std::uint64_t max_size,
     std::uint64_t chunk_size,
     float eps,
-    BufferORAMType buffer_oram_type
+    BufferORAMType buffer_oram_type,
+    const GradientAggregationConfig &aggregation
 ) :
 max_size(max_size),
 _entry_size(memory->page_size()),
+aggregator(memory->page_size(), aggregation),
 buffer_entry_size(this->_entry_size * 2 + 2),
 chunk_size(chunk_size),
 eps(eps),
@@ -819,7 +1028,7 @@ void OramBufferDP::load_entries() {
         
         std::cout << absl::StreamFormat("Processing chunk %lu of %lu: %lu requests\n", chunk_index + 1, num_chunks, this_chunk_size);
 
-        uint64_t k_union = union_linear_scanning(this->request_id_buffer.data() + chunk_start_offset, this->union_buffer.data() + chunk_start_offset, this_chunk_size);
+        uint64_t k_union = union_bitonic_sort(this->request_id_buffer.data() + chunk_start_offset, this->union_buffer.data() + chunk_start_offset, this_chunk_size);
 
         std::cout << absl::StreamFormat("k_union: %lu\n", k_union);
         this->k_union_sum += k_union;
@@ -922,15 +1131,17 @@ OramBufferDP::download(std::uint64_t entry_id) {
     // generate_new_path
     std::uint64_t new_path = absl::Uniform(this->bit_gen, 0UL, this->ll_buffer->num_paths());
     // get old path and write new path
-    std::uint64_t old_path = this->ll_memory->read_and_update_position_map_function(entry_id, [=, this] (std::uint64_t old_path) {
+    // a dummy fakes the position map update and searches a random path for an id no block has
+    bool is_dummy = (entry_id == dummy_entry_id);
+    std::uint64_t old_path = this->ll_memory->read_and_update_position_map_function(is_dummy ? 0 : entry_id, [=, this] (std::uint64_t old_path) {
         bool is_present = old_path & this->in_buffer_mask;
         uint64_t new_path_marked = new_path | this->in_buffer_mask;
         uint64_t path = old_path;
         conditional_memcpy(is_present, &path, &new_path_marked, sizeof(uint64_t));
         return path;
-    });
+    }, is_dummy);
 
-    bool present = old_path & this->in_buffer_mask;
+    bool present = (old_path & this->in_buffer_mask) && !is_dummy;
     old_path &= (~this->in_buffer_mask);
 
     auto random_buffer_path = absl::Uniform(this->bit_gen, 0UL, this->ll_buffer->num_paths());
@@ -943,7 +1154,7 @@ OramBufferDP::download(std::uint64_t entry_id) {
 
     bool block_found = this->buffer_oram_block_buffer.metadata.is_valid();
 
-    if (!block_found) {
+    if (!block_found && !is_dummy) {
         this->num_dropped_requests++;
         // throw std::runtime_error(absl::StrFormat("Can't find block %lu in buffer for aggregation.", entry_id));
     }
@@ -959,14 +1170,16 @@ OramBufferDP::aggregate(std::uint64_t entry_id) {
     // generate_new_path
     std::uint64_t new_path = absl::Uniform(this->bit_gen, 0UL, this->ll_buffer->num_paths());
     // get old path and write new path
-    std::uint64_t old_path = this->ll_memory->read_and_update_position_map_function(entry_id, [=, this] (std::uint64_t old_path) {
+    // a dummy fakes the position map update and searches a random path for an id no block has
+    bool is_dummy = (entry_id == dummy_entry_id);
+    std::uint64_t old_path = this->ll_memory->read_and_update_position_map_function(is_dummy ? 0 : entry_id, [=, this] (std::uint64_t old_path) {
         bool is_present = old_path & this->in_buffer_mask;
         uint64_t new_path_marked = new_path | this->in_buffer_mask;
         uint64_t path = old_path;
         conditional_memcpy(is_present, &path, &new_path_marked, sizeof(uint64_t));
         return path;
-    });
-    bool present = old_path & this->in_buffer_mask;
+    }, is_dummy);
+    bool present = (old_path & this->in_buffer_mask) && !is_dummy;
     old_path &= (~this->in_buffer_mask);
 
     auto random_buffer_path = absl::Uniform(this->bit_gen, 0UL, this->ll_buffer->num_paths());
@@ -984,13 +1197,13 @@ OramBufferDP::aggregate(std::uint64_t entry_id) {
     // }
 
 
-    // do "aggregation"
+    // aggregate the client gradient
     uint16_t counter = 0;
     std::memcpy(&counter, this->buffer_oram_block_buffer.block.data() + 2 * this->_entry_size, sizeof(std::uint16_t));
     counter += 1;
     std::memcpy(this->buffer_oram_block_buffer.block.data() + 2 * this->_entry_size, &counter, sizeof(std::uint16_t));
 
-    this->buffer_oram_block_buffer.block[this->_entry_size] += 1;
+    this->aggregator.accumulate(true, this->buffer_oram_block_buffer.block.data() + this->_entry_size);
 
     // place block back into the buffer
     this->buffer_oram_block_buffer.metadata.set_path(new_path);
@@ -1049,7 +1262,7 @@ OramBufferDP::move_entry_to_main_oram(std::uint64_t entry_id) {
     uint16_t counter = 0;
     std::memcpy(&counter, this->buffer_oram_block_buffer.block.data() + 2 * this->_entry_size, sizeof(std::uint16_t));
 
-    bool counter_valid = (this->buffer_oram_block_buffer.block[this->_entry_size] == (counter & 0xFF));
+    bool counter_valid = this->aggregator.is_valid(this->buffer_oram_block_buffer.block.data() + this->_entry_size, counter);
 
     if (!is_dummy && !counter_valid) {
         throw std::runtime_error("validation failed");
@@ -1058,6 +1271,7 @@ OramBufferDP::move_entry_to_main_oram(std::uint64_t entry_id) {
     // setup main oram access
     this->main_oram_block_buffer.metadata = BlockMetadata(entry_id, new_path, !is_dummy);
     std::memcpy(this->main_oram_block_buffer.block.data(), this->buffer_oram_block_buffer.block.data(), this->_entry_size);
+    this->aggregator.apply(this->main_oram_block_buffer.block.data(), this->buffer_oram_block_buffer.block.data() + this->_entry_size, counter);
 
     auto oram_start = std::chrono::steady_clock::now();
     this->ll_memory->place_block_on_path(this->main_oram_block_buffer);
@@ -1092,10 +1306,12 @@ OramBufferDPLinearScan::OramBufferDPLinearScan(
     std::uint64_t max_size,
     std::uint64_t chunk_size,
     float eps,
-    BufferORAMType buffer_oram_type
+    BufferORAMType buffer_oram_type,
+    const GradientAggregationConfig &aggregation
 ) :
 max_size(max_size),
 _entry_size(memory->page_size()),
+aggregator(memory->page_size(), aggregation),
 buffer_entry_size(this->_entry_size * 2 + 2),
 chunk_size(chunk_size),
 eps(eps),
@@ -1218,7 +1434,7 @@ void OramBufferDPLinearScan::load_entries() {
     std::cout << absl::StreamFormat("Total clients: %lu\n", total_clients);
     std::cout << "Performing Union";
 
-    uint64_t k_union = union_linear_scanning(this->request_id_buffer.data(), this->union_buffer.data(), total_clients);
+    uint64_t k_union = union_bitonic_sort(this->request_id_buffer.data(), this->union_buffer.data(), total_clients);
 
     std::cout << absl::StreamFormat("k_union: %lu\n", k_union);
     this->k_union_sum += k_union;
@@ -1351,6 +1567,7 @@ OramBufferDPLinearScan::download(std::uint64_t entry_id) {
     //     return path;
     // });
 
+    // the buffer position map holds 32 bit ids, so a dummy is never present and searches a random path
     std::uint64_t old_path = this->bufer_posmap_read_and_update(entry_id, new_path);
 
     bool present = (old_path != std::numeric_limits<uint64_t>::max());
@@ -1366,7 +1583,7 @@ OramBufferDPLinearScan::download(std::uint64_t entry_id) {
 
     bool block_found = this->buffer_oram_block_buffer.metadata.is_valid();
 
-    if (!block_found) {
+    if (!block_found && entry_id != dummy_entry_id) {
         this->num_dropped_requests++;
         // throw std::runtime_error(absl::StrFormat("Can't find block %lu in buffer for aggregation.", entry_id));
     }
@@ -1409,13 +1626,13 @@ OramBufferDPLinearScan::aggregate(std::uint64_t entry_id) {
     // }
 
 
-    // do "aggregation"
+    // aggregate the client gradient
     uint16_t counter = 0;
     std::memcpy(&counter, this->buffer_oram_block_buffer.block.data() + 2 * this->_entry_size, sizeof(std::uint16_t));
     counter += 1;
     std::memcpy(this->buffer_oram_block_buffer.block.data() + 2 * this->_entry_size, &counter, sizeof(std::uint16_t));
 
-    this->buffer_oram_block_buffer.block[this->_entry_size] += 1;
+    this->aggregator.accumulate(true, this->buffer_oram_block_buffer.block.data() + this->_entry_size);
 
     // place block back into the buffer
     this->buffer_oram_block_buffer.metadata.set_path(new_path);
@@ -1479,7 +1696,7 @@ OramBufferDPLinearScan::move_entry_to_main_oram(std::uint64_t entry_id) {
     uint16_t counter = 0;
     std::memcpy(&counter, this->buffer_oram_block_buffer.block.data() + 2 * this->_entry_size, sizeof(std::uint16_t));
 
-    bool counter_valid = (this->buffer_oram_block_buffer.block[this->_entry_size] == (counter & 0xFF));
+    bool counter_valid = this->aggregator.is_valid(this->buffer_oram_block_buffer.block.data() + this->_entry_size, counter);
 
     if (!is_dummy && !counter_valid) {
         throw std::runtime_error("validation failed");
@@ -1488,6 +1705,7 @@ OramBufferDPLinearScan::move_entry_to_main_oram(std::uint64_t entry_id) {
     // setup main oram access
     this->main_oram_block_buffer.metadata = BlockMetadata(entry_id, new_path, !is_dummy);
     std::memcpy(this->main_oram_block_buffer.block.data(), this->buffer_oram_block_buffer.block.data(), this->_entry_size);
+    this->aggregator.apply(this->main_oram_block_buffer.block.data(), this->buffer_oram_block_buffer.block.data() + this->_entry_size, counter);
 
     auto oram_start = std::chrono::steady_clock::now();
     this->ll_memory->place_block_on_path(this->main_oram_block_buffer);
@@ -1543,7 +1761,7 @@ OramBufferDPLinearScan::update_flush_buffer() {
         uint16_t counter = 0;
         std::memcpy(&counter, this->buffer_oram_block_buffer.block.data() + 2 * this->_entry_size, sizeof(std::uint16_t));
 
-        bool counter_valid = (this->buffer_oram_block_buffer.block[this->_entry_size] == (counter & 0xFF));
+        bool counter_valid = this->aggregator.is_valid(this->buffer_oram_block_buffer.block.data() + this->_entry_size, counter);
 
         if (!is_dummy && !counter_valid) {
             throw std::runtime_error("validation failed");
@@ -1552,6 +1770,7 @@ OramBufferDPLinearScan::update_flush_buffer() {
         // setup main oram access
         this->main_oram_block_buffer.metadata = BlockMetadata(entry_id, this->memory_path_buffer[i], !is_dummy);
         std::memcpy(this->main_oram_block_buffer.block.data(), this->buffer_oram_block_buffer.block.data(), this->_entry_size);
+        this->aggregator.apply(this->main_oram_block_buffer.block.data(), this->buffer_oram_block_buffer.block.data() + this->_entry_size, counter);
 
         auto oram_start = std::chrono::steady_clock::now();
         this->ll_memory->place_block_on_path(this->main_oram_block_buffer);
@@ -1569,3 +1788,258 @@ OramBufferDPLinearScan::update_flush_buffer() {
 }
 
 
+
+ShardedRecSysBuffer::ShardedRecSysBuffer(
+    std::vector<std::unique_ptr<RecSysBuffer>> &&shards
+) :
+shards(std::move(shards)),
+shard_entries(this->shards.size()),
+worker_times(this->shards.size(), std::chrono::nanoseconds::zero()),
+phase_wall_times(NUM_PHASES, std::chrono::nanoseconds::zero()),
+phase_worker_times(NUM_PHASES, std::chrono::nanoseconds::zero()),
+phase_start(this->shards.size() + 1),
+phase_end(this->shards.size() + 1),
+stopping(false),
+worker_errors(this->shards.size())
+{
+    if (this->shards.empty()) {
+        throw std::invalid_argument("ShardedRecSysBuffer needs at least one shard");
+    }
+    for (const auto &shard : this->shards) {
+        if (shard->entry_size() != this->shards.front()->entry_size()) {
+            throw std::invalid_argument("All shards of a ShardedRecSysBuffer need the same entry size");
+        }
+        shard->underlying_memory()->reset_statistics();
+    }
+
+    for (std::size_t i = 0; i < this->shards.size(); i++) {
+        this->workers.emplace_back(&ShardedRecSysBuffer::worker_loop, this, i);
+    }
+}
+
+ShardedRecSysBuffer::~ShardedRecSysBuffer() {
+    this->stopping = true;
+    this->phase_start.arrive_and_wait();
+    for (auto &worker : this->workers) {
+        worker.join();
+    }
+}
+
+std::uint64_t
+ShardedRecSysBuffer::num_entries() const {
+    // entries past the end of the smallest shard would not have a home
+    std::uint64_t min_shard_entries = std::numeric_limits<std::uint64_t>::max();
+    for (const auto &shard : this->shards) {
+        min_shard_entries = std::min(min_shard_entries, shard->num_entries());
+    }
+    return min_shard_entries * this->shards.size();
+}
+
+std::uint64_t
+ShardedRecSysBuffer::entry_size() const {
+    return this->shards.front()->entry_size();
+}
+
+void
+ShardedRecSysBuffer::worker_loop(std::size_t shard_index) {
+    while (true) {
+        this->phase_start.arrive_and_wait();
+        if (this->stopping) {
+            break;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        try {
+            this->task(this->shards[shard_index].get(), shard_index);
+        } catch (...) {
+            this->worker_errors[shard_index] = std::current_exception();
+        }
+        this->worker_times[shard_index] = std::chrono::steady_clock::now() - start;
+
+        this->phase_end.arrive_and_wait();
+    }
+}
+
+void
+ShardedRecSysBuffer::run_on_shards(Phase phase, std::function<void(RecSysBuffer *, std::size_t)> &&task) {
+    std::vector<std::chrono::nanoseconds> oram_times_before;
+    for (auto &shard : this->shards) {
+        oram_times_before.emplace_back(shard->get_oram_time());
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    this->task = std::move(task);
+    this->phase_start.arrive_and_wait();
+    this->phase_end.arrive_and_wait();
+    auto end = std::chrono::steady_clock::now();
+
+    // the shards run side by side, so the slowest one is what the phase waits for
+    std::chrono::nanoseconds max_oram_time = std::chrono::nanoseconds::zero();
+    for (std::size_t i = 0; i < this->shards.size(); i++) {
+        max_oram_time = std::max(max_oram_time, this->shards[i]->get_oram_time() - oram_times_before[i]);
+        this->phase_worker_times[phase] += this->worker_times[i];
+    }
+    this->oram_time += max_oram_time;
+    this->overall_time += (end - start);
+    this->phase_wall_times[phase] += (end - start);
+
+    for (auto &error : this->worker_errors) {
+        if (error) {
+            std::exception_ptr to_throw = error;
+            error = nullptr;
+            std::rethrow_exception(to_throw);
+        }
+    }
+}
+
+std::uint64_t
+ShardedRecSysBuffer::shard_batch_size(std::uint64_t batch_size) {
+    if (batch_size != this->last_batch_size) {
+        this->last_batch_size = batch_size;
+        this->last_shard_batch_size = ShardRouter::padded_slots_per_shard(this->shards.size(), batch_size);
+    }
+    return this->last_shard_batch_size;
+}
+
+void
+ShardedRecSysBuffer::run_batch(Phase phase, const std::vector<std::uint64_t> &entry_ids) {
+    const std::uint64_t num_shards = this->shards.size();
+    const std::uint64_t count = entry_ids.size();
+    constexpr std::size_t entry_id_size = sizeof(std::uint64_t);
+
+    this->route_shards.resize(count);
+    byte_t *records = this->router.reset(count, entry_id_size);
+    for (std::uint64_t i = 0; i < count; i++) {
+        std::uint64_t local_entry_id = entry_ids[i] / num_shards;
+        this->route_shards[i] = entry_ids[i] % num_shards;
+        std::memcpy(records + i * entry_id_size, &local_entry_id, entry_id_size);
+    }
+
+    // a batch that overflows the padded size anyway, e.g. because it repeats many entries, gives every shard as
+    // many entries as the busiest one instead of failing, which reveals that it overflowed
+    std::uint64_t max_load = ShardRouter::max_shard_load(this->route_shards.data(), count, num_shards, this->shard_loads);
+    const std::uint64_t entries_per_shard = std::max(this->shard_batch_size(count), max_load);
+    this->router.route(this->route_shards.data(), num_shards, entries_per_shard, reinterpret_cast<const byte_t *>(&dummy_entry_id));
+
+    for (std::uint64_t shard_index = 0; shard_index < num_shards; shard_index++) {
+        auto &entries = this->shard_entries[shard_index];
+        entries.resize(entries_per_shard);
+        std::memcpy(entries.data(), this->router.slot_record(shard_index * entries_per_shard), entries_per_shard * entry_id_size);
+    }
+
+    this->run_on_shards(phase, [this, phase](RecSysBuffer *shard, std::size_t shard_index) {
+        if (phase == DOWNLOAD) {
+            shard->download_batch(this->shard_entries[shard_index]);
+        } else {
+            shard->aggregate_batch(this->shard_entries[shard_index]);
+        }
+    });
+}
+
+void
+ShardedRecSysBuffer::run_single(Phase phase, std::uint64_t entry_id) {
+    // one access per shard on the calling thread, a round of the workers would cost more than it saves
+    const std::uint64_t num_shards = this->shards.size();
+    const std::uint64_t target_shard = entry_id % num_shards;
+    const std::uint64_t local_entry_id = entry_id / num_shards;
+
+    auto start = std::chrono::steady_clock::now();
+    for (std::uint64_t shard_index = 0; shard_index < num_shards; shard_index++) {
+        RecSysBuffer *shard = this->shards[shard_index].get();
+        auto oram_time_before = shard->get_oram_time();
+
+        std::uint64_t shard_entry_id = dummy_entry_id;
+        conditional_memcpy(shard_index == target_shard, &shard_entry_id, &local_entry_id, sizeof(std::uint64_t));
+        if (phase == DOWNLOAD) {
+            shard->download(shard_entry_id);
+        } else {
+            shard->aggregate(shard_entry_id);
+        }
+        this->oram_time += shard->get_oram_time() - oram_time_before;
+    }
+    auto end = std::chrono::steady_clock::now();
+    this->overall_time += (end - start);
+    this->phase_wall_times[phase] += (end - start);
+    this->phase_worker_times[phase] += (end - start);
+}
+
+void
+ShardedRecSysBuffer::reserve(std::uint64_t entry_id) {
+    // not padded, the number of reservations of every shard shows the spread of the round over the shards
+    auto start = std::chrono::steady_clock::now();
+    this->shards[entry_id % this->shards.size()]->reserve(entry_id / this->shards.size());
+    auto end = std::chrono::steady_clock::now();
+    this->overall_time += (end - start);
+    this->phase_wall_times[RESERVE] += (end - start);
+    this->phase_worker_times[RESERVE] += (end - start);
+}
+
+void
+ShardedRecSysBuffer::load_entries() {
+    this->run_on_shards(LOAD, [](RecSysBuffer *shard, std::size_t) {
+        shard->load_entries();
+    });
+}
+
+void
+ShardedRecSysBuffer::download(std::uint64_t entry_id) {
+    this->run_single(DOWNLOAD, entry_id);
+}
+
+void
+ShardedRecSysBuffer::aggregate(std::uint64_t entry_id) {
+    this->run_single(AGGREGATE, entry_id);
+}
+
+void
+ShardedRecSysBuffer::download_batch(const std::vector<std::uint64_t> &entry_ids) {
+    this->run_batch(DOWNLOAD, entry_ids);
+}
+
+void
+ShardedRecSysBuffer::aggregate_batch(const std::vector<std::uint64_t> &entry_ids) {
+    this->run_batch(AGGREGATE, entry_ids);
+}
+
+void
+ShardedRecSysBuffer::update_flush_buffer() {
+    this->run_on_shards(FLUSH, [](RecSysBuffer *shard, std::size_t) {
+        shard->update_flush_buffer();
+    });
+}
+
+void
+ShardedRecSysBuffer::save_buffer_stats() {
+    for (std::size_t i = 0; i < this->shards.size(); i++) {
+        // the caller saves the statistics of underlying_memory()
+        if (i > 0) {
+            this->shards[i]->underlying_memory()->save_statistics();
+        }
+        this->shards[i]->save_buffer_stats();
+    }
+}
+
+std::size_t
+ShardedRecSysBuffer::get_total_requests() {
+    return this->sum_over_shards([](RecSysBuffer *shard) {return shard->get_total_requests();});
+}
+
+std::size_t
+ShardedRecSysBuffer::get_k_union_sum() {
+    return this->sum_over_shards([](RecSysBuffer *shard) {return shard->get_k_union_sum();});
+}
+
+std::size_t
+ShardedRecSysBuffer::get_k_sum() {
+    return this->sum_over_shards([](RecSysBuffer *shard) {return shard->get_k_sum();});
+}
+
+std::size_t
+ShardedRecSysBuffer::get_num_dropped_entries() {
+    return this->sum_over_shards([](RecSysBuffer *shard) {return shard->get_num_dropped_entries();});
+}
+
+std::size_t
+ShardedRecSysBuffer::get_num_dropped_requests() {
+    return this->sum_over_shards([](RecSysBuffer *shard) {return shard->get_num_dropped_requests();});
+}
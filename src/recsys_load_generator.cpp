@@ -0,0 +1,541 @@
+#include <recsys_server.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cxxopts.hpp>
+#include <absl/random/random.h>
+#include <absl/strings/str_format.h>
+#include <toml++/toml.h>
+#include <request_stream.hpp>
+#include <util.hpp>
+
+using recsys_protocol::Op;
+using recsys_protocol::Status;
+
+namespace {
+
+std::runtime_error
+system_error(std::string_view what) {
+    return std::runtime_error(absl::StrFormat("%s: %s", what, std::strerror(errno)));
+}
+
+// every client needs a descriptor, the default soft limit is often 1024
+void
+raise_file_limit(std::uint64_t num_files) {
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+        throw system_error("getrlimit failed");
+    }
+    if (limit.rlim_cur >= num_files) {
+        return;
+    }
+    if (limit.rlim_max < num_files) {
+        throw std::invalid_argument(absl::StrFormat("%lu clients need more than the hard limit of %lu open files", num_files, limit.rlim_max));
+    }
+    limit.rlim_cur = num_files;
+    if (setrlimit(RLIMIT_NOFILE, &limit) != 0) {
+        throw system_error("setrlimit failed");
+    }
+}
+
+struct LatencySummary {
+    std::uint64_t count;
+    double mean_us;
+    double p50_us;
+    double p99_us;
+    double p999_us;
+    double max_us;
+};
+
+LatencySummary
+summarize(std::vector<std::int64_t> &latencies_ns) {
+    LatencySummary summary{};
+    summary.count = latencies_ns.size();
+    if (latencies_ns.empty()) {
+        return summary;
+    }
+    std::sort(latencies_ns.begin(), latencies_ns.end());
+    double sum = 0.0;
+    for (auto latency : latencies_ns) {
+        sum += static_cast<double>(latency);
+    }
+    auto percentile = [&](double fraction) {
+        std::size_t index = std::min(latencies_ns.size() - 1, static_cast<std::size_t>(fraction * static_cast<double>(latencies_ns.size())));
+        return static_cast<double>(latencies_ns[index]) / 1e3;
+    };
+    summary.mean_us = sum / static_cast<double>(latencies_ns.size()) / 1e3;
+    summary.p50_us = percentile(0.5);
+    summary.p99_us = percentile(0.99);
+    summary.p999_us = percentile(0.999);
+    summary.max_us = static_cast<double>(latencies_ns.back()) / 1e3;
+    return summary;
+}
+
+/**
+ * @brief Simulates many clients of a recsys_server, each on its own connection, from one thread.
+ *
+ * Every round each client draws its entries, optionally reserves them, downloads them, trains for
+ * train_time and aggregates them. The clients only wait for each other after the reservations and
+ * at the end of the round, when one END_ROUND is sent.
+ */
+class LoadGenerator {
+    public:
+    LoadGenerator(const std::filesystem::path &socket_path, std::uint64_t num_clients, std::uint64_t entries_per_client, std::chrono::microseconds train_time) :
+    entries_per_client(entries_per_client),
+    train_time(train_time),
+    errors(0),
+    busy_clients(0),
+    latencies_ns(static_cast<std::size_t>(Op::SHUTDOWN) + 1),
+    receive_buffer(64 * 1024)
+    {
+        this->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (this->epoll_fd < 0) {
+            throw system_error("Unable to create the epoll instance");
+        }
+
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (socket_path.native().size() >= sizeof(address.sun_path)) {
+            throw std::invalid_argument(absl::StrFormat("Socket path %s is too long", socket_path.native()));
+        }
+        std::strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+        this->clients.resize(num_clients);
+        for (std::size_t index = 0; index < num_clients; index++) {
+            auto &client = this->clients[index];
+            // blocking until the server accepts, so a full listen backlog only slows down the start
+            client.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (client.fd < 0) {
+                throw system_error("Unable to create a client socket");
+            }
+            if (connect(client.fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0) {
+                throw system_error(absl::StrFormat("Unable to connect to %s", socket_path.native()));
+            }
+
+            recsys_protocol::ServerInfo info;
+            std::size_t received = 0;
+            while (received < sizeof(info)) {
+                ssize_t result = recv(client.fd, reinterpret_cast<byte_t *>(&info) + received, sizeof(info) - received, 0);
+                if (result <= 0) {
+                    throw system_error("The server closed the connection");
+                }
+                received += result;
+            }
+            this->info = info;
+
+            if (fcntl(client.fd, F_SETFL, O_NONBLOCK) != 0) {
+                throw system_error("Unable to make a client socket nonblocking");
+            }
+            client.stage = Stage::IDLE;
+            client.output_offset = 0;
+            client.writable_wanted = false;
+
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.u64 = index;
+            if (epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, client.fd, &event) != 0) {
+                throw system_error("Unable to watch a client socket");
+            }
+        }
+
+        // all clients send the same gradients, the server does not look at them
+        this->gradients.resize(this->entries_per_client * this->info.entry_size, 1);
+    }
+
+    ~LoadGenerator() {
+        for (auto &client : this->clients) {
+            close(client.fd);
+        }
+        close(this->epoll_fd);
+    }
+
+    const recsys_protocol::ServerInfo &server_info() const {
+        return this->info;
+    }
+
+    /**
+     * @brief Runs one round for all clients with entries drawn from pattern.
+     */
+    void run_round(const AccessPattern &pattern, absl::BitGen &bit_gen, bool reserve) {
+        for (auto &client : this->clients) {
+            client.entries.resize(this->entries_per_client);
+            for (auto &entry : client.entries) {
+                entry = pattern.get_address(this->info.num_entries, bit_gen);
+            }
+        }
+
+        if (reserve) {
+            for (std::size_t index = 0; index < this->clients.size(); index++) {
+                this->send(index, Op::RESERVE, Stage::RESERVING);
+            }
+            this->wait_for_clients();
+        }
+
+        for (std::size_t index = 0; index < this->clients.size(); index++) {
+            this->send(index, Op::DOWNLOAD, Stage::DOWNLOADING);
+        }
+        this->wait_for_clients();
+
+        this->send(0, Op::END_ROUND, Stage::ENDING_ROUND);
+        this->wait_for_clients();
+    }
+
+    void shutdown_server() {
+        this->send(0, Op::SHUTDOWN, Stage::SHUTTING_DOWN);
+        this->wait_for_clients();
+    }
+
+    LatencySummary latency_summary(Op op) {
+        return summarize(this->latencies_ns[static_cast<std::size_t>(op)]);
+    }
+
+    std::uint64_t num_errors() const {
+        return this->errors;
+    }
+
+    protected:
+    enum class Stage {
+        IDLE,
+        RESERVING,
+        DOWNLOADING,
+        TRAINING,
+        AGGREGATING,
+        ENDING_ROUND,
+        SHUTTING_DOWN
+    };
+
+    struct Client {
+        int fd;
+        Stage stage;
+        std::vector<std::uint64_t> entries;
+        bytes_t output;
+        std::size_t output_offset;
+        bool writable_wanted;
+        bytes_t input;
+        std::chrono::steady_clock::time_point sent;
+        std::chrono::steady_clock::time_point train_until;
+    };
+
+    void send(std::size_t index, Op op, Stage stage) {
+        auto &client = this->clients[index];
+        recsys_protocol::RequestHeader header{};
+        header.op = op;
+        bool with_entries = (op == Op::RESERVE || op == Op::DOWNLOAD || op == Op::AGGREGATE);
+        header.count = with_entries ? static_cast<std::uint32_t>(client.entries.size()) : 0;
+
+        std::size_t entries_length = header.count * sizeof(std::uint64_t);
+        std::size_t gradients_length = (op == Op::AGGREGATE) ? this->gradients.size() : 0;
+        client.output.resize(sizeof(header) + entries_length + gradients_length);
+        std::memcpy(client.output.data(), &header, sizeof(header));
+        if (entries_length > 0) {
+            std::memcpy(client.output.data() + sizeof(header), client.entries.data(), entries_length);
+        }
+        if (gradients_length > 0) {
+            std::memcpy(client.output.data() + sizeof(header) + entries_length, this->gradients.data(), gradients_length);
+        }
+        client.output_offset = 0;
+        if (client.stage == Stage::IDLE) {
+            this->busy_clients++;
+        }
+        client.stage = stage;
+        client.sent = std::chrono::steady_clock::now();
+        this->write_to(index);
+    }
+
+    void write_to(std::size_t index) {
+        auto &client = this->clients[index];
+        while (client.output_offset < client.output.size()) {
+            ssize_t sent = ::send(client.fd, client.output.data() + client.output_offset, client.output.size() - client.output_offset, MSG_NOSIGNAL);
+            if (sent > 0) {
+                client.output_offset += sent;
+            } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                this->set_writable_wanted(index, true);
+                return;
+            } else if (sent < 0 && errno == EINTR) {
+                continue;
+            } else {
+                throw system_error("Lost the connection to the server");
+            }
+        }
+        this->set_writable_wanted(index, false);
+    }
+
+    void set_writable_wanted(std::size_t index, bool wanted) {
+        auto &client = this->clients[index];
+        if (client.writable_wanted == wanted) {
+            return;
+        }
+        epoll_event event{};
+        event.events = wanted ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+        event.data.u64 = index;
+        if (epoll_ctl(this->epoll_fd, EPOLL_CTL_MOD, client.fd, &event) != 0) {
+            throw system_error("Unable to update a watched client socket");
+        }
+        client.writable_wanted = wanted;
+    }
+
+    // returns true once the answer to the outstanding request has arrived
+    bool read_from(Client &client) {
+        while (true) {
+            ssize_t received = recv(client.fd, this->receive_buffer.data(), this->receive_buffer.size(), 0);
+            if (received > 0) {
+                client.input.insert(client.input.end(), this->receive_buffer.begin(), this->receive_buffer.begin() + received);
+                continue;
+            }
+            if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            }
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("The server closed the connection");
+        }
+
+        recsys_protocol::ResponseHeader header;
+        if (client.input.size() < sizeof(header)) {
+            return false;
+        }
+        std::memcpy(&header, client.input.data(), sizeof(header));
+        if (client.input.size() < sizeof(header) + header.length) {
+            return false;
+        }
+
+        if (header.status != Status::OK) {
+            if (this->errors == 0) {
+                std::string message(client.input.begin() + sizeof(header), client.input.begin() + sizeof(header) + header.length);
+                std::cout << absl::StreamFormat("The server answered with an error: %s\n", message);
+            }
+            this->errors++;
+        }
+        // there is only one outstanding request per client
+        client.input.clear();
+        return true;
+    }
+
+    // called when the answer to the request of the current stage arrived
+    void advance(std::size_t index, std::chrono::steady_clock::time_point now) {
+        auto &client = this->clients[index];
+        Op op;
+        switch (client.stage) {
+            case Stage::RESERVING:
+                op = Op::RESERVE;
+                client.stage = Stage::IDLE;
+                break;
+            case Stage::DOWNLOADING:
+                op = Op::DOWNLOAD;
+                client.stage = Stage::TRAINING;
+                client.train_until = now + this->train_time;
+                // every client trains equally long, so the queue stays sorted by deadline
+                this->training_clients.emplace_back(index);
+                break;
+            case Stage::AGGREGATING:
+                op = Op::AGGREGATE;
+                client.stage = Stage::IDLE;
+                break;
+            case Stage::ENDING_ROUND:
+                op = Op::END_ROUND;
+                client.stage = Stage::IDLE;
+                break;
+            case Stage::SHUTTING_DOWN:
+                op = Op::SHUTDOWN;
+                client.stage = Stage::IDLE;
+                break;
+            default:
+                throw std::logic_error("Answer without a request");
+        }
+        this->latencies_ns[static_cast<std::size_t>(op)].emplace_back(std::chrono::duration_cast<std::chrono::nanoseconds>(now - client.sent).count());
+        if (client.stage == Stage::IDLE) {
+            this->busy_clients--;
+        }
+    }
+
+    // runs the event loop until every client is idle again
+    void wait_for_clients() {
+        std::vector<epoll_event> events(1024);
+
+        while (this->busy_clients > 0) {
+            auto now = std::chrono::steady_clock::now();
+            while (!this->training_clients.empty() && this->clients[this->training_clients.front()].train_until <= now) {
+                this->send(this->training_clients.front(), Op::AGGREGATE, Stage::AGGREGATING);
+                this->training_clients.pop_front();
+            }
+
+            int timeout = -1;
+            if (!this->training_clients.empty()) {
+                // round up, epoll only has milliseconds
+                auto until_deadline = this->clients[this->training_clients.front()].train_until - now;
+                timeout = static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(until_deadline).count());
+            }
+            int num_events = epoll_wait(this->epoll_fd, events.data(), static_cast<int>(events.size()), timeout);
+            if (num_events < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw system_error("epoll_wait failed");
+            }
+
+            now = std::chrono::steady_clock::now();
+            for (int i = 0; i < num_events; i++) {
+                std::size_t index = events[i].data.u64;
+                if (events[i].events & EPOLLOUT) {
+                    this->write_to(index);
+                }
+                if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && this->read_from(this->clients[index])) {
+                    this->advance(index, now);
+                }
+            }
+        }
+    }
+
+    const std::uint64_t entries_per_client;
+    const std::chrono::microseconds train_time;
+    recsys_protocol::ServerInfo info;
+    int epoll_fd;
+    std::vector<Client> clients;
+    // clients waiting to aggregate, oldest download first
+    std::deque<std::size_t> training_clients;
+    bytes_t gradients;
+    std::uint64_t errors;
+    // clients with a request in flight or still training
+    std::uint64_t busy_clients;
+    std::vector<std::vector<std::int64_t>> latencies_ns;
+    bytes_t receive_buffer;
+};
+
+}
+
+int recsys_load_entry_point(int argc, const char** argv) {
+    cxxopts::Options recsys_load_options("RecSysLoad", "Simulates many concurrent clients of a recsys_server");
+
+    recsys_load_options.add_options()
+    ("subcommand", "ignore", cxxopts::value<std::string>())
+    ("a,socket", "Path of the server socket", cxxopts::value<std::string>()->default_value("recsys.sock"))
+    ("c,clients", "Number of concurrent clients, each has its own connection", cxxopts::value<std::string>()->default_value("1Ki"))
+    ("k,entries_per_client", "Number of entries each client downloads and aggregates per round", cxxopts::value<std::string>()->default_value("16"))
+    ("r,rounds", "Number of rounds to simulate", cxxopts::value<std::string>()->default_value("16"))
+    ("P,pattern", "Name of the pattern the entries are drawn from", cxxopts::value<std::string>()->default_value("Uniform"))
+    ("R,reserve", "Reserve the entries before downloading them, needed by the DP buffers", cxxopts::value<bool>()->default_value("false"))
+    ("T,train_time", "Microseconds each client spends between its download and its aggregation", cxxopts::value<uint64_t>()->default_value("0"))
+    ("s,shutdown", "Shut down the server after the last round", cxxopts::value<bool>()->default_value("false"))
+    ("o, output_file", "Generate TOML output summarizing results.", cxxopts::value<std::string>())
+    ("h,help", "show help text");
+
+    recsys_load_options.parse_positional("subcommand");
+
+    auto result = recsys_load_options.parse(argc, argv);
+
+    if (result.count("subcommand") != 1 || result["subcommand"].as<std::string>() != "recsys_load") {
+        std::cout << "Incorrect sub command!\n";
+        return -1;
+    }
+
+    if (result.count("help") > 0) {
+        std::cout << recsys_load_options.help();
+        return 0;
+    }
+
+    auto num_clients = parse_size(result["clients"].as<std::string>());
+    auto entries_per_client = parse_size(result["entries_per_client"].as<std::string>());
+    auto num_rounds = parse_size(result["rounds"].as<std::string>());
+    bool reserve = result["reserve"].as<bool>();
+    std::chrono::microseconds train_time(result["train_time"].as<uint64_t>());
+
+    if (num_clients == 0 || entries_per_client == 0 || entries_per_client > recsys_protocol::max_request_count) {
+        std::cout << absl::StreamFormat("Need at least one client and 1 to %u entries per client!\n", recsys_protocol::max_request_count);
+        return -1;
+    }
+
+    // some headroom for stdio and the libraries
+    raise_file_limit(num_clients + 64);
+
+    std::cout << absl::StreamFormat("Connecting %lu clients\n", num_clients);
+    LoadGenerator load_generator(result["socket"].as<std::string>(), num_clients, entries_per_client, train_time);
+    std::cout << absl::StreamFormat(
+        "Server has %lu entries of %lu bytes\n",
+        load_generator.server_info().num_entries, load_generator.server_info().entry_size
+    );
+
+    auto &pattern = get_pattern_by_name(result["pattern"].as<std::string>());
+    auto bit_gen = absl::BitGen();
+
+    std::vector<std::int64_t> round_times_ns;
+    auto start = std::chrono::steady_clock::now();
+    for (std::uint64_t round = 0; round < num_rounds; round++) {
+        auto round_start = std::chrono::steady_clock::now();
+        load_generator.run_round(pattern, bit_gen, reserve);
+        auto round_end = std::chrono::steady_clock::now();
+        round_times_ns.emplace_back(std::chrono::duration_cast<std::chrono::nanoseconds>(round_end - round_start).count());
+        std::cout << absl::StreamFormat(
+            "Completed round %lu of %lu in %lf seconds\n",
+            round + 1, num_rounds, std::chrono::duration<double>(round_end - round_start).count()
+        );
+    }
+    std::chrono::duration<double> total_seconds(std::chrono::steady_clock::now() - start);
+
+    if (result["shutdown"].as<bool>()) {
+        load_generator.shutdown_server();
+    }
+
+    // every client sends one download and one aggregate per round
+    double requests = 2.0 * static_cast<double>(num_clients * num_rounds);
+    double entries = requests * static_cast<double>(entries_per_client);
+
+    std::cout << absl::StreamFormat("%lu rounds in %lf seconds, %lf requests/s, %lf entries/s\n", num_rounds, total_seconds.count(), requests / total_seconds.count(), entries / total_seconds.count());
+    if (load_generator.num_errors() > 0) {
+        std::cout << absl::StreamFormat("%lu requests failed\n", load_generator.num_errors());
+    }
+
+    toml::table table;
+    table.emplace("clients", static_cast<int64_t>(num_clients));
+    table.emplace("entries_per_client", static_cast<int64_t>(entries_per_client));
+    table.emplace("rounds", static_cast<int64_t>(num_rounds));
+    table.emplace("train_time_us", static_cast<int64_t>(train_time.count()));
+    table.emplace("total_seconds", total_seconds.count());
+    table.emplace("requests_per_second", requests / total_seconds.count());
+    table.emplace("entries_per_second", entries / total_seconds.count());
+    table.emplace("errors", static_cast<int64_t>(load_generator.num_errors()));
+
+    auto round_summary = summarize(round_times_ns);
+    table.emplace("round", toml::table{
+        {"mean_us", round_summary.mean_us},
+        {"max_us", round_summary.max_us}
+    });
+
+    std::vector<std::pair<Op, const char *>> ops = {{Op::DOWNLOAD, "download"}, {Op::AGGREGATE, "aggregate"}, {Op::END_ROUND, "end_round"}};
+    if (reserve) {
+        ops.insert(ops.begin(), {Op::RESERVE, "reserve"});
+    }
+    for (const auto &[op, name] : ops) {
+        auto summary = load_generator.latency_summary(op);
+        std::cout << absl::StreamFormat(
+            "%-9s latency: mean %9.1f us, p50 %9.1f us, p99 %9.1f us, p99.9 %9.1f us, max %9.1f us\n",
+            name, summary.mean_us, summary.p50_us, summary.p99_us, summary.p999_us, summary.max_us
+        );
+        table.emplace(name, toml::table{
+            {"requests", static_cast<int64_t>(summary.count)},
+            {"mean_us", summary.mean_us},
+            {"p50_us", summary.p50_us},
+            {"p99_us", summary.p99_us},
+            {"p999_us", summary.p999_us},
+            {"max_us", summary.max_us}
+        });
+    }
+
+    if (result.count("output_file") > 0) {
+        std::ofstream out_file(result["output_file"].as<std::string>());
+        out_file << table;
+    }
+
+    return 0;
+}
@@ -0,0 +1,637 @@
+#include <recsys_server.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cxxopts.hpp>
+#include <absl/strings/str_format.h>
+#include <toml++/toml.h>
+#include <disk_memory.hpp>
+#include <recsys_sim.hpp>
+#include <util.hpp>
+
+using recsys_protocol::Op;
+using recsys_protocol::Status;
+
+namespace {
+
+const char *
+op_name(Op op) {
+    switch (op) {
+        case Op::RESERVE:
+            return "reserve";
+        case Op::DOWNLOAD:
+            return "download";
+        case Op::AGGREGATE:
+            return "aggregate";
+        case Op::END_ROUND:
+            return "end_round";
+        case Op::SHUTDOWN:
+            return "shutdown";
+    }
+    return "unknown";
+}
+
+std::runtime_error
+system_error(std::string_view what) {
+    return std::runtime_error(absl::StrFormat("%s: %s", what, std::strerror(errno)));
+}
+
+}
+
+RecSysServer::RecSysServer(
+    std::unique_ptr<RecSysBuffer> &&buffer,
+    const std::filesystem::path &socket_path,
+    bool use_reserve,
+    std::uint64_t max_batch_size,
+    bool verbose
+) :
+buffer(std::move(buffer)),
+socket_path(socket_path),
+use_reserve(use_reserve),
+max_batch_size(std::max<std::uint64_t>(max_batch_size, 1)),
+verbose(verbose),
+listen_fd(-1),
+epoll_fd(-1),
+entries_loaded(false),
+shutdown_requested(false),
+rounds(0),
+open_connections(0),
+max_connections(0),
+op_statistics(static_cast<std::size_t>(Op::SHUTDOWN) + 1),
+receive_buffer(64 * 1024)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (this->socket_path.native().size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument(absl::StrFormat("Socket path %s is too long", this->socket_path.native()));
+    }
+    std::strncpy(address.sun_path, this->socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+    // a socket left behind by an earlier server
+    std::filesystem::remove(this->socket_path);
+
+    this->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (this->listen_fd < 0) {
+        throw system_error("Unable to create the server socket");
+    }
+    if (bind(this->listen_fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0) {
+        close(this->listen_fd);
+        throw system_error(absl::StrFormat("Unable to bind %s", this->socket_path.native()));
+    }
+    if (listen(this->listen_fd, SOMAXCONN) != 0) {
+        close(this->listen_fd);
+        throw system_error("Unable to listen on the server socket");
+    }
+
+    this->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (this->epoll_fd < 0) {
+        close(this->listen_fd);
+        throw system_error("Unable to create the epoll instance");
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = listen_tag;
+    if (epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, this->listen_fd, &event) != 0) {
+        close(this->epoll_fd);
+        close(this->listen_fd);
+        throw system_error("Unable to watch the server socket");
+    }
+}
+
+RecSysServer::~RecSysServer() {
+    for (auto &connection : this->connections) {
+        if (!connection.closed) {
+            close(connection.fd);
+        }
+    }
+    close(this->epoll_fd);
+    close(this->listen_fd);
+    std::error_code error;
+    std::filesystem::remove(this->socket_path, error);
+}
+
+void
+RecSysServer::run() {
+    std::vector<epoll_event> events(1024);
+
+    while (!this->shutdown_requested) {
+        int num_events = epoll_wait(this->epoll_fd, events.data(), static_cast<int>(events.size()), -1);
+        if (num_events < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw system_error("epoll_wait failed");
+        }
+
+        bool accept_pending = false;
+        for (int i = 0; i < num_events; i++) {
+            if (events[i].data.u64 == listen_tag) {
+                accept_pending = true;
+                continue;
+            }
+            std::size_t index = events[i].data.u64;
+            if (events[i].events & EPOLLOUT) {
+                this->write_to(index);
+            }
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                this->read_from(index);
+            }
+        }
+
+        this->process_pending();
+
+        // most answers fit in the socket buffers, the rest waits for EPOLLOUT
+        for (auto index : this->connections_with_output) {
+            this->write_to(index);
+        }
+        this->connections_with_output.clear();
+
+        // only now, so the slot of a connection closed above is not reused while it has pending requests
+        if (accept_pending) {
+            this->accept_connections();
+        }
+    }
+
+    // deliver the remaining answers, including the one to SHUTDOWN
+    std::vector<pollfd> poll_fds;
+    while (true) {
+        poll_fds.clear();
+        for (const auto &connection : this->connections) {
+            if (!connection.closed && connection.output_offset < connection.output.size()) {
+                poll_fds.push_back({connection.fd, POLLOUT, 0});
+            }
+        }
+        if (poll_fds.empty() || poll(poll_fds.data(), poll_fds.size(), 1000) <= 0) {
+            break;
+        }
+        for (std::size_t i = 0; i < this->connections.size(); i++) {
+            this->write_to(i);
+        }
+    }
+}
+
+void
+RecSysServer::accept_connections() {
+    while (true) {
+        int fd = accept4(this->listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNABORTED) {
+                return;
+            }
+            if (errno == EMFILE || errno == ENFILE) {
+                // the waiting clients are accepted once others disconnect
+                std::cout << absl::StreamFormat("Out of file descriptors with %lu connections\n", this->open_connections);
+                return;
+            }
+            throw system_error("accept failed");
+        }
+
+        std::size_t index;
+        if (this->free_connections.empty()) {
+            index = this->connections.size();
+            this->connections.emplace_back();
+        } else {
+            index = this->free_connections.back();
+            this->free_connections.pop_back();
+        }
+
+        auto &connection = this->connections[index];
+        connection.fd = fd;
+        connection.input.clear();
+        connection.output_offset = 0;
+        connection.writable_wanted = false;
+        connection.closed = false;
+
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = index;
+        if (epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            throw system_error("Unable to watch a connection");
+        }
+        this->open_connections++;
+        this->max_connections = std::max(this->max_connections, this->open_connections);
+
+        recsys_protocol::ServerInfo info;
+        info.num_entries = this->buffer->num_entries();
+        info.entry_size = this->buffer->entry_size();
+        connection.output.resize(sizeof(info));
+        std::memcpy(connection.output.data(), &info, sizeof(info));
+        this->write_to(index);
+    }
+}
+
+void
+RecSysServer::read_from(std::size_t index) {
+    auto &connection = this->connections[index];
+    if (connection.closed) {
+        return;
+    }
+
+    bool disconnected = false;
+    while (true) {
+        ssize_t received = recv(connection.fd, this->receive_buffer.data(), this->receive_buffer.size(), 0);
+        if (received > 0) {
+            connection.input.insert(connection.input.end(), this->receive_buffer.begin(), this->receive_buffer.begin() + received);
+            continue;
+        }
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        // the client disconnected, its complete requests are still served
+        disconnected = true;
+        break;
+    }
+
+    const std::uint64_t num_entries = this->buffer->num_entries();
+    const std::uint64_t entry_size = this->buffer->entry_size();
+    std::size_t offset = 0;
+    while (connection.input.size() - offset >= sizeof(recsys_protocol::RequestHeader)) {
+        recsys_protocol::RequestHeader header;
+        std::memcpy(&header, connection.input.data() + offset, sizeof(header));
+
+        if (header.op < Op::RESERVE || header.op > Op::SHUTDOWN || header.count > recsys_protocol::max_request_count) {
+            // there is no way to find the next request after a bad header
+            std::cout << absl::StreamFormat("Closing connection %d after a malformed request\n", connection.fd);
+            this->close_connection(index);
+            return;
+        }
+
+        std::size_t length = sizeof(header) + header.count * sizeof(std::uint64_t);
+        if (header.op == Op::AGGREGATE) {
+            length += header.count * entry_size;
+        }
+        if (connection.input.size() - offset < length) {
+            break;
+        }
+
+        PendingRequest request;
+        request.connection = index;
+        request.op = header.op;
+        request.entries_begin = this->pending_entries.size();
+        request.count = header.count;
+        request.error = nullptr;
+
+        // the gradients are not used, the buffers simulate the aggregation on their own
+        this->pending_entries.resize(request.entries_begin + header.count);
+        std::memcpy(this->pending_entries.data() + request.entries_begin, connection.input.data() + offset + sizeof(header), header.count * sizeof(std::uint64_t));
+        for (std::uint32_t i = 0; i < header.count; i++) {
+            if (this->pending_entries[request.entries_begin + i] >= num_entries) {
+                request.error = "Entry id out of range";
+            }
+        }
+
+        this->pending.emplace_back(request);
+        offset += length;
+    }
+
+    connection.input.erase(connection.input.begin(), connection.input.begin() + offset);
+    if (disconnected) {
+        this->close_connection(index);
+    }
+}
+
+void
+RecSysServer::write_to(std::size_t index) {
+    auto &connection = this->connections[index];
+    while (!connection.closed && connection.output_offset < connection.output.size()) {
+        ssize_t sent = send(
+            connection.fd,
+            connection.output.data() + connection.output_offset,
+            connection.output.size() - connection.output_offset,
+            MSG_NOSIGNAL | MSG_DONTWAIT
+        );
+        if (sent > 0) {
+            connection.output_offset += sent;
+        } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // the client is slow to read, send the rest once the socket has room
+            this->set_writable_wanted(index, true);
+            return;
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else {
+            this->close_connection(index);
+            return;
+        }
+    }
+
+    connection.output.clear();
+    connection.output_offset = 0;
+    this->set_writable_wanted(index, false);
+}
+
+void
+RecSysServer::set_writable_wanted(std::size_t index, bool wanted) {
+    auto &connection = this->connections[index];
+    if (connection.closed || connection.writable_wanted == wanted) {
+        return;
+    }
+    epoll_event event{};
+    event.events = wanted ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+    event.data.u64 = index;
+    if (epoll_ctl(this->epoll_fd, EPOLL_CTL_MOD, connection.fd, &event) != 0) {
+        throw system_error("Unable to update a watched connection");
+    }
+    connection.writable_wanted = wanted;
+}
+
+void
+RecSysServer::process_pending() {
+    std::size_t begin = 0;
+    while (begin < this->pending.size()) {
+        const auto &first = this->pending[begin];
+        if (first.error != nullptr) {
+            this->respond(first.connection, Status::ERROR, reinterpret_cast<const byte_t *>(first.error), std::strlen(first.error));
+            begin++;
+            continue;
+        }
+
+        // merge the following requests with the same operation, round ends are never merged
+        std::size_t end = begin + 1;
+        std::uint64_t batch_entries = first.count;
+        if (first.op != Op::END_ROUND && first.op != Op::SHUTDOWN) {
+            while (
+                end < this->pending.size() &&
+                this->pending[end].op == first.op &&
+                this->pending[end].error == nullptr &&
+                batch_entries + this->pending[end].count <= this->max_batch_size
+            ) {
+                batch_entries += this->pending[end].count;
+                end++;
+            }
+        }
+
+        this->run_batch(first.op, begin, end);
+        begin = end;
+    }
+
+    this->pending.clear();
+    this->pending_entries.clear();
+}
+
+void
+RecSysServer::run_batch(Op op, std::size_t begin, std::size_t end) {
+    this->batch_entries.clear();
+    for (std::size_t i = begin; i < end; i++) {
+        auto entries_begin = this->pending_entries.begin() + this->pending[i].entries_begin;
+        this->batch_entries.insert(this->batch_entries.end(), entries_begin, entries_begin + this->pending[i].count);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::string error;
+    try {
+        switch (op) {
+            case Op::RESERVE:
+                if (this->entries_loaded) {
+                    throw std::runtime_error("Reservations are closed once the downloads of the round have started");
+                }
+                for (auto entry_id : this->batch_entries) {
+                    this->buffer->reserve(entry_id);
+                }
+                break;
+            case Op::DOWNLOAD:
+                if (this->use_reserve && !this->entries_loaded) {
+                    this->buffer->load_entries();
+                }
+                this->entries_loaded = true;
+                this->buffer->download_batch(this->batch_entries);
+                break;
+            case Op::AGGREGATE:
+                this->buffer->aggregate_batch(this->batch_entries);
+                break;
+            case Op::END_ROUND:
+                this->buffer->update_flush_buffer();
+                this->entries_loaded = false;
+                this->rounds++;
+                break;
+            case Op::SHUTDOWN:
+                this->shutdown_requested = true;
+                break;
+        }
+    } catch (const std::exception &e) {
+        error = e.what();
+    }
+    auto end_time = std::chrono::steady_clock::now();
+
+    auto &statistics = this->op_statistics[static_cast<std::size_t>(op)];
+    statistics.requests += end - begin;
+    statistics.entries += this->batch_entries.size();
+    statistics.batches++;
+    statistics.max_batch_entries = std::max<std::uint64_t>(statistics.max_batch_entries, this->batch_entries.size());
+    statistics.time += end_time - start;
+
+    if (this->verbose || !error.empty()) {
+        std::cout << absl::StreamFormat(
+            "%s batch of %lu requests, %lu entries in %lu us%s%s\n",
+            op_name(op), end - begin, this->batch_entries.size(),
+            std::chrono::duration_cast<std::chrono::microseconds>(end_time - start).count(),
+            error.empty() ? "" : ": ", error
+        );
+    }
+
+    for (std::size_t i = begin; i < end; i++) {
+        const auto &request = this->pending[i];
+        if (!error.empty()) {
+            this->respond(request.connection, Status::ERROR, reinterpret_cast<const byte_t *>(error.data()), error.size());
+        } else if (op == Op::DOWNLOAD) {
+            // the buffers only simulate the accesses, the entries are sent as zeros
+            std::size_t length = request.count * this->buffer->entry_size();
+            if (this->entry_payload.size() < length) {
+                this->entry_payload.resize(length, 0);
+            }
+            this->respond(request.connection, Status::OK, this->entry_payload.data(), length);
+        } else {
+            this->respond(request.connection, Status::OK, nullptr, 0);
+        }
+    }
+}
+
+void
+RecSysServer::respond(std::size_t index, Status status, const byte_t *data, std::size_t length) {
+    auto &connection = this->connections[index];
+    if (connection.closed) {
+        return;
+    }
+
+    recsys_protocol::ResponseHeader header{};
+    header.status = status;
+    header.length = static_cast<std::uint32_t>(length);
+
+    std::size_t offset = connection.output.size();
+    if (offset == 0) {
+        this->connections_with_output.emplace_back(index);
+    }
+    connection.output.resize(offset + sizeof(header) + length);
+    std::memcpy(connection.output.data() + offset, &header, sizeof(header));
+    if (length > 0) {
+        std::memcpy(connection.output.data() + offset + sizeof(header), data, length);
+    }
+}
+
+void
+RecSysServer::close_connection(std::size_t index) {
+    auto &connection = this->connections[index];
+    if (connection.closed) {
+        return;
+    }
+    // closing the descriptor also removes it from the epoll instance
+    close(connection.fd);
+    connection.closed = true;
+    connection.input = bytes_t();
+    connection.output = bytes_t();
+    connection.output_offset = 0;
+    this->free_connections.emplace_back(index);
+    this->open_connections--;
+}
+
+toml::table
+RecSysServer::statistics_to_toml() const {
+    toml::table table;
+    table.emplace("rounds", static_cast<int64_t>(this->rounds));
+    table.emplace("max_connections", static_cast<int64_t>(this->max_connections));
+    table.emplace("max_batch_size", static_cast<int64_t>(this->max_batch_size));
+    table.emplace("oram_time_ns", this->buffer->get_oram_time().count());
+    table.emplace("overall_time_ns", this->buffer->get_overall_time().count());
+
+    for (auto op : {Op::RESERVE, Op::DOWNLOAD, Op::AGGREGATE, Op::END_ROUND}) {
+        const auto &statistics = this->op_statistics[static_cast<std::size_t>(op)];
+        table.emplace(op_name(op), toml::table{
+            {"requests", static_cast<int64_t>(statistics.requests)},
+            {"entries", static_cast<int64_t>(statistics.entries)},
+            {"batches", static_cast<int64_t>(statistics.batches)},
+            {"max_batch_entries", static_cast<int64_t>(statistics.max_batch_entries)},
+            {"mean_batch_entries", statistics.batches == 0 ? 0.0 : static_cast<double>(statistics.entries) / static_cast<double>(statistics.batches)},
+            {"time_ns", statistics.time.count()}
+        });
+    }
+    return table;
+}
+
+int recsys_server_entry_point(int argc, const char** argv) {
+    cxxopts::Options recsys_server_options("RecSysServer", "Serves a recsys buffer to concurrent clients over a Unix domain socket");
+
+    recsys_server_options.add_options()
+    ("subcommand", "ignore", cxxopts::value<std::string>())
+    ("m,memory", "Directory to load memory from", cxxopts::value<std::string>())
+    ("b,buffer", "Which buffer to use", cxxopts::value<std::string>()->default_value("LinearScanBuffer"))
+    ("S,samples_per_round", "Number of entries downloaded by all clients in one round, the capacity of the buffer", cxxopts::value<std::string>()->default_value("5000"))
+    ("U,k_union", "Number of request to process in each union", cxxopts::value<std::string>()->default_value("4Ki"))
+    ("E,epsilon", "Epsilon paramter for DP modes", cxxopts::value<float>()->default_value("1.0"))
+    ("precision", "Precision of the embedding weights, FP32 or BF16", cxxopts::value<std::string>()->default_value("FP32"))
+    ("optimizer", "Optimizer applied to the aggregated gradients on flush, FedAvg, Adagrad or Adam", cxxopts::value<std::string>()->default_value("FedAvg"))
+    ("learning_rate", "Learning rate of the optimizer", cxxopts::value<float>()->default_value("0.01"))
+    ("a,socket", "Path of the Unix domain socket to listen on", cxxopts::value<std::string>()->default_value("recsys.sock"))
+    ("T,threads", "Number of threads, each drives one shard of a ShardedOram memory", cxxopts::value<std::size_t>()->default_value("1"))
+    ("B,max_batch_size", "Maximum number of entries handed to the buffer in one batch", cxxopts::value<std::string>()->default_value("4Ki"))
+    ("C,additional_cache", "Bytes ", cxxopts::value<std::string>())
+    ("v,verbose", "Print every batch.", cxxopts::value<bool>()->default_value("false"))
+    ("d, temp_dir", "Change directory where temp files for disk memory are stored.", cxxopts::value<std::string>()->default_value("."))
+    ("u, unsafe_optimization", "Enable unsafe optimizations", cxxopts::value<bool>()->default_value("false"))
+    ("o, output_file", "Generate TOML output summarizing results.", cxxopts::value<std::string>())
+    ("h,help", "show help text");
+
+    recsys_server_options.parse_positional("subcommand");
+
+    auto result = recsys_server_options.parse(argc, argv);
+
+    if (result.count("subcommand") != 1 || result["subcommand"].as<std::string>() != "recsys_server") {
+        std::cout << "Incorrect sub command!\n";
+        return -1;
+    }
+
+    if (result.count("help") > 0) {
+        std::cout << recsys_server_options.help();
+        return 0;
+    }
+
+    if (result.count("additional_cache") > 0) {
+        auto additional_cache_amount = parse_size(result["additional_cache"].as<std::string>());
+        std::cout << absl::StreamFormat("Adding %lu bytes of additional cache\n", additional_cache_amount);
+        set_additional_cache_amount(additional_cache_amount);
+    }
+
+    if (result.count("memory") != 1) {
+        std::cout << "Need to specify a memory directory!\n";
+        return -1;
+    }
+
+    const std::filesystem::path memory_directory(result["memory"].as<std::string>());
+    set_disk_memory_temp_file_directory(result["temp_dir"].as<std::string>());
+
+    std::string buffer_name = result["buffer"].as<std::string>();
+    GradientAggregationConfig aggregation;
+    aggregation.precision = gradient_precision_from_name(result["precision"].as<std::string>());
+    aggregation.optimizer = gradient_optimizer_from_name(result["optimizer"].as<std::string>());
+    aggregation.learning_rate = result["learning_rate"].as<float>();
+
+    bool use_reserve = false;
+    auto buffer = create_recsys_buffer(
+        buffer_name,
+        memory_directory,
+        parse_size(result["samples_per_round"].as<std::string>()),
+        result["unsafe_optimization"].as<bool>(),
+        parse_size(result["k_union"].as<std::string>()),
+        result["epsilon"].as<float>(),
+        use_reserve,
+        result["threads"].as<std::size_t>(),
+        aggregation
+    );
+    if (!buffer) {
+        std::cout << absl::StreamFormat("Unknown buffer type \"%s\"\n", buffer_name);
+        return -1;
+    }
+    buffer->underlying_memory()->reset_statistics();
+
+    const std::filesystem::path socket_path(result["socket"].as<std::string>());
+    RecSysServer server(
+        std::move(buffer),
+        socket_path,
+        use_reserve,
+        parse_size(result["max_batch_size"].as<std::string>()),
+        result["verbose"].as<bool>()
+    );
+
+    std::cout << absl::StreamFormat("Serving %s on %s\n", buffer_name, socket_path.native());
+    server.run();
+
+    auto table = server.statistics_to_toml();
+    std::cout << absl::StreamFormat("Shut down after %ld rounds\n", table["rounds"].value_or<int64_t>(0));
+    for (auto op : {Op::RESERVE, Op::DOWNLOAD, Op::AGGREGATE}) {
+        const auto &op_table = *table[op_name(op)].as_table();
+        std::cout << absl::StreamFormat(
+            "%-9s %10ld requests in %8ld batches, %8.1f entries per batch\n",
+            op_name(op),
+            op_table["requests"].value_or<int64_t>(0),
+            op_table["batches"].value_or<int64_t>(0),
+            op_table["mean_batch_entries"].value_or(0.0)
+        );
+    }
+    std::chrono::duration<double> oram_time_seconds(server.get_buffer()->get_oram_time());
+    std::chrono::duration<double> overall_time_seconds(server.get_buffer()->get_overall_time());
+    std::cout << absl::StreamFormat("Buffer took %lf seconds, ORAM took %lf seconds\n", overall_time_seconds.count(), oram_time_seconds.count());
+
+    server.get_buffer()->underlying_memory()->save_statistics();
+    server.get_buffer()->save_buffer_stats();
+
+    if (result.count("output_file") > 0) {
+        table.emplace("buffer", buffer_name);
+        table.emplace("precision", result["precision"].as<std::string>());
+        table.emplace("optimizer", result["optimizer"].as<std::string>());
+        std::ofstream out_file(result["output_file"].as<std::string>());
+        out_file << table;
+    }
+
+    return 0;
+}
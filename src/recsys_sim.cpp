@@ -7,6 +7,7 @@
 #include <request_stream.hpp>
 #include <absl/random/random.h>
 #include <memory_loader.hpp>
+#include <sharded_oram.hpp>
 #include <util.hpp>
 #include <vector>
 #include <recsys_buffer.hpp>
@@ -21,6 +22,141 @@ enum SimMode {
     SAMPLE_FILE
 };
 
+namespace {
+
+std::unique_ptr<RecSysBuffer>
+create_recsys_buffer_on(
+    const std::string &buffer_name,
+    unique_memory_t &&memory,
+    std::uint64_t samples_per_round,
+    bool unsafe_opt,
+    std::uint64_t k_union,
+    float epsilon,
+    const GradientAggregationConfig &aggregation,
+    bool &use_reserve
+) {
+    std::unique_ptr<RecSysBuffer> buffer;
+    use_reserve = false;
+
+    if (buffer_name == "NoBuffer") {
+        buffer = std::make_unique<NoBuffer>(
+            std::move(memory)
+        );
+    } else if (buffer_name == "LinearScanBuffer") {
+        buffer = std::make_unique<LinearScanBuffer>(
+            std::move(memory),
+            samples_per_round,
+            unsafe_opt,
+            aggregation
+        );
+    } else if (buffer_name == "HashBuffer") {
+        buffer = std::make_unique<HashBuffer>(
+            std::move(memory),
+            samples_per_round,
+            unsafe_opt,
+            HashBuffer::default_bucket_size,
+            HashBuffer::default_stash_size,
+            aggregation
+        );
+    } else if (buffer_name == "ORAMBuffer") {
+        buffer = std::make_unique<OramBuffer>(
+            std::move(memory),
+            samples_per_round,
+            unsafe_opt,
+            OramBuffer::UpdateMode::EMPTY_ORAM,
+            nullptr,
+            aggregation
+        );
+    }  else if (buffer_name == "ORAMBufferPopNPush") {
+        buffer = std::make_unique<OramBuffer>(
+            std::move(memory),
+            samples_per_round,
+            unsafe_opt,
+            OramBuffer::UpdateMode::POP_N_PUSH,
+            nullptr,
+            aggregation
+        );
+    } else if (buffer_name == "ORAMBuffer3") {
+        buffer = std::make_unique<OramBuffer3>(
+            std::move(memory),
+            samples_per_round,
+            unsafe_opt,
+            OramBuffer3::BufferORAMType::PathORAM,
+            aggregation
+        );
+    } else if (buffer_name == "ORAMBuffer3RAW") {
+        buffer = std::make_unique<OramBuffer3>(
+            std::move(memory),
+            samples_per_round,
+            unsafe_opt,
+            OramBuffer3::BufferORAMType::PageOptimizedRAWORAM,
+            aggregation
+        );
+    } else if (buffer_name == "ORAMBufferDP") {
+        buffer = std::make_unique<OramBufferDP>(
+            std::move(memory),
+            samples_per_round,
+            k_union,
+            epsilon,
+            OramBufferDP::BufferORAMType::PageOptimizedRAWORAM,
+            aggregation
+        );
+        use_reserve = true;
+    } else if (buffer_name == "ORAMBufferDPLinearScanPosmap") {
+        buffer = std::make_unique<OramBufferDPLinearScan>(
+            std::move(memory),
+            samples_per_round,
+            k_union,
+            epsilon,
+            OramBufferDPLinearScan::BufferORAMType::PageOptimizedRAWORAM,
+            aggregation
+        );
+        use_reserve = true;
+    }
+
+    return buffer;
+}
+
+}
+
+std::unique_ptr<RecSysBuffer>
+create_recsys_buffer(
+    const std::string &buffer_name,
+    const std::filesystem::path &memory_directory,
+    std::uint64_t samples_per_round,
+    bool unsafe_opt,
+    std::uint64_t k_union,
+    float epsilon,
+    bool &use_reserve,
+    std::uint64_t threads,
+    const GradientAggregationConfig &aggregation
+) {
+    auto memory = MemoryLoader::load(memory_directory);
+    if (threads <= 1) {
+        return create_recsys_buffer_on(buffer_name, std::move(memory), samples_per_round, unsafe_opt, k_union, epsilon, aggregation, use_reserve);
+    }
+
+    ShardedOram *sharded_oram = dynamic_cast<ShardedOram *>(memory.get());
+    if (sharded_oram == nullptr) {
+        throw std::invalid_argument("Running the clients on several threads needs a ShardedOram memory");
+    }
+    auto memory_shards = sharded_oram->release_shards();
+    if (memory_shards.size() != threads) {
+        throw std::invalid_argument(absl::StrFormat("Every thread drives one shard, but the ShardedOram has %lu shards for %lu threads", memory_shards.size(), threads));
+    }
+
+    // any shard may get all entries of a round, so every shard buffer gets the full capacity
+    std::vector<std::unique_ptr<RecSysBuffer>> buffer_shards;
+    for (auto &memory_shard : memory_shards) {
+        auto buffer_shard = create_recsys_buffer_on(buffer_name, std::move(memory_shard), samples_per_round, unsafe_opt, k_union, epsilon, aggregation, use_reserve);
+        if (!buffer_shard) {
+            return nullptr;
+        }
+        buffer_shards.emplace_back(std::move(buffer_shard));
+    }
+    return std::make_unique<ShardedRecSysBuffer>(std::move(buffer_shards));
+}
+
 int recsys_sim_entry_point(int argc, const char** argv) {
     cxxopts::Options recsys_sim_options("Runs trace file", "Read a trace file and execute it on given memory");
 
@@ -38,12 +174,15 @@ int recsys_sim_entry_point(int argc, const char** argv) {
     ("C,additional_cache", "Bytes ", cxxopts::value<std::string>())
     ("U,k_union", "Number of request to process in each union", cxxopts::value<std::string>()->default_value("4Ki"))
     ("E,epsilon", "Epsilon paramter for DP modes", cxxopts::value<float>()->default_value("1.0"))
+    ("precision", "Precision of the embedding weights, FP32 or BF16", cxxopts::value<std::string>()->default_value("FP32"))
+    ("optimizer", "Optimizer applied to the aggregated gradients on flush, FedAvg, Adagrad or Adam", cxxopts::value<std::string>()->default_value("FedAvg"))
+    ("learning_rate", "Learning rate of the optimizer", cxxopts::value<float>()->default_value("0.01"))
     // ("l,log", "Enable access logging", cxxopts::value<bool>()->default_value("false"))
     ("v,verbose", "Enable verbose output.", cxxopts::value<bool>()->default_value("false"))
     // ("V, verify", "Check contents.", cxxopts::value<bool>()->default_value("false"))
     ("d, temp_dir", "Change directory where temp files for disk memory are stored.", cxxopts::value<std::string>()->default_value("."))
     ("u, unsafe_optimization", "Enable unsafe optimizations", cxxopts::value<bool>()->default_value("false"))
-    // ("T, threads", "Number of threads to run.", cxxopts::value<std::size_t>()->default_value("1"))
+    ("T, threads", "Number of client threads, each drives one shard of a ShardedOram memory", cxxopts::value<std::size_t>()->default_value("1"))
     // ("s, stat_file", "File dump stats.", cxxopts::value<std::string>())
     ("o, output_file", "Generate TOML output summarizing results.", cxxopts::value<std::string>())
     ("h,help", "show help text");
@@ -96,62 +235,15 @@ int recsys_sim_entry_point(int argc, const char** argv) {
 
     bool use_reserve = false;
 
-    if (buffer_name == "NoBuffer") {
-        buffer = std::make_unique<NoBuffer>(
-            MemoryLoader::load(memory_directory)
-        );
-    } else if (buffer_name == "LinearScanBuffer") {
-        buffer = std::make_unique<LinearScanBuffer>(
-            MemoryLoader::load(memory_directory),
-            samples_per_round,
-            unsafe_opt
-        );
-    } else if (buffer_name == "ORAMBuffer") {
-        buffer = std::make_unique<OramBuffer>(
-            MemoryLoader::load(memory_directory),
-            samples_per_round,
-            unsafe_opt
-        );
-    }  else if (buffer_name == "ORAMBufferPopNPush") {
-        buffer = std::make_unique<OramBuffer>(
-            MemoryLoader::load(memory_directory),
-            samples_per_round,
-            unsafe_opt,
-            OramBuffer::UpdateMode::POP_N_PUSH
-        );
-    } else if (buffer_name == "ORAMBuffer3") {
-        buffer = std::make_unique<OramBuffer3>(
-            MemoryLoader::load(memory_directory),
-            samples_per_round,
-            unsafe_opt
-        );
-    } else if (buffer_name == "ORAMBuffer3RAW") {
-        buffer = std::make_unique<OramBuffer3>(
-            MemoryLoader::load(memory_directory),
-            samples_per_round,
-            unsafe_opt,
-            OramBuffer3::BufferORAMType::PageOptimizedRAWORAM
-        );
-    } else if (buffer_name == "ORAMBufferDP") {
-        buffer = std::make_unique<OramBufferDP>(
-            MemoryLoader::load(memory_directory),
-            samples_per_round,
-            k_union,
-            epsilon,
-            OramBufferDP::BufferORAMType::PageOptimizedRAWORAM
-        );
-        use_reserve = true;
-    } else if (buffer_name == "ORAMBufferDPLinearScanPosmap") {
-        buffer = std::make_unique<OramBufferDPLinearScan>(
-            MemoryLoader::load(memory_directory),
-            samples_per_round,
-            k_union,
-            epsilon,
-            OramBufferDPLinearScan::BufferORAMType::PageOptimizedRAWORAM
-        );
-        use_reserve = true;
-    }
-    else {
+    std::size_t threads = result["threads"].as<std::size_t>();
+
+    GradientAggregationConfig aggregation;
+    aggregation.precision = gradient_precision_from_name(result["precision"].as<std::string>());
+    aggregation.optimizer = gradient_optimizer_from_name(result["optimizer"].as<std::string>());
+    aggregation.learning_rate = result["learning_rate"].as<float>();
+
+    buffer = create_recsys_buffer(buffer_name, memory_directory, samples_per_round, unsafe_opt, k_union, epsilon, use_reserve, threads, aggregation);
+    if (!buffer) {
         std::cout << absl::StreamFormat("Unknown buffer type \"%s\"\n", buffer_name);
         exit(-1);
     }
@@ -191,7 +283,20 @@ int recsys_sim_entry_point(int argc, const char** argv) {
 
     buffer->underlying_memory()->reset_statistics();
 
+    // wall time of every phase over all rounds
+    std::chrono::nanoseconds reserve_time = std::chrono::nanoseconds::zero();
+    std::chrono::nanoseconds load_time = std::chrono::nanoseconds::zero();
+    std::chrono::nanoseconds download_time = std::chrono::nanoseconds::zero();
+    std::chrono::nanoseconds aggregate_time = std::chrono::nanoseconds::zero();
+    std::chrono::nanoseconds update_time = std::chrono::nanoseconds::zero();
+
+    // a round lasts from drawing its samples until its flush is done
+    std::vector<std::chrono::steady_clock::time_point> round_start_times(num_rounds);
+    std::vector<std::chrono::steady_clock::time_point> round_end_times(num_rounds);
+
     for (std::uint64_t round = 0; round < num_rounds; round++) {
+        round_start_times[round] = std::chrono::steady_clock::now();
+
         if (mode == REUSE) {
             std::cout << absl::StreamFormat("Shuffling %lu indicies...\n", permutation.size());
             std::shuffle(permutation.begin(), permutation.end(), bit_gen);
@@ -225,47 +330,81 @@ int recsys_sim_entry_point(int argc, const char** argv) {
         if (use_reserve) {
             std::cout << absl::StreamFormat("Staring Reservation Phase of round %lu\n", round + 1);
 
+            auto reserve_start = std::chrono::steady_clock::now();
             for (std::uint64_t i = 0; i < samples_per_round; i++) {
                 if (verbose) {
                     std::cout << absl::StreamFormat("Downloading entry %lu\n", samples[i]);
                 }
                 buffer->reserve(samples[i]);
             }
+            reserve_time += (std::chrono::steady_clock::now() - reserve_start);
+        }
 
+        if (use_reserve) {
             std::cout << absl::StreamFormat("Staring Load Phase of round %lu\n", round + 1);
 
+            auto load_start = std::chrono::steady_clock::now();
             buffer->load_entries();
+            load_time += (std::chrono::steady_clock::now() - load_start);
         }
 
 
         std::cout << absl::StreamFormat("Staring Download Phase of round %lu\n", round + 1);
 
-        for (std::uint64_t i = 0; i < samples_per_round; i++) {
-            if (verbose) {
+        if (verbose) {
+            for (std::uint64_t i = 0; i < samples_per_round; i++) {
                 std::cout << absl::StreamFormat("Downloading entry %lu\n", samples[i]);
             }
-            buffer->download(samples[i]);
         }
+        // all clients of the round at once, a ShardedRecSysBuffer runs them on its threads
+        auto download_start = std::chrono::steady_clock::now();
+        buffer->download_batch(samples);
+        download_time += (std::chrono::steady_clock::now() - download_start);
 
 
         std::cout << absl::StreamFormat("Staring Aggregation Phase of round %lu\n", round + 1);
 
         std::shuffle(samples.begin(), samples.end(), bit_gen);
 
-        for (std::uint64_t i = 0; i < samples_per_round; i++) {
-            if (verbose) {
+        if (verbose) {
+            for (std::uint64_t i = 0; i < samples_per_round; i++) {
                 std::cout << absl::StreamFormat("Aggregating entry %lu\n", samples[i]);
             }
-            buffer->aggregate(samples[i]);
         }
+        auto aggregate_start = std::chrono::steady_clock::now();
+        buffer->aggregate_batch(samples);
+        aggregate_time += (std::chrono::steady_clock::now() - aggregate_start);
 
         std::cout << absl::StreamFormat("Staring Update Phase of round %lu\n", round + 1);
 
+        auto update_start = std::chrono::steady_clock::now();
         buffer->update_flush_buffer();
+        auto update_end = std::chrono::steady_clock::now();
+        update_time += (update_end - update_start);
+        round_end_times[round] = update_end;
 
         std::cout << absl::StreamFormat("Completed round %lu of %lu\n", round + 1, num_rounds);
     }
 
+    // the steady state is the time between the ends of the rounds after the first, which also pays for warming up
+    std::vector<double> round_latencies_ms;
+    for (std::uint64_t round = 0; round < num_rounds; round++) {
+        std::chrono::duration<double, std::milli> latency(round_end_times[round] - round_start_times[round]);
+        round_latencies_ms.emplace_back(latency.count());
+    }
+    std::sort(round_latencies_ms.begin(), round_latencies_ms.end());
+    double mean_round_latency_ms = 0.0;
+    for (auto latency : round_latencies_ms) {
+        mean_round_latency_ms += latency / static_cast<double>(num_rounds);
+    }
+    double p50_round_latency_ms = round_latencies_ms.empty() ? 0.0 : round_latencies_ms[round_latencies_ms.size() / 2];
+    double max_round_latency_ms = round_latencies_ms.empty() ? 0.0 : round_latencies_ms.back();
+    double steady_state_samples_per_second = 0.0;
+    if (num_rounds > 1) {
+        std::chrono::duration<double> steady_state_seconds(round_end_times.back() - round_end_times.front());
+        steady_state_samples_per_second = static_cast<double>(samples_per_round * (num_rounds - 1)) / steady_state_seconds.count();
+    }
+
     std::chrono::duration<double> oram_time_seconds(buffer->get_oram_time());
     std::chrono::duration<double> overall_time_seconds(buffer->get_overall_time());
     std::chrono::duration<double> buffer_time_seconds(overall_time_seconds - oram_time_seconds);
@@ -286,6 +425,40 @@ int recsys_sim_entry_point(int argc, const char** argv) {
     buffer->underlying_memory()->save_statistics();
     buffer->save_buffer_stats();
 
+    struct PhaseTime {
+        const char *name;
+        std::chrono::nanoseconds wall_time;
+        ShardedRecSysBuffer::Phase sharded_phase;
+    };
+    std::vector<PhaseTime> phase_times = {
+        {"reserve", reserve_time, ShardedRecSysBuffer::RESERVE},
+        {"load", load_time, ShardedRecSysBuffer::LOAD},
+        {"download", download_time, ShardedRecSysBuffer::DOWNLOAD},
+        {"aggregate", aggregate_time, ShardedRecSysBuffer::AGGREGATE},
+        {"update", update_time, ShardedRecSysBuffer::FLUSH}
+    };
+    // busy time of all workers over the wall time of all of them, 1.0 means no worker ever waited for another
+    auto sharded_buffer = dynamic_cast<ShardedRecSysBuffer *>(buffer.get());
+    auto phase_utilization = [&](const PhaseTime &phase) {
+        auto wall_time = sharded_buffer->get_phase_wall_time(phase.sharded_phase);
+        if (wall_time.count() == 0) {
+            return 1.0;
+        }
+        return static_cast<double>(sharded_buffer->get_phase_worker_time(phase.sharded_phase).count()) / (static_cast<double>(wall_time.count()) * static_cast<double>(sharded_buffer->num_shards()));
+    };
+    for (const auto &phase : phase_times) {
+        std::chrono::duration<double> phase_seconds(phase.wall_time);
+        if (sharded_buffer != nullptr) {
+            std::cout << absl::StreamFormat("%-9s phase took %lf seconds, %.1f%% utilization of %lu threads\n", phase.name, phase_seconds.count(), phase_utilization(phase) * 100.0, threads);
+        } else {
+            std::cout << absl::StreamFormat("%-9s phase took %lf seconds\n", phase.name, phase_seconds.count());
+        }
+    }
+    std::cout << absl::StreamFormat("Round latency: mean %.1f ms, p50 %.1f ms, max %.1f ms\n", mean_round_latency_ms, p50_round_latency_ms, max_round_latency_ms);
+    if (num_rounds > 1) {
+        std::cout << absl::StreamFormat("Steady state throughput after the first round: %.1f samples per second\n", steady_state_samples_per_second);
+    }
+
     if (use_reserve) {
         std::cout << absl::StreamFormat("%lu total requests\n", total_requests);
         std::cout << absl::StreamFormat("%lu k_union sum\n", k_union_sum);
@@ -299,6 +472,9 @@ int recsys_sim_entry_point(int argc, const char** argv) {
         toml::table table;
         table.emplace("rounds", static_cast<int64_t>(num_rounds));
         table.emplace("samples_per_round", static_cast<int64_t>(samples_per_round));
+        table.emplace("precision", result["precision"].as<std::string>());
+        table.emplace("optimizer", result["optimizer"].as<std::string>());
+        table.emplace("learning_rate", static_cast<double>(aggregation.learning_rate));
 
         table.emplace("oram_time_ns", buffer->get_oram_time().count());
         table.emplace("overall_time_ns", buffer->get_overall_time().count());
@@ -318,6 +494,22 @@ int recsys_sim_entry_point(int argc, const char** argv) {
             table.emplace("num_dropped_requests", static_cast<int64_t>(num_dropped_requests));
         }
 
+        table.emplace("threads", static_cast<int64_t>(threads));
+        for (const auto &phase : phase_times) {
+            std::chrono::duration<double> phase_seconds(phase.wall_time);
+            table.emplace(absl::StrFormat("%s_time_seconds", phase.name), phase_seconds.count());
+            if (sharded_buffer != nullptr) {
+                table.emplace(absl::StrFormat("%s_utilization", phase.name), phase_utilization(phase));
+            }
+        }
+
+        table.emplace("mean_round_latency_ms", mean_round_latency_ms);
+        table.emplace("p50_round_latency_ms", p50_round_latency_ms);
+        table.emplace("max_round_latency_ms", max_round_latency_ms);
+        if (num_rounds > 1) {
+            table.emplace("steady_state_samples_per_second", steady_state_samples_per_second);
+        }
+
         std::ofstream out_file(result["output_file"].as<std::string>());
 
         out_file << table;
@@ -0,0 +1,933 @@
+#include <ring_oram.hpp>
+#include <util.hpp>
+#include <absl/strings/str_format.h>
+#include <memory_loader.hpp>
+#include <cmath>
+#include <fstream>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <limits>
+
+RingOram::ComputedParameters
+RingOram::compute_parameters(
+    addr_t untrusted_memory_page_size,
+    addr_t block_size,
+    addr_t num_blocks,
+    addr_t blocks_per_bucket,
+    addr_t dummies_per_bucket,
+    CryptoModule *crypto_module,
+    double max_load_factor
+) {
+    addr_t auth_tag_size = crypto_module->auth_tag_size();
+    if (block_size + auth_tag_size > untrusted_memory_page_size) {
+        throw std::invalid_argument(absl::StrFormat("A block of %lu bytes and its auth tag does not fit in a %lu byte page", block_size, untrusted_memory_page_size));
+    }
+    // access counts are stored in a byte and the permutation uses a byte per slot
+    if (dummies_per_bucket == 0 || dummies_per_bucket > std::numeric_limits<std::uint8_t>::max()) {
+        throw std::invalid_argument("Ring ORAM needs between 1 and 255 dummy slots per bucket");
+    }
+    if (blocks_per_bucket + dummies_per_bucket > std::numeric_limits<std::uint8_t>::max() + 1UL) {
+        throw std::invalid_argument("Ring ORAM supports at most 256 slots per bucket");
+    }
+
+    addr_t required_blocks;
+    if (max_load_factor == 1.0) {
+        required_blocks = num_blocks;
+    } else {
+        required_blocks = static_cast<addr_t>(std::ceil(static_cast<double>(num_blocks) / max_load_factor));
+    }
+    std::cout << absl::StrFormat("Tree need to hold %lu blocks to stay under the load factor of %lf \n", required_blocks, max_load_factor);
+    std::size_t block_index_size = num_bytes(num_blocks - 1);
+    std::cout << absl::StreamFormat("To index %lu blocks requires an index %lu bytes in size\n", num_blocks, block_index_size);
+    addr_t num_buckets = divide_round_up(required_blocks, blocks_per_bucket);
+    std::cout << absl::StrFormat("Tree needs %lu buckets\n", num_buckets);
+    addr_t levels = 0;
+    addr_t total_buckets = 0;
+    addr_t buckets_this_level = 1;
+    while(total_buckets < num_buckets) {
+        total_buckets += buckets_this_level;
+        buckets_this_level = buckets_this_level << 1;
+        levels++;
+    }
+    addr_t num_paths = 1UL << (levels - 1);
+    std::cout << absl::StrFormat("Number of paths in tree %lu\n", num_paths);
+    addr_t path_index_size = num_bytes((num_paths * 2) - 1);
+    std::cout << absl::StreamFormat("To index %lu paths requires index of %lu bytes\n", num_paths, path_index_size);
+    addr_t slots_per_bucket = blocks_per_bucket + dummies_per_bucket;
+    std::cout << absl::StrFormat("Each bucket has %lu real and %lu dummy slots\n", blocks_per_bucket, dummies_per_bucket);
+    std::cout << absl::StrFormat("Tree requires %lu levels containing %lu blocks\n", levels, total_buckets * blocks_per_bucket);
+    std::cout << absl::StrFormat("Load factor is %lf\n", ((double) num_blocks) / ((double) (total_buckets * blocks_per_bucket)));
+    addr_t untrusted_memory_size = total_buckets * slots_per_bucket * untrusted_memory_page_size;
+    std::cout << absl::StrFormat("Tree requires %sB of untrusted memory \n", size_to_string(untrusted_memory_size));
+    addr_t bucket_metadata_size = BucketMetadataLayout(blocks_per_bucket, dummies_per_bucket, block_index_size, path_index_size).metadata_size();
+    std::cout << absl::StrFormat("Each bucket requires %lu bytes of metadata in the valid bit tree\n", bucket_metadata_size);
+
+    return {
+        .levels = levels,
+        .blocks_per_bucket = blocks_per_bucket,
+        .dummies_per_bucket = dummies_per_bucket,
+        .num_paths = num_paths,
+        .untrusted_memory_size = untrusted_memory_size,
+        .block_index_size = block_index_size,
+        .path_index_size = path_index_size,
+        .untrusted_memory_page_size = untrusted_memory_page_size,
+        .bucket_metadata_size = bucket_metadata_size
+    };
+}
+
+unique_memory_t
+RingOram::create(
+    std::string_view name,
+    unique_memory_t &&position_map, unique_memory_t &&untrusted_memory,
+    std::unique_ptr<ValidBitTreeController> &&valid_bit_tree_controller,
+    unique_memory_t &&valid_bit_tree_memory,
+    std::unique_ptr<CryptoModule> &&crypto_module,
+    uint64_t block_size,
+    uint64_t num_blocks,
+    uint64_t blocks_per_bucket,
+    uint64_t dummies_per_bucket,
+    uint64_t num_accesses_per_eviction,
+    uint64_t stash_capacity,
+    double max_load_factor
+) {
+    auto computed_parameters = RingOram::compute_parameters(
+        untrusted_memory->page_size(),
+        block_size,
+        num_blocks,
+        blocks_per_bucket,
+        dummies_per_bucket,
+        crypto_module.get(),
+        max_load_factor
+    );
+
+    assert(untrusted_memory->size() >= computed_parameters.untrusted_memory_size);
+
+    return unique_memory_t(
+        new RingOram(
+            "RingOram",
+            name,
+            std::move(position_map),
+            std::move(untrusted_memory),
+            std::move(valid_bit_tree_controller),
+            std::move(valid_bit_tree_memory),
+            std::move(crypto_module),
+            computed_parameters,
+            block_size,
+            num_blocks,
+            num_accesses_per_eviction,
+            stash_capacity,
+            new BinaryPathOramStatistics
+        )
+    );
+}
+
+RingOram::RingOram(
+    std::string_view type, std::string_view name,
+    unique_memory_t &&position_map, unique_memory_t &&untrusted_memory,
+    std::unique_ptr<ValidBitTreeController> &&valid_bit_tree_controller,
+    unique_memory_t &&valid_bit_tree_memory,
+    std::unique_ptr<CryptoModule> &&crypto_module,
+    const RingOram::ComputedParameters &computed_parameters,
+    uint64_t block_size,
+    uint64_t num_blocks,
+    uint64_t num_accesses_per_eviction,
+    uint64_t stash_capacity,
+    BinaryPathOramStatistics *statistics
+) :
+Memory(type, name, num_blocks * block_size, statistics),
+crypto_module(std::move(crypto_module)),
+position_map(std::move(position_map)),
+untrusted_memory(std::move(untrusted_memory)),
+valid_bit_tree_controller(std::move(valid_bit_tree_controller)),
+valid_bit_tree_memory(std::move(valid_bit_tree_memory)),
+block_size(block_size),
+num_blocks(num_blocks),
+levels(computed_parameters.levels),
+blocks_per_bucket(computed_parameters.blocks_per_bucket),
+dummies_per_bucket(computed_parameters.dummies_per_bucket),
+_num_paths(computed_parameters.num_paths),
+num_accesses_per_eviction(num_accesses_per_eviction),
+random_nonce_bytes(this->crypto_module->nonce_size() - 2 * sizeof(std::uint64_t)),
+auth_tag_bytes(this->crypto_module->auth_tag_size()),
+untrusted_memory_page_size(this->untrusted_memory->page_size()),
+path_index_size(computed_parameters.path_index_size),
+position_map_page_size(this->position_map->page_size()),
+num_position_map_entries_per_page(position_map_page_size / computed_parameters.path_index_size),
+bucket_layout(computed_parameters.blocks_per_bucket, computed_parameters.dummies_per_bucket, computed_parameters.block_index_size, computed_parameters.path_index_size),
+oram_statistics(statistics),
+eviction_path_gen(std::vector<int64_t>(computed_parameters.levels - 1, 2)),
+access_counter(0),
+stash(block_size, stash_capacity),
+slot_buffer(block_size),
+dummy_block(block_size),
+online_read_hits(computed_parameters.levels),
+bucket_blocks(computed_parameters.levels * computed_parameters.blocks_per_bucket * block_size),
+bucket_block_metadata(computed_parameters.levels * computed_parameters.blocks_per_bucket),
+eviction_metadata_buffer(computed_parameters.blocks_per_bucket),
+eviction_data_block_buffer(computed_parameters.blocks_per_bucket * block_size),
+permutation_buffer(computed_parameters.blocks_per_bucket + computed_parameters.dummies_per_bucket)
+{
+    for (addr_t i = 0; i < this->levels; i++) {
+        this->online_read_requests.emplace_back(MemoryRequestType::READ, 0, this->untrusted_memory_page_size);
+    }
+
+    // generate random key
+    this->key.resize(this->crypto_module->key_size());
+    this->crypto_module->random(this->key.data(), this->crypto_module->key_size());
+    this->nonce_buffer.resize(this->crypto_module->nonce_size());
+    this->crypto_module->random(this->nonce_buffer.data(), this->random_nonce_bytes);
+}
+
+RingOram::RingOram(
+        std::string_view type, const toml::table &table,
+        unique_memory_t &&position_map, unique_memory_t &&untrusted_memory,
+        unique_memory_t &&valid_bit_tree_memory,
+        BinaryPathOramStatistics *statistics
+) :
+Memory(type, table, parse_size(*table["block_size"].node()) * parse_size(*table["num_blocks"].node()), statistics),
+crypto_module(get_crypto_module_by_name(table["crypto_module"].value<std::string_view>().value())),
+position_map(std::move(position_map)),
+untrusted_memory(std::move(untrusted_memory)),
+valid_bit_tree_controller(std::make_unique<ParentCounterValidBitTreeController>(*table["valid_bit_tree_controller"].as_table(), this->crypto_module.get(), valid_bit_tree_memory.get())),
+valid_bit_tree_memory(std::move(valid_bit_tree_memory)),
+block_size(parse_size(*table["block_size"].node())),
+num_blocks(parse_size(*table["num_blocks"].node())),
+levels(parse_size(*table["levels"].node())),
+blocks_per_bucket(parse_size(*table["blocks_per_bucket"].node())),
+dummies_per_bucket(parse_size(*table["dummies_per_bucket"].node())),
+_num_paths(parse_size(*table["num_paths"].node())),
+num_accesses_per_eviction(parse_size(*table["num_accesses_per_eviction"].node())),
+random_nonce_bytes(this->crypto_module->nonce_size() - 2 * sizeof(std::uint64_t)),
+auth_tag_bytes(this->crypto_module->auth_tag_size()),
+untrusted_memory_page_size(this->untrusted_memory->page_size()),
+path_index_size(parse_size(table["path_index_size"])),
+position_map_page_size(this->position_map->page_size()),
+num_position_map_entries_per_page(position_map_page_size / parse_size(table["path_index_size"])),
+bucket_layout(this->blocks_per_bucket, this->dummies_per_bucket, parse_size(table["block_index_size"]), parse_size(table["path_index_size"])),
+oram_statistics(statistics),
+eviction_path_gen(table["eviction_path_gen"].as_table()),
+access_counter(table["access_counter"].value<int64_t>().value_or(0)),
+stash(block_size, parse_size_or(table["stash_capacity"], num_accesses_per_eviction * 3)),
+slot_buffer(block_size),
+dummy_block(block_size),
+online_read_hits(levels),
+bucket_blocks(levels * blocks_per_bucket * block_size),
+bucket_block_metadata(levels * blocks_per_bucket),
+eviction_metadata_buffer(blocks_per_bucket),
+eviction_data_block_buffer(blocks_per_bucket * block_size),
+permutation_buffer(blocks_per_bucket + dummies_per_bucket)
+{
+    for (addr_t i = 0; i < this->levels; i++) {
+        this->online_read_requests.emplace_back(MemoryRequestType::READ, 0, this->untrusted_memory_page_size);
+    }
+
+    this->key.resize(this->crypto_module->key_size());
+    hex_string_to_bytes(table["key"].value<std::string_view>().value(), this->key.data(), this->crypto_module->key_size());
+    this->nonce_buffer.resize(this->crypto_module->nonce_size());
+    hex_string_to_bytes(table["random_nonce"].value<std::string_view>().value(), this->nonce_buffer.data(), this->random_nonce_bytes);
+}
+
+void
+RingOram::init() {
+    this->position_map->init();
+    this->untrusted_memory->init();
+
+    MemoryRequest position_map_write(MemoryRequestType::WRITE, 0, this->path_index_size);
+    for (uint64_t i = 0; i < num_blocks; i++) {
+        position_map_write.address = get_position_map_address(i);
+        uint64_t path = absl::Uniform(this->bit_gen, 0UL, this->_num_paths);
+        std::memcpy(position_map_write.data.data(), &path, this->path_index_size);
+        if (i % 1000000UL == 0) {
+            std::cout << absl::StrFormat("Writing initial value %lu to position map entry %lu\n", path, i);
+        }
+        this->position_map->access(position_map_write);
+    }
+
+    // every bucket starts out empty with a fresh permutation, all slots are filled with encrypted dummies
+    MemoryRequest metadata_request(MemoryRequestType::WRITE, 0, this->bucket_layout.metadata_size());
+    MemoryRequest slot_request(MemoryRequestType::WRITE, 0, this->untrusted_memory_page_size);
+    const uint64_t slots_per_bucket = this->bucket_layout.slots_per_bucket();
+
+    for (uint64_t level = 0; level < this->levels; level++) {
+        for (uint64_t level_offset = 0; level_offset < (1UL << level); level_offset++) {
+            uint64_t bucket_index = (1UL << level) - 1 + level_offset;
+            if ((bucket_index + 1) % 10000UL == 0) {
+                std::cout << absl::StreamFormat("Writing bucket %lu of %lu\n", bucket_index + 1, (1UL << this->levels) - 1);
+            }
+
+            std::memset(metadata_request.data.data(), 0, metadata_request.size);
+            this->shuffle_bucket_metadata(metadata_request.data.data());
+            metadata_request.address = this->valid_bit_tree_controller->get_address_of(level, level_offset);
+            this->valid_bit_tree_memory->access(metadata_request);
+
+            uint64_t counter = this->bucket_layout.get_write_counter(metadata_request.data.data());
+            for (uint64_t slot = 0; slot < slots_per_bucket; slot++) {
+                slot_request.address = (bucket_index * slots_per_bucket + slot) * this->untrusted_memory_page_size;
+                this->prepare_nonce(slot_request.address, counter);
+                this->crypto_module->encrypt(
+                    this->key.data(),
+                    this->nonce_buffer.data(),
+                    this->dummy_block.data(),
+                    this->block_size,
+                    slot_request.data.data(),
+                    slot_request.data.data() + this->block_size
+                );
+                this->untrusted_memory->access(slot_request);
+            }
+        }
+    }
+
+    this->valid_bit_tree_controller->encrypt_contents(this->key.data());
+}
+
+uint64_t
+RingOram::size() const {
+    return this->num_blocks * this->block_size;
+}
+
+bool
+RingOram::isBacked() const {
+    return this->untrusted_memory->isBacked();
+}
+
+uint64_t
+RingOram::page_size() const {
+    return this->block_size;
+}
+
+void
+RingOram::access(MemoryRequest &request) {
+    auto start_time = std::chrono::steady_clock::now();
+    uint64_t logical_block_address = request.address / block_size;
+    uint64_t logical_end_block_address = (request.address + request.size - 1UL) / block_size;
+
+    if (logical_block_address != logical_end_block_address) {
+         throw std::invalid_argument("Ring ORAM does not support access across block boundaries!");
+    }
+
+    this->Memory::log_request(request);
+
+    uint64_t access_offset = request.address - logical_block_address * block_size;
+
+    this->access_block(request.type, logical_block_address, request.data.data(), access_offset, request.size);
+    auto end_time = std::chrono::steady_clock::now();
+    this->oram_statistics->add_overall_time(end_time - start_time);
+}
+
+bool
+RingOram::is_request_type_supported(MemoryRequestType type) const {
+    switch (type)
+    {
+    case MemoryRequestType::READ:
+    case MemoryRequestType::WRITE:
+    case MemoryRequestType::READ_WRITE:
+    case MemoryRequestType::POP:
+    case MemoryRequestType::DUMMY_POP:
+    case MemoryRequestType::PUSH:
+    case MemoryRequestType::DUMMY_PUSH:
+        return true;
+        break;
+    default:
+        return false;
+        break;
+    }
+}
+
+void
+RingOram::start_logging(bool append) {
+    this->Memory::start_logging(append);
+    this->untrusted_memory->start_logging(append);
+    this->position_map->start_logging(append);
+    this->valid_bit_tree_memory->start_logging(append);
+}
+
+void
+RingOram::stop_logging() {
+    this->Memory::stop_logging();
+    this->untrusted_memory->stop_logging();
+    this->position_map->stop_logging();
+    this->valid_bit_tree_memory->stop_logging();
+}
+
+toml::table
+RingOram::to_toml_self() const {
+    auto table = this->Memory::to_toml();
+    table.emplace("block_size", size_to_string(this->block_size));
+    table.emplace("levels", size_to_string(this->levels));
+    table.emplace("blocks_per_bucket", size_to_string(this->blocks_per_bucket));
+    table.emplace("dummies_per_bucket", size_to_string(this->dummies_per_bucket));
+    table.emplace("num_blocks", size_to_string(this->num_blocks));
+    table.emplace("num_accesses_per_eviction", size_to_string(this->num_accesses_per_eviction));
+    table.emplace("num_paths", size_to_string(this->_num_paths));
+    table.emplace("eviction_path_gen", eviction_path_gen.to_toml());
+    table.emplace("access_counter", static_cast<int64_t>(this->access_counter));
+    table.emplace("stash_capacity", size_to_string(this->stash.capacity()));
+    table.emplace("valid_bit_tree_controller", this->valid_bit_tree_controller->to_toml());
+    table.emplace("key", bytes_to_hex_string(this->key.data(), this->crypto_module->key_size()));
+    table.emplace("crypto_module", this->crypto_module->name());
+    table.emplace("random_nonce", bytes_to_hex_string(this->nonce_buffer.data(), this->random_nonce_bytes));
+    table.emplace("path_index_size", size_to_string(this->bucket_layout.path_index_size));
+    table.emplace("block_index_size", size_to_string(this->bucket_layout.block_index_size));
+
+    return table;
+}
+
+toml::table
+RingOram::to_toml() const {
+    auto table = this->to_toml_self();
+    table.emplace("position_map", this->position_map->to_toml());
+    table.emplace("untrusted_memory", this->untrusted_memory->to_toml());
+    table.emplace("valid_bit_tree_memory", this->valid_bit_tree_memory->to_toml());
+    return table;
+}
+
+void
+RingOram::save_to_disk(const std::filesystem::path &location) const {
+    // write config file
+    std::ofstream config_file(location / "config.toml");
+    config_file << this->to_toml_self() << "\n";
+
+    config_file.close();
+
+    // write out position map
+    std::filesystem::path position_map_directory = location / "position_map";
+    std::filesystem::create_directory(position_map_directory);
+    this->position_map->save_to_disk(position_map_directory);
+
+    // write out untrusted memory
+    std::filesystem::path untrusted_memory_directory = location / "untrusted_memory";
+    std::filesystem::create_directory(untrusted_memory_directory);
+    this->untrusted_memory->save_to_disk(untrusted_memory_directory);
+
+    // write out bucket metadata
+    std::filesystem::path bitfield_directory = location / "bitfield";
+    std::filesystem::create_directory(bitfield_directory);
+    this->valid_bit_tree_memory->save_to_disk(bitfield_directory);
+
+    // save stash
+    this->stash.save_stash(location);
+}
+
+unique_memory_t
+RingOram::load_from_disk(const std::filesystem::path &location) {
+    auto table = toml::parse_file((location / "config.toml").string());
+    return RingOram::load_from_disk(location, table);
+}
+
+unique_memory_t
+RingOram::load_from_disk(const std::filesystem::path &location, const toml::table &table) {
+    unique_memory_t position_map = MemoryLoader::load(location / "position_map");
+    unique_memory_t untrusted_memory = MemoryLoader::load(location / "untrusted_memory");
+    unique_memory_t bitfield = MemoryLoader::load(location / "bitfield");
+
+    RingOram *oram = new RingOram(
+        "RingOram", table,
+        std::move(position_map), std::move(untrusted_memory), std::move(bitfield),
+        new BinaryPathOramStatistics()
+    );
+    oram->stash.load_stash(location);
+
+    return unique_memory_t(oram);
+}
+
+void
+RingOram::reset_statistics(bool from_file) {
+    this->Memory::reset_statistics(from_file);
+    this->untrusted_memory->reset_statistics(from_file);
+    this->valid_bit_tree_memory->reset_statistics(from_file);
+    this->position_map->reset_statistics(from_file);
+}
+
+void
+RingOram::save_statistics() {
+    this->Memory::save_statistics();
+    this->untrusted_memory->save_statistics();
+    this->valid_bit_tree_memory->save_statistics();
+    this->position_map->save_statistics();
+}
+
+void
+RingOram::barrier() {
+    this->Memory::barrier();
+    this->untrusted_memory->barrier();
+    this->valid_bit_tree_memory->barrier();
+    this->position_map->barrier();
+}
+
+void
+RingOram::access_block(
+    MemoryRequestType request_type, uint64_t logical_block_address, unsigned char *buffer,
+    uint64_t offset, uint64_t length
+) {
+    bool place_block_in_stash = true;
+    bool force_bypass_read = false;
+    bool is_dummy = (request_type == MemoryRequestType::DUMMY_POP || request_type == MemoryRequestType::DUMMY_PUSH);
+
+    if (request_type == MemoryRequestType::POP || request_type == MemoryRequestType::DUMMY_POP) {
+        place_block_in_stash = false;
+    }
+
+    if (request_type == MemoryRequestType::PUSH || request_type == MemoryRequestType::DUMMY_PUSH) {
+        force_bypass_read = true;
+    }
+
+    if (length == UINT64_MAX) {
+        length = this->block_size - offset;
+    }
+
+    if (offset + length > this->block_size) {
+         throw std::invalid_argument("Access crosses block boundaries");
+    }
+
+    // generate a new path for the block
+    uint64_t new_path = absl::Uniform(this->bit_gen, 0UL, this->_num_paths);
+
+    // read and update position map
+    uint64_t path_index = this->read_and_update_position_map(logical_block_address, new_path, is_dummy);
+
+    const uint64_t invalid_logical_block_address = std::numeric_limits<std::uint64_t>::max();
+    conditional_memcpy(is_dummy, &logical_block_address, &invalid_logical_block_address, sizeof(std::uint64_t));
+
+    StashEntry target_block(this->block_size);
+
+    target_block.metadata.set_path(path_index);
+    target_block.metadata.set_block_index(logical_block_address);
+
+    if (!force_bypass_read) {
+        this->find_and_remove_block_from_path(&(target_block.metadata), target_block.block.data());
+    }
+    bool block_found = target_block.metadata.is_valid();
+
+    if(!block_found) {
+        // block has not been found
+        if (
+            request_type != MemoryRequestType::WRITE
+            && request_type != MemoryRequestType::PUSH
+            && request_type != MemoryRequestType::DUMMY_PUSH
+            && request_type != MemoryRequestType::DUMMY_POP
+            ){
+            throw std::runtime_error(absl::StrFormat("Can not read block %lu, block does not exist in ORAM!", logical_block_address));
+        }
+
+        // create block
+        target_block.metadata = BlockMetadata(logical_block_address, path_index, true);
+    }
+    // update block
+    target_block.metadata.set_path(new_path);
+
+    BlockMetadata invalid;
+    conditional_memcpy(is_dummy, &target_block.metadata, &invalid, block_metadata_size);
+
+    bytes_t temp_buffer(request_type == MemoryRequestType::READ_WRITE ? length : 0);
+
+    switch (request_type)
+    {
+    case MemoryRequestType::READ:
+    case MemoryRequestType::POP:
+    case MemoryRequestType::DUMMY_POP:
+        std::memcpy(buffer, target_block.block.data() + offset, length);
+        break;
+    case MemoryRequestType::WRITE:
+    case MemoryRequestType::PUSH:
+    case MemoryRequestType::DUMMY_PUSH:
+        std::memcpy(target_block.block.data() + offset, buffer, length);
+        break;
+    case MemoryRequestType::READ_WRITE:
+        // copy original contents into temp buffer
+        std::memcpy(temp_buffer.data(), target_block.block.data() + offset, length);
+        // write new value into block
+        std::memcpy(target_block.block.data() + offset, buffer, length);
+        // move original contents from temp buffer back into the request
+        std::memcpy(buffer, temp_buffer.data(), length);
+        break;
+    default:
+        throw std::invalid_argument("unkown memory request type");
+        break;
+    }
+
+    if (place_block_in_stash) {
+        this->place_block_on_path(&(target_block.metadata), target_block.block.data());
+    }
+}
+
+void
+RingOram::find_and_remove_block_from_path(BlockMetadata *metadata, byte_t * data) {
+    std::uint64_t path = metadata->get_path();
+    std::uint64_t logical_block_address = metadata->get_block_index();
+
+    BlockMetadata metadata_buf(logical_block_address, path, false);
+
+    auto stash_access_start = std::chrono::steady_clock::now();
+    bool block_found = this->stash.find_and_remove_block(logical_block_address, &metadata_buf, data);
+    auto stash_access_end = std::chrono::steady_clock::now();
+    this->oram_statistics->add_stash_access_time(stash_access_end - stash_access_start);
+
+    // the path is always read, a stash hit only turns every level into a dummy read
+    auto valid_bit_tree_start = std::chrono::steady_clock::now();
+    this->valid_bit_tree_controller->read_path(this->key.data(), path);
+    auto valid_bit_tree_end = std::chrono::steady_clock::now();
+    this->oram_statistics->add_valid_bit_tree_time(valid_bit_tree_end - valid_bit_tree_start);
+    this->currently_loaded_path = path;
+
+    block_found = this->read_block_from_path(logical_block_address, &metadata_buf, data) || block_found;
+
+    // write bucket metadata back
+    valid_bit_tree_start = std::chrono::steady_clock::now();
+    this->valid_bit_tree_controller->write_path(this->key.data());
+    this->valid_bit_tree_memory->barrier();
+    valid_bit_tree_end = std::chrono::steady_clock::now();
+    this->oram_statistics->add_valid_bit_tree_time(valid_bit_tree_end - valid_bit_tree_start);
+
+    *metadata = metadata_buf;
+}
+
+void
+RingOram::place_block_on_path(const BlockMetadata *metadata, const byte_t * data) {
+    auto stash_access_start = std::chrono::steady_clock::now();
+    this->stash.add_block(metadata, data);
+    auto stash_access_end = std::chrono::steady_clock::now();
+    this->oram_statistics->add_stash_access_time(stash_access_end - stash_access_start);
+
+    access_counter++;
+
+    if (this->access_counter >= this->num_accesses_per_eviction) {
+        this->eviction_access();
+        this->access_counter = 0;
+    }
+}
+
+std::uint64_t
+RingOram::num_paths() const noexcept {
+    return this->_num_paths;
+}
+
+bool
+RingOram::read_block_from_path(addr_t logical_block_address, BlockMetadata *metadata_buffer, byte_t *block_buffer) {
+    this->oram_statistics->increment_path_read();
+    bool found = false;
+    std::vector<addr_t> reshuffle_levels;
+
+    // pick one slot per bucket: the target block if it is in the bucket, the next unread dummy otherwise
+    auto path_scan_start = std::chrono::steady_clock::now();
+    for (addr_t level = 0; level < this->levels; level++) {
+        byte_t *bucket_metadata = this->get_bucket_metadata(level);
+        std::uint64_t logical_slot = 0;
+        bool found_here = false;
+        BlockMetadata target_metadata;
+        for (std::uint64_t slot = 0; slot < this->blocks_per_bucket; slot++) {
+            std::uint8_t physical_slot = this->bucket_layout.get_physical_slot(bucket_metadata, slot);
+            bool is_target = this->bucket_layout.get_occupied(bucket_metadata, slot)
+                && this->valid_bit_tree_controller->is_valid(level, physical_slot)
+                && this->bucket_layout.get_block_index(bucket_metadata, slot) == logical_block_address;
+            BlockMetadata slot_metadata(logical_block_address, this->bucket_layout.get_path_index(bucket_metadata, slot), true);
+            conditional_memcpy(is_target, &logical_slot, &slot, sizeof(std::uint64_t));
+            conditional_memcpy(is_target, &target_metadata, &slot_metadata, block_metadata_size);
+            found_here = found_here || is_target;
+        }
+
+        std::uint64_t dummy_slot = 0;
+        bool dummy_available = false;
+        for (std::uint64_t slot = this->blocks_per_bucket; slot < this->bucket_layout.slots_per_bucket(); slot++) {
+            bool is_unread = this->valid_bit_tree_controller->is_valid(level, this->bucket_layout.get_physical_slot(bucket_metadata, slot));
+            conditional_memcpy(is_unread && !dummy_available, &dummy_slot, &slot, sizeof(std::uint64_t));
+            dummy_available = dummy_available || is_unread;
+        }
+        if (!dummy_available) {
+            throw std::runtime_error(absl::StrFormat("Bucket on level %lu ran out of dummy slots", level));
+        }
+        conditional_memcpy(!found_here, &logical_slot, &dummy_slot, sizeof(std::uint64_t));
+        conditional_memcpy(found_here, metadata_buffer, &target_metadata, block_metadata_size);
+        found = found || found_here;
+
+        // every slot can only be read once between two shuffles of the bucket
+        std::uint8_t physical_slot = this->bucket_layout.get_physical_slot(bucket_metadata, logical_slot);
+        this->valid_bit_tree_controller->set_valid(level, physical_slot, false);
+        std::uint8_t access_count = this->bucket_layout.get_access_count(bucket_metadata) + 1;
+        this->bucket_layout.set_access_count(bucket_metadata, access_count);
+        if (access_count >= this->dummies_per_bucket) {
+            reshuffle_levels.push_back(level);
+        }
+
+        this->online_read_hits[level] = found_here;
+        this->online_read_requests[level].type = MemoryRequestType::READ;
+        this->online_read_requests[level].address = this->get_slot_address(level, physical_slot);
+    }
+    auto path_scan_end = std::chrono::steady_clock::now();
+    this->oram_statistics->add_path_scan_time(path_scan_end - path_scan_start);
+
+    auto path_read_start = std::chrono::steady_clock::now();
+    this->untrusted_memory->batch_access(this->online_read_requests);
+    auto path_read_end = std::chrono::steady_clock::now();
+    this->oram_statistics->add_path_read_time(path_read_end - path_read_start);
+
+    auto crypto_start = std::chrono::steady_clock::now();
+    for (addr_t level = 0; level < this->levels; level++) {
+        this->prepare_nonce(this->online_read_requests[level].address, this->bucket_layout.get_write_counter(this->get_bucket_metadata(level)));
+        auto verification_result = this->crypto_module->decrypt(
+            this->key.data(),
+            this->nonce_buffer.data(),
+            this->online_read_requests[level].data.data(),
+            this->block_size,
+            this->online_read_requests[level].data.data() + this->block_size,
+            this->slot_buffer.data()
+        );
+
+        if (!verification_result) {
+            throw std::runtime_error("Auth Tag verification Failed");
+        }
+
+        conditional_memcpy(this->online_read_hits[level], block_buffer, this->slot_buffer.data(), this->block_size);
+    }
+    auto crypto_end = std::chrono::steady_clock::now();
+    this->oram_statistics->add_crypto_time(crypto_end - crypto_start);
+
+    // early reshuffle for buckets that have used up their dummies
+    if (!reshuffle_levels.empty()) {
+        this->read_buckets(reshuffle_levels);
+        this->write_buckets(reshuffle_levels);
+    }
+
+    return found;
+}
+
+void
+RingOram::read_buckets(const std::vector<addr_t> &bucket_levels) {
+    std::vector<MemoryRequest> requests;
+    requests.reserve(bucket_levels.size() * this->blocks_per_bucket);
+
+    // read Z slots per bucket: every unread real slot, padded with unread dummies
+    for (addr_t level: bucket_levels) {
+        const byte_t *bucket_metadata = this->get_bucket_metadata(level);
+        std::uint64_t next_dummy = this->blocks_per_bucket;
+        for (std::uint64_t slot = 0; slot < this->blocks_per_bucket; slot++) {
+            std::uint8_t physical_slot = this->bucket_layout.get_physical_slot(bucket_metadata, slot);
+            bool unread = this->valid_bit_tree_controller->is_valid(level, physical_slot);
+            if (!unread) {
+                while (!this->valid_bit_tree_controller->is_valid(level, this->bucket_layout.get_physical_slot(bucket_metadata, next_dummy))) {
+                    next_dummy++;
+                }
+                physical_slot = this->bucket_layout.get_physical_slot(bucket_metadata, next_dummy);
+                next_dummy++;
+            }
+
+            *this->get_bucket_block_metadata(level, slot) = BlockMetadata(
+                this->bucket_layout.get_block_index(bucket_metadata, slot),
+                this->bucket_layout.get_path_index(bucket_metadata, slot),
+                unread && this->bucket_layout.get_occupied(bucket_metadata, slot)
+            );
+            requests.emplace_back(MemoryRequestType::READ, this->get_slot_address(level, physical_slot), this->untrusted_memory_page_size);
+        }
+    }
+
+    auto path_read_start = std::chrono::steady_clock::now();
+    this->untrusted_memory->batch_access(requests);
+    auto path_read_end = std::chrono::steady_clock::now();
+    this->oram_statistics->add_path_read_time(path_read_end - path_read_start);
+
+    auto crypto_start = std::chrono::steady_clock::now();
+    std::size_t request_index = 0;
+    for (addr_t level: bucket_levels) {
+        std::uint64_t counter = this->bucket_layout.get_write_counter(this->get_bucket_metadata(level));
+        for (std::uint64_t slot = 0; slot < this->blocks_per_bucket; slot++, request_index++) {
+            this->prepare_nonce(requests[request_index].address, counter);
+            auto verification_result = this->crypto_module->decrypt(
+                this->key.data(),
+                this->nonce_buffer.data(),
+                requests[request_index].data.data(),
+                this->block_size,
+                requests[request_index].data.data() + this->block_size,
+                this->get_bucket_block(level, slot)
+            );
+
+            if (!verification_result) {
+                throw std::runtime_error("Auth Tag verification Failed");
+            }
+        }
+    }
+    auto crypto_end = std::chrono::steady_clock::now();
+    this->oram_statistics->add_crypto_time(crypto_end - crypto_start);
+}
+
+void
+RingOram::write_buckets(const std::vector<addr_t> &bucket_levels) {
+    const std::uint64_t slots_per_bucket = this->bucket_layout.slots_per_bucket();
+    std::vector<MemoryRequest> requests;
+    requests.reserve(bucket_levels.size() * slots_per_bucket);
+
+    auto crypto_start = std::chrono::steady_clock::now();
+    for (addr_t level: bucket_levels) {
+        byte_t *bucket_metadata = this->get_bucket_metadata(level);
+        this->shuffle_bucket_metadata(bucket_metadata);
+        for (std::uint64_t slot = 0; slot < this->blocks_per_bucket; slot++) {
+            const BlockMetadata *block_metadata = this->get_bucket_block_metadata(level, slot);
+            this->bucket_layout.set_occupied(bucket_metadata, slot, block_metadata->is_valid());
+            this->bucket_layout.set_block_index(bucket_metadata, slot, block_metadata->get_block_index());
+            this->bucket_layout.set_path_index(bucket_metadata, slot, block_metadata->get_path());
+        }
+
+        std::uint64_t counter = this->bucket_layout.get_write_counter(bucket_metadata);
+        for (std::uint64_t slot = 0; slot < slots_per_bucket; slot++) {
+            auto &request = requests.emplace_back(
+                MemoryRequestType::WRITE,
+                this->get_slot_address(level, this->bucket_layout.get_physical_slot(bucket_metadata, slot)),
+                this->untrusted_memory_page_size
+            );
+            this->prepare_nonce(request.address, counter);
+            this->crypto_module->encrypt(
+                this->key.data(),
+                this->nonce_buffer.data(),
+                slot < this->blocks_per_bucket ? this->get_bucket_block(level, slot) : this->dummy_block.data(),
+                this->block_size,
+                request.data.data(),
+                request.data.data() + this->block_size
+            );
+        }
+    }
+    auto crypto_end = std::chrono::steady_clock::now();
+    this->oram_statistics->add_crypto_time(crypto_end - crypto_start);
+
+    auto path_write_start = std::chrono::steady_clock::now();
+    this->untrusted_memory->batch_access(requests);
+    auto path_write_end = std::chrono::steady_clock::now();
+    this->oram_statistics->add_path_write_time(path_write_end - path_write_start);
+}
+
+void
+RingOram::shuffle_bucket_metadata(byte_t *bucket_metadata) {
+    const std::uint64_t slots_per_bucket = this->bucket_layout.slots_per_bucket();
+    std::iota(this->permutation_buffer.begin(), this->permutation_buffer.end(), 0);
+    std::ranges::shuffle(this->permutation_buffer, this->bit_gen);
+    for (std::uint64_t slot = 0; slot < slots_per_bucket; slot++) {
+        this->bucket_layout.set_physical_slot(bucket_metadata, slot, this->permutation_buffer[slot]);
+    }
+
+    // mark every slot as unread
+    std::memset(bucket_metadata, 0, this->bucket_layout.occupied_bits_offset());
+    for (std::uint64_t slot = 0; slot < slots_per_bucket; slot++) {
+        bucket_metadata[slot / 8UL] |= (1 << (slot % 8UL));
+    }
+
+    this->bucket_layout.set_access_count(bucket_metadata, 0);
+    this->bucket_layout.set_write_counter(bucket_metadata, this->bucket_layout.get_write_counter(bucket_metadata) + 1);
+}
+
+uint64_t
+RingOram::read_and_update_position_map(uint64_t logical_block_address, uint64_t new_path, bool dummy) {
+    auto position_map_access_start = std::chrono::steady_clock::now();
+    std::uint64_t old_path = 0;
+    const MemoryRequestType read = MemoryRequestType::READ;
+    const uint64_t dummy_block_index = absl::Uniform(this->bit_gen, 0UL, this->num_blocks);
+    conditional_memcpy(dummy, &logical_block_address, &dummy_block_index, sizeof(std::uint64_t));
+    if (this->position_map->is_request_type_supported(MemoryRequestType::READ_WRITE)) {
+        MemoryRequest position_map_update(MemoryRequestType::READ_WRITE, get_position_map_address(logical_block_address), this->path_index_size);
+        conditional_memcpy(dummy, &position_map_update.type, &read, sizeof(MemoryRequestType));
+        std::memcpy(position_map_update.data.data(), &new_path, this->path_index_size);
+        this->position_map->access(position_map_update);
+        std::memcpy(&old_path, position_map_update.data.data(), this->path_index_size);
+    } else {
+        MemoryRequest position_map_update(MemoryRequestType::READ, get_position_map_address(logical_block_address), this->path_index_size);
+        this->position_map->access(position_map_update);
+        std::memcpy(&old_path, position_map_update.data.data(), this->path_index_size);
+
+        position_map_update.type = MemoryRequestType::WRITE;
+        conditional_memcpy(dummy, &position_map_update.type, &read, sizeof(MemoryRequestType));
+        std::memcpy(position_map_update.data.data(), &new_path, this->path_index_size);
+        this->position_map->access(position_map_update);
+    }
+    auto position_map_access_end = std::chrono::steady_clock::now();
+    this->oram_statistics->add_position_map_access_time(position_map_access_end - position_map_access_start);
+    return old_path;
+}
+
+std::size_t
+RingOram::try_evict_block_from_bucket_buffer(std::size_t max_count, uint64_t ignored_bits, uint64_t path, BlockMetadata *metadatas, byte_t *data_blocks, uint64_t level_limit) {
+    std::size_t num_blocks_evicted = 0;
+    auto path_scan_start = std::chrono::steady_clock::now();
+    BlockMetadata invalid;
+    // start from the deepest allowed level so blocks already on this level always stay
+    for (uint64_t i = 0; i <= level_limit; i++) {
+        uint64_t level = level_limit - i;
+        for (uint64_t slot = 0; slot < this->blocks_per_bucket; slot++) {
+            BlockMetadata *metadata = this->get_bucket_block_metadata(level, slot);
+            bool is_eviction_candidate = metadata->is_valid() && (metadata->get_path() >> ignored_bits) == (path >> ignored_bits);
+            bool do_evict = (num_blocks_evicted < max_count) && is_eviction_candidate;
+            std::size_t offset = num_blocks_evicted == max_count ? max_count - 1: num_blocks_evicted;
+
+            conditional_memcpy(do_evict, metadatas + offset, metadata, block_metadata_size);
+            conditional_memcpy(do_evict, data_blocks + (this->block_size * offset), this->get_bucket_block(level, slot), this->block_size);
+            conditional_memcpy(do_evict, metadata, &invalid, block_metadata_size);
+
+            num_blocks_evicted += (do_evict ? 1: 0);
+        }
+    }
+    auto path_scan_end = std::chrono::steady_clock::now();
+    this->oram_statistics->add_path_scan_time(path_scan_end - path_scan_start);
+    return num_blocks_evicted;
+}
+
+void
+RingOram::eviction_access() {
+    addr_t path = this->eviction_path_gen.next_path();
+
+    auto valid_bit_tree_start = std::chrono::steady_clock::now();
+    this->valid_bit_tree_controller->read_path(this->key.data(), path);
+    auto valid_bit_tree_end = std::chrono::steady_clock::now();
+    this->oram_statistics->add_valid_bit_tree_time(valid_bit_tree_end - valid_bit_tree_start);
+    this->currently_loaded_path = path;
+
+    std::vector<addr_t> all_levels(this->levels);
+    std::iota(all_levels.begin(), all_levels.end(), 0);
+
+    this->oram_statistics->increment_path_read();
+    this->read_buckets(all_levels);
+
+    #ifdef PROFILE_TREE_LOAD
+    std::vector<int64_t> tree_loads(this->levels);
+    #endif
+    // greedily fill buckets from the leaf up
+    for (addr_t i = 0; i < this->levels; i++) {
+        addr_t level = this->levels - 1 - i;
+        BlockMetadata *metadata_ptr = this->eviction_metadata_buffer.data();
+        byte_t *data_ptr = this->eviction_data_block_buffer.data();
+        auto slots_available = this->blocks_per_bucket;
+        auto num_evicted_from_path = this->try_evict_block_from_bucket_buffer(slots_available, this->levels - 1 - level, path, metadata_ptr, data_ptr, level);
+        metadata_ptr += num_evicted_from_path;
+        data_ptr += (num_evicted_from_path * this->block_size);
+        slots_available -= num_evicted_from_path;
+
+        auto stash_access_start = std::chrono::steady_clock::now();
+        auto num_evicted_from_stash = this->stash.try_evict_blocks(slots_available, this->levels - 1 - level, path, metadata_ptr, data_ptr);
+        auto stash_access_end = std::chrono::steady_clock::now();
+        this->oram_statistics->add_stash_access_time(stash_access_end - stash_access_start);
+        metadata_ptr += num_evicted_from_stash;
+        slots_available -= num_evicted_from_stash;
+
+        // set remaining slots to invalid
+        for (addr_t j = 0; j < slots_available; j++) {
+            metadata_ptr[j] = BlockMetadata();
+        }
+
+        #ifdef PROFILE_TREE_LOAD
+        tree_loads[level] = this->blocks_per_bucket - slots_available;
+        #endif
+
+        // copy results back into bucket buffer
+        std::memcpy(this->get_bucket_block_metadata(level, 0), this->eviction_metadata_buffer.data(), this->blocks_per_bucket * block_metadata_size);
+        std::memcpy(this->get_bucket_block(level, 0), this->eviction_data_block_buffer.data(), this->blocks_per_bucket * this->block_size);
+    }
+
+    #ifdef PROFILE_TREE_LOAD
+    oram_statistics->log_tree_load(std::move(tree_loads));
+    #endif
+
+    this->oram_statistics->increment_path_write();
+    this->write_buckets(all_levels);
+
+    valid_bit_tree_start = std::chrono::steady_clock::now();
+    this->valid_bit_tree_controller->write_path(this->key.data());
+    valid_bit_tree_end = std::chrono::steady_clock::now();
+    this->oram_statistics->add_valid_bit_tree_time(valid_bit_tree_end - valid_bit_tree_start);
+
+    this->oram_statistics->log_stash_size(this->stash.size());
+}
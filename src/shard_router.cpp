@@ -0,0 +1,161 @@
+#include <shard_router.hpp>
+#include <oblivious.hpp>
+#include <absl/strings/str_format.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+    // log of num_shards times the binomial tail P[more than slots_per_shard of count elements go to one shard]
+    double log_overflow_probability(std::uint64_t num_shards, std::uint64_t count, std::uint64_t slots_per_shard) {
+        const double log_shard_probability = -std::log(static_cast<double>(num_shards));
+        const double log_other_probability = std::log1p(-1.0 / static_cast<double>(num_shards));
+        const double log_count_factorial = std::lgamma(static_cast<double>(count + 1));
+
+        double log_sum = -std::numeric_limits<double>::infinity();
+        for (std::uint64_t k = slots_per_shard + 1; k <= count; k++) {
+            double log_term = log_count_factorial - std::lgamma(static_cast<double>(k + 1)) - std::lgamma(static_cast<double>(count - k + 1))
+                + static_cast<double>(k) * log_shard_probability + static_cast<double>(count - k) * log_other_probability;
+            double larger = std::max(log_sum, log_term);
+            log_sum = larger + std::log1p(std::exp(std::min(log_sum, log_term) - larger));
+        }
+        return log_sum - log_shard_probability;
+    }
+
+    const double log_overflow_limit = -static_cast<double>(ShardRouter::overflow_security_parameter) * std::log(2.0);
+
+    void sort_records(std::uint64_t *keys, byte_t *records, std::uint64_t count, std::size_t record_size) {
+        // entry ids of ShardedRecSysBuffer are blended in vector registers together with the keys
+        if (record_size == sizeof(std::uint64_t)) {
+            oblivious::bitonic_sort<std::uint64_t, sizeof(std::uint64_t)>(keys, records, count);
+        } else {
+            oblivious::bitonic_sort<std::uint64_t>(keys, records, count, record_size);
+        }
+    }
+}
+
+std::uint64_t
+ShardRouter::padded_slots_per_shard(std::uint64_t num_shards, std::uint64_t count) {
+    if (num_shards == 1) {
+        return count;
+    }
+
+    // count slots never overflow and the probability shrinks with every slot
+    std::uint64_t low = (count + num_shards - 1) / num_shards;
+    std::uint64_t high = count;
+    while (low < high) {
+        std::uint64_t middle = low + (high - low) / 2;
+        if (log_overflow_probability(num_shards, count, middle) < log_overflow_limit) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+    return low;
+}
+
+std::uint64_t
+ShardRouter::max_padded_elements(std::uint64_t num_shards, std::uint64_t slots_per_shard) {
+    if (num_shards == 1) {
+        return slots_per_shard;
+    }
+
+    // slots_per_shard elements never overflow and the probability grows with the number of elements
+    std::uint64_t low = slots_per_shard;
+    std::uint64_t high = num_shards * slots_per_shard;
+    while (low < high) {
+        std::uint64_t middle = low + (high - low + 1) / 2;
+        if (log_overflow_probability(num_shards, middle, slots_per_shard) < log_overflow_limit) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return low;
+}
+
+std::uint64_t
+ShardRouter::max_shard_load(const std::uint64_t *shard_indices, std::uint64_t count, std::uint64_t num_shards, std::vector<std::uint64_t> &loads) {
+    loads.assign(num_shards, 0);
+    for (std::uint64_t i = 0; i < count; i++) {
+        for (std::uint64_t j = 0; j < num_shards; j++) {
+            loads[j] += static_cast<std::uint64_t>(j == shard_indices[i]);
+        }
+    }
+
+    std::uint64_t max_load = 0;
+    for (auto load : loads) {
+        std::uint64_t larger = 0UL - static_cast<std::uint64_t>(load > max_load);
+        max_load = (larger & load) | (~larger & max_load);
+    }
+    return max_load;
+}
+
+byte_t *
+ShardRouter::reset(std::uint64_t count, std::size_t record_size) {
+    if (count > max_elements) {
+        throw std::invalid_argument(absl::StrFormat("ShardRouter can not route a batch of %lu elements", count));
+    }
+    this->count = count;
+    this->record_size = record_size;
+    this->routed_slots = 0;
+    this->records.assign(count * record_size, 0);
+    return this->records.data();
+}
+
+void
+ShardRouter::route(const std::uint64_t *shard_indices, std::uint64_t num_shards, std::uint64_t slots_per_shard, const byte_t *dummy_record) {
+    const std::uint64_t num_slots = num_shards * slots_per_shard;
+    if (num_shards > (std::numeric_limits<std::uint64_t>::max() >> shard_shift) || num_slots > max_elements) {
+        throw std::invalid_argument(absl::StrFormat("ShardRouter can not route to %lu shards of %lu slots", num_shards, slots_per_shard));
+    }
+    const std::uint64_t num_elements = this->count + num_slots;
+
+    this->keys.resize(num_elements);
+    this->marks.resize(num_elements);
+    this->records.resize(num_elements * this->record_size);
+
+    // the elements of the batch, then slots_per_shard dummies for every shard
+    for (std::uint64_t i = 0; i < this->count; i++) {
+        this->keys[i] = (shard_indices[i] << shard_shift) | i;
+    }
+    for (std::uint64_t slot = 0; slot < num_slots; slot++) {
+        this->keys[this->count + slot] = ((slot / slots_per_shard) << shard_shift) | dummy_bit | (slot % slots_per_shard);
+        std::memcpy(this->records.data() + (this->count + slot) * this->record_size, dummy_record, this->record_size);
+    }
+
+    // group by shard, the elements in their order first, elements of the same shard keep their order
+    sort_records(this->keys.data(), this->records.data(), num_elements, this->record_size);
+
+    // keep the first slots_per_shard elements of every shard
+    std::uint64_t rank = 0;
+    std::uint64_t dropped = 0;
+    for (std::uint64_t i = 0; i < num_elements; i++) {
+        std::uint64_t previous = this->keys[i - static_cast<std::uint64_t>(i > 0)];
+        std::uint64_t same_shard = static_cast<std::uint64_t>(i > 0) & static_cast<std::uint64_t>((this->keys[i] >> shard_shift) == (previous >> shard_shift));
+        rank = (rank + 1) & (0UL - same_shard);
+        std::uint64_t kept = static_cast<std::uint64_t>(rank < slots_per_shard);
+        dropped |= (kept ^ 1UL) & static_cast<std::uint64_t>((this->keys[i] & dummy_bit) == 0);
+        this->marks[i] = static_cast<std::uint8_t>(kept);
+    }
+    if (dropped) {
+        throw std::runtime_error(absl::StrFormat("ShardRouter batch of %lu elements does not fit %lu slots per shard", this->count, slots_per_shard));
+    }
+    oblivious::compact<std::uint64_t>(this->keys.data(), this->records.data(), this->marks.data(), num_elements, this->record_size);
+
+    this->routed_slots = num_slots;
+}
+
+void
+ShardRouter::restore_order(byte_t *results, std::size_t result_size) {
+    // the dummies go last, their positions are only unique within a shard
+    for (std::uint64_t slot = 0; slot < this->routed_slots; slot++) {
+        std::uint64_t key = this->keys[slot];
+        this->keys[slot] = ((key & dummy_bit) << (63 - 32)) | (key & position_mask);
+    }
+
+    sort_records(this->keys.data(), results, this->routed_slots, result_size);
+    this->routed_slots = 0;
+}
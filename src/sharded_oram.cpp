@@ -0,0 +1,477 @@
+#include <sharded_oram.hpp>
+#include <memory_loader.hpp>
+#include <page_optimized_raw_oram.hpp>
+#include <util.hpp>
+#include <absl/strings/str_format.h>
+#include <algorithm>
+
+namespace {
+    // the fields of a shard request in the records of the oblivious routing, the data follows
+    struct RoutedRequestHeader {
+        MemoryRequestType type;
+        uint64_t address;
+        uint64_t size;
+        uint64_t data_size;
+    };
+}
+
+void
+ShardedOramStatistics::clear() {
+    this->MemoryStatistics::clear();
+    this->rounds = 0;
+    this->overflow_rounds = 0;
+    std::ranges::fill(this->real_requests_per_shard, 0);
+    std::ranges::fill(this->dummy_requests_per_shard, 0);
+}
+
+toml::table
+ShardedOramStatistics::to_toml() const {
+    auto table = this->MemoryStatistics::to_toml();
+    table.emplace("rounds", this->rounds);
+    table.emplace("overflow_rounds", this->overflow_rounds);
+    table.emplace("real_requests_per_shard", toml_array_from_vector(this->real_requests_per_shard));
+    table.emplace("dummy_requests_per_shard", toml_array_from_vector(this->dummy_requests_per_shard));
+
+    int64_t total_real_requests = 0;
+    int64_t max_real_requests = 0;
+    for (auto real_requests : this->real_requests_per_shard) {
+        total_real_requests += real_requests;
+        max_real_requests = std::max(max_real_requests, real_requests);
+    }
+    int64_t total_requests = total_real_requests;
+    for (auto dummy_requests : this->dummy_requests_per_shard) {
+        total_requests += dummy_requests;
+    }
+    // 1.0 means every shard got the same number of real requests
+    double average_real_requests = static_cast<double>(total_real_requests) / static_cast<double>(std::max<std::size_t>(1, this->real_requests_per_shard.size()));
+    table.emplace("shard_load_imbalance", average_real_requests == 0.0 ? 1.0 : static_cast<double>(max_real_requests) / average_real_requests);
+    table.emplace("dummy_request_fraction", total_requests == 0 ? 0.0 : 1.0 - static_cast<double>(total_real_requests) / static_cast<double>(total_requests));
+    return table;
+}
+
+void
+ShardedOramStatistics::from_toml(const toml::table &table) {
+    this->MemoryStatistics::from_toml(table);
+    this->rounds = table["rounds"].value<int64_t>().value();
+    this->overflow_rounds = table["overflow_rounds"].value_or<int64_t>(0);
+    this->real_requests_per_shard = vector_from_toml_array<int64_t>(table["real_requests_per_shard"].as_array());
+    this->dummy_requests_per_shard = vector_from_toml_array<int64_t>(table["dummy_requests_per_shard"].as_array());
+}
+
+unique_memory_t
+ShardedOram::create(
+    std::string_view name,
+    std::vector<unique_memory_t> &&shards,
+    uint64_t block_size, uint64_t num_blocks,
+    uint64_t shard_batch_size
+) {
+    return unique_memory_t(new ShardedOram(
+        "ShardedOram", name,
+        std::move(shards),
+        block_size, num_blocks,
+        shard_batch_size,
+        new ShardedOramStatistics()
+    ));
+}
+
+ShardedOram::ShardedOram(
+    std::string_view type, std::string_view name,
+    std::vector<unique_memory_t> &&shards,
+    uint64_t block_size, uint64_t num_blocks,
+    uint64_t shard_batch_size,
+    ShardedOramStatistics *statistics
+) :
+Memory(type, name, block_size * num_blocks, statistics),
+shards(std::move(shards)),
+block_size(block_size),
+num_blocks(num_blocks),
+blocks_per_shard(divide_round_up(num_blocks, static_cast<uint64_t>(this->shards.size()))),
+shard_batch_size(shard_batch_size),
+requests_per_round(ShardRouter::max_padded_elements(this->shards.size(), shard_batch_size)),
+sharded_statistics(statistics),
+shard_requests(this->shards.size()),
+single_request(1),
+round_start(this->shards.size() + 1),
+round_end(this->shards.size() + 1),
+stopping(false),
+worker_errors(this->shards.size())
+{
+    if (this->shards.empty()) {
+        throw std::invalid_argument("ShardedOram needs at least one shard");
+    }
+
+    if (this->shard_batch_size == 0) {
+        throw std::invalid_argument("ShardedOram shard batch size has to be at least 1");
+    }
+
+    if (this->shards.size() * this->shard_batch_size > ShardRouter::max_elements) {
+        throw std::invalid_argument(absl::StrFormat("ShardedOram can not route %lu requests per round", this->shards.size() * this->shard_batch_size));
+    }
+
+    for (const auto &shard : this->shards) {
+        if (shard->page_size() != this->block_size) {
+            throw std::invalid_argument(absl::StrFormat("Shard block size %lu does not match ShardedOram block size %lu", shard->page_size(), this->block_size));
+        }
+        if (shard->size() < this->blocks_per_shard * this->block_size) {
+            throw std::invalid_argument(absl::StrFormat("Shard of %lu bytes can not hold %lu blocks", shard->size(), this->blocks_per_shard));
+        }
+    }
+
+    this->sharded_statistics->real_requests_per_shard.resize(this->shards.size());
+    this->sharded_statistics->dummy_requests_per_shard.resize(this->shards.size());
+    this->sharded_statistics->clear();
+
+    for (std::size_t i = 0; i < this->shards.size(); i++) {
+        for (uint64_t j = 0; j < this->shard_batch_size; j++) {
+            this->shard_requests[i].emplace_back(MemoryRequestType::READ, 0, this->block_size);
+        }
+    }
+
+    RoutedRequestHeader dummy_header;
+    dummy_header.type = MemoryRequestType::DUMMY_POP;
+    dummy_header.address = 0;
+    dummy_header.size = this->block_size;
+    dummy_header.data_size = this->block_size;
+    this->dummy_record.assign(sizeof(RoutedRequestHeader) + this->block_size, 0);
+    std::memcpy(this->dummy_record.data(), &dummy_header, sizeof(dummy_header));
+
+    for (std::size_t i = 0; i < this->shards.size(); i++) {
+        this->workers.emplace_back(&ShardedOram::worker_loop, this, i);
+    }
+}
+
+ShardedOram::ShardedOram(
+    std::string_view type, const toml::table &table,
+    std::vector<unique_memory_t> &&shards,
+    ShardedOramStatistics *statistics
+) :
+ShardedOram(
+    table["type"].value<std::string_view>().value(), table["name"].value<std::string_view>().value(),
+    std::move(shards),
+    parse_size(table["block_size"]), parse_size(table["num_blocks"]),
+    parse_size(table["shard_batch_size"]),
+    statistics
+)
+{}
+
+ShardedOram::~ShardedOram() {
+    this->stop_workers();
+}
+
+void
+ShardedOram::stop_workers() {
+    if (this->workers.empty()) {
+        return;
+    }
+    this->stopping = true;
+    this->round_start.arrive_and_wait();
+    for (auto &worker : this->workers) {
+        worker.join();
+    }
+    this->workers.clear();
+}
+
+std::vector<unique_memory_t>
+ShardedOram::release_shards() {
+    this->stop_workers();
+    return std::move(this->shards);
+}
+
+void
+ShardedOram::worker_loop(std::size_t shard_index) {
+    while (true) {
+        this->round_start.arrive_and_wait();
+        if (this->stopping) {
+            break;
+        }
+
+        try {
+            this->shards[shard_index]->batch_access(this->shard_requests[shard_index]);
+        } catch (...) {
+            this->worker_errors[shard_index] = std::current_exception();
+        }
+
+        this->round_end.arrive_and_wait();
+    }
+}
+
+void
+ShardedOram::run_round() {
+    this->round_start.arrive_and_wait();
+    this->round_end.arrive_and_wait();
+
+    for (auto &error : this->worker_errors) {
+        if (error) {
+            std::exception_ptr to_throw = error;
+            error = nullptr;
+            std::rethrow_exception(to_throw);
+        }
+    }
+}
+
+void
+ShardedOram::init() {
+    for (auto &shard : this->shards) {
+        shard->init();
+    }
+}
+
+void
+ShardedOram::fast_init() {
+    for (auto &shard : this->shards) {
+        PageOptimizedRAWOram *oram = dynamic_cast<PageOptimizedRAWOram *>(shard.get());
+        if (oram == nullptr) {
+            throw std::runtime_error("ShardedOram fast initialization needs PageOptimizedRAWOram shards");
+        }
+        oram->fast_init();
+    }
+}
+
+uint64_t
+ShardedOram::size() const {
+    return this->num_blocks * this->block_size;
+}
+
+bool
+ShardedOram::isBacked() const {
+    return std::ranges::all_of(this->shards, [](const auto &shard) {return shard->isBacked();});
+}
+
+uint64_t
+ShardedOram::page_size() const {
+    return this->block_size;
+}
+
+void
+ShardedOram::access(MemoryRequest &request) {
+    std::swap(this->single_request[0], request);
+    try {
+        this->batch_access(this->single_request);
+    } catch (...) {
+        std::swap(this->single_request[0], request);
+        throw;
+    }
+    std::swap(this->single_request[0], request);
+}
+
+void
+ShardedOram::batch_access(std::vector<MemoryRequest> &requests) {
+    const uint64_t num_shards = this->shards.size();
+
+    for (auto &request : requests) {
+        uint64_t logical_block_address = request.address / this->block_size;
+        if (logical_block_address != (request.address + request.size - 1) / this->block_size) {
+            throw std::invalid_argument("ShardedOram does not support access across block boundaries!");
+        }
+        if (logical_block_address >= this->num_blocks) {
+            throw std::invalid_argument(absl::StrFormat("Block %lu is out of range for ShardedOram with %lu blocks", logical_block_address, this->num_blocks));
+        }
+        this->Memory::log_request(request);
+    }
+
+    // every round takes the next requests_per_round requests, so the rounds only depend on the batch size
+    const uint64_t num_rounds = divide_round_up(static_cast<uint64_t>(requests.size()), this->requests_per_round);
+
+    for (uint64_t round = 0; round < num_rounds; round++) {
+        const uint64_t start = round * this->requests_per_round;
+        const uint64_t count = std::min(this->requests_per_round, requests.size() - start);
+        const uint64_t shard_rounds = this->route_round(requests, start, count);
+        for (uint64_t shard_round = 0; shard_round < shard_rounds; shard_round++) {
+            this->run_shard_round(requests, start, count, shard_round, shard_rounds * this->shard_batch_size);
+        }
+        this->collect_round(requests, start, count);
+
+        for (uint64_t i = 0; i < num_shards; i++) {
+            this->sharded_statistics->real_requests_per_shard[i] += this->shard_loads[i];
+            this->sharded_statistics->dummy_requests_per_shard[i] += shard_rounds * this->shard_batch_size - this->shard_loads[i];
+        }
+        this->sharded_statistics->rounds += shard_rounds;
+        this->sharded_statistics->overflow_rounds += shard_rounds - 1;
+    }
+}
+
+uint64_t
+ShardedOram::route_round(std::vector<MemoryRequest> &requests, uint64_t start, uint64_t count) {
+    const uint64_t num_shards = this->shards.size();
+    const uint64_t record_size = sizeof(RoutedRequestHeader) + this->block_size;
+
+    this->route_shards.resize(count);
+    byte_t *records = this->router.reset(count, record_size);
+    for (uint64_t i = 0; i < count; i++) {
+        const MemoryRequest &request = requests[start + i];
+        uint64_t logical_block_address = request.address / this->block_size;
+        this->route_shards[i] = logical_block_address % num_shards;
+
+        RoutedRequestHeader header;
+        header.type = request.type;
+        header.address = (logical_block_address / num_shards) * this->block_size + request.address % this->block_size;
+        header.size = request.size;
+        header.data_size = std::min(static_cast<uint64_t>(request.data.size()), this->block_size);
+        std::memcpy(records + i * record_size, &header, sizeof(header));
+        std::memcpy(records + i * record_size + sizeof(header), request.data.data(), header.data_size);
+    }
+
+    // a round that overflows a shard's batch anyway runs as several rounds of the shards instead of failing,
+    // requests to the same block keep their order across them
+    uint64_t max_load = ShardRouter::max_shard_load(this->route_shards.data(), count, num_shards, this->shard_loads);
+    uint64_t shard_rounds = std::max<uint64_t>(1, divide_round_up(max_load, this->shard_batch_size));
+
+    this->router.route(this->route_shards.data(), num_shards, shard_rounds * this->shard_batch_size, this->dummy_record.data());
+    this->route_results.assign(this->router.num_slots() * this->block_size, 0);
+    return shard_rounds;
+}
+
+void
+ShardedOram::run_shard_round(std::vector<MemoryRequest> &requests, uint64_t start, uint64_t count, uint64_t shard_round, uint64_t slots_per_shard) {
+    const uint64_t num_shards = this->shards.size();
+
+    for (uint64_t i = 0; i < num_shards; i++) {
+        for (uint64_t j = 0; j < this->shard_batch_size; j++) {
+            const uint64_t slot = i * slots_per_shard + shard_round * this->shard_batch_size + j;
+            MemoryRequest &shard_request = this->shard_requests[i][j];
+            const byte_t *record = this->router.slot_record(slot);
+            RoutedRequestHeader header;
+            std::memcpy(&header, record, sizeof(header));
+            shard_request.type = header.type;
+            shard_request.address = header.address;
+            shard_request.size = header.size;
+            shard_request.data.assign(record + sizeof(header), record + sizeof(header) + header.data_size);
+            // every slot copies some update function, dummies ignore theirs
+            shard_request.update_function = requests[start + this->router.position(slot) % count].update_function;
+        }
+    }
+
+    this->run_round();
+
+    for (uint64_t i = 0; i < num_shards; i++) {
+        for (uint64_t j = 0; j < this->shard_batch_size; j++) {
+            const uint64_t slot = i * slots_per_shard + shard_round * this->shard_batch_size + j;
+            const MemoryRequest &shard_request = this->shard_requests[i][j];
+            std::memcpy(this->route_results.data() + slot * this->block_size, shard_request.data.data(), std::min(static_cast<uint64_t>(shard_request.data.size()), this->block_size));
+        }
+    }
+}
+
+void
+ShardedOram::collect_round(std::vector<MemoryRequest> &requests, uint64_t start, uint64_t count) {
+    // sort the results back into the order of the round, the dummies go last
+    this->router.restore_order(this->route_results.data(), this->block_size);
+
+    for (uint64_t i = 0; i < count; i++) {
+        MemoryRequest &request = requests[start + i];
+        const byte_t *record = this->route_results.data() + i * this->block_size;
+        request.data.assign(record, record + request.size);
+    }
+}
+
+bool
+ShardedOram::is_request_type_supported(MemoryRequestType type) const {
+    switch (type)
+    {
+    case MemoryRequestType::READ:
+    case MemoryRequestType::WRITE:
+    case MemoryRequestType::READ_WRITE:
+    case MemoryRequestType::UPDATE:
+        return std::ranges::all_of(this->shards, [type](const auto &shard) {return shard->is_request_type_supported(type);});
+        break;
+    default:
+        return false;
+        break;
+    }
+}
+
+void
+ShardedOram::start_logging(bool append) {
+    this->Memory::start_logging(append);
+    for (auto &shard : this->shards) {
+        shard->start_logging(append);
+    }
+}
+
+void
+ShardedOram::stop_logging() {
+    this->Memory::stop_logging();
+    for (auto &shard : this->shards) {
+        shard->stop_logging();
+    }
+}
+
+void
+ShardedOram::barrier() {
+    this->Memory::barrier();
+    for (auto &shard : this->shards) {
+        shard->barrier();
+    }
+}
+
+toml::table
+ShardedOram::to_toml_self() const {
+    auto table = this->Memory::to_toml();
+    table.emplace("block_size", size_to_string(this->block_size));
+    table.emplace("num_blocks", size_to_string(this->num_blocks));
+    table.emplace("num_shards", size_to_string(this->shards.size()));
+    table.emplace("shard_batch_size", size_to_string(this->shard_batch_size));
+    return table;
+}
+
+toml::table
+ShardedOram::to_toml() const {
+    auto table = this->to_toml_self();
+    toml::array shard_tables;
+    for (const auto &shard : this->shards) {
+        shard_tables.push_back(shard->to_toml());
+    }
+    table.emplace("shards", shard_tables);
+    return table;
+}
+
+void
+ShardedOram::save_to_disk(const std::filesystem::path &location) const {
+    // write config file
+    std::ofstream config_file(location / "config.toml");
+    config_file << this->to_toml_self() << "\n";
+
+    // write out shards
+    for (std::size_t i = 0; i < this->shards.size(); i++) {
+        std::filesystem::path shard_directory = location / absl::StrFormat("shard_%lu", i);
+        std::filesystem::create_directory(shard_directory);
+        this->shards[i]->save_to_disk(shard_directory);
+    }
+}
+
+unique_memory_t
+ShardedOram::load_from_disk(const std::filesystem::path &location) {
+    auto table = toml::parse_file((location / "config.toml").string());
+    return ShardedOram::load_from_disk(location, table);
+}
+
+unique_memory_t
+ShardedOram::load_from_disk(const std::filesystem::path &location, const toml::table &table) {
+    uint64_t num_shards = parse_size(table["num_shards"]);
+    std::vector<unique_memory_t> shards;
+    for (uint64_t i = 0; i < num_shards; i++) {
+        shards.emplace_back(MemoryLoader::load(location / absl::StrFormat("shard_%lu", i)));
+    }
+
+    return unique_memory_t(new ShardedOram(
+        "ShardedOram", table,
+        std::move(shards),
+        new ShardedOramStatistics()
+    ));
+}
+
+void
+ShardedOram::reset_statistics(bool from_file) {
+    this->Memory::reset_statistics(from_file);
+    for (auto &shard : this->shards) {
+        shard->reset_statistics(from_file);
+    }
+}
+
+void
+ShardedOram::save_statistics() {
+    this->Memory::save_statistics();
+    for (auto &shard : this->shards) {
+        shard->save_statistics();
+    }
+}
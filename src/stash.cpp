@@ -6,6 +6,7 @@
 #include <conditional_memcpy.hpp>
 #include <absl/strings/str_format.h>
 #include <iostream>
+#include <util.hpp>
 
 void 
 StashEntry::write_to_memory(byte_t *metadata_address, byte_t *data_address) const {
@@ -155,6 +156,46 @@ Stash::try_evict_blocks(uint64_t max_count, uint64_t ignored_bits, uint64_t path
     return num_blocks_evicted;
 }
 
+int64_t 
+Stash::deepest_level(uint64_t path, uint64_t levels, uint64_t tree_bits) const {
+    int64_t deepest = -1;
+    for (std::size_t i = 0; i < this->capacity(); i++)
+    {
+        int64_t level = static_cast<int64_t>(deepest_common_level(this->metadata[i].get_path(), path, levels, tree_bits));
+        bool is_deeper = this->metadata[i].is_valid() && level > deepest;
+        conditional_memcpy(is_deeper, &deepest, &level, sizeof(int64_t));
+    }
+    return deepest;
+}
+
+bool 
+Stash::conditional_remove_deepest_block(bool do_remove, uint64_t path, uint64_t levels, BlockMetadata *metadata, byte_t *data, uint64_t tree_bits) {
+    // first pass locates the deepest block, second pass moves it out
+    int64_t deepest = -1;
+    std::size_t deepest_index = 0;
+    for (std::size_t i = 0; i < this->capacity(); i++)
+    {
+        int64_t level = static_cast<int64_t>(deepest_common_level(this->metadata[i].get_path(), path, levels, tree_bits));
+        bool is_deeper = this->metadata[i].is_valid() && level > deepest;
+        conditional_memcpy(is_deeper, &deepest, &level, sizeof(int64_t));
+        conditional_memcpy(is_deeper, &deepest_index, &i, sizeof(std::size_t));
+    }
+
+    bool removed = do_remove && deepest >= 0;
+    BlockMetadata invalid;
+    for (std::size_t i = 0; i < this->capacity(); i++)
+    {
+        bool is_target = removed && (i == deepest_index);
+        conditional_memcpy(is_target, metadata, &this->metadata[i], block_metadata_size);
+        conditional_memcpy(is_target, data, this->data_blocks.data() + i * this->block_size, this->block_size);
+        conditional_memcpy(is_target, &this->metadata[i], &invalid, block_metadata_size);
+    }
+
+    this->num_blocks_in_stash -= (removed ? 1: 0);
+
+    return removed;
+}
+
 // void 
 // Stash::clear_invalid_blocks() {
 //     auto new_end = std::remove_if(this->stash.begin(), this->stash.end(), [](const StashEntry &entry) {
@@ -0,0 +1,385 @@
+#include <stash_simulator.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <stdexcept>
+#include <cxxopts.hpp>
+#include <absl/strings/str_format.h>
+#include <crypto_module.hpp>
+#include <page_optimized_raw_oram.hpp>
+#include <binary_path_oram_2.hpp>
+#include <util.hpp>
+
+namespace {
+
+std::vector<int64_t>
+eviction_level_sizes(uint64_t levels, uint64_t top_level_order, uint64_t tree_bits) {
+    std::vector<int64_t> level_sizes(levels > 1 ? levels - 1 : 0, 1L << tree_bits);
+    if (!level_sizes.empty()) {
+        level_sizes[0] = static_cast<int64_t>(top_level_order);
+    }
+    return level_sizes;
+}
+
+toml::array
+histogram_to_toml(const std::vector<uint64_t> &histogram) {
+    toml::array array;
+    for (uint64_t count : histogram) {
+        array.emplace_back(static_cast<int64_t>(count));
+    }
+    return array;
+}
+
+}
+
+StashSimulator::StashSimulator(
+    EvictionPolicy policy,
+    uint64_t num_blocks,
+    uint64_t levels,
+    uint64_t top_level_order,
+    uint64_t blocks_per_bucket,
+    uint64_t num_accesses_per_eviction,
+    uint64_t evictions_per_batch,
+    uint64_t tree_bits
+) :
+policy(policy),
+num_blocks(num_blocks),
+levels(levels),
+top_level_order(top_level_order),
+blocks_per_bucket(blocks_per_bucket),
+num_accesses_per_eviction(num_accesses_per_eviction),
+evictions_per_batch(evictions_per_batch),
+tree_bits(tree_bits),
+num_paths(levels >= 2 ? top_level_order << ((levels - 2) * tree_bits) : 1),
+eviction_path_gen(eviction_level_sizes(levels, top_level_order, tree_bits)),
+access_counter(0),
+next_eviction_path(0),
+next_slot(0),
+path_blocks(levels * blocks_per_bucket),
+path_depth_end(levels + 1),
+stash_depth_end(levels + 1),
+accesses(0),
+evictions(0),
+_max_stash_size(0)
+{
+    if (levels < 2) {
+        throw std::invalid_argument("StashSimulator needs a tree with at least 2 levels");
+    }
+    if (this->num_paths >= invalid_path) {
+        throw std::invalid_argument(absl::StrFormat("StashSimulator supports at most %lu paths, tree has %lu", static_cast<uint64_t>(invalid_path) - 1, this->num_paths));
+    }
+
+    uint64_t level_size = 1;
+    uint64_t total_buckets = 0;
+    for (uint64_t level = 0; level < levels; level++) {
+        this->level_start.emplace_back(total_buckets);
+        total_buckets += level_size;
+        level_size = (level == 0) ? top_level_order : level_size << tree_bits;
+    }
+
+    if (num_blocks > total_buckets * blocks_per_bucket) {
+        throw std::invalid_argument(absl::StrFormat("%lu blocks do not fit into a tree of %lu slots", num_blocks, total_buckets * blocks_per_bucket));
+    }
+    this->slots.resize(total_buckets * blocks_per_bucket, invalid_path);
+}
+
+uint64_t
+StashSimulator::bucket_of(uint64_t level, uint64_t path) const {
+    // with a top level order above 2 the path index has a bit more than the levels below the root
+    if (level == 0) {
+        return 0;
+    }
+    return this->level_start[level] + (path >> ((this->levels - 1 - level) * this->tree_bits));
+}
+
+uint64_t
+StashSimulator::random_path_in_bucket(uint64_t level, uint64_t level_offset) {
+    uint64_t path_upper = level_offset << ((this->levels - 1 - level) * this->tree_bits);
+    uint64_t path_lower_limit = level == 0 ? this->num_paths : 1UL << ((this->levels - 1 - level) * this->tree_bits);
+    return path_upper | absl::Uniform(this->bit_gen, 0UL, path_lower_limit);
+}
+
+uint64_t
+StashSimulator::deepest_level(uint32_t block_path, uint64_t path) const {
+    uint64_t differing_levels = divide_round_up<uint64_t>(std::bit_width(block_path ^ path), this->tree_bits);
+    return differing_levels >= this->levels ? 0 : this->levels - 1 - differing_levels;
+}
+
+void
+StashSimulator::fast_init() {
+    this->stash.clear();
+    this->eviction_path_gen.reset();
+    this->next_eviction_path = this->eviction_path_gen.next_path();
+    this->access_counter = 0;
+
+    // mark num_blocks random slots as taken, then give each of them a path through its bucket
+    std::fill(this->slots.begin(), this->slots.end(), invalid_path);
+    std::fill(this->slots.begin(), this->slots.begin() + this->num_blocks, 0);
+    std::shuffle(this->slots.begin(), this->slots.end(), this->bit_gen);
+
+    for (uint64_t level = 0; level < this->levels; level++) {
+        uint64_t level_end = (level + 1 < this->levels) ? this->level_start[level + 1] : this->slots.size() / this->blocks_per_bucket;
+        for (uint64_t bucket = this->level_start[level]; bucket < level_end; bucket++) {
+            for (uint64_t slot = bucket * this->blocks_per_bucket; slot < (bucket + 1) * this->blocks_per_bucket; slot++) {
+                if (this->slots[slot] != invalid_path) {
+                    this->slots[slot] = static_cast<uint32_t>(this->random_path_in_bucket(level, bucket - this->level_start[level]));
+                }
+            }
+        }
+    }
+    this->next_slot = absl::Uniform(this->bit_gen, 0UL, this->slots.size());
+}
+
+void
+StashSimulator::log_stash_size(std::vector<uint64_t> &histogram, uint64_t size) {
+    if (histogram.size() <= size) {
+        histogram.resize(size + 1, 0);
+    }
+    histogram[size]++;
+    this->_max_stash_size = std::max(this->_max_stash_size, size);
+}
+
+void
+StashSimulator::sort_by_depth(const uint32_t *blocks, uint64_t count, uint64_t path, std::vector<uint32_t> &sorted, std::vector<uint64_t> &depth_end) const {
+    // counting sort, deepest first; depth_end[i] ends up as the number of blocks that can go to
+    // level levels - 1 - i or deeper
+    std::fill(depth_end.begin(), depth_end.end(), 0);
+    for (uint64_t i = 0; i < count; i++) {
+        depth_end[this->levels - this->deepest_level(blocks[i], path)]++;
+    }
+    std::partial_sum(depth_end.begin(), depth_end.end(), depth_end.begin());
+    sorted.resize(count);
+    for (uint64_t i = 0; i < count; i++) {
+        sorted[depth_end[this->levels - 1 - this->deepest_level(blocks[i], path)]++] = blocks[i];
+    }
+}
+
+void
+StashSimulator::evict_path(uint64_t path) {
+    // the slots are occupied at random, so copy without branching on it
+    uint32_t *path_blocks = this->path_blocks.data();
+    uint64_t num_path_blocks = 0;
+    for (uint64_t level = 0; level < this->levels; level++) {
+        uint32_t *bucket = this->slots.data() + this->bucket_of(level, path) * this->blocks_per_bucket;
+        for (uint64_t slot_index = 0; slot_index < this->blocks_per_bucket; slot_index++) {
+            path_blocks[num_path_blocks] = bucket[slot_index];
+            num_path_blocks += (bucket[slot_index] != invalid_path);
+        }
+        std::fill(bucket, bucket + this->blocks_per_bucket, invalid_path);
+    }
+    this->sort_by_depth(path_blocks, num_path_blocks, path, this->sorted_path_blocks, this->path_depth_end);
+    this->sort_by_depth(this->stash.data(), this->stash.size(), path, this->sorted_stash_blocks, this->stash_depth_end);
+
+    // fill the buckets from the leaf up like evict_loaded_path, blocks from the path buffer first and
+    // then blocks from the stash; every block read from the path fits back in
+    uint64_t path_taken = 0;
+    uint64_t stash_taken = 0;
+    for (uint64_t i = 0; i < this->levels; i++) {
+        uint64_t level = this->levels - 1 - i;
+        uint32_t *bucket = this->slots.data() + this->bucket_of(level, path) * this->blocks_per_bucket;
+        uint64_t slot_index = 0;
+
+        while (path_taken < this->path_depth_end[i] && slot_index < this->blocks_per_bucket) {
+            bucket[slot_index++] = this->sorted_path_blocks[path_taken++];
+        }
+        while (stash_taken < this->stash_depth_end[i] && slot_index < this->blocks_per_bucket) {
+            bucket[slot_index++] = this->sorted_stash_blocks[stash_taken++];
+        }
+    }
+
+    if (path_taken != this->sorted_path_blocks.size()) {
+        throw std::runtime_error(absl::StrFormat("Eviction of path %lu dropped %lu blocks read from the path", path, this->sorted_path_blocks.size() - path_taken));
+    }
+    this->stash.assign(this->sorted_stash_blocks.begin() + stash_taken, this->sorted_stash_blocks.end());
+    this->evictions++;
+}
+
+void
+StashSimulator::access() {
+    uint64_t accessed_path;
+    uint32_t new_path = static_cast<uint32_t>(absl::Uniform(this->bit_gen, 0UL, this->num_paths));
+
+    uint64_t block = absl::Uniform(this->bit_gen, 0UL, this->num_blocks);
+    if (block < this->stash.size()) {
+        accessed_path = this->stash[block];
+        this->stash[block] = new_path;
+    } else {
+        uint64_t slot = this->next_slot;
+        while (this->slots[slot] == invalid_path) {
+            slot = absl::Uniform(this->bit_gen, 0UL, this->slots.size());
+        }
+        accessed_path = this->slots[slot];
+        this->slots[slot] = invalid_path;
+        this->stash.emplace_back(new_path);
+    }
+    this->accesses++;
+
+    // the slot is a cache miss in large trees, draw the next one early so it is loaded by then
+    this->next_slot = absl::Uniform(this->bit_gen, 0UL, this->slots.size());
+    __builtin_prefetch(this->slots.data() + this->next_slot);
+
+    if (this->policy == EvictionPolicy::ACCESSED_PATH) {
+        this->log_stash_size(this->peak_stash_load, this->stash.size());
+        this->evict_path(accessed_path);
+        this->log_stash_size(this->stash_load, this->stash.size());
+        return;
+    }
+
+    this->access_counter++;
+    if (this->access_counter < this->num_accesses_per_eviction * this->evictions_per_batch) {
+        return;
+    }
+    this->access_counter = 0;
+
+    this->log_stash_size(this->peak_stash_load, this->stash.size());
+    for (uint64_t i = 0; i < this->evictions_per_batch; i++) {
+        this->evict_path(this->next_eviction_path);
+        this->next_eviction_path = this->eviction_path_gen.next_path();
+    }
+    this->log_stash_size(this->stash_load, this->stash.size());
+
+    // the eviction paths are fixed, load the next one while the accesses run
+    for (uint64_t level = 0; level < this->levels; level++) {
+        const uint32_t *bucket = this->slots.data() + this->bucket_of(level, this->next_eviction_path) * this->blocks_per_bucket;
+        for (uint64_t offset = 0; offset < this->blocks_per_bucket; offset += 64 / sizeof(uint32_t)) {
+            __builtin_prefetch(bucket + offset);
+        }
+    }
+}
+
+void
+StashSimulator::run(uint64_t count) {
+    for (uint64_t i = 0; i < count; i++) {
+        this->access();
+    }
+}
+
+void
+StashSimulator::clear_statistics() {
+    this->stash_load.clear();
+    this->peak_stash_load.clear();
+    this->accesses = 0;
+    this->evictions = 0;
+    this->_max_stash_size = this->stash.size();
+}
+
+uint64_t
+StashSimulator::stash_size() const {
+    return this->stash.size();
+}
+
+uint64_t
+StashSimulator::max_stash_size() const {
+    return this->_max_stash_size;
+}
+
+toml::table
+StashSimulator::to_toml() const {
+    return toml::table{
+        {"eviction_policy", this->policy == EvictionPolicy::ACCESSED_PATH ? "accessed_path" : "read_only_access"},
+        {"num_blocks", static_cast<int64_t>(this->num_blocks)},
+        {"levels", static_cast<int64_t>(this->levels)},
+        {"top_level_order", static_cast<int64_t>(this->top_level_order)},
+        {"tree_order", static_cast<int64_t>(1UL << this->tree_bits)},
+        {"blocks_per_bucket", static_cast<int64_t>(this->blocks_per_bucket)},
+        {"num_accesses_per_eviction", static_cast<int64_t>(this->num_accesses_per_eviction)},
+        {"evictions_per_batch", static_cast<int64_t>(this->evictions_per_batch)},
+        {"load_factor", static_cast<double>(this->num_blocks) / static_cast<double>(this->slots.size())},
+        {"accesses", static_cast<int64_t>(this->accesses)},
+        {"evictions", static_cast<int64_t>(this->evictions)},
+        {"max_stash_size", static_cast<int64_t>(this->_max_stash_size)},
+        {"stash_load", histogram_to_toml(this->stash_load)},
+        {"peak_stash_load", histogram_to_toml(this->peak_stash_load)}
+    };
+}
+
+int simulate_stash_entry_point(int argc, const char** argv) {
+    cxxopts::Options simulate_options("Simulate stash", "Measures the stash occupancy of an ORAM configuration without data or crypto");
+
+    simulate_options.add_options()
+    ("subcommand", "ignore", cxxopts::value<std::string>())
+    ("t,type", "PageOptimizedRAWOram or BinaryPathOram2", cxxopts::value<std::string>()->default_value("PageOptimizedRAWOram"))
+    ("s,size", "The size of Oram to simulate", cxxopts::value<std::string>()->default_value("100KiB"))
+    ("b,block_size", "The size of blocks in Oram", cxxopts::value<std::string>()->default_value("64B"))
+    ("P,page_size", "The size of the untrusted memory pages", cxxopts::value<std::string>()->default_value("4KiB"))
+    ("L,load_factor", "The maximum load factor the tree can have", cxxopts::value<double>()->default_value("0.75"))
+    ("c,crypto_module", "Type of Crypto the ORAM would use, only affects the blocks per bucket", cxxopts::value<std::string>()->default_value("PlainText"))
+    ("a,num_accesses_per_eviction", "Number of AO access per EO access, PageOptimizedRAWOram only", cxxopts::value<uint64_t>()->default_value("4"))
+    ("evictions_per_batch", "Number of eviction paths evicted together, PageOptimizedRAWOram only", cxxopts::value<uint64_t>()->default_value("1"))
+    ("e,levels_per_page", "How many levels of buckets to fit on each page, BinaryPathOram2 only", cxxopts::value<std::string>()->default_value("1"))
+    ("O,tree_order", "The order of the tree, a power of two, BinaryPathOram2 only", cxxopts::value<uint64_t>()->default_value("2"))
+    ("n,count", "Number of uniformly random accesses to simulate", cxxopts::value<std::string>()->default_value("1M"))
+    ("w,warmup", "Number of accesses to run before collecting statistics", cxxopts::value<std::string>()->default_value("0"))
+    ("o,output_file", "Write the stash load histograms to this TOML file", cxxopts::value<std::string>())
+    ("h,help", "show help text");
+
+    simulate_options.parse_positional("subcommand");
+
+    auto result = simulate_options.parse(argc, argv);
+
+    if (result.count("subcommand") != 1 || result["subcommand"].as<std::string>() != "simulate_stash") {
+        std::cout << "Incorrect sub command!\n";
+        return -1;
+    }
+
+    if (result.count("help") > 0) {
+        std::cout << simulate_options.help();
+        return 0;
+    }
+
+    std::string type = result["type"].as<std::string>();
+    uint64_t size = parse_size(result["size"].as<std::string>());
+    uint64_t block_size = parse_size(result["block_size"].as<std::string>());
+    uint64_t page_size = parse_size(result["page_size"].as<std::string>());
+    double load_factor = result["load_factor"].as<double>();
+    auto crypto_module = get_crypto_module_by_name(result["crypto_module"].as<std::string>());
+    uint64_t num_blocks = size / block_size;
+    uint64_t count = parse_size(result["count"].as<std::string>());
+    uint64_t warmup = parse_size(result["warmup"].as<std::string>());
+
+    std::unique_ptr<StashSimulator> simulator;
+    if (type == "PageOptimizedRAWOram") {
+        auto parameters = PageOptimizedRAWOram::compute_parameters(page_size, block_size, num_blocks, 2, crypto_module.get(), load_factor);
+        simulator = std::make_unique<StashSimulator>(
+            StashSimulator::EvictionPolicy::READ_ONLY_ACCESS,
+            num_blocks, parameters.levels, parameters.top_level_order, parameters.blocks_per_bucket,
+            result["num_accesses_per_eviction"].as<uint64_t>(),
+            result["evictions_per_batch"].as<uint64_t>()
+        );
+    } else if (type == "BinaryPathOram2") {
+        uint64_t levels_per_page = parse_size(result["levels_per_page"].as<std::string>());
+        uint64_t tree_order = result["tree_order"].as<uint64_t>();
+        auto parameters = BinaryPathOram2::compute_parameters(block_size, page_size, levels_per_page, num_blocks, crypto_module.get(), load_factor, false, tree_order);
+        simulator = std::make_unique<StashSimulator>(
+            StashSimulator::EvictionPolicy::ACCESSED_PATH,
+            num_blocks, parameters.levels, tree_order, parameters.blocks_per_bucket,
+            1, 1, parameters.tree_bits
+        );
+    } else {
+        std::cout << absl::StreamFormat("Stash simulation does not support %s!\n", type);
+        return -1;
+    }
+
+    simulator->fast_init();
+    simulator->run(warmup);
+    simulator->clear_statistics();
+
+    auto start = std::chrono::steady_clock::now();
+    simulator->run(count);
+    auto end = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+
+    std::cout << absl::StreamFormat("Simulated %lu accesses in %.2fs (%.0f accesses/s)\n", count, seconds, static_cast<double>(count) / seconds);
+    std::cout << absl::StreamFormat("Max stash size %lu\n", simulator->max_stash_size());
+
+    if (result.count("output_file") > 0) {
+        std::ofstream output_file(result["output_file"].as<std::string>());
+        output_file << simulator->to_toml() << std::endl;
+    }
+
+    return 0;
+}
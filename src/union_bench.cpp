@@ -0,0 +1,158 @@
+#include <union_bench.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <vector>
+#include <cxxopts.hpp>
+#include <absl/random/random.h>
+#include <absl/strings/str_format.h>
+#include <toml++/toml.h>
+#include <union.hpp>
+#include <util.hpp>
+
+namespace {
+
+struct UnionTiming {
+    uint64_t chunk_size;
+    uint64_t k_union;
+    // 0 when the linear scan was skipped
+    double linear_scanning_seconds;
+    double bitonic_sort_seconds;
+};
+
+// runs the union until min_duration has passed, at least once, returns the mean time of one run
+template<typename F>
+double
+seconds_per_run(std::chrono::milliseconds min_duration, F &&run) {
+    uint64_t count = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto end = start;
+    do {
+        run();
+        count++;
+        end = std::chrono::steady_clock::now();
+    } while (end - start < min_duration);
+    return std::chrono::duration<double>(end - start).count() / static_cast<double>(count);
+}
+
+/**
+ * @brief Times union_linear_scanning and union_bitonic_sort on one chunk of entry ids with about
+ * distinct_fraction * chunk_size distinct values, the way OramBufferDP::load_entries calls them, and checks
+ * that both give the same union.
+ */
+UnionTiming
+measure_union(uint64_t chunk_size, double distinct_fraction, uint64_t max_linear_size, std::chrono::milliseconds min_duration, absl::BitGen &bit_gen) {
+    uint64_t num_distinct = std::max(1UL, static_cast<uint64_t>(static_cast<double>(chunk_size) * distinct_fraction));
+    std::vector<uint64_t> input(chunk_size);
+    for (auto &entry_id : input) {
+        entry_id = absl::Uniform(bit_gen, 0UL, num_distinct);
+    }
+
+    std::vector<uint64_t> bitonic_output(chunk_size, std::numeric_limits<uint64_t>::max());
+    uint64_t k_union = 0;
+    UnionTiming result;
+    result.chunk_size = chunk_size;
+    result.bitonic_sort_seconds = seconds_per_run(min_duration, [&]() {
+        k_union = union_bitonic_sort(input.data(), bitonic_output.data(), chunk_size);
+    });
+    result.k_union = k_union;
+
+    result.linear_scanning_seconds = 0.0;
+    if (chunk_size <= max_linear_size) {
+        std::vector<uint64_t> linear_output(chunk_size, std::numeric_limits<uint64_t>::max());
+        uint64_t linear_k_union = 0;
+        result.linear_scanning_seconds = seconds_per_run(min_duration, [&]() {
+            linear_k_union = union_linear_scanning(input.data(), linear_output.data(), chunk_size);
+        });
+        if (linear_k_union != k_union || linear_output != bitonic_output) {
+            throw std::runtime_error(absl::StrFormat("Union of %lu entries differs between linear scanning and bitonic sort", chunk_size));
+        }
+    }
+
+    return result;
+}
+
+}
+
+int union_bench_entry_point(int argc, const char** argv) {
+    cxxopts::Options union_bench_options("UnionBench", "Compares the oblivious union algorithms of the DP buffers");
+
+    union_bench_options.add_options()
+    ("subcommand", "ignore", cxxopts::value<std::string>())
+    ("c,chunk_sizes", "Number of requests per union, e.g. the chunk size of ORAMBufferDP", cxxopts::value<std::vector<std::string>>()->default_value("1Ki,2Ki,4Ki,8Ki,16Ki,32Ki,64Ki"))
+    ("d,distinct_fraction", "Number of distinct entry ids as a fraction of the chunk size", cxxopts::value<double>()->default_value("0.5"))
+    ("L,max_linear_size", "Largest chunk size to run the quadratic linear scan on", cxxopts::value<std::string>()->default_value("64Ki"))
+    ("m,duration", "Minimum time spent on each measurement in milliseconds", cxxopts::value<uint64_t>()->default_value("200"))
+    ("o,output_file", "Write the measurements to this TOML file", cxxopts::value<std::string>())
+    ("h,help", "show help text");
+
+    union_bench_options.parse_positional("subcommand");
+
+    auto result = union_bench_options.parse(argc, argv);
+
+    if (result.count("subcommand") != 1 || result["subcommand"].as<std::string>() != "union_bench") {
+        std::cout << "Incorrect sub command!\n";
+        return -1;
+    }
+
+    if (result.count("help") > 0) {
+        std::cout << union_bench_options.help();
+        return 0;
+    }
+
+    double distinct_fraction = result["distinct_fraction"].as<double>();
+    if (distinct_fraction <= 0.0 || distinct_fraction > 1.0) {
+        std::cout << "distinct_fraction has to be in (0, 1]!\n";
+        return -1;
+    }
+    uint64_t max_linear_size = parse_size(result["max_linear_size"].as<std::string>());
+    std::chrono::milliseconds min_duration(result["duration"].as<uint64_t>());
+
+    std::vector<uint64_t> chunk_sizes;
+    for (const auto &chunk_size : result["chunk_sizes"].as<std::vector<std::string>>()) {
+        chunk_sizes.emplace_back(parse_size(chunk_size));
+    }
+    std::sort(chunk_sizes.begin(), chunk_sizes.end());
+
+    absl::BitGen bit_gen;
+    toml::table table;
+    for (uint64_t chunk_size : chunk_sizes) {
+        if (chunk_size == 0) {
+            continue;
+        }
+        auto timing = measure_union(chunk_size, distinct_fraction, max_linear_size, min_duration, bit_gen);
+
+        if (timing.linear_scanning_seconds > 0.0) {
+            std::cout << absl::StreamFormat(
+                "chunk %6lu, k_union %6lu: linear scanning %10.3f ms, bitonic sort %8.3f ms, speedup %8.1fx\n",
+                chunk_size, timing.k_union, timing.linear_scanning_seconds * 1e3, timing.bitonic_sort_seconds * 1e3,
+                timing.linear_scanning_seconds / timing.bitonic_sort_seconds
+            );
+        } else {
+            std::cout << absl::StreamFormat(
+                "chunk %6lu, k_union %6lu: linear scanning    skipped, bitonic sort %8.3f ms\n",
+                chunk_size, timing.k_union, timing.bitonic_sort_seconds * 1e3
+            );
+        }
+
+        toml::table chunk_table{
+            {"k_union", static_cast<int64_t>(timing.k_union)},
+            {"bitonic_sort_seconds", timing.bitonic_sort_seconds}
+        };
+        if (timing.linear_scanning_seconds > 0.0) {
+            chunk_table.emplace("linear_scanning_seconds", timing.linear_scanning_seconds);
+        }
+        table.emplace(std::to_string(chunk_size), std::move(chunk_table));
+    }
+
+    if (result.count("output_file") > 0) {
+        table.emplace("distinct_fraction", distinct_fraction);
+        std::ofstream output_file(result["output_file"].as<std::string>());
+        output_file << table << std::endl;
+    }
+
+    return 0;
+}
@@ -130,7 +130,7 @@
 
 
 ParentCounterValidBitTreeController::Parameters 
-ParentCounterValidBitTreeController::compute_parameters(CryptoModule *crypto, addr_t levels, addr_t page_size, addr_t valid_bits_per_bucket) {
+ParentCounterValidBitTreeController::compute_parameters(CryptoModule *crypto, addr_t levels, addr_t page_size, addr_t valid_bits_per_bucket, addr_t cache_size) {
     Parameters result;
 
     result.levels = levels;
@@ -186,6 +186,18 @@ ParentCounterValidBitTreeController::compute_parameters(CryptoModule *crypto, ad
 
     // compute level start offsets
 
+    // the leaf page level is never cached, every path has its own leaf page
+    result.cached_page_levels = 0;
+    addr_t cached_size = 0;
+    addr_t cached_level_size = 1;
+    while (result.cached_page_levels + 1 < result.page_levels && cached_size + cached_level_size * result.page_size <= cache_size) {
+        cached_size += cached_level_size * result.page_size;
+        cached_level_size <<= result.levels_per_non_leaf_page;
+        result.cached_page_levels++;
+    }
+
+    std::cout << absl::StreamFormat("Caching the top %lu page levels in %lu bytes of trusted memory.\n", result.cached_page_levels, cached_size);
+
     return result;
     
 }
@@ -193,24 +205,132 @@ ParentCounterValidBitTreeController::compute_parameters(CryptoModule *crypto, ad
 ParentCounterValidBitTreeController::ParentCounterValidBitTreeController(Parameters parameters, CryptoModule *crypto_module, Memory* memory) :
 parameters(parameters),
 nonce_buffer(crypto_module->nonce_size()),
-decrypted_buffer((parameters.page_levels - 1) * parameters.page_size + parameters.leaf_page_size),
-path_access_requests(parameters.page_levels),
+crypto_batch(crypto_module->nonce_size()),
+path_access_requests(parameters.page_levels - parameters.cached_page_levels),
+loaded_pages(parameters.page_levels),
 content_encrypted(false),
 root_counter(0),
 memory(memory),
 crypto_module(crypto_module)
 {
     crypto_module->random(nonce_buffer.data(), parameters.random_nonce_bytes);
+    this->init_cache();
+}
+
+void 
+ParentCounterValidBitTreeController::init_cache() {
+    this->cached_level_start.clear();
+    addr_t num_cached_pages = 0;
+    addr_t level_size = 1;
+    for (addr_t page_level = 0; page_level < this->parameters.cached_page_levels; page_level++) {
+        this->cached_level_start.push_back(num_cached_pages);
+        num_cached_pages += level_size;
+        level_size <<= this->parameters.levels_per_non_leaf_page;
+    }
+    this->cached_pages.resize(num_cached_pages * this->parameters.page_size);
+    this->cache_loaded = false;
+    this->cache_dirty = false;
+}
+
+void 
+ParentCounterValidBitTreeController::load_cache(const byte_t *key) {
+    const addr_t page_size_with_tag = this->parameters.page_size + this->parameters.auth_tag_size;
+    std::vector<MemoryRequest> requests;
+    addr_t level_size = 1;
+    for (addr_t page_level = 0; page_level < this->parameters.cached_page_levels; page_level++) {
+        addr_t level_start = this->get_start_address_for_page_level(page_level);
+        requests.assign(level_size, MemoryRequest(MemoryRequestType::READ, 0, page_size_with_tag));
+        for (addr_t page_index = 0; page_index < level_size; page_index++) {
+            requests[page_index].address = level_start + page_index * page_size_with_tag;
+        }
+        this->memory->batch_access(requests);
+
+        this->crypto_batch.clear();
+        for (addr_t page_index = 0; page_index < level_size; page_index++) {
+            std::uint64_t counter = this->root_counter;
+            if (page_level > 0) {
+                addr_t child_index = page_index % (1UL << this->parameters.levels_per_non_leaf_page);
+                counter = this->get_counter_from_page(this->get_cached_page(page_level - 1, page_index >> this->parameters.levels_per_non_leaf_page), child_index);
+            }
+
+            std::memcpy(this->nonce_buffer.data() + this->parameters.random_nonce_bytes, &requests[page_index].address, sizeof(addr_t));
+            std::memcpy(this->nonce_buffer.data() + this->parameters.random_nonce_bytes + sizeof(addr_t), &counter, sizeof(addr_t));
+
+            this->crypto_batch.add(this->nonce_buffer.data(), requests[page_index].data.data(), requests[page_index].data.data() + this->parameters.page_size);
+        }
+
+        if (!this->crypto_batch.decrypt(this->crypto_module, key, this->parameters.page_size)) {
+            throw std::runtime_error("Auth Tag verification Failed");
+        }
+        for (addr_t page_index = 0; page_index < level_size; page_index++) {
+            std::memcpy(this->get_cached_page(page_level, page_index), requests[page_index].data.data(), this->parameters.page_size);
+        }
+        level_size <<= this->parameters.levels_per_non_leaf_page;
+    }
+    this->cache_loaded = true;
+    this->cache_dirty = false;
+}
+
+void 
+ParentCounterValidBitTreeController::flush(const byte_t *key) {
+    if (!this->cache_dirty) {
+        return;
+    }
+
+    // bottom up, every page bumps its counter in the parent before the parent is encrypted
+    const addr_t page_size_with_tag = this->parameters.page_size + this->parameters.auth_tag_size;
+    std::vector<MemoryRequest> requests;
+    for (addr_t i = 0; i < this->parameters.cached_page_levels; i++) {
+        addr_t page_level = this->parameters.cached_page_levels - 1 - i;
+        addr_t level_size = 1UL << (page_level * this->parameters.levels_per_non_leaf_page);
+        addr_t level_start = this->get_start_address_for_page_level(page_level);
+        requests.assign(level_size, MemoryRequest(MemoryRequestType::WRITE, 0, page_size_with_tag));
+        this->crypto_batch.clear();
+        for (addr_t page_index = 0; page_index < level_size; page_index++) {
+            requests[page_index].address = level_start + page_index * page_size_with_tag;
+
+            std::uint64_t counter;
+            if (page_level == 0) {
+                this->root_counter += 1;
+                counter = this->root_counter;
+            } else {
+                byte_t *parent = this->get_cached_page(page_level - 1, page_index >> this->parameters.levels_per_non_leaf_page);
+                addr_t child_index = page_index % (1UL << this->parameters.levels_per_non_leaf_page);
+                counter = this->get_counter_from_page(parent, child_index) + 1;
+                this->set_counter_in_page(parent, child_index, counter);
+            }
+
+            std::memcpy(this->nonce_buffer.data() + this->parameters.random_nonce_bytes, &requests[page_index].address, sizeof(addr_t));
+            std::memcpy(this->nonce_buffer.data() + this->parameters.random_nonce_bytes + sizeof(addr_t), &counter, sizeof(addr_t));
+
+            std::memcpy(requests[page_index].data.data(), this->get_cached_page(page_level, page_index), this->parameters.page_size);
+            this->crypto_batch.add(this->nonce_buffer.data(), requests[page_index].data.data(), requests[page_index].data.data() + this->parameters.page_size);
+        }
+        this->crypto_batch.encrypt(this->crypto_module, key, this->parameters.page_size);
+        this->memory->batch_access(requests);
+    }
+    this->cache_dirty = false;
 }
 
 void 
 ParentCounterValidBitTreeController::read_path(byte_t *key, addr_t path) {
+    this->submit_read_path(key, path);
+    this->complete_read_path(key);
+}
+
+void 
+ParentCounterValidBitTreeController::submit_read_path(byte_t *key, addr_t path) {
     if (!this->content_encrypted) {
         throw std::runtime_error("Path read attempted while memory is not encrypted");
     }
 
+    if (!this->cache_loaded) {
+        this->load_cache(key);
+    }
+
     // std::cout << absl::StreamFormat("Reading path %lu\n", path);
     currently_loaded_path = path;
+    const addr_t cached_page_levels = this->parameters.cached_page_levels;
     addr_t level_start = 0;
     addr_t level_size = 1;
     addr_t ignored_bits = this->parameters.levels - 1;
@@ -222,26 +342,44 @@ ParentCounterValidBitTreeController::read_path(byte_t *key, addr_t path) {
         addr_t levels_per_page_in_this_page_level = (page_level == this->parameters.page_levels - 1 ? this->parameters.levels_per_leaf_page : this->parameters.levels_per_non_leaf_page);
         addr_t address = level_start + page_index * page_size_in_this_page_level;
 
-        this->path_access_requests[page_level].address = address;
-        this->path_access_requests[page_level].type = MemoryRequestType::READ;
-        this->path_access_requests[page_level].size = page_size_in_this_page_level;
-        this->path_access_requests[page_level].data.resize(page_size_in_this_page_level);
+        if (page_level < cached_page_levels) {
+            this->loaded_pages[page_level] = this->get_cached_page(page_level, page_index);
+        } else {
+            auto &request = this->path_access_requests[page_level - cached_page_levels];
+            request.address = address;
+            request.type = MemoryRequestType::READ;
+            request.size = page_size_in_this_page_level;
+            request.data.resize(page_size_in_this_page_level);
+        }
 
         ignored_bits -= levels_per_page_in_this_page_level;
         level_start += level_size * page_size_in_this_page_level;
         level_size *= (1 << levels_per_page_in_this_page_level);
     }
 
-    this->memory->batch_access(this->path_access_requests);
+    this->memory->submit_batch_access(this->path_access_requests);
+}
+
+void 
+ParentCounterValidBitTreeController::complete_read_path(byte_t *key) {
+    this->memory->complete_batch_access(this->path_access_requests);
 
-    // decrypt path
-    ignored_bits = this->parameters.levels - 1;
+    // decrypt path below the cached pages
+    const addr_t path = this->currently_loaded_path.value();
+    const addr_t cached_page_levels = this->parameters.cached_page_levels;
+    addr_t ignored_bits = this->parameters.levels - 1;
     for (addr_t page_level = 0; page_level < this->parameters.page_levels; page_level++) {
+        addr_t levels_per_page_in_this_page_level = (page_level == this->parameters.page_levels - 1 ? this->parameters.levels_per_leaf_page : this->parameters.levels_per_non_leaf_page);
+        if (page_level < cached_page_levels) {
+            ignored_bits -= levels_per_page_in_this_page_level;
+            continue;
+        }
+
+        auto &request = this->path_access_requests[page_level - cached_page_levels];
         std::uint64_t counter;
         addr_t page_index = path >> ignored_bits;
         // std::cout << page_index << "\n";
         addr_t page_size_in_this_page_level = (page_level == this->parameters.page_levels - 1 ? this->parameters.leaf_page_size : this->parameters.page_size) + this->parameters.auth_tag_size;
-        addr_t levels_per_page_in_this_page_level = (page_level == this->parameters.page_levels - 1 ? this->parameters.levels_per_leaf_page : this->parameters.levels_per_non_leaf_page);
         if (page_level == 0) {
             counter = root_counter;
         } else {
@@ -252,27 +390,33 @@ ParentCounterValidBitTreeController::read_path(byte_t *key, addr_t path) {
         }
 
         //set counter and page id in nonce
-        std::memcpy(this->nonce_buffer.data() + this->parameters.random_nonce_bytes, &this->path_access_requests[page_level].address, sizeof(addr_t));
+        std::memcpy(this->nonce_buffer.data() + this->parameters.random_nonce_bytes, &request.address, sizeof(addr_t));
         std::memcpy(this->nonce_buffer.data() + this->parameters.random_nonce_bytes + sizeof(addr_t), &counter, sizeof(addr_t));
 
-        bool verification_result = crypto_module->decrypt(
+        bool verification_result = crypto_module->decrypt_in_place(
             key, // key
             this->nonce_buffer.data(), // nonce
-            this->path_access_requests[page_level].data.data(), //ciphertext
+            request.data.data(), // ciphertext, replaced by the message
             page_size_in_this_page_level - this->parameters.auth_tag_size, // message length
-            this->path_access_requests[page_level].data.data() + page_size_in_this_page_level - this->parameters.auth_tag_size, // auth tag,
-            this->decrypted_buffer.data() + page_level * this->parameters.page_size // message
+            request.data.data() + page_size_in_this_page_level - this->parameters.auth_tag_size // auth tag
         );
 
         if (!verification_result) {
             throw std::runtime_error("Auth Tag verification Failed");
         }
+        this->loaded_pages[page_level] = request.data.data();
         ignored_bits -= levels_per_page_in_this_page_level;
     }
 }
 
 void 
 ParentCounterValidBitTreeController::write_path(byte_t *key) {
+    this->submit_write_path(key);
+    this->complete_write_path();
+}
+
+void 
+ParentCounterValidBitTreeController::submit_write_path(byte_t *key) {
     if (!this->content_encrypted) {
         throw std::runtime_error("Path write attempted while memory is not encrypted");
     }
@@ -302,11 +446,19 @@ ParentCounterValidBitTreeController::write_path(byte_t *key) {
 
     // this->memory->batch_access(this->path_access_requests);
 
-    // encrypt path
+    // encrypt path up to the cached pages, they are written back by flush()
+    const addr_t cached_page_levels = this->parameters.cached_page_levels;
     addr_t ignored_bits = this->parameters.levels_per_leaf_page - 1;
-    this->root_counter += 1;
-    for (addr_t i = 0; i < this->parameters.page_levels; i++) {
+    if (cached_page_levels == 0) {
+        this->root_counter += 1;
+    } else {
+        // the counters of the first uncached page level are in the cache
+        this->cache_dirty = true;
+    }
+    this->crypto_batch.clear();
+    for (addr_t i = 0; i < this->parameters.page_levels - cached_page_levels; i++) {
         addr_t page_level = this->parameters.page_levels - i - 1;
+        auto &request = this->path_access_requests[page_level - cached_page_levels];
         std::uint64_t counter;
         addr_t page_index = path >> ignored_bits;
         // std::cout << page_index << "\n";
@@ -321,25 +473,42 @@ ParentCounterValidBitTreeController::write_path(byte_t *key) {
             this->set_counter_in_page(this->get_decrypted_page(page_level - 1), counter_offset_in_parent, counter);
         }
 
-        this->path_access_requests[page_level].type = MemoryRequestType::WRITE;
+        request.type = MemoryRequestType::WRITE;
 
         //set counter and page id in nonce
-        std::memcpy(this->nonce_buffer.data() + this->parameters.random_nonce_bytes, &this->path_access_requests[page_level].address, sizeof(addr_t));
+        std::memcpy(this->nonce_buffer.data() + this->parameters.random_nonce_bytes, &request.address, sizeof(addr_t));
         std::memcpy(this->nonce_buffer.data() + this->parameters.random_nonce_bytes + sizeof(addr_t), &counter, sizeof(addr_t));
 
-        crypto_module->encrypt(
-            key,
-            this->nonce_buffer.data(),
-            this->get_decrypted_page(page_level),
-            page_size_in_this_page_level - this->parameters.auth_tag_size,
-            this->path_access_requests[page_level].data.data(),
-            this->path_access_requests[page_level].data.data() + page_size_in_this_page_level - this->parameters.auth_tag_size
-        );
+        if (page_level == this->parameters.page_levels - 1) {
+            crypto_module->encrypt_in_place(
+                key,
+                this->nonce_buffer.data(),
+                request.data.data(),
+                page_size_in_this_page_level - this->parameters.auth_tag_size,
+                request.data.data() + page_size_in_this_page_level - this->parameters.auth_tag_size
+            );
+        } else {
+            // non-leaf pages all have the same size and are encrypted together once all their counters are bumped
+            this->crypto_batch.add(
+                this->nonce_buffer.data(),
+                request.data.data(),
+                request.data.data() + page_size_in_this_page_level - this->parameters.auth_tag_size
+            );
+        }
 
         ignored_bits += this->parameters.levels_per_non_leaf_page;
     }
+    this->crypto_batch.encrypt(this->crypto_module, key, this->parameters.page_size);
+    this->crypto_batch.clear();
 
-    this->memory->batch_access(this->path_access_requests);
+    this->memory->submit_batch_access(this->path_access_requests);
+}
+
+void 
+ParentCounterValidBitTreeController::complete_write_path() {
+    this->memory->complete_batch_access(this->path_access_requests);
+    // the buffers hold cipher text now, a path has to be read again before its bits can be used
+    this->currently_loaded_path.reset();
 }
 
 addr_t 
@@ -370,6 +539,9 @@ ParentCounterValidBitTreeController::get_address_of(addr_t level, addr_t bucket_
 
 void 
 ParentCounterValidBitTreeController::encrypt_contents(byte_t *key) {
+    // the cache is read again from the newly encrypted pages
+    this->cache_loaded = false;
+    this->cache_dirty = false;
     MemoryRequest parent_request(MemoryRequestType::READ, 0, this->parameters.page_size);
     MemoryRequest data_request(MemoryRequestType::READ, 0, this->parameters.page_size);
     bytes_t data_buffer(this->parameters.page_size);
@@ -472,8 +644,94 @@ ParentCounterValidBitTreeController::encrypt_contents(byte_t *key) {
 
 void 
 ParentCounterValidBitTreeController::decrypt_contents(byte_t *key) {
+    this->flush(key);
+    this->cache_loaded = false;
+    MemoryRequest parent_request(MemoryRequestType::READ, 0, this->parameters.page_size);
+    MemoryRequest data_request(MemoryRequestType::READ, 0, this->parameters.page_size);
+    bytes_t data_buffer(this->parameters.page_size);
+    // go from the root down, the counters of a page level are only readable after its parent level is decrypted
+    for (std::uint64_t level = 0; level < this->parameters.page_levels; level++) {
+        if (level != 0) {
+            auto page_size_this_level = 
+                (level == this->parameters.page_levels - 1? this->parameters.leaf_page_size: this->parameters.page_size) + this->parameters.auth_tag_size;
+            auto parent_page_size = this->parameters.page_size + this->parameters.auth_tag_size;
+            auto level_start = get_start_address_for_page_level(level);
+            auto parent_level_start = get_start_address_for_page_level(level - 1);
+            auto level_size = get_page_level_size_in_pages(level);
+            std::optional<std::uint64_t> loaded_parent_index;
+            for (addr_t j = 0; j < level_size; j++) {
+                auto parent_index = j / (1UL << this->parameters.levels_per_non_leaf_page);
+                auto child_index_in_parent = j % (1 << this->parameters.levels_per_non_leaf_page);
+                if (!loaded_parent_index.has_value() || parent_index != loaded_parent_index.value()) {
+                    parent_request.type = MemoryRequestType::READ;
+                    parent_request.address = parent_level_start + parent_index * parent_page_size;
+                    this->memory->access(parent_request);
+                    loaded_parent_index = parent_index;
+                }
+
+                data_request.type = MemoryRequestType::READ;
+                data_request.address = level_start + j * page_size_this_level;
+                data_request.size = page_size_this_level;
+                data_request.data.resize(page_size_this_level);
+
+                this->memory->access(data_request);
+                data_buffer.resize(page_size_this_level);
+
+                auto counter = get_counter_from_page(parent_request.data.data(), child_index_in_parent);
+
+                //set counter and page id in nonce
+                std::memcpy(this->nonce_buffer.data() + this->parameters.random_nonce_bytes, &data_request.address, sizeof(addr_t));
+                std::memcpy(this->nonce_buffer.data() + this->parameters.random_nonce_bytes + sizeof(addr_t), &counter, sizeof(addr_t));
+
+                bool verification_result = this->crypto_module->decrypt(
+                    key,
+                    this->nonce_buffer.data(),
+                    data_request.data.data(),
+                    page_size_this_level - this->parameters.auth_tag_size,
+                    data_request.data.data() + page_size_this_level - this->parameters.auth_tag_size,
+                    data_buffer.data()
+                );
+
+                if (!verification_result) {
+                    throw std::runtime_error("Auth Tag verification Failed");
+                }
+
+                // write back the plain text, the auth tag is left as is
+                std::memcpy(data_request.data.data(), data_buffer.data(), page_size_this_level - this->parameters.auth_tag_size);
+                data_request.type = MemoryRequestType::WRITE;
+                this->memory->access(data_request);
+            }
+        } else {
+            // hardcoded exception for the root
+            data_request.type = MemoryRequestType::READ;
+            data_request.address = 0;
+            data_request.size = this->parameters.page_size + this->parameters.auth_tag_size;
+            data_request.data.resize(this->parameters.page_size + this->parameters.auth_tag_size);
+
+            this->memory->access(data_request);
+
+            std::memcpy(this->nonce_buffer.data() + this->parameters.random_nonce_bytes, &data_request.address, sizeof(addr_t));
+            std::memcpy(this->nonce_buffer.data() + this->parameters.random_nonce_bytes + sizeof(addr_t), &(this->root_counter), sizeof(addr_t));
+
+            bool verification_result = this->crypto_module->decrypt(
+                key,
+                this->nonce_buffer.data(),
+                data_request.data.data(),
+                this->parameters.page_size,
+                data_request.data.data() + this->parameters.page_size,
+                data_buffer.data()
+            );
+
+            if (!verification_result) {
+                throw std::runtime_error("Auth Tag verification Failed");
+            }
+
+            std::memcpy(data_request.data.data(), data_buffer.data(), this->parameters.page_size);
+            data_request.type = MemoryRequestType::WRITE;
+            this->memory->access(data_request);
+        }
+    }
     this->content_encrypted = false;
-    throw std::runtime_error("Not Implemented");
 }
 
 toml::table 
@@ -489,6 +747,7 @@ ParentCounterValidBitTreeController::to_toml() const noexcept {
     table.emplace("bytes_per_bucket", size_to_string(this->parameters.bytes_per_bucket));
     table.emplace("required_memory_size", size_to_string(this->parameters.required_memory_size));
     table.emplace("random_nonce_bytes", size_to_string(this->parameters.random_nonce_bytes));
+    table.emplace("cached_page_levels", size_to_string(this->parameters.cached_page_levels));
     table.emplace("random_nonce", bytes_to_hex_string(this->nonce_buffer.data(), this->parameters.random_nonce_bytes));
     table.emplace("root_counter", size_to_string(root_counter));
     table.emplace("content_encrypted", this->content_encrypted);
@@ -507,11 +766,13 @@ parameters (Parameters{
     .auth_tag_size = parse_size(table["auth_tag_size"]),
     .bytes_per_bucket = parse_size(table["bytes_per_bucket"]),
     .required_memory_size = parse_size(table["required_memory_size"]),
-    .random_nonce_bytes = parse_size(table["random_nonce_bytes"])
+    .random_nonce_bytes = parse_size(table["random_nonce_bytes"]),
+    .cached_page_levels = parse_size_or(table["cached_page_levels"], 0)
 }),
 nonce_buffer(crypto_module->nonce_size()),
-decrypted_buffer((parameters.page_levels - 1) * parameters.page_size + parameters.leaf_page_size),
-path_access_requests(parameters.page_levels),
+crypto_batch(crypto_module->nonce_size()),
+path_access_requests(parameters.page_levels - parameters.cached_page_levels),
+loaded_pages(parameters.page_levels),
 content_encrypted(table["content_encrypted"].value<bool>().value()),
 root_counter(parse_size(table["root_counter"])),
 memory(memory),
@@ -522,4 +783,5 @@ crypto_module(crypto_module)
     }
     this->nonce_buffer.resize(crypto_module->nonce_size());
     hex_string_to_bytes(table["random_nonce"].value<std::string_view>().value(), nonce_buffer.data(), this->parameters.random_nonce_bytes);
+    this->init_cache();
 }
\ No newline at end of file
@@ -0,0 +1,250 @@
+#include <gtest/gtest.h>
+#include <oblivious.hpp>
+#include <union.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <vector>
+#include <absl/strings/str_format.h>
+
+namespace {
+    // every count up to 70 covers the non power of two cases of the recursions, the larger ones cross several levels
+    std::vector<std::size_t> test_counts() {
+        std::vector<std::size_t> counts(71);
+        std::iota(counts.begin(), counts.end(), 0);
+        for (std::size_t count : {127UL, 129UL, 255UL, 1000UL, 1023UL, 1025UL, 3001UL}) {
+            counts.emplace_back(count);
+        }
+        return counts;
+    }
+
+    // the payload of element index holds the index in its first four bytes and a pattern derived from it after that
+    void fill_payload(byte_t *payload, std::size_t payload_size, std::uint32_t index) {
+        std::memcpy(payload, &index, std::min(payload_size, sizeof(index)));
+        for (std::size_t i = sizeof(index); i < payload_size; i++) {
+            payload[i] = static_cast<byte_t>(index * 31 + i);
+        }
+    }
+
+    std::uint32_t payload_index(const byte_t *payload, std::size_t payload_size) {
+        std::uint32_t index = 0;
+        std::memcpy(&index, payload, std::min(payload_size, sizeof(index)));
+        return index;
+    }
+
+    template <typename Key>
+    std::vector<Key> random_keys(std::size_t count, Key max_key, std::mt19937_64 &rng) {
+        std::uniform_int_distribution<Key> distribution(0, max_key);
+        std::vector<Key> keys(count);
+        for (auto &key : keys) {
+            key = distribution(rng);
+        }
+        return keys;
+    }
+
+    std::vector<byte_t> indexed_payloads(std::size_t count, std::size_t payload_size) {
+        std::vector<byte_t> payloads(count * payload_size);
+        for (std::size_t i = 0; i < count; i++) {
+            fill_payload(payloads.data() + i * payload_size, payload_size, static_cast<std::uint32_t>(i));
+        }
+        return payloads;
+    }
+
+    // checks that the payloads are a permutation of the indexed ones and that each one still carries its key
+    template <typename Key>
+    void expect_payloads_follow_keys(const std::vector<Key> &original_keys, const std::vector<Key> &keys, const std::vector<byte_t> &payloads, std::size_t payload_size) {
+        std::vector<bool> seen(keys.size(), false);
+        std::vector<byte_t> expected(payload_size);
+        for (std::size_t i = 0; i < keys.size(); i++) {
+            const byte_t *payload = payloads.data() + i * payload_size;
+            std::uint32_t index = payload_index(payload, payload_size);
+            ASSERT_LT(index, keys.size()) << absl::StrFormat("element %lu", i);
+            ASSERT_FALSE(seen[index]) << absl::StrFormat("payload %u appears twice", index);
+            seen[index] = true;
+            ASSERT_EQ(keys[i], original_keys[index]) << absl::StrFormat("element %lu lost its payload", i);
+            fill_payload(expected.data(), payload_size, index);
+            ASSERT_EQ(std::memcmp(payload, expected.data(), payload_size), 0) << absl::StrFormat("payload of element %lu is torn", i);
+        }
+    }
+
+    template <typename Key, std::size_t PayloadSize>
+    void check_sorts(Key max_key) {
+        std::mt19937_64 rng(0xC0FFEE + PayloadSize + max_key);
+        for (std::size_t count : test_counts()) {
+            SCOPED_TRACE(absl::StrFormat("count %lu", count));
+            const std::vector<Key> original_keys = random_keys<Key>(count, max_key, rng);
+            std::vector<Key> expected_keys = original_keys;
+            std::sort(expected_keys.begin(), expected_keys.end());
+
+            for (int algorithm = 0; algorithm < 4; algorithm++) {
+                SCOPED_TRACE(absl::StrFormat("algorithm %d", algorithm));
+                std::vector<Key> keys = original_keys;
+                std::vector<byte_t> payloads = indexed_payloads(count, PayloadSize);
+                byte_t *payload_pointer = PayloadSize > 0 ? payloads.data() : nullptr;
+
+                std::vector<Key> sorted_keys = expected_keys;
+                if (algorithm == 0) {
+                    oblivious::bitonic_sort<Key, PayloadSize>(keys.data(), payload_pointer, count);
+                } else if (algorithm == 1) {
+                    oblivious::bitonic_sort<Key, PayloadSize>(keys.data(), payload_pointer, count, false);
+                    std::reverse(sorted_keys.begin(), sorted_keys.end());
+                } else if (algorithm == 2) {
+                    oblivious::odd_even_merge_sort<Key, PayloadSize>(keys.data(), payload_pointer, count);
+                } else {
+                    oblivious::bitonic_sort<Key>(keys.data(), payload_pointer, count, PayloadSize);
+                }
+
+                ASSERT_EQ(keys, sorted_keys);
+                if constexpr (PayloadSize > 0) {
+                    expect_payloads_follow_keys(original_keys, keys, payloads, PayloadSize);
+                }
+            }
+        }
+    }
+
+    // runs either compact overload, payload_size 0 picks the compile time one
+    template <typename Key, std::size_t PayloadSize, bool DynamicPayload>
+    void check_compact(std::size_t payload_size) {
+        std::mt19937_64 rng(0xBADC0DE + payload_size + sizeof(Key));
+        std::bernoulli_distribution mark_distribution(0.4);
+        for (std::size_t count : test_counts()) {
+            SCOPED_TRACE(absl::StrFormat("count %lu", count));
+            const std::vector<Key> original_keys = random_keys<Key>(count, std::numeric_limits<Key>::max(), rng);
+            std::vector<std::uint8_t> marks(count);
+            for (auto &mark : marks) {
+                mark = mark_distribution(rng);
+            }
+
+            std::vector<std::size_t> expected_order(count);
+            std::iota(expected_order.begin(), expected_order.end(), 0);
+            auto expected_end = std::stable_partition(expected_order.begin(), expected_order.end(), [&](std::size_t i) { return marks[i] != 0; });
+            const std::size_t expected_marked = expected_end - expected_order.begin();
+
+            std::vector<Key> keys = original_keys;
+            std::vector<byte_t> payloads = indexed_payloads(count, payload_size);
+            byte_t *payload_pointer = payload_size > 0 ? payloads.data() : nullptr;
+            std::size_t marked;
+            if constexpr (DynamicPayload) {
+                marked = oblivious::compact<Key>(keys.data(), payload_pointer, marks.data(), count, payload_size);
+            } else {
+                marked = oblivious::compact<Key, PayloadSize>(keys.data(), payload_pointer, marks.data(), count);
+            }
+
+            ASSERT_EQ(marked, expected_marked);
+            for (std::size_t i = 0; i < count; i++) {
+                ASSERT_EQ(marks[i], i < expected_marked ? 1 : 0) << absl::StrFormat("mark of element %lu", i);
+            }
+            // the marked elements keep their order, the others only have to stay a permutation
+            for (std::size_t i = 0; i < expected_marked; i++) {
+                ASSERT_EQ(keys[i], original_keys[expected_order[i]]) << absl::StrFormat("element %lu", i);
+            }
+            if (payload_size > 0) {
+                for (std::size_t i = 0; i < expected_marked; i++) {
+                    ASSERT_EQ(payload_index(payloads.data() + i * payload_size, payload_size), expected_order[i]) << absl::StrFormat("element %lu", i);
+                }
+                expect_payloads_follow_keys(original_keys, keys, payloads, payload_size);
+            } else {
+                std::vector<Key> sorted_keys = keys;
+                std::vector<Key> sorted_original_keys = original_keys;
+                std::sort(sorted_keys.begin(), sorted_keys.end());
+                std::sort(sorted_original_keys.begin(), sorted_original_keys.end());
+                ASSERT_EQ(sorted_keys, sorted_original_keys);
+            }
+        }
+    }
+
+    template <typename Key, std::size_t PayloadSize>
+    void check_select() {
+        std::mt19937_64 rng(0x5E1EC7 + PayloadSize + sizeof(Key));
+        for (std::size_t count : test_counts()) {
+            if (count == 0) {
+                continue;
+            }
+            SCOPED_TRACE(absl::StrFormat("count %lu", count));
+            const std::vector<Key> keys = random_keys<Key>(count, std::numeric_limits<Key>::max(), rng);
+            const std::vector<byte_t> payloads = indexed_payloads(count, PayloadSize);
+            for (std::size_t index : {std::size_t(0), count / 2, count - 1}) {
+                Key key = 0;
+                std::vector<byte_t> payload(PayloadSize);
+                oblivious::select<Key, PayloadSize>(keys.data(), PayloadSize > 0 ? payloads.data() : nullptr, count, index, key, payload.data());
+                ASSERT_EQ(key, keys[index]);
+                ASSERT_EQ(std::memcmp(payload.data(), payloads.data() + index * PayloadSize, PayloadSize), 0);
+            }
+        }
+    }
+
+    template <typename T>
+    void check_union(T max_value) {
+        std::mt19937_64 rng(0x0417 + max_value);
+        constexpr T untouched = std::numeric_limits<T>::max();
+        for (std::size_t count : test_counts()) {
+            SCOPED_TRACE(absl::StrFormat("count %lu", count));
+            const std::vector<T> input = random_keys<T>(count, max_value, rng);
+
+            std::vector<T> linear_output(count, untouched);
+            std::vector<T> bitonic_output(count, untouched);
+            std::uint64_t linear_count = union_linear_scanning(input.data(), linear_output.data(), count);
+            std::uint64_t bitonic_count = union_bitonic_sort(input.data(), bitonic_output.data(), count);
+
+            ASSERT_EQ(bitonic_count, linear_count);
+            for (std::size_t i = 0; i < count; i++) {
+                ASSERT_EQ(bitonic_output[i], i < bitonic_count ? linear_output[i] : untouched) << absl::StrFormat("output %lu", i);
+            }
+        }
+    }
+}
+
+TEST(ObliviousTest, SortUint32) {
+    check_sorts<std::uint32_t, 0>(std::numeric_limits<std::uint32_t>::max());
+    check_sorts<std::uint32_t, 4>(std::numeric_limits<std::uint32_t>::max());
+    check_sorts<std::uint32_t, 13>(std::numeric_limits<std::uint32_t>::max());
+}
+
+TEST(ObliviousTest, SortUint64) {
+    check_sorts<std::uint64_t, 0>(std::numeric_limits<std::uint64_t>::max());
+    check_sorts<std::uint64_t, 8>(std::numeric_limits<std::uint64_t>::max());
+    check_sorts<std::uint64_t, 13>(std::numeric_limits<std::uint64_t>::max());
+}
+
+TEST(ObliviousTest, SortWithDuplicateKeys) {
+    check_sorts<std::uint32_t, 4>(7);
+    check_sorts<std::uint64_t, 8>(7);
+    check_sorts<std::uint64_t, 13>(1);
+}
+
+TEST(ObliviousTest, CompactUint32) {
+    check_compact<std::uint32_t, 0, false>(0);
+    check_compact<std::uint32_t, 4, false>(4);
+    check_compact<std::uint32_t, 13, false>(13);
+}
+
+TEST(ObliviousTest, CompactUint64) {
+    check_compact<std::uint64_t, 0, false>(0);
+    check_compact<std::uint64_t, 8, false>(8);
+    check_compact<std::uint64_t, 13, false>(13);
+}
+
+TEST(ObliviousTest, CompactRuntimePayloadSize) {
+    check_compact<std::uint32_t, 0, true>(4);
+    check_compact<std::uint64_t, 0, true>(8);
+    check_compact<std::uint64_t, 0, true>(13);
+    check_compact<std::uint64_t, 0, true>(72);
+}
+
+TEST(ObliviousTest, Select) {
+    check_select<std::uint32_t, 0>();
+    check_select<std::uint32_t, 4>();
+    check_select<std::uint32_t, 13>();
+    check_select<std::uint64_t, 0>();
+    check_select<std::uint64_t, 8>();
+    check_select<std::uint64_t, 13>();
+}
+
+TEST(ObliviousTest, UnionBitonicSortMatchesLinearScanning) {
+    check_union<std::uint32_t>(std::numeric_limits<std::uint32_t>::max());
+    check_union<std::uint64_t>(std::numeric_limits<std::uint64_t>::max());
+    check_union<std::uint32_t>(40);
+    check_union<std::uint64_t>(3);
+}
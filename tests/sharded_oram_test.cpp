@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+#include <memory_interface.hpp>
+#include <oram_builders.hpp>
+#include <sharded_oram.hpp>
+#include <shard_router.hpp>
+#include <absl/random/random.h>
+#include <cstring>
+#include <vector>
+
+namespace {
+    constexpr uint64_t block_size = 64;
+    constexpr uint64_t num_shards = 4;
+    constexpr uint64_t shard_batch_size = 32;
+    constexpr uint64_t num_blocks = 256;
+
+    unique_memory_t create_test_sharded_oram() {
+        std::vector<unique_memory_t> shards;
+        for (uint64_t i = 0; i < num_shards; i++) {
+            shards.emplace_back(createBinaryPathOram2((num_blocks / num_shards) * block_size, block_size));
+        }
+        auto oram = ShardedOram::create("test_sharded_oram", std::move(shards), block_size, num_blocks, shard_batch_size);
+        oram->init();
+        return oram;
+    }
+
+    bytes_t block_value(uint64_t block, uint64_t version) {
+        bytes_t value(block_size);
+        for (uint64_t i = 0; i < block_size; i++) {
+            value[i] = static_cast<byte_t>(block * 31 + version * 7 + i);
+        }
+        return value;
+    }
+}
+
+TEST(ShardedOramTest, TestRouterKeepsBatchOrderPerShard) {
+    ShardRouter router;
+    std::vector<uint64_t> shard_indices = {1, 0, 1, 1, 2, 0};
+    byte_t *records = router.reset(shard_indices.size(), sizeof(uint64_t));
+    for (uint64_t i = 0; i < shard_indices.size(); i++) {
+        std::memcpy(records + i * sizeof(uint64_t), &i, sizeof(uint64_t));
+    }
+    std::vector<uint64_t> loads;
+    EXPECT_EQ(ShardRouter::max_shard_load(shard_indices.data(), shard_indices.size(), 3, loads), 3);
+    EXPECT_EQ(loads, (std::vector<uint64_t>{2, 3, 1}));
+
+    const uint64_t dummy = 1000;
+    router.route(shard_indices.data(), 3, 4, reinterpret_cast<const byte_t *>(&dummy));
+    ASSERT_EQ(router.num_slots(), 12);
+
+    std::vector<std::vector<uint64_t>> expected = {{1, 5, dummy, dummy}, {0, 2, 3, dummy}, {4, dummy, dummy, dummy}};
+    for (uint64_t shard = 0; shard < 3; shard++) {
+        for (uint64_t i = 0; i < 4; i++) {
+            uint64_t slot = shard * 4 + i;
+            uint64_t value;
+            std::memcpy(&value, router.slot_record(slot), sizeof(value));
+            EXPECT_EQ(value, expected[shard][i]);
+            EXPECT_EQ(router.is_dummy(slot), value == dummy);
+        }
+    }
+
+    // the results come back in the order of the batch
+    std::vector<uint64_t> results(router.num_slots());
+    for (uint64_t slot = 0; slot < results.size(); slot++) {
+        std::memcpy(&results[slot], router.slot_record(slot), sizeof(uint64_t));
+    }
+    router.restore_order(reinterpret_cast<byte_t *>(results.data()), sizeof(uint64_t));
+    for (uint64_t i = 0; i < shard_indices.size(); i++) {
+        EXPECT_EQ(results[i], i);
+    }
+}
+
+TEST(ShardedOramTest, TestRouterThrowsWhenSlotsAreTooFew) {
+    ShardRouter router;
+    std::vector<uint64_t> shard_indices = {0, 0, 0};
+    router.reset(shard_indices.size(), sizeof(uint64_t));
+    const uint64_t dummy = 0;
+    EXPECT_THROW(router.route(shard_indices.data(), 2, 2, reinterpret_cast<const byte_t *>(&dummy)), std::runtime_error);
+}
+
+TEST(ShardedOramTest, TestBatchAccess) {
+    auto oram = create_test_sharded_oram();
+
+    std::vector<MemoryRequest> writes;
+    for (uint64_t block = 0; block < num_blocks; block++) {
+        writes.emplace_back(MemoryRequestType::WRITE, block * block_size, block_value(block, 0));
+    }
+    oram->batch_access(writes);
+
+    absl::BitGen bit_gen;
+    std::vector<MemoryRequest> reads;
+    std::vector<uint64_t> blocks;
+    for (uint64_t i = 0; i < 3 * num_blocks; i++) {
+        uint64_t block = absl::Uniform(bit_gen, 0UL, num_blocks);
+        blocks.emplace_back(block);
+        reads.emplace_back(MemoryRequestType::READ, block * block_size, block_size);
+    }
+    oram->batch_access(reads);
+    for (uint64_t i = 0; i < reads.size(); i++) {
+        EXPECT_EQ(reads[i].data, block_value(blocks[i], 0)) << "read " << i << " of block " << blocks[i];
+    }
+}
+
+TEST(ShardedOramTest, TestBatchRepeatingOneBlock) {
+    auto oram = create_test_sharded_oram();
+
+    std::vector<MemoryRequest> writes;
+    for (uint64_t block = 0; block < num_blocks; block++) {
+        writes.emplace_back(MemoryRequestType::WRITE, block * block_size, block_value(block, 0));
+    }
+    oram->batch_access(writes);
+
+    // every request of the batch goes to the same shard, far more than its batch in a round, and the
+    // writes and reads of the block have to stay in order
+    const uint64_t block = 5;
+    std::vector<MemoryRequest> requests;
+    for (uint64_t version = 1; version <= shard_batch_size; version++) {
+        requests.emplace_back(MemoryRequestType::WRITE, block * block_size, block_value(block, version));
+        requests.emplace_back(MemoryRequestType::READ, block * block_size, block_size);
+    }
+    ASSERT_NO_THROW(oram->batch_access(requests));
+    for (uint64_t i = 1; i < requests.size(); i += 2) {
+        EXPECT_EQ(requests[i].data, block_value(block, i / 2 + 1)) << "read " << i;
+    }
+
+    // the other blocks of the shard are untouched
+    MemoryRequest other(MemoryRequestType::READ, (block + num_shards) * block_size, block_size);
+    oram->access(other);
+    EXPECT_EQ(other.data, block_value(block + num_shards, 0));
+}